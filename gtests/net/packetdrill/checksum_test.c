@@ -26,10 +26,12 @@
 
 #include <arpa/inet.h>
 #include <assert.h>
+#include <string.h>
 #include "ip.h"
 #include "ipv6.h"
 #include "sctp.h"
 #include "tcp.h"
+#include "utils.h"
 
 static void test_tcp_udp_v4_checksum(void)
 {
@@ -130,11 +132,58 @@ static void test_sctp_crc32c(void)
 	assert(crc32c == 0xdad73774);
 }
 
+/* A DSS checksum of the pseudo-header alone, extended with the payload,
+ * must match checksum_dss() over the pseudo-header plus the payload.
+ */
+static void test_add_payload_to_dss_checksum(void)
+{
+	/* The pseudo-header in host byte order, as mptcp.c builds it. */
+	struct {
+		u64 dsn;
+		u32 ssn;
+		u16 dll;
+		u16 zeros;
+	} pseudo = { 0x0102030405060708ULL, 0x0a0b0c0d, 0, 0 };
+	const u8 payload[] = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde };
+	const u16 rfc1071[] = { 0xd664, 0xf862 };	/* for 6 and 7 bytes */
+	u16 buffer[(sizeof(pseudo) + sizeof(payload) + 1) / 2];
+	u8 *bytes = (u8 *)buffer;
+	u16 checksum, expected;
+	u64 dsn;
+	u32 ssn, len;
+	u16 dll;
+
+	for (len = sizeof(payload) - 1; len <= sizeof(payload); ++len) {
+		pseudo.dll = len;
+		checksum = htons(checksum_dss((u16 *)&pseudo,
+					      sizeof(pseudo)));
+		add_payload_to_dss_checksum(&checksum, payload, len);
+
+		/* The same bytes in network byte order, zero-padded to a
+		 * whole number of words.
+		 */
+		memset(buffer, 0, sizeof(buffer));
+		dsn = htobe64(pseudo.dsn);
+		ssn = htonl(pseudo.ssn);
+		dll = htons(pseudo.dll);
+		memcpy(bytes, &dsn, sizeof(dsn));
+		memcpy(bytes + 8, &ssn, sizeof(ssn));
+		memcpy(bytes + 12, &dll, sizeof(dll));
+		memcpy(bytes + sizeof(pseudo), payload, len);
+		expected = checksum_dss(buffer,
+					(sizeof(pseudo) + len + 1) & ~1);
+
+		assert(checksum == expected);
+		assert(ntohs(checksum) == rfc1071[len - 6]);
+	}
+}
+
 int main(void)
 {
 	test_tcp_udp_v4_checksum();
 	test_tcp_udp_v6_checksum();
 	test_ipv4_checksum();
 	test_sctp_crc32c();
+	test_add_payload_to_dss_checksum();
 	return 0;
 }
@@ -27,6 +27,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,6 +36,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include "open_memstream.h"
 #include "run.h"
 #include "tcp.h"
 
@@ -57,6 +59,62 @@ const char python_preamble[] =
 "sys.excepthook = excepthook\n"
 "\n";
 
+/* The file descriptor on which a persistent worker reports results. */
+#define CODE_WORKER_RESULT_FD	3
+
+/* For --code_persistent we start the interpreter once on the
+ * following loop and then feed it the code for each script on its
+ * stdin, as a line with the byte count followed by the code itself.
+ * Each script runs in a fresh global namespace. The worker writes the
+ * exit status of each script as a line on CODE_WORKER_RESULT_FD, so
+ * that output printed by the script itself does not get in the way.
+ */
+const char python_worker[] =
+"import os\n"
+"import sys\n"
+"import traceback\n"
+"_requests = getattr(sys.stdin, 'buffer', sys.stdin)\n"
+"_results = os.fdopen(3, 'w')\n"
+"while True:\n"
+"  _header = _requests.readline()\n"
+"  if not _header:\n"
+"    break\n"
+"  _code = _requests.read(int(_header))\n"
+"  _globals = {'__name__': '__main__'}\n"
+"  _status = 0\n"
+"  try:\n"
+"    exec(compile(_code, '<packetdrill>', 'exec'), _globals)\n"
+"  except SystemExit as e:\n"
+"    if e.code is None:\n"
+"      _status = 0\n"
+"    elif isinstance(e.code, int):\n"
+"      _status = e.code\n"
+"    else:\n"
+"      sys.stderr.write('%s\\n' % e.code)\n"
+"      _status = 1\n"
+"  except:\n"
+"    sys.stderr.write('%s:%d: error in Python code\\n' %\n"
+"                     (_globals.get('_file', '?'),\n"
+"                      _globals.get('_line', 0)))\n"
+"    traceback.print_exc()\n"
+"    _status = 1\n"
+"  sys.stdout.flush()\n"
+"  sys.stderr.flush()\n"
+"  _results.write('%d\\n' % _status)\n"
+"  _results.flush()\n";
+
+/* A long-lived post-processing interpreter, shared by all the scripts
+ * that this process runs.
+ */
+struct code_worker {
+	pid_t pid;			/* process ID of the interpreter */
+	char *command_line;		/* command line it was started with */
+	char *path;			/* path of the worker loop program */
+	FILE *requests;			/* we write code to run here */
+	FILE *results;			/* we read exit statuses here */
+};
+static struct code_worker *code_worker;	/* NULL until first needed */
+
 /* Write out the standard utility routines useful for a given language. */
 static void write_preamble(struct code_state *code)
 {
@@ -410,6 +468,7 @@ struct code_state *code_new(struct config *config)
 
 	code->command_line = strdup(config->code_command_line);
 	code->verbose = config->verbose;
+	code->persistent = config->code_persistent;
 
 	return code;
 }
@@ -511,12 +570,179 @@ static void delete_code_file(struct code_state *code)
 		die_perror("error deleting code file: unlink:");
 }
 
+/* Shut down the persistent worker, if any: closing its stdin makes
+ * the worker loop exit.
+ */
+static void code_worker_stop(void)
+{
+	struct code_worker *worker = code_worker;
+
+	if (worker == NULL)
+		return;
+	code_worker = NULL;
+
+	fclose(worker->requests);
+	fclose(worker->results);
+	if (waitpid(worker->pid, NULL, 0) < 0)
+		die_perror("waitpid");
+	if (unlink(worker->path) != 0)
+		die_perror("error deleting code worker file: unlink");
+
+	free(worker->command_line);
+	free(worker->path);
+	free(worker);
+}
+
+/* Write out the worker loop program and start the configured command
+ * line on it, with pipes for feeding it code and reading back results.
+ * Dies on failure, since without the worker no code can run.
+ */
+static void code_worker_start(struct code_state *code)
+{
+	static bool registered_exit_handler = false;
+	char path_template[] = "/tmp/code_worker_XXXXXX";
+	int request_fds[2], result_fds[2];
+	char *full_command_line = NULL;
+	FILE *file = NULL;
+	pid_t pid;
+	int fd;
+
+	assert(code->format == FORMAT_PYTHON);
+	assert(code_worker == NULL);
+
+	fd = mkstemp(path_template);
+	if (fd < 0)
+		die_perror("error making temp file for code worker: mkstemp");
+	file = fdopen(fd, "w");
+	if (file == NULL)
+		die_perror("error opening temp file for code worker: fdopen");
+	fprintf(file, "%s", python_worker);
+	if (fclose(file) != 0)
+		die_perror("error closing temp file for code worker: fclose");
+
+	if (pipe(request_fds) < 0 || pipe(result_fds) < 0)
+		die_perror("pipe");
+
+	asprintf(&full_command_line, "%s %s", code->command_line,
+		 path_template);
+	if (code->verbose)
+		printf("starting code worker: '%s'\n", full_command_line);
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0)
+		die_perror("fork");
+	if (pid == 0) {
+		if (dup2(request_fds[0], STDIN_FILENO) < 0 ||
+		    dup2(result_fds[1], CODE_WORKER_RESULT_FD) < 0)
+			_exit(EXIT_FAILURE);
+		if (request_fds[0] > CODE_WORKER_RESULT_FD)
+			close(request_fds[0]);
+		if (request_fds[1] > CODE_WORKER_RESULT_FD)
+			close(request_fds[1]);
+		if (result_fds[0] > CODE_WORKER_RESULT_FD)
+			close(result_fds[0]);
+		if (result_fds[1] > CODE_WORKER_RESULT_FD)
+			close(result_fds[1]);
+		execl("/bin/sh", "sh", "-c", full_command_line, (char *)NULL);
+		_exit(EXIT_FAILURE);
+	}
+	free(full_command_line);
+
+	close(request_fds[0]);
+	close(result_fds[1]);
+	/* Don't leak our ends into shell commands run by later scripts. */
+	if (fcntl(request_fds[1], F_SETFD, FD_CLOEXEC) < 0 ||
+	    fcntl(result_fds[0], F_SETFD, FD_CLOEXEC) < 0)
+		die_perror("fcntl FD_CLOEXEC");
+
+	struct code_worker *worker = calloc(1, sizeof(struct code_worker));
+	worker->pid = pid;
+	worker->command_line = strdup(code->command_line);
+	worker->path = strdup(path_template);
+	worker->requests = fdopen(request_fds[1], "w");
+	worker->results = fdopen(result_fds[0], "r");
+	if (worker->requests == NULL || worker->results == NULL)
+		die_perror("fdopen");
+	code_worker = worker;
+
+	if (!registered_exit_handler) {
+		atexit(code_worker_stop);
+		registered_exit_handler = true;
+	}
+}
+
+/* Format all the code fragments into memory and run them in the
+ * persistent worker, starting the worker first if need be. On
+ * success, returns STATUS_OK. On error returns STATUS_ERR and fills
+ * in *error.
+ */
+static int execute_code_persistent(struct code_state *code, char **error)
+{
+	int result = STATUS_ERR;	/* return value */
+	char *buffer = NULL;
+	size_t len = 0;
+	char line[32];
+
+	code->file = open_memstream(&buffer, &len);
+	if (code->file == NULL)
+		die_perror("open_memstream");
+	write_preamble(code);
+	write_all_fragments(code);
+	if (fclose(code->file) != 0)
+		die_perror("fclose");
+	code->file = NULL;
+
+	/* Scripts may change --code_command, so restart if needed. */
+	if (code_worker != NULL &&
+	    strcmp(code_worker->command_line, code->command_line) != 0)
+		code_worker_stop();
+	if (code_worker == NULL)
+		code_worker_start(code);
+
+	if (code->verbose) {
+		printf("%s", buffer);
+		printf("running in code worker %d\n", code_worker->pid);
+	}
+	fflush(stdout);		/* the worker shares our stdout */
+
+	fprintf(code_worker->requests, "%zu\n", len);
+	fwrite(buffer, 1, len, code_worker->requests);
+	if (fflush(code_worker->requests) != 0) {
+		asprintf(error, "error sending code to '%s': %s",
+			 code->command_line, strerror(errno));
+		code_worker_stop();
+		goto out;
+	}
+
+	if (fgets(line, sizeof(line), code_worker->results) == NULL) {
+		asprintf(error, "'%s' exited without running code",
+			 code->command_line);
+		code_worker_stop();
+		goto out;
+	}
+	int status = atoi(line);
+	if (status != 0) {
+		asprintf(error, "'%s' returned non-zero status %d",
+			 code->command_line, status);
+		goto out;
+	}
+	result = STATUS_OK;
+
+out:
+	free(buffer);
+	return result;
+}
+
 /* Write out the code to a file, execute the code, and delete the file. */
 int code_execute(struct code_state *code, char **error)
 {
 	if (code->list_head == NULL)
 		return STATUS_OK;	/* no code to execute */
 
+	if (code->persistent)
+		return execute_code_persistent(code, error);
+
 	write_code_file(code);
 	int result = execute_code_command_line(code, error);
 	delete_code_file(code);
@@ -82,6 +82,7 @@ struct code_fragment {
 /* Internal state for the code execution module. */
 struct code_state {
 	bool verbose;				/* print debug info? */
+	bool persistent;			/* use long-lived interpreter? */
 	enum code_format_t format;		/* language syntax to emit */
 	enum code_data_t data_type;		/* data to get for snippets */
 	char *command_line;			/* system(3) command to run */
@@ -108,7 +109,9 @@ extern void run_code_event(struct state *state,
 
 /* Call this at the end of test execution to run the code by writing
  * out the text of the code and invoking the command line supplied by
- * the user. On success, returns STATUS_OK. On error returns
+ * the user. With --code_persistent the code is instead handed to a
+ * single interpreter process that stays alive across all the scripts
+ * run by this process. On success, returns STATUS_OK. On error returns
  * STATUS_ERR and fills in *error.
  */
 extern int code_execute(struct code_state *code, char **error);
@@ -40,6 +40,7 @@ enum option_codes {
 	OPT_CODE_COMMAND,
 	OPT_CODE_FORMAT,
 	OPT_CODE_SOCKOPT,
+	OPT_CODE_PERSISTENT,
 	OPT_CONNECT_PORT,
 	OPT_REMOTE_IP,
 	OPT_LOCAL_IP,
@@ -47,8 +48,17 @@ enum option_codes {
 	OPT_NETMASK_IP,
 	OPT_SPEED,
 	OPT_MTU,
+	OPT_VNET_HDR,
+	OPT_TUN_QUEUES,
+	OPT_TUN_QUEUE_CPUS,
+	OPT_TUN_STEERING,
+	OPT_REUSE_NETDEV,
+	OPT_NETDEV,
 	OPT_INIT_SCRIPTS,
 	OPT_TOLERANCE_USECS,
+	OPT_TOLERANCE_NSECS,
+	OPT_INJECTION_LAG_USECS,
+	OPT_RESET_WAIT_USECS,
 	OPT_WIRE_CLIENT,
 	OPT_WIRE_SERVER,
 	OPT_WIRE_SERVER_IP,
@@ -58,6 +68,16 @@ enum option_codes {
 	OPT_TCP_TS_TICK_USECS,
 	OPT_NON_FATAL,
 	OPT_DRY_RUN,
+	OPT_SAMPLE_USECS,
+	OPT_SAMPLE_FILE,
+	OPT_SAMPLE_FORMAT,
+	OPT_FUZZ_ITERATIONS,
+	OPT_FUZZ_DIR,
+	OPT_FUZZ_SEED,
+	OPT_FUZZ_MUTATIONS,
+	OPT_PAYLOAD_HUGETLB,
+	OPT_IO_URING,
+	OPT_PAYLOAD_PATTERN,
 	OPT_VERBOSE = 'v',	/* our only single-letter option */
 };
 
@@ -68,6 +88,7 @@ struct option options[] = {
 	{ "code_command",	.has_arg = true,  NULL, OPT_CODE_COMMAND },
 	{ "code_format",	.has_arg = true,  NULL, OPT_CODE_FORMAT },
 	{ "code_sockopt",	.has_arg = true,  NULL, OPT_CODE_SOCKOPT },
+	{ "code_persistent",	.has_arg = false, NULL, OPT_CODE_PERSISTENT },
 	{ "connect_port",	.has_arg = true,  NULL, OPT_CONNECT_PORT },
 	{ "remote_ip",		.has_arg = true,  NULL, OPT_REMOTE_IP },
 	{ "local_ip",		.has_arg = true,  NULL, OPT_LOCAL_IP },
@@ -75,8 +96,17 @@ struct option options[] = {
 	{ "netmask_ip",		.has_arg = true,  NULL, OPT_NETMASK_IP },
 	{ "speed",		.has_arg = true,  NULL, OPT_SPEED },
 	{ "mtu",		.has_arg = true,  NULL, OPT_MTU },
+	{ "vnet_hdr",		.has_arg = false, NULL, OPT_VNET_HDR },
+	{ "tun_queues",		.has_arg = true,  NULL, OPT_TUN_QUEUES },
+	{ "tun_queue_cpus",	.has_arg = true,  NULL, OPT_TUN_QUEUE_CPUS },
+	{ "tun_steering",	.has_arg = true,  NULL, OPT_TUN_STEERING },
+	{ "reuse_netdev",	.has_arg = false, NULL, OPT_REUSE_NETDEV },
+	{ "netdev",		.has_arg = true,  NULL, OPT_NETDEV },
 	{ "init_scripts",	.has_arg = true,  NULL, OPT_INIT_SCRIPTS },
 	{ "tolerance_usecs",	.has_arg = true,  NULL, OPT_TOLERANCE_USECS },
+	{ "tolerance_nsecs",	.has_arg = true,  NULL, OPT_TOLERANCE_NSECS },
+	{ "injection_lag_usecs", .has_arg = true, NULL, OPT_INJECTION_LAG_USECS },
+	{ "reset_wait_usecs",	.has_arg = true,  NULL, OPT_RESET_WAIT_USECS },
 	{ "wire_client",	.has_arg = false, NULL, OPT_WIRE_CLIENT },
 	{ "wire_server",	.has_arg = false, NULL, OPT_WIRE_SERVER },
 	{ "wire_server_ip",	.has_arg = true,  NULL, OPT_WIRE_SERVER_IP },
@@ -86,6 +116,16 @@ struct option options[] = {
 	{ "tcp_ts_tick_usecs",	.has_arg = true,  NULL, OPT_TCP_TS_TICK_USECS },
 	{ "non_fatal",		.has_arg = true,  NULL, OPT_NON_FATAL },
 	{ "dry_run",		.has_arg = false, NULL, OPT_DRY_RUN },
+	{ "sample_usecs",	.has_arg = true,  NULL, OPT_SAMPLE_USECS },
+	{ "sample_file",	.has_arg = true,  NULL, OPT_SAMPLE_FILE },
+	{ "sample_format",	.has_arg = true,  NULL, OPT_SAMPLE_FORMAT },
+	{ "fuzz_iterations",	.has_arg = true,  NULL, OPT_FUZZ_ITERATIONS },
+	{ "fuzz_dir",		.has_arg = true,  NULL, OPT_FUZZ_DIR },
+	{ "fuzz_seed",		.has_arg = true,  NULL, OPT_FUZZ_SEED },
+	{ "fuzz_mutations",	.has_arg = true,  NULL, OPT_FUZZ_MUTATIONS },
+	{ "payload_hugetlb",	.has_arg = false, NULL, OPT_PAYLOAD_HUGETLB },
+	{ "io_uring",		.has_arg = false, NULL, OPT_IO_URING },
+	{ "payload_pattern",	.has_arg = false, NULL, OPT_PAYLOAD_PATTERN },
 	{ "verbose",		.has_arg = false, NULL, OPT_VERBOSE },
 	{ NULL },
 };
@@ -98,6 +138,7 @@ void show_usage(void)
 		"\t[--code_command=code_command]\n"
 		"\t[--code_format=code_format]\n"
 		"\t[--code_sockopt=TCP_INFO]\n"
+		"\t[--code_persistent]\n"
 		"\t[--connect_port=connect_port]\n"
 		"\t[--remote_ip=remote_ip]\n"
 		"\t[--local_ip=local_ip]\n"
@@ -106,7 +147,16 @@ void show_usage(void)
 		"\t[--init_scripts=<comma separated filenames>]\n"
 		"\t[--speed=<speed in Mbps>]\n"
 		"\t[--mtu=<MTU in bytes>]\n"
+		"\t[--vnet_hdr]\n"
+		"\t[--tun_queues=<number of tun queues>]\n"
+		"\t[--tun_queue_cpus=<comma separated CPU per queue>]\n"
+		"\t[--tun_steering=[flow,packet]]\n"
+		"\t[--reuse_netdev]\n"
+		"\t[--netdev=[tun,xdp,loopback]]\n"
 		"\t[--tolerance_usecs=tolerance_usecs]\n"
+		"\t[--tolerance_nsecs=tolerance_nsecs]\n"
+		"\t[--injection_lag_usecs=<report injections later than this>]\n"
+		"\t[--reset_wait_usecs=<wait for reset connections to go away>]\n"
 		"\t[--tcp_ts_tick_usecs=<microseconds per TCP TS val tick>]\n"
 		"\t[--non_fatal=<comma separated types: packet,syscall>]\n"
 		"\t[--wire_client]\n"
@@ -116,6 +166,16 @@ void show_usage(void)
 		"\t[--wire_client_dev=<eth_dev_name>]\n"
 		"\t[--wire_server_dev=<eth_dev_name>]\n"
 		"\t[--dry_run]\n"
+		"\t[--sample_usecs=<TCP_INFO sampling interval>]\n"
+		"\t[--sample_file=<path for samples>]\n"
+		"\t[--sample_format=[csv,json]]\n"
+		"\t[--fuzz_iterations=<number of MPTCP fuzzing iterations>]\n"
+		"\t[--fuzz_dir=<directory for fuzzing reproducers>]\n"
+		"\t[--fuzz_seed=<fuzzing random seed>]\n"
+		"\t[--fuzz_mutations=<mutations saved in a reproducer>]\n"
+		"\t[--payload_hugetlb]\n"
+		"\t[--io_uring]\n"
+		"\t[--payload_pattern]\n"
 		"\t[--verbose|-v]\n"
 		"\tscript_path ...\n");
 }
@@ -189,14 +249,22 @@ static void set_ipv6_defaults(struct config *config)
 /* Set default configuration before we begin parsing. */
 void set_default_config(struct config *config)
 {
+	int i;
+
 	memset(config, 0, sizeof(*config));
 	config->code_command_line	= "/usr/bin/python";
 	config->code_format		= "python";
 	config->code_sockopt		= "";		/* auto-detect */
+	config->sample_format		= "csv";
+	config->tun_queues		= 1;
+	for (i = 0; i < TUN_MAX_QUEUES; ++i)
+		config->tun_queue_cpus[i] = -1;
+	config->tun_steering		= TUN_STEER_FLOW;
+	config->netdev_type		= NETDEV_TUN;
 	config->ip_version		= IP_VERSION_4;
 	config->default_live_bind_port	= 8080;
 	config->default_live_connect_port	= 8080;
-	config->tolerance_usecs		= 4000;
+	config->tolerance_nsecs		= 4000000;
 	config->speed			= TUN_DRIVER_SPEED_CUR;
 	config->mtu			= TUN_DRIVER_DEFAULT_MTU;
 
@@ -215,11 +283,27 @@ void set_default_config(struct config *config)
 
 	config->init_scripts = NULL;
 
+	config->fuzz_dir		= ".";
+
 	config->wire_server_port	= 8081;
 	config->wire_client_device	= "eth0";
 	config->wire_server_device	= "eth0";
 }
 
+void config_free(struct config *config)
+{
+	int i;
+
+	if (config->argv != NULL) {
+		for (i = 0; config->argv[i] != NULL; ++i)
+			free((char *)config->argv[i]);
+		free((char **)config->argv);
+		config->argv = NULL;
+	}
+	free(config->script_path);
+	config->script_path = NULL;
+}
+
 static void set_remote_ip_and_prefix(struct config *config)
 {
 	config->live_remote_ip = config->live_remote_prefix.ip;
@@ -339,6 +423,27 @@ void parse_non_fatal_arg(char *arg, struct config *config)
 	free(argdup);
 }
 
+/* Parse the comma-separated list of CPUs for --tun_queue_cpus; queue i
+ * is injected from the i-th CPU, and "-1" leaves a queue unpinned.
+ */
+static void parse_tun_queue_cpus_arg(char *arg, struct config *config,
+				     char *where)
+{
+	char *argdup, *saveptr, *token, *end;
+	int i = 0;
+
+	argdup = strdup(arg);
+	token = strtok_r(argdup, ", ", &saveptr);
+	while (token != NULL) {
+		long cpu = strtol(token, &end, 10);
+		if (end == token || *end || cpu < -1 || i >= TUN_MAX_QUEUES)
+			die("%s: bad --tun_queue_cpus: %s\n", where, arg);
+		config->tun_queue_cpus[i++] = cpu;
+		token = strtok_r(NULL, ", ", &saveptr);
+	}
+
+	free(argdup);
+}
 
 /* Process a command line option */
 static void process_option(int opt, char *optarg, struct config *config,
@@ -377,6 +482,9 @@ static void process_option(int opt, char *optarg, struct config *config,
 	case OPT_CODE_SOCKOPT:
 		config->code_sockopt = optarg;
 		break;
+	case OPT_CODE_PERSISTENT:
+		config->code_persistent = true;
+		break;
 	case OPT_CONNECT_PORT:
 		port = atoi(optarg);
 		if ((port <= 0) || (port > 0xffff))
@@ -397,6 +505,39 @@ static void process_option(int opt, char *optarg, struct config *config,
 		if (config->mtu < 0)
 			die("%s: bad --mtu: %s\n", where, optarg);
 		break;
+	case OPT_VNET_HDR:
+		config->vnet_hdr = true;
+		break;
+	case OPT_TUN_QUEUES:
+		config->tun_queues = atoi(optarg);
+		if (config->tun_queues < 1 ||
+		    config->tun_queues > TUN_MAX_QUEUES)
+			die("%s: bad --tun_queues: %s\n", where, optarg);
+		break;
+	case OPT_TUN_QUEUE_CPUS:
+		parse_tun_queue_cpus_arg(optarg, config, where);
+		break;
+	case OPT_TUN_STEERING:
+		if (strcmp(optarg, "flow") == 0)
+			config->tun_steering = TUN_STEER_FLOW;
+		else if (strcmp(optarg, "packet") == 0)
+			config->tun_steering = TUN_STEER_PACKET;
+		else
+			die("%s: bad --tun_steering: %s\n", where, optarg);
+		break;
+	case OPT_REUSE_NETDEV:
+		config->reuse_netdev = true;
+		break;
+	case OPT_NETDEV:
+		if (strcmp(optarg, "tun") == 0)
+			config->netdev_type = NETDEV_TUN;
+		else if (strcmp(optarg, "xdp") == 0)
+			config->netdev_type = NETDEV_XDP;
+		else if (strcmp(optarg, "loopback") == 0)
+			config->netdev_type = NETDEV_LOOPBACK;
+		else
+			die("%s: bad --netdev: %s\n", where, optarg);
+		break;
 	case OPT_NETMASK_IP:
 		strncpy(config->live_netmask_ip_string, optarg,	ADDR_STR_LEN-1);
 		break;
@@ -413,10 +554,26 @@ static void process_option(int opt, char *optarg, struct config *config,
 		config->speed = speed;
 		break;
 	case OPT_TOLERANCE_USECS:
-		config->tolerance_usecs = atoi(optarg);
-		if (config->tolerance_usecs <= 0)
+		config->tolerance_nsecs = atoll(optarg) * 1000;
+		if (config->tolerance_nsecs <= 0)
 			die("%s: bad --tolerance_usecs: %s\n", where, optarg);
 		break;
+	case OPT_TOLERANCE_NSECS:
+		config->tolerance_nsecs = atoll(optarg);
+		if (config->tolerance_nsecs <= 0)
+			die("%s: bad --tolerance_nsecs: %s\n", where, optarg);
+		break;
+	case OPT_INJECTION_LAG_USECS:
+		config->injection_lag_nsecs = atoll(optarg) * 1000;
+		if (config->injection_lag_nsecs <= 0)
+			die("%s: bad --injection_lag_usecs: %s\n",
+			    where, optarg);
+		break;
+	case OPT_RESET_WAIT_USECS:
+		config->reset_wait_nsecs = atoll(optarg) * 1000;
+		if (config->reset_wait_nsecs <= 0)
+			die("%s: bad --reset_wait_usecs: %s\n", where, optarg);
+		break;
 	case OPT_TCP_TS_TICK_USECS:
 		config->tcp_ts_tick_usecs = atoi(optarg);
 		if (config->tcp_ts_tick_usecs < 0 ||
@@ -449,6 +606,44 @@ static void process_option(int opt, char *optarg, struct config *config,
 	case OPT_DRY_RUN:
 		config->dry_run = true;
 		break;
+	case OPT_SAMPLE_USECS:
+		config->sample_usecs = atoi(optarg);
+		if (config->sample_usecs <= 0)
+			die("%s: bad --sample_usecs: %s\n", where, optarg);
+		break;
+	case OPT_SAMPLE_FILE:
+		config->sample_path = optarg;
+		break;
+	case OPT_SAMPLE_FORMAT:
+		if (strcmp(optarg, "csv") != 0 && strcmp(optarg, "json") != 0)
+			die("%s: bad --sample_format: %s\n", where, optarg);
+		config->sample_format = optarg;
+		break;
+	case OPT_FUZZ_ITERATIONS:
+		config->fuzz_iterations = atoi(optarg);
+		if (config->fuzz_iterations <= 0)
+			die("%s: bad --fuzz_iterations: %s\n", where, optarg);
+		break;
+	case OPT_FUZZ_DIR:
+		config->fuzz_dir = strdup(optarg);
+		break;
+	case OPT_FUZZ_SEED:
+		config->fuzz_seed = strtoul(optarg, &end, 10);
+		if (end == optarg || *end)
+			die("%s: bad --fuzz_seed: %s\n", where, optarg);
+		break;
+	case OPT_FUZZ_MUTATIONS:
+		config->fuzz_mutations = strdup(optarg);
+		break;
+	case OPT_PAYLOAD_HUGETLB:
+		config->payload_hugetlb = true;
+		break;
+	case OPT_IO_URING:
+		config->io_uring = true;
+		break;
+	case OPT_PAYLOAD_PATTERN:
+		config->payload_pattern = true;
+		break;
 	case OPT_VERBOSE:
 		config->verbose = true;
 		break;
@@ -501,7 +696,10 @@ static void parse_script_options(struct config *config,
 				break;
 			}
 		}
-		if (c != 0) {
+		if (c != 0 && options[i].has_arg && opt->value == NULL) {
+			die("%s: option '%s' requires a value\n",
+			    config->script_path, opt->name);
+		} else if (c != 0) {
 			process_option(options[i].val,
 				       opt->value, config,
 				       config->script_path);
@@ -37,6 +37,20 @@
 
 #define TUN_DRIVER_SPEED_CUR	0	/* don't change current speed */
 #define TUN_DRIVER_DEFAULT_MTU 1500	/* default MTU for tun device */
+#define TUN_MAX_QUEUES		16	/* max IFF_MULTI_QUEUE tun queues */
+
+/* How injected packets are spread over the queues of a multi-queue tun. */
+enum tun_steering_t {
+	TUN_STEER_FLOW,		/* each 4-tuple (subflow) gets its own queue */
+	TUN_STEER_PACKET,	/* round-robin every packet over all queues */
+};
+
+/* Which local netdev backend injects and sniffs packets. */
+enum netdev_type_t {
+	NETDEV_TUN,		/* tun device plus PF_PACKET sniffing */
+	NETDEV_XDP,		/* veth pair plus AF_XDP socket on the peer */
+	NETDEV_LOOPBACK,	/* no kernel: an in-memory TCP responder */
+};
 
 extern struct option options[];
 
@@ -75,19 +89,39 @@ struct config {
 
 	int live_prefix_len;		/* IPv4/IPv6 interface prefix len */
 
-	int tolerance_usecs;		/* tolerance for time divergence */
+	s64 tolerance_nsecs;		/* tolerance for time divergence */
+	s64 injection_lag_nsecs;	/* report injections this late (or 0) */
+	s64 reset_wait_nsecs;		/* wait for resets to take (or 0) */
 	int tcp_ts_tick_usecs;		/* microseconds per TS val tick */
 
 	u32 speed;			/* speed reported by tun driver;
 					 * may require special tun driver
 					 */
 	int mtu;			/* MTU of tun device */
+	bool vnet_hdr;			/* use IFF_VNET_HDR (GSO, page frags)? */
+	int tun_queues;			/* number of tun queues (1 = classic) */
+	int tun_queue_cpus[TUN_MAX_QUEUES];	/* CPU to inject queue i from,
+						 * or -1 to leave unpinned
+						 */
+	enum tun_steering_t tun_steering;	/* queue selection policy */
+	bool reuse_netdev;		/* keep the tun device for next script? */
+	enum netdev_type_t netdev_type;	/* local netdev backend */
 
 	bool non_fatal_packet;		/* treat packet asserts as non-fatal */
 	bool non_fatal_syscall;		/* treat syscall asserts as non-fatal */
 
 	bool dry_run;			/* parse script but don't execute? */
 
+	/* In-process fuzzing of MPTCP options (see fuzz.h) */
+	int fuzz_iterations;		/* iterations to run; 0 = no fuzzing */
+	char *fuzz_dir;			/* where to save reproducers */
+	u32 fuzz_seed;			/* random seed; 0 = pick one */
+	char *fuzz_mutations;		/* mutations to replay, or NULL */
+
+	bool payload_hugetlb;		/* back syscall payloads w/ hugepages? */
+	bool io_uring;			/* issue socket calls via io_uring? */
+	bool payload_pattern;		/* inject and check patterned data? */
+
 	bool verbose;			/* print detailed debug info? */
 	char *script_path;		/* pathname of script file */
 
@@ -100,6 +134,14 @@ struct config {
 	/* setsockopt option number (TCP_INFO) for code */
 	char *code_sockopt;
 
+	/* Keep one post-processing interpreter alive across scripts? */
+	bool code_persistent;
+
+	/* Background TCP_INFO sampling; 0 usecs means disabled */
+	int sample_usecs;		/* time between samples */
+	char *sample_path;		/* output file; NULL for default */
+	char *sample_format;		/* "csv" or "json" */
+
 	/* File scripts to run at beginning of test (using system) */
 	char *init_scripts;
 
@@ -124,6 +166,11 @@ struct invocation {
 /* Set default configuration */
 extern void set_default_config(struct config *config);
 
+/* Free what setting up the configuration allocated for it: the copy
+ * of the command line arguments and the script path.
+ */
+extern void config_free(struct config *config);
+
 /* Parse the "non-fatal" command line options given the (comma-delimited) string
  * from the command line.  Modifies the associated booleans in the given
  * config.
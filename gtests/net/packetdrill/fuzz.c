@@ -0,0 +1,589 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * A persistent fuzzing loop for MPTCP option handling.
+ *
+ * The input we mutate is the TCP option bytes of every inbound script
+ * packet that carries an MPTCP option, laid end to end. The parsed
+ * script stays in memory: each iteration copies an input from the
+ * corpus into the packets, mutates subtypes, lengths, DSS flags and
+ * checksum bits in place, and runs the script in a forked child. The
+ * child inherits the already configured netdev, and resets its
+ * connections through the normal end-of-script path.
+ *
+ * With kcov, each child traces the kernel code that its main thread
+ * and its syscall thread run, each thread into its own kcov buffer,
+ * and inputs that reach new edges join the corpus. tun hands each
+ * injected packet to the stack in the writing thread, with only
+ * bottom halves disabled, so the TCP and MPTCP input path of injected
+ * packets is traced as part of the main thread. Work that runs from a
+ * real softirq, such as retransmit and delayed ACK timers, is not
+ * traced: KCOV_TRACE_PC skips softirqs, and the stack does not tag that
+ * work with a kcov remote handle that KCOV_REMOTE_ENABLE could follow.
+ * Without kcov, the only feedback is how the child exited. Either way, new and crashing
+ * inputs are written out as the original script plus a
+ * --fuzz_mutations option that puts the mutated bytes back, so that
+ * "packetdrill <reproducer>.pkt" replays them exactly.
+ */
+
+#include "fuzz.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef linux
+#include <linux/kcov.h>
+#endif
+
+#include "logging.h"
+#include "mptcp.h"
+#include "netdev.h"
+#include "packet.h"
+#include "run.h"
+#include "tcp_options.h"
+#include "tcp_options_iterator.h"
+
+/* MP_CAPABLE "checksum required" flag. */
+#define MP_CAPABLE_FLAG_A	0x80
+
+/* An inbound script packet whose TCP options we mutate. */
+struct fuzz_target {
+	struct packet *packet;
+	int ordinal;		/* index among the script's packet events */
+	int offset;		/* where its options start in an input */
+	int len;		/* bytes of TCP options */
+};
+
+/* The threads of a child that we trace, each with its own kcov fd. */
+enum fuzz_thread_t {
+	FUZZ_THREAD_MAIN,	/* injects packets, runs non-blocking calls */
+	FUZZ_THREAD_SYSCALL,	/* runs blocking system calls */
+	FUZZ_NUM_THREADS,
+};
+
+/* A kcov fd and the PCs it traced. */
+struct fuzz_kcov {
+	int fd;			/* kcov, or -1 if not available */
+	unsigned long *area;	/* PCs traced by the last child */
+};
+
+struct fuzz {
+	struct config *config;
+	struct script *script;
+
+	struct fuzz_target *targets;
+	int num_targets;
+	int input_len;		/* sum of the targets' option bytes */
+
+	u8 *corpus[FUZZ_MAX_CORPUS];	/* inputs worth mutating */
+	int corpus_len;
+	u8 *input;		/* the input of the current iteration */
+
+	u8 *coverage;		/* bitmap of coverage seen so far */
+	int coverage_bits;	/* bits set in coverage */
+
+	struct fuzz_kcov kcov[FUZZ_NUM_THREADS];
+
+	int iterations;
+	int num_new;
+	int num_crashes;
+	int num_timeouts;
+};
+
+/* Return the n-th packet event of the script, or NULL. */
+static struct event *find_packet_event(struct script *script, int ordinal)
+{
+	struct event *event = NULL;
+	int n = 0;
+
+	for (event = script->event_list; event != NULL; event = event->next) {
+		if (event->type != PACKET_EVENT)
+			continue;
+		if (n++ == ordinal)
+			return event;
+	}
+	return NULL;
+}
+
+static bool has_mptcp_option(struct packet *packet)
+{
+	int i;
+
+	if (tcp_options_ensure_index(packet, NULL))
+		return false;
+	for (i = 0; i < packet->num_tcp_options; ++i) {
+		if (packet->tcp_options[i].kind == TCPOPT_MPTCP)
+			return true;
+	}
+	return false;
+}
+
+/* Find the inbound packets with MPTCP options, which make up our input. */
+static void find_targets(struct fuzz *fuzz)
+{
+	struct event *event = NULL;
+	int ordinal = 0;
+
+	for (event = fuzz->script->event_list; event != NULL;
+	     event = event->next) {
+		struct packet *packet = event->event.packet;
+		struct fuzz_target *target = NULL;
+
+		if (event->type != PACKET_EVENT)
+			continue;
+		++ordinal;
+		if (packet_direction(packet) != DIRECTION_INBOUND ||
+		    packet->tcp == NULL || !has_mptcp_option(packet))
+			continue;
+
+		fuzz->targets = realloc(fuzz->targets,
+					(fuzz->num_targets + 1) *
+					sizeof(struct fuzz_target));
+		target = &fuzz->targets[fuzz->num_targets++];
+		target->packet = packet;
+		target->ordinal = ordinal - 1;
+		target->offset = fuzz->input_len;
+		target->len = packet_tcp_options_len(packet);
+		fuzz->input_len += target->len;
+	}
+}
+
+/* Copy the packets' current option bytes into an input. */
+static void save_input(const struct fuzz *fuzz, u8 *input)
+{
+	int i;
+
+	for (i = 0; i < fuzz->num_targets; ++i) {
+		const struct fuzz_target *target = &fuzz->targets[i];
+
+		memcpy(input + target->offset,
+		       packet_tcp_options(target->packet), target->len);
+	}
+}
+
+/* Put an input's option bytes into the packets. */
+static void load_input(const struct fuzz *fuzz, const u8 *input)
+{
+	int i;
+
+	for (i = 0; i < fuzz->num_targets; ++i) {
+		const struct fuzz_target *target = &fuzz->targets[i];
+
+		memcpy(packet_tcp_options(target->packet),
+		       input + target->offset, target->len);
+		tcp_options_index(target->packet, NULL);
+	}
+}
+
+/* Apply one random mutation to the given MPTCP option, which has
+ * 'space' bytes up to the end of the TCP options.
+ */
+static void mutate_mptcp_option(u8 *option, int space)
+{
+	u8 subtype = option[2] >> 4;
+	int len = option[1];
+
+	switch (random() % 5) {
+	case 0:		/* another subtype */
+		option[2] = (option[2] & 0x0f) | ((random() % 8) << 4);
+		break;
+	case 1:		/* another length that still fits */
+		option[1] = 2 + random() % (space - 1);
+		break;
+	case 2:		/* DSS flags (F, m, M, a, A), or the flags byte */
+		if (subtype == DSS_SUBTYPE && len > 3)
+			option[3] ^= 1 << (random() % 5);
+		else if (len > 3)
+			option[3] ^= 1 << (random() % 8);
+		break;
+	case 3:		/* checksums */
+		if (subtype == MP_CAPABLE_SUBTYPE && len > 3)
+			option[3] ^= MP_CAPABLE_FLAG_A;
+		else if (subtype == DSS_SUBTYPE && len >= 4)
+			option[len - 1 - random() % 2] ^=
+				1 << (random() % 8);
+		break;
+	case 4:		/* any bit past the kind and length */
+		if (len > 2)
+			option[2 + random() % (len - 2)] ^=
+				1 << (random() % 8);
+		break;
+	}
+}
+
+/* Mutate the packets in place; keep only mutations that leave options
+ * we can still walk, so that the script can run at all.
+ */
+static void mutate(struct fuzz *fuzz)
+{
+	int n = 1 + random() % FUZZ_MAX_MUTATIONS;
+
+	while (n-- > 0) {
+		struct fuzz_target *target =
+			&fuzz->targets[random() % fuzz->num_targets];
+		struct packet *packet = target->packet;
+		u8 saved[MAX_TCP_OPTION_BYTES];
+		u8 *options = packet_tcp_options(packet);
+		struct tcp_option *option = NULL;
+		int slot, offset;
+
+		do {
+			slot = random() % packet->num_tcp_options;
+		} while (packet->tcp_options[slot].kind != TCPOPT_MPTCP);
+
+		memcpy(saved, options, target->len);
+		option = tcp_option_at(packet, slot);
+		offset = (u8 *)option - options;
+		mutate_mptcp_option((u8 *)option, target->len - offset);
+		if (tcp_options_index(packet, NULL) ||
+		    !has_mptcp_option(packet)) {
+			memcpy(options, saved, target->len);
+			tcp_options_index(packet, NULL);
+		}
+	}
+}
+
+/* Set the bit for the given feature; return true if it is new. */
+static bool add_coverage(struct fuzz *fuzz, u64 feature)
+{
+	u64 bit = ((feature * 0x9e3779b97f4a7c15ULL) >> 40) %
+		  FUZZ_COVERAGE_BITS;
+	u8 mask = 1 << (bit & 7);
+
+	if (fuzz->coverage[bit / 8] & mask)
+		return false;
+	fuzz->coverage[bit / 8] |= mask;
+	++fuzz->coverage_bits;
+	return true;
+}
+
+/* In a fuzzing child, the fuzzer whose kcov fds its threads enable. */
+static struct fuzz *child_fuzz;
+
+static void kcov_open(struct fuzz *fuzz)
+{
+	int i;
+
+	for (i = 0; i < FUZZ_NUM_THREADS; ++i)
+		fuzz->kcov[i].fd = -1;
+#ifdef linux
+	for (i = 0; i < FUZZ_NUM_THREADS; ++i) {
+		struct fuzz_kcov *kcov = &fuzz->kcov[i];
+		int fd = open("/sys/kernel/debug/kcov", O_RDWR);
+		void *area = NULL;
+
+		if (fd < 0) {
+			fprintf(stderr, "fuzz: no kcov (%s); using exit "
+				"status as feedback\n", strerror(errno));
+			return;
+		}
+		if (ioctl(fd, KCOV_INIT_TRACE, FUZZ_KCOV_ENTRIES))
+			die_perror("KCOV_INIT_TRACE");
+		area = mmap(NULL, FUZZ_KCOV_ENTRIES * sizeof(unsigned long),
+			    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (area == MAP_FAILED)
+			die_perror("mmap kcov");
+		kcov->fd = fd;
+		kcov->area = area;
+	}
+#else
+	fprintf(stderr, "fuzz: no kcov on this platform; using exit status "
+		"as feedback\n");
+#endif
+}
+
+/* Start tracing the calling thread, in the child, into the kcov fd
+ * of the given thread.
+ */
+static void kcov_start(struct fuzz *fuzz, enum fuzz_thread_t thread)
+{
+#ifdef linux
+	if (fuzz->kcov[thread].fd < 0)
+		return;
+	if (ioctl(fuzz->kcov[thread].fd, KCOV_ENABLE, KCOV_TRACE_PC))
+		die_perror("KCOV_ENABLE");
+#endif
+}
+
+void fuzz_syscall_thread_start(void)
+{
+	if (child_fuzz != NULL)
+		kcov_start(child_fuzz, FUZZ_THREAD_SYSCALL);
+}
+
+/* Forget what the last child traced, before forking the next one. */
+static void kcov_reset(struct fuzz *fuzz)
+{
+	int i;
+
+	for (i = 0; i < FUZZ_NUM_THREADS; ++i) {
+		if (fuzz->kcov[i].fd >= 0)
+			__atomic_store_n(&fuzz->kcov[i].area[0], 0,
+					 __ATOMIC_RELAXED);
+	}
+}
+
+/* Add the edges the last child traced; return true if any is new. */
+static bool kcov_collect(struct fuzz *fuzz)
+{
+	unsigned long i, n;
+	bool is_new = false;
+	int t;
+
+	for (t = 0; t < FUZZ_NUM_THREADS; ++t) {
+		const struct fuzz_kcov *kcov = &fuzz->kcov[t];
+		u64 prev = 0;
+
+		if (kcov->fd < 0)
+			continue;
+		n = __atomic_load_n(&kcov->area[0], __ATOMIC_RELAXED);
+		if (n >= FUZZ_KCOV_ENTRIES)
+			n = FUZZ_KCOV_ENTRIES - 1;
+		for (i = 0; i < n; ++i) {
+			u64 pc = kcov->area[i + 1];
+
+			is_new |= add_coverage(fuzz, (prev >> 1) ^ pc);
+			prev = pc;
+		}
+	}
+	return is_new;
+}
+
+/* Write the current input as a script that replays it. */
+static void save_reproducer(struct fuzz *fuzz, const char *kind)
+{
+	char *path = NULL;
+	FILE *f = NULL;
+	bool first = true;
+	int i, j;
+
+	asprintf(&path, "%s/%s-%06d.pkt", fuzz->config->fuzz_dir, kind,
+		 fuzz->iterations);
+	f = fopen(path, "w");
+	if (f == NULL)
+		die_perror(path);
+
+	fprintf(f, "// fuzz %s input, iteration %d, seed %u, from %s\n",
+		kind, fuzz->iterations, fuzz->config->fuzz_seed,
+		fuzz->config->script_path);
+	fprintf(f, "--fuzz_mutations=\"");
+	for (i = 0; i < fuzz->num_targets; ++i) {
+		const struct fuzz_target *target = &fuzz->targets[i];
+		const u8 *bytes = fuzz->input + target->offset;
+
+		if (memcmp(bytes, fuzz->corpus[0] + target->offset,
+			   target->len) == 0)
+			continue;
+		fprintf(f, "%s%d:", first ? "" : ",", target->ordinal);
+		for (j = 0; j < target->len; ++j)
+			fprintf(f, "%02x", bytes[j]);
+		first = false;
+	}
+	fprintf(f, "\"\n");
+	fwrite(fuzz->script->buffer, 1, fuzz->script->length, f);
+	if (fclose(f))
+		die_perror(path);
+
+	printf("fuzz: saved %s\n", path);
+	free(path);
+}
+
+/* Run the script once, with the current input, in a child process.
+ * Returns the child's wait status.
+ */
+static int run_one(struct fuzz *fuzz)
+{
+	int status = 0;
+	pid_t pid;
+
+	kcov_reset(fuzz);
+	pid = fork();
+
+	if (pid < 0)
+		die_perror("fork");
+	if (pid == 0) {
+		if (!fuzz->config->verbose) {
+			int null_fd = open("/dev/null", O_WRONLY);
+
+			if (null_fd >= 0) {
+				dup2(null_fd, STDOUT_FILENO);
+				dup2(null_fd, STDERR_FILENO);
+			}
+		}
+		alarm(FUZZ_TIMEOUT_SECS);
+		child_fuzz = fuzz;
+		kcov_start(fuzz, FUZZ_THREAD_MAIN);
+		run_script(fuzz->config, fuzz->script);
+		exit(EXIT_SUCCESS);
+	}
+
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR)
+			die_perror("waitpid");
+	}
+	return status;
+}
+
+static bool is_crash(int status)
+{
+	if (!WIFSIGNALED(status))
+		return false;
+	return WTERMSIG(status) != SIGALRM && WTERMSIG(status) != SIGKILL;
+}
+
+void run_fuzz(struct config *config, struct script *script)
+{
+	struct fuzz fuzz;
+	s64 start_nsecs = now_nsecs();
+	int i;
+
+	memset(&fuzz, 0, sizeof(fuzz));
+	fuzz.config = config;
+	fuzz.script = script;
+
+	find_targets(&fuzz);
+	if (fuzz.num_targets == 0)
+		die("%s: no inbound packets with MPTCP options to fuzz\n",
+		    config->script_path);
+
+	if (config->fuzz_seed == 0)
+		config->fuzz_seed = time(NULL) ^ getpid();
+	srandom(config->fuzz_seed);
+	printf("fuzz: %s: %d packets, %d option bytes, seed %u\n",
+	       config->script_path, fuzz.num_targets, fuzz.input_len,
+	       config->fuzz_seed);
+
+	fuzz.coverage = calloc(FUZZ_COVERAGE_BITS / 8, 1);
+	fuzz.input = malloc(fuzz.input_len);
+	fuzz.corpus[0] = malloc(fuzz.input_len);
+	save_input(&fuzz, fuzz.corpus[0]);
+	fuzz.corpus_len = 1;
+	kcov_open(&fuzz);
+
+	/* Set up the tun device once; every child reuses it. */
+	if (!config->is_wire_client && config->netdev_type == NETDEV_TUN) {
+		config->reuse_netdev = true;
+		netdev_free(local_netdev_new(config));
+	}
+
+	for (i = 0; i < config->fuzz_iterations; ++i) {
+		const u8 *parent = fuzz.corpus[random() % fuzz.corpus_len];
+		bool is_new = false;
+		int status;
+
+		fuzz.iterations = i;
+		load_input(&fuzz, parent);
+		mutate(&fuzz);
+		save_input(&fuzz, fuzz.input);
+
+		status = run_one(&fuzz);
+		is_new = kcov_collect(&fuzz);
+		is_new |= add_coverage(&fuzz, (u64)status << 32);
+
+		if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM)
+			++fuzz.num_timeouts;
+		if (is_crash(status)) {
+			++fuzz.num_crashes;
+			save_reproducer(&fuzz, "crash");
+		} else if (is_new) {
+			++fuzz.num_new;
+			save_reproducer(&fuzz, "new");
+			if (fuzz.corpus_len < FUZZ_MAX_CORPUS) {
+				fuzz.corpus[fuzz.corpus_len] =
+					malloc(fuzz.input_len);
+				memcpy(fuzz.corpus[fuzz.corpus_len++],
+				       fuzz.input, fuzz.input_len);
+			}
+		}
+	}
+
+	printf("fuzz: %d iterations in %.3f sec: %d new, %d crashes, "
+	       "%d timeouts, %d coverage bits\n",
+	       config->fuzz_iterations,
+	       nsecs_to_secs(now_nsecs() - start_nsecs), fuzz.num_new,
+	       fuzz.num_crashes, fuzz.num_timeouts, fuzz.coverage_bits);
+	load_input(&fuzz, fuzz.corpus[0]);
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+void fuzz_replay(struct config *config, struct script *script)
+{
+	const char *s = config->fuzz_mutations;
+
+	while (*s != '\0') {
+		struct event *event = NULL;
+		struct packet *packet = NULL;
+		u8 *options = NULL;
+		char *end = NULL;
+		int ordinal, len = 0;
+
+		ordinal = strtol(s, &end, 10);
+		if (end == s || *end != ':')
+			die("%s: bad --fuzz_mutations: %s\n",
+			    config->script_path, s);
+		s = end + 1;
+
+		event = find_packet_event(script, ordinal);
+		if (event == NULL || event->event.packet->tcp == NULL)
+			die("%s: --fuzz_mutations: no TCP packet event %d\n",
+			    config->script_path, ordinal);
+		packet = event->event.packet;
+		options = packet_tcp_options(packet);
+
+		while (hex_digit(s[0]) >= 0 && hex_digit(s[1]) >= 0) {
+			if (len == packet_tcp_options_len(packet))
+				die("%s: --fuzz_mutations: too many bytes "
+				    "for packet event %d\n",
+				    config->script_path, ordinal);
+			options[len++] = hex_digit(s[0]) << 4 |
+					 hex_digit(s[1]);
+			s += 2;
+		}
+		if (len != packet_tcp_options_len(packet))
+			die("%s: --fuzz_mutations: need %d bytes for packet "
+			    "event %d\n", config->script_path,
+			    packet_tcp_options_len(packet), ordinal);
+		tcp_options_index(packet, NULL);
+
+		if (*s == ',')
+			++s;
+		else if (*s != '\0')
+			die("%s: bad --fuzz_mutations: %s\n",
+			    config->script_path, s);
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * In-process fuzzing of the MPTCP options in the inbound packets of a
+ * script (--fuzz_iterations), and replay of the mutations a fuzzing
+ * run saved in a reproducer (--fuzz_mutations).
+ */
+
+#ifndef __FUZZ_H__
+#define __FUZZ_H__
+
+#include "types.h"
+
+#include "config.h"
+#include "script.h"
+
+/* Max number of interesting inputs we keep mutating. */
+#define FUZZ_MAX_CORPUS		1024
+
+/* Bits in the map of coverage seen so far. */
+#define FUZZ_COVERAGE_BITS	(1 << 20)
+
+/* Max number of kernel PCs kcov records per iteration. */
+#define FUZZ_KCOV_ENTRIES	(1 << 18)
+
+/* Max mutations applied to an input in one iteration. */
+#define FUZZ_MAX_MUTATIONS	4
+
+/* An iteration that runs longer than this is killed. */
+#define FUZZ_TIMEOUT_SECS	10
+
+/* Run the script config->fuzz_iterations times, each time with the
+ * MPTCP options of its inbound packets mutated. The netdev stays up
+ * for the whole run, and each iteration runs in a forked child, so a
+ * failing iteration does not end the run. Kernel coverage from kcov,
+ * when available, decides which mutated inputs are worth keeping;
+ * those, and any that crash packetdrill itself, are saved as .pkt
+ * reproducers in config->fuzz_dir.
+ */
+extern void run_fuzz(struct config *config, struct script *script);
+
+/* Start kcov tracing of the calling thread, the syscall thread of a
+ * fuzzing child, into its own kcov buffer. A no-op outside of a
+ * fuzzing child, or without kcov.
+ */
+extern void fuzz_syscall_thread_start(void);
+
+/* Apply the mutations in config->fuzz_mutations, as saved in a
+ * reproducer, to the parsed script.
+ */
+extern void fuzz_replay(struct config *config, struct script *script);
+
+#endif /* __FUZZ_H__ */
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * End-to-end benchmark of the interpreter loop. Runs scripts through
+ * run_script() on the kernel-free loopback netdev (--netdev=loopback),
+ * several times each, and reports how many events per second the
+ * loop gets through and how far behind their script times events
+ * finish. With no kernel in the packet path, these numbers are a
+ * baseline for the interpreter's own overhead.
+ *
+ * usage: loopback_bench [--bench_runs=N] [--bench_json=<path>]
+ *                       [--bench_pace_usecs=N] [packetdrill options]
+ *                       script...
+ *
+ * With --bench_pace_usecs, each inbound data segment is injected N
+ * usecs after the event before it, whatever time the script gives, so
+ * one script serves both for back to back and for paced runs.
+ *
+ * Like packetdrill, this needs the privileges to set a real-time
+ * scheduling policy and lock memory.
+ */
+
+#include "types.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "logging.h"
+#include "packet.h"
+#include "parse.h"
+#include "run.h"
+#include "script.h"
+
+/* Default number of times we run each script. */
+#define BENCH_DEFAULT_RUNS	10
+
+/* Results for all the runs of one script. */
+struct script_result {
+	const char *path;
+	int runs;
+	s64 events;		/* events run, over all runs */
+	s64 loop_nsecs;		/* time in the event loop, over all runs */
+	s64 *lags;		/* dispatch lags of timed events... */
+	int num_lags;		/* ...how many we have... */
+	int max_lags;		/* ...and how many fit */
+};
+
+static void add_lag(struct script_result *result, s64 lag_nsecs)
+{
+	if (result->num_lags == result->max_lags) {
+		result->max_lags = result->max_lags ? 2 * result->max_lags
+						    : 1024;
+		result->lags = realloc(result->lags,
+				       result->max_lags * sizeof(s64));
+		if (result->lags == NULL)
+			die_perror("realloc");
+	}
+	result->lags[result->num_lags++] = lag_nsecs;
+}
+
+/* Collect the timings run_script() left in the script's events. */
+static void add_run(struct script_result *result,
+		    const struct script *script)
+{
+	const struct event *event = NULL;
+	s64 start_nsecs = 0, end_nsecs = 0;
+
+	for (event = script->event_list; event != NULL; event = event->next) {
+		if (event->finished_nsecs == 0)
+			continue;
+		++result->events;
+		end_nsecs = event->finished_nsecs;
+		if (event->time_type == ANY_TIME)
+			continue;
+		/* The loop started when the first timed event was due. */
+		if (start_nsecs == 0)
+			start_nsecs = event->finished_nsecs -
+				      event->dispatch_lag_nsecs;
+		add_lag(result, event->dispatch_lag_nsecs);
+	}
+	result->loop_nsecs += end_nsecs - start_nsecs;
+	++result->runs;
+}
+
+/* Inject each inbound data segment pace_nsecs after the event before it. */
+static void pace_data_segments(struct script *script, s64 pace_nsecs)
+{
+	struct event *event = NULL;
+
+	for (event = script->event_list; event != NULL; event = event->next) {
+		if (event->type == PACKET_EVENT &&
+		    event->time_type == RELATIVE_TIME &&
+		    packet_direction(event->event.packet) ==
+		    DIRECTION_INBOUND &&
+		    packet_payload_len(event->event.packet) > 0)
+			event->time_nsecs = pace_nsecs;
+	}
+}
+
+static int compare_s64(const void *a, const void *b)
+{
+	s64 x = *(const s64 *)a, y = *(const s64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Return the given percentile of the sorted lags, in microseconds. */
+static double lag_percentile_usecs(const struct script_result *result,
+				   int percentile)
+{
+	int i;
+
+	if (result->num_lags == 0)
+		return 0;
+	i = (result->num_lags - 1) * percentile / 100;
+	return result->lags[i] / 1000.0;
+}
+
+static double events_per_sec(const struct script_result *result)
+{
+	if (result->loop_nsecs <= 0)
+		return 0;
+	return result->events * 1e9 / result->loop_nsecs;
+}
+
+static void print_results(FILE *f, struct script_result *results,
+			  int num, bool json)
+{
+	static const int percentiles[] = { 50, 90, 99, 100 };
+	int i, p;
+
+	if (json)
+		fprintf(f, "{\n  \"scripts\": [");
+	for (i = 0; i < num; ++i) {
+		const struct script_result *r = &results[i];
+
+		if (!json) {
+			fprintf(f, "%s: %d runs, %lld events, "
+				"%.0f events/sec\n", r->path, r->runs,
+				r->events, events_per_sec(r));
+			fprintf(f, "  dispatch lag usecs:");
+			for (p = 0; p < ARRAY_SIZE(percentiles); ++p) {
+				fprintf(f, " p%d %.1f", percentiles[p],
+					lag_percentile_usecs(r,
+							     percentiles[p]));
+			}
+			fputc('\n', f);
+			continue;
+		}
+		fprintf(f, "%s\n    { \"script\": \"%s\", \"runs\": %d, "
+			"\"events\": %lld, \"events_per_sec\": %.0f",
+			i > 0 ? "," : "", r->path, r->runs, r->events,
+			events_per_sec(r));
+		for (p = 0; p < ARRAY_SIZE(percentiles); ++p) {
+			fprintf(f, ", \"lag_p%d_usecs\": %.1f",
+				percentiles[p],
+				lag_percentile_usecs(r, percentiles[p]));
+		}
+		fprintf(f, " }");
+	}
+	if (json)
+		fprintf(f, "\n  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct script_result *results = NULL;
+	const char *json_path = NULL;
+	char **pd_argv = calloc(argc + 1, sizeof(char *));
+	char **script_paths = NULL;
+	struct config config;
+	int pd_argc = 0, runs = BENCH_DEFAULT_RUNS;
+	s64 pace_nsecs = -1;
+	int num_scripts, i, run;
+
+	/* Take out our own options; the rest are for packetdrill. */
+	for (i = 0; i < argc; ++i) {
+		if (strncmp(argv[i], "--bench_runs=", 13) == 0)
+			runs = atoi(argv[i] + 13);
+		else if (strncmp(argv[i], "--bench_json=", 13) == 0)
+			json_path = argv[i] + 13;
+		else if (strncmp(argv[i], "--bench_pace_usecs=", 19) == 0)
+			pace_nsecs = atoll(argv[i] + 19) * 1000;
+		else
+			pd_argv[pd_argc++] = argv[i];
+	}
+	if (runs <= 0)
+		die("--bench_runs must be positive\n");
+	if (pace_nsecs < -1)
+		die("--bench_pace_usecs must not be negative\n");
+
+	set_default_config(&config);
+	script_paths = parse_command_line_options(pd_argc, pd_argv, &config);
+	for (num_scripts = 0; script_paths[num_scripts] != NULL;
+	     ++num_scripts)
+		;
+	if (num_scripts == 0) {
+		fprintf(stderr, "usage: loopback_bench [--bench_runs=N] "
+			"[--bench_json=<path>] [--bench_pace_usecs=N] "
+			"[packetdrill options] script...\n");
+		exit(EXIT_FAILURE);
+	}
+
+	results = calloc(num_scripts, sizeof(struct script_result));
+	for (i = 0; i < num_scripts; ++i) {
+		results[i].path = script_paths[i];
+		for (run = 0; run < runs; ++run) {
+			struct script script;
+
+			if (parse_script_and_set_config(pd_argc, pd_argv,
+							&config, &script,
+							script_paths[i],
+							NULL))
+				exit(EXIT_FAILURE);
+			if (config.netdev_type != NETDEV_LOOPBACK)
+				die("%s: needs --netdev=loopback\n",
+				    script_paths[i]);
+			if (pace_nsecs >= 0)
+				pace_data_segments(&script, pace_nsecs);
+
+			run_script(&config, &script);
+			add_run(&results[i], &script);
+			script_free(&script);
+			config_free(&config);
+		}
+		qsort(results[i].lags, results[i].num_lags, sizeof(s64),
+		      compare_s64);
+	}
+
+	print_results(stdout, results, num_scripts, false);
+	if (json_path != NULL) {
+		FILE *f = fopen(json_path, "w");
+
+		if (f == NULL)
+			die_perror("fopen");
+		print_results(f, results, num_scripts, true);
+		fclose(f);
+	}
+	return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * A netdev with no kernel behind it. Every injected packet is handed
+ * straight to a small TCP responder, which queues its answers in
+ * memory for the interpreter to sniff. Since neither direction makes
+ * a system call, timing errors measured on this netdev are purely the
+ * interpreter's own.
+ */
+
+#include "loopback_netdev.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+#include "packet.h"
+#include "packet_checksum.h"
+#include "run.h"
+#include "socket.h"
+#include "tcp_packet.h"
+
+/* What the responder remembers about one TCP connection. */
+struct loopback_flow {
+	struct tuple inbound;	/* tuple of packets injected for the flow */
+	u32 snd_nxt;		/* next sequence number we send */
+};
+
+struct loopback_netdev {
+	struct netdev netdev;		/* "inherit" from netdev */
+
+	struct packet *queue[LOOPBACK_MAX_QUEUED];	/* answers... */
+	int queue_head;			/* ...oldest answer... */
+	int queue_len;			/* ...and how many there are */
+
+	struct loopback_flow flows[LOOPBACK_MAX_FLOWS];
+	int num_flows;			/* valid entries in flows */
+};
+
+struct netdev_ops loopback_netdev_ops;
+
+/* "Downcast" an abstract netdev to our loopback flavor. */
+static inline struct loopback_netdev *to_loopback_netdev(
+	struct netdev *netdev)
+{
+	return (struct loopback_netdev *)netdev;
+}
+
+struct netdev *loopback_netdev_new(struct config *config)
+{
+	struct loopback_netdev *netdev =
+		calloc(1, sizeof(struct loopback_netdev));
+
+	DEBUGP("loopback_netdev_new\n");
+
+	netdev->netdev.ops = &loopback_netdev_ops;
+	return (struct netdev *)netdev;
+}
+
+static void loopback_netdev_free(struct netdev *a_netdev)
+{
+	struct loopback_netdev *netdev = to_loopback_netdev(a_netdev);
+
+	DEBUGP("loopback_netdev_free\n");
+
+	while (netdev->queue_len > 0) {
+		packet_free(netdev->queue[netdev->queue_head]);
+		netdev->queue_head =
+			(netdev->queue_head + 1) % LOOPBACK_MAX_QUEUED;
+		--netdev->queue_len;
+	}
+
+	memset(netdev, 0, sizeof(*netdev));  /* paranoia */
+	free(netdev);
+}
+
+static struct loopback_flow *find_flow(struct loopback_netdev *netdev,
+				       const struct tuple *inbound)
+{
+	int i;
+
+	for (i = 0; i < netdev->num_flows; ++i) {
+		if (is_equal_tuple(&netdev->flows[i].inbound, inbound))
+			return &netdev->flows[i];
+	}
+	return NULL;
+}
+
+static void forget_flow(struct loopback_netdev *netdev,
+			struct loopback_flow *flow)
+{
+	*flow = netdev->flows[--netdev->num_flows];
+}
+
+/* Queue an answer from the responder on the flow, as if the kernel
+ * had just sent it.
+ */
+static void answer(struct loopback_netdev *netdev, const struct packet *in,
+		   const char *flags, u32 seq, u32 ack)
+{
+	struct packet *packet = NULL;
+	struct tuple inbound, outbound;
+	char *error = NULL;
+
+	if (netdev->queue_len == LOOPBACK_MAX_QUEUED) {
+		DEBUGP("loopback queue full; dropping answer\n");
+		return;
+	}
+
+	packet = new_tcp_packet(-1, packet_address_family(in),
+				DIRECTION_OUTBOUND, ECN_NONE, flags,
+				seq, 0, ack, LOOPBACK_WINDOW, NULL, &error);
+	if (packet == NULL)
+		die("loopback netdev: %s\n", error);
+
+	get_packet_tuple(in, &inbound);
+	reverse_tuple(&inbound, &outbound);
+	set_packet_tuple(packet, &outbound);
+	checksum_packet(packet);
+	packet->time_nsecs = now_nsecs();
+
+	netdev->queue[(netdev->queue_head + netdev->queue_len) %
+		      LOOPBACK_MAX_QUEUED] = packet;
+	++netdev->queue_len;
+}
+
+/* Play the kernel's part for one injected packet. */
+static void respond(struct loopback_netdev *netdev, struct packet *packet)
+{
+	const struct tcp *tcp = packet->tcp;
+	struct loopback_flow *flow = NULL;
+	struct tuple inbound;
+	u32 seq, rcv_nxt;
+
+	if (tcp == NULL)
+		return;
+
+	get_packet_tuple(packet, &inbound);
+	flow = find_flow(netdev, &inbound);
+	seq = ntohl(tcp->seq);
+
+	if (tcp->rst) {
+		if (flow != NULL)
+			forget_flow(netdev, flow);
+		return;
+	}
+
+	if (tcp->syn && !tcp->ack) {
+		if (flow == NULL) {
+			if (netdev->num_flows == LOOPBACK_MAX_FLOWS)
+				die("loopback netdev: too many flows\n");
+			flow = &netdev->flows[netdev->num_flows++];
+			flow->inbound = inbound;
+		}
+		flow->snd_nxt = LOOPBACK_ISN + 1;
+		answer(netdev, packet, "S.", LOOPBACK_ISN, seq + 1);
+		return;
+	}
+
+	if (flow == NULL) {
+		DEBUGP("loopback netdev: dropping packet for unknown flow\n");
+		return;
+	}
+
+	rcv_nxt = seq + packet_payload_len(packet) + tcp->fin;
+	if (tcp->fin) {
+		answer(netdev, packet, "F.", flow->snd_nxt, rcv_nxt);
+		++flow->snd_nxt;
+	} else if (rcv_nxt != seq) {
+		answer(netdev, packet, ".", flow->snd_nxt, rcv_nxt);
+	}
+}
+
+static int loopback_netdev_send(struct netdev *a_netdev,
+				struct packet *packet)
+{
+	struct loopback_netdev *netdev = to_loopback_netdev(a_netdev);
+
+	DEBUGP("loopback_netdev_send\n");
+
+	assert(packet->ip_bytes > 0);
+	respond(netdev, packet);
+	return STATUS_OK;
+}
+
+static int loopback_netdev_receive(struct netdev *a_netdev,
+				   struct packet **packet, char **error)
+{
+	struct loopback_netdev *netdev = to_loopback_netdev(a_netdev);
+
+	DEBUGP("loopback_netdev_receive\n");
+
+	assert(*packet == NULL);	/* should be no packet yet */
+
+	/* Nothing else can ever produce a packet, so don't wait. */
+	if (netdev->queue_len == 0) {
+		asprintf(error, "loopback netdev has no outbound packet");
+		return STATUS_ERR;
+	}
+
+	*packet = netdev->queue[netdev->queue_head];
+	netdev->queue_head = (netdev->queue_head + 1) % LOOPBACK_MAX_QUEUED;
+	--netdev->queue_len;
+	return STATUS_OK;
+}
+
+struct netdev_ops loopback_netdev_ops = {
+	.free = loopback_netdev_free,
+	.send = loopback_netdev_send,
+	.receive = loopback_netdev_receive,
+};
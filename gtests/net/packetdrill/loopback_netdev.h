@@ -0,0 +1,57 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * A kernel-free netdev for measuring the interpreter itself: injected
+ * packets go to a tiny in-memory TCP responder instead of the kernel,
+ * and its answers are what the script sniffs.
+ */
+
+#ifndef __LOOPBACK_NETDEV_H__
+#define __LOOPBACK_NETDEV_H__
+
+#include "types.h"
+
+#include "config.h"
+#include "netdev.h"
+
+/* Max number of answers waiting to be sniffed. */
+#define LOOPBACK_MAX_QUEUED	64
+
+/* Max number of TCP connections the responder tracks at once. */
+#define LOOPBACK_MAX_FLOWS	64
+
+/* Initial sequence number and receive window of the responder. */
+#define LOOPBACK_ISN		0
+#define LOOPBACK_WINDOW		65535
+
+/* Allocate and return a new netdev whose "kernel" is a scripted
+ * responder (--netdev=loopback). For each injected TCP packet it
+ * answers immediately, as a minimal TCP server that never sends data:
+ *
+ *   SYN          ->  SYN/ACK with seq LOOPBACK_ISN
+ *   data or FIN  ->  ACK of everything received (FIN/ACK for a FIN)
+ *   pure ACK     ->  nothing
+ *   RST          ->  nothing, and the connection is forgotten
+ *
+ * Packets for unknown connections and non-TCP packets are dropped.
+ * Sniffing when no answer is pending is an error rather than a wait.
+ */
+extern struct netdev *loopback_netdev_new(struct config *config);
+
+#endif /* __LOOPBACK_NETDEV_H__ */
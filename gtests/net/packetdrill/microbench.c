@@ -0,0 +1,621 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Micro-benchmarks for the per-event hot paths of the interpreter:
+ * packet parsing and copying, mapping packets between script and live
+ * space, verifying outbound packets, filling in MPTCP options, packet
+ * dumps and script parsing.
+ *
+ * Every benchmark runs a fixed number of operations on fixed inputs,
+ * several times over, and reports the fastest run in nanoseconds per
+ * operation along with heap allocations per operation. "make bench"
+ * runs them all and also writes the results to bench.json, so they
+ * can be compared across commits.
+ */
+
+#include "types.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include "config.h"
+#include "logging.h"
+#include "mptcp.h"
+#include "packet.h"
+#include "packet_checksum.h"
+#include "packet_parser.h"
+#include "packet_to_string.h"
+#include "run.h"
+#include "run_packet.h"
+#include "script.h"
+#include "socket.h"
+#include "tcp_options.h"
+#include "tcp_options_iterator.h"
+#include "tcp_packet.h"
+
+/* Number of timed runs of each benchmark; we report the fastest. */
+#define BENCH_RUNS		5
+
+/* Operations per timed run for cheap and for expensive benchmarks. */
+#define BENCH_OPS		100000
+#define BENCH_OPS_SLOW		2000
+
+/* Heap allocations made since we started counting. We count by
+ * interposing on the glibc allocator entry points; elsewhere
+ * allocations are not counted and are reported as unknown.
+ */
+static u64 num_allocs;
+
+#if defined(__GLIBC__)
+#define COUNT_ALLOCS	1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+	++num_allocs;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	++num_allocs;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	++num_allocs;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+#else
+#define COUNT_ALLOCS	0
+#endif /* defined(__GLIBC__) */
+
+/* A single benchmark: 'op' is called 'ops' times per timed run. */
+struct benchmark {
+	const char *name;
+	void (*op)(void *arg);
+	void *arg;
+	int ops;
+	double ns_per_op;		/* result: fastest run */
+	double allocs_per_op;		/* result: from the fastest run */
+};
+
+/* A TCP/IPv4 ACK with SACK and timestamp options:
+ * 192.0.2.1:53055 > 192.168.0.1:8080
+ * . 1:1(0) ack 2202903899 win 257
+ * <sack 2202905347:2202906795,TS val 300 ecr 1623332896>
+ */
+static const u8 tcp_ipv4_bytes[] = {
+	0x45, 0x00, 0x00, 0x3c, 0x00, 0x00, 0x00, 0x00,
+	0xff, 0x06, 0x39, 0x11, 0xc0, 0x00, 0x02, 0x01,
+	0xc0, 0xa8, 0x00, 0x01, 0xcf, 0x3f, 0x1f, 0x90,
+	0x00, 0x00, 0x00, 0x01, 0x83, 0x4d, 0xa5, 0x5b,
+	0xa0, 0x10, 0x01, 0x01, 0xdb, 0x2d, 0x00, 0x00,
+	0x05, 0x0a, 0x83, 0x4d, 0xab, 0x03, 0x83, 0x4d,
+	0xb0, 0xab, 0x08, 0x0a, 0x00, 0x00, 0x01, 0x2c,
+	0x60, 0xc2, 0x18, 0x20
+};
+
+/* A small but typical script, for the script parsing benchmark. */
+static const char bench_script[] =
+	"0   socket(..., SOCK_STREAM, IPPROTO_TCP) = 3\n"
+	"+0  setsockopt(3, SOL_SOCKET, SO_REUSEADDR, [1], 4) = 0\n"
+	"+0  bind(3, ..., ...) = 0\n"
+	"+0  listen(3, 1) = 0\n"
+	"+0  < S 0:0(0) win 32792 <mss 1000,sackOK,nop,nop,nop,wscale 7>\n"
+	"+0  > S. 0:0(0) ack 1 <mss 1460,nop,nop,sackOK,nop,wscale 6>\n"
+	"+.1 < . 1:1(0) ack 1 win 257\n"
+	"+0  accept(3, ..., ...) = 4\n"
+	"+0  write(4, ..., 1000) = 1000\n"
+	"+0  > P. 1:1001(1000) ack 1\n"
+	"+.1 < . 1:1(0) ack 1001 win 257\n"
+	"+0  < P. 1:1001(1000) ack 1001 win 257\n"
+	"+0  > . 1001:1001(0) ack 1001\n"
+	"+0  read(4, ..., 1000) = 1000\n"
+	"+0  close(4) = 0\n"
+	"+0  > F. 1001:1001(0) ack 1001\n";
+
+/* Fixture shared by the TCP mapping and verification benchmarks. */
+struct tcp_fixture {
+	struct config config;
+	struct state state;
+	struct event event;
+	struct socket *socket;
+	struct packet *script_outbound;	/* "> P. 1:1001(1000) ack 1" */
+	struct packet *live_outbound;	/* what the kernel sent for it */
+	struct packet *script_inbound;	/* "< . 1:1(0) ack 1001" */
+};
+
+/* Fixture for one MPTCP option subtype. */
+struct mptcp_fixture {
+	struct packet *packet;		/* inbound packet with the option */
+	u8 options[MAX_TCP_OPTION_BYTES];	/* pristine option bytes */
+	int options_len;
+	u8 subtype;
+};
+
+static struct tcp_fixture tcp;
+static struct mp_join_info join_info;
+
+static s64 now_monotonic_nsecs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		die_perror("clock_gettime");
+	return timespec_to_nsecs(&ts);
+}
+
+/* Build a TCP/IPv4 packet, with the given options padded out with
+ * NOPs in front, for the given 4-tuple.
+ */
+static struct packet *new_bench_tcp_packet(
+	enum direction_t direction, const char *flags, u32 seq,
+	u16 payload_bytes, u32 ack, struct tcp_option **opts, int num_opts,
+	const struct tuple *tuple)
+{
+	struct tcp_options *options = tcp_options_new();
+	struct packet *packet = NULL;
+	char *error = NULL;
+	int bytes = 0, i;
+
+	for (i = 0; i < num_opts; ++i)
+		bytes += opts[i]->length;
+	while ((bytes++ & 0x3) != 0) {
+		struct tcp_option *nop = tcp_option_new(TCPOPT_NOP, 1);
+		tcp_options_append(options, nop);
+		free(nop);
+	}
+	for (i = 0; i < num_opts; ++i) {
+		tcp_options_append(options, opts[i]);
+		free(opts[i]);
+	}
+
+	packet = new_tcp_packet(-1, AF_INET, direction, ECN_NONE, flags,
+				seq, payload_bytes, ack, 257, options, &error);
+	if (packet == NULL)
+		die("new_tcp_packet: %s\n", error);
+	free(options);
+
+	set_packet_tuple(packet, tuple);
+	checksum_packet(packet);
+	return packet;
+}
+
+static struct tcp_option *new_ts_option(u32 val, u32 ecr)
+{
+	struct tcp_option *option =
+		tcp_option_new(TCPOPT_TIMESTAMP, TCPOLEN_TIMESTAMP);
+
+	option->data.time_stamp.val = htonl(val);
+	option->data.time_stamp.ecr = htonl(ecr);
+	return option;
+}
+
+static void set_endpoint(struct endpoint *endpoint, const char *ip, u16 port)
+{
+	endpoint->ip = ipv4_parse(ip);
+	endpoint->port = htons(port);
+}
+
+static void setup_tcp_fixture(void)
+{
+	struct tuple script_outbound, live_outbound, script_inbound;
+	struct tcp_option *opts[1];
+	char *error = NULL;
+
+	set_default_config(&tcp.config);
+	tcp.state.config = &tcp.config;
+	tcp.state.packets = packets_new();
+	tcp.event.time_type = ANY_TIME;
+	tcp.event.type = PACKET_EVENT;
+	tcp.state.event = &tcp.event;
+
+	tcp.socket = socket_new(&tcp.state);
+	tcp.socket->state = SOCKET_PASSIVE_SYNACK_ACKED;
+	tcp.socket->address_family = AF_INET;
+	tcp.socket->protocol = IPPROTO_TCP;
+	set_endpoint(&tcp.socket->script.local, "192.168.0.1", 8080);
+	set_endpoint(&tcp.socket->script.remote, "192.0.2.1", 40000);
+	tcp.socket->script.local_isn = 0;
+	tcp.socket->script.remote_isn = 0;
+	tcp.socket->live = tcp.socket->script;
+	tcp.socket->live.remote.port = htons(53055);
+	tcp.socket->live.local_isn = 1000000;
+	tcp.socket->live.remote_isn = 5000;
+
+	socket_get_outbound(&tcp.socket->script, &script_outbound);
+	socket_get_outbound(&tcp.socket->live, &live_outbound);
+	socket_get_inbound(&tcp.socket->script, &script_inbound);
+
+	opts[0] = new_ts_option(100, 200);
+	tcp.script_outbound = new_bench_tcp_packet(
+		DIRECTION_OUTBOUND, "P.", 1, 1000, 1, opts, 1,
+		&script_outbound);
+	opts[0] = new_ts_option(777, 200);
+	tcp.live_outbound = new_bench_tcp_packet(
+		DIRECTION_OUTBOUND, "P.", 1 + 1000000, 1000, 1 + 5000, opts, 1,
+		&live_outbound);
+	opts[0] = new_ts_option(300, 100);
+	tcp.script_inbound = new_bench_tcp_packet(
+		DIRECTION_INBOUND, ".", 1, 0, 1001, opts, 1, &script_inbound);
+
+	/* Check the fixture is right; this also learns the TS val mapping
+	 * that map_inbound_packet() needs.
+	 */
+	if (verify_outbound_live_packet(&tcp.state, tcp.socket,
+					tcp.script_outbound,
+					tcp.live_outbound, &error))
+		die("bench fixture: %s\n", error);
+}
+
+static void setup_mptcp_fixture(struct mptcp_fixture *f, u8 subtype,
+				const char *flags, u16 payload_bytes)
+{
+	struct tuple inbound;
+	struct tcp_option *opt = NULL;
+
+	socket_get_inbound(&tcp.socket->live, &inbound);
+	switch (subtype) {
+	case MP_CAPABLE_SUBTYPE:
+		opt = tcp_option_new(TCPOPT_MPTCP, TCPOLEN_MP_CAPABLE_SYN);
+		opt->data.mp_capable.flags = MP_CAPABLE_FLAGS;
+		break;
+	case MP_JOIN_SUBTYPE:
+		opt = tcp_option_new(TCPOPT_MPTCP, TCPOLEN_MP_JOIN_ACK);
+		break;
+	case DSS_SUBTYPE:
+		opt = tcp_option_new(TCPOPT_MPTCP, TCPOLEN_DSS_DACK4_DSN4);
+		opt->data.dss.flag_A = 1;
+		opt->data.dss.flag_M = 1;
+		memset(&opt->data.dss.dack_dsn, 0xff,
+		       TCPOLEN_DSS_DACK4_DSN4 - 4);
+		break;
+	case ADD_ADDR_SUBTYPE:
+		opt = tcp_option_new(TCPOPT_MPTCP, TCPOLEN_ADD_ADDR_V4);
+		opt->data.add_addr.ipver = 4;
+		opt->data.add_addr.address_id = (u8)UNDEFINED;
+		break;
+	case REMOVE_ADDR_SUBTYPE:
+		opt = tcp_option_new(TCPOPT_MPTCP, TCPOLEN_REMOVE_ADDR + 1);
+		opt->data.remove_addr.address_id = 1;
+		break;
+	case MP_PRIO_SUBTYPE:
+		opt = tcp_option_new(TCPOPT_MPTCP, TCPOLEN_MP_PRIO);
+		break;
+	case MP_FAIL_SUBTYPE:
+		opt = tcp_option_new(TCPOPT_MPTCP, TCPOLEN_MP_FAIL);
+		opt->data.mp_fail.dsn8 = (u64)UNDEFINED;
+		break;
+	case MP_FASTCLOSE_SUBTYPE:
+		opt = tcp_option_new(TCPOPT_MPTCP, TCPOLEN_MP_FASTCLOSE);
+		opt->data.mp_fastclose.receiver_key = (u64)UNDEFINED;
+		break;
+	default:
+		assert(!"bad MPTCP subtype");
+	}
+	opt->data.mp_capable.subtype = subtype;
+
+	f->subtype = subtype;
+	f->packet = new_bench_tcp_packet(DIRECTION_INBOUND, flags, 1,
+					 payload_bytes, 1, &opt, 1, &inbound);
+	f->options_len = packet_tcp_options_len(f->packet);
+	memcpy(f->options, packet_tcp_options(f->packet), f->options_len);
+}
+
+/* Set up an MPTCP connection with keys and one subflow, as if the
+ * MP_CAPABLE handshake had completed on the fixture socket.
+ */
+static void setup_mptcp_connection(void)
+{
+	struct tuple inbound;
+	struct packet *syn = NULL;
+
+	init_mp_state();
+	set_packetdrill_key(0x0123456789abcdefULL);
+	set_kernel_key(0xfedcba9876543210ULL);
+	mp_state.conn->idsn = sha1_least_64bits(mp_state.conn->packetdrill_key);
+	mp_state.conn->remote_idsn = sha1_least_64bits(mp_state.conn->kernel_key);
+	add_mp_var_key("a", &mp_state.conn->packetdrill_key);
+
+	socket_get_inbound(&tcp.socket->live, &inbound);
+	syn = new_bench_tcp_packet(DIRECTION_INBOUND, "S", 0, 0, 0,
+				   NULL, 0, &inbound);
+	if (new_subflow_inbound(syn) == NULL)
+		die("bench fixture: cannot create MPTCP subflow\n");
+	packet_free(syn);
+
+	join_info.ack.is_var = true;
+}
+
+static void bench_parse_packet(void *arg)
+{
+	const struct packet *template = arg;
+	int bytes = packet_end((struct packet *)template) - template->buffer;
+	struct packet *packet = packet_new(bytes);
+	char *error = NULL;
+
+	memcpy(packet->buffer, template->buffer, bytes);
+	if (parse_packet(packet, bytes, PACKET_LAYER_3_IP, &error) !=
+	    PACKET_OK)
+		die("parse_packet: %s\n", error);
+	packet_free(packet);
+}
+
+static void bench_packet_copy(void *arg)
+{
+	packet_free(packet_copy(arg));
+}
+
+static void bench_packet_to_string(void *arg)
+{
+	char *dump = NULL, *error = NULL;
+
+	if (packet_to_string(arg, DUMP_FULL, &dump, &error))
+		die("packet_to_string: %s\n", error);
+	free(dump);
+}
+
+static void bench_map_inbound_packet(void *arg)
+{
+	struct packet *live_packet = packet_copy(tcp.script_inbound);
+	char *error = NULL;
+
+	if (map_inbound_packet(tcp.socket, live_packet, &error))
+		die("map_inbound_packet: %s\n", error);
+	packet_free(live_packet);
+}
+
+static void bench_map_outbound_live_packet(void *arg)
+{
+	struct packet *actual_packet = packet_copy(tcp.live_outbound);
+	char *error = NULL;
+
+	if (map_outbound_live_packet(tcp.socket, tcp.live_outbound,
+				     actual_packet, tcp.script_outbound,
+				     &error))
+		die("map_outbound_live_packet: %s\n", error);
+	packet_free(actual_packet);
+}
+
+static void bench_verify_outbound_live_packet(void *arg)
+{
+	char *error = NULL;
+
+	if (verify_outbound_live_packet(&tcp.state, tcp.socket,
+					tcp.script_outbound,
+					tcp.live_outbound, &error))
+		die("verify_outbound_live_packet: %s\n", error);
+}
+
+/* Fill in the MPTCP option of an inbound packet. Restores the script
+ * option bytes first, and re-queues any script variable the handler
+ * consumes, so every operation does the same work.
+ */
+static void bench_mptcp_option(void *arg)
+{
+	struct mptcp_fixture *f = arg;
+
+	memcpy(packet_tcp_options(f->packet), f->options, f->options_len);
+	if (f->subtype == MP_CAPABLE_SUBTYPE)
+		enqueue_var("a");
+	else if (f->subtype == MP_JOIN_SUBTYPE)
+		queue_enqueue(&mp_state.vars_queue, &join_info);
+	if (mptcp_insert_and_extract_opt_fields(f->packet, f->packet,
+						DIRECTION_INBOUND))
+		die("mptcp_insert_and_extract_opt_fields failed for "
+		    "subtype %u\n", f->subtype);
+}
+
+static void bench_parse_script(void *arg)
+{
+	char *argv[] = { "microbench", NULL };
+	struct config config;
+	struct script script;
+
+	memset(&config, 0, sizeof(config));
+	memset(&script, 0, sizeof(script));
+	if (parse_script_and_set_config(1, argv, &config, &script,
+					"bench.pkt", bench_script))
+		die("parse_script failed\n");
+	script_free(&script);
+	config_free(&config);
+	free_mp_state();
+}
+
+/* Run the benchmark BENCH_RUNS times and keep the fastest run. */
+static void run_benchmark(struct benchmark *b)
+{
+	int run, i;
+
+	b->op(b->arg);		/* warm up caches and lazy state */
+	b->ns_per_op = -1;
+	for (run = 0; run < BENCH_RUNS; ++run) {
+		u64 allocs = num_allocs;
+		s64 start = now_monotonic_nsecs();
+		double ns;
+
+		for (i = 0; i < b->ops; ++i)
+			b->op(b->arg);
+		ns = (double)(now_monotonic_nsecs() - start) / b->ops;
+		if (b->ns_per_op < 0 || ns < b->ns_per_op) {
+			b->ns_per_op = ns;
+			b->allocs_per_op =
+				(double)(num_allocs - allocs) / b->ops;
+		}
+	}
+}
+
+static void print_results(FILE *f, const struct benchmark *benchmarks,
+			  int num, bool json)
+{
+	const char *separator = "";
+	int i;
+
+	if (json)
+		fprintf(f, "{\n  \"benchmarks\": [");
+	for (i = 0; i < num; ++i) {
+		const struct benchmark *b = &benchmarks[i];
+
+		if (b->ns_per_op < 0)
+			continue;	/* filtered out */
+		if (!json) {
+			fprintf(f, "%-40s %12.1f ns/op", b->name,
+				b->ns_per_op);
+			if (COUNT_ALLOCS)
+				fprintf(f, " %8.2f allocs/op",
+					b->allocs_per_op);
+			fputc('\n', f);
+			continue;
+		}
+		fprintf(f, "%s\n    { \"name\": \"%s\", \"ops\": %d, "
+			"\"ns_per_op\": %.1f, \"allocs_per_op\": ",
+			separator, b->name, b->ops, b->ns_per_op);
+		if (COUNT_ALLOCS)
+			fprintf(f, "%.2f }", b->allocs_per_op);
+		else
+			fprintf(f, "null }");
+		separator = ",";
+	}
+	if (json)
+		fprintf(f, "\n  ]\n}\n");
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: microbench [--json=<path>] "
+		"[--filter=<substring>]\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{ "json",	.has_arg = true, NULL, 'j' },
+		{ "filter",	.has_arg = true, NULL, 'f' },
+		{ NULL },
+	};
+	static const struct {
+		u8 subtype;
+		const char *name;
+		const char *flags;
+	} subtypes[] = {
+		{ MP_CAPABLE_SUBTYPE,	"mptcp/mp_capable",	"S." },
+		{ MP_JOIN_SUBTYPE,	"mptcp/mp_join",	"." },
+		{ DSS_SUBTYPE,		"mptcp/dss",		"." },
+		{ ADD_ADDR_SUBTYPE,	"mptcp/add_addr",	"." },
+		{ REMOVE_ADDR_SUBTYPE,	"mptcp/remove_addr",	"." },
+		{ MP_PRIO_SUBTYPE,	"mptcp/mp_prio",	"." },
+		{ MP_FAIL_SUBTYPE,	"mptcp/mp_fail",	"." },
+		{ MP_FASTCLOSE_SUBTYPE,	"mptcp/mp_fastclose",	"." },
+	};
+	struct mptcp_fixture mptcp[ARRAY_SIZE(subtypes)];
+	struct benchmark benchmarks[32];
+	const char *json_path = NULL, *filter = NULL;
+	struct packet *tcp_ipv4 = NULL;
+	char *error = NULL;
+	int num = 0, i, c;
+
+	while ((c = getopt_long(argc, argv, "", options, NULL)) != -1) {
+		switch (c) {
+		case 'j':
+			json_path = optarg;
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	setup_tcp_fixture();
+	setup_mptcp_connection();
+
+	tcp_ipv4 = packet_new(sizeof(tcp_ipv4_bytes));
+	memcpy(tcp_ipv4->buffer, tcp_ipv4_bytes, sizeof(tcp_ipv4_bytes));
+	if (parse_packet(tcp_ipv4, sizeof(tcp_ipv4_bytes), PACKET_LAYER_3_IP,
+			 &error) != PACKET_OK)
+		die("parse_packet: %s\n", error);
+
+	for (i = 0; i < ARRAY_SIZE(subtypes); ++i)
+		setup_mptcp_fixture(&mptcp[i], subtypes[i].subtype,
+				    subtypes[i].flags,
+				    subtypes[i].subtype == DSS_SUBTYPE ?
+				    1000 : 0);
+
+#define ADD_BENCH(bench_name, bench_op, bench_arg, bench_ops)	\
+	benchmarks[num++] = (struct benchmark) {		\
+		.name = bench_name, .op = bench_op,		\
+		.arg = bench_arg, .ops = bench_ops,		\
+	}
+	ADD_BENCH("parse_packet/tcp_ipv4", bench_parse_packet,
+		  tcp_ipv4, BENCH_OPS);
+	ADD_BENCH("parse_packet/mptcp_dss", bench_parse_packet,
+		  mptcp[2].packet, BENCH_OPS);
+	ADD_BENCH("packet_copy", bench_packet_copy,
+		  tcp.script_outbound, BENCH_OPS);
+	ADD_BENCH("map_inbound_packet", bench_map_inbound_packet,
+		  NULL, BENCH_OPS);
+	ADD_BENCH("map_outbound_live_packet", bench_map_outbound_live_packet,
+		  NULL, BENCH_OPS);
+	ADD_BENCH("verify_outbound_live_packet",
+		  bench_verify_outbound_live_packet, NULL, BENCH_OPS);
+	for (i = 0; i < ARRAY_SIZE(subtypes); ++i)
+		ADD_BENCH(subtypes[i].name, bench_mptcp_option,
+			  &mptcp[i], BENCH_OPS);
+	ADD_BENCH("packet_to_string", bench_packet_to_string,
+		  tcp_ipv4, BENCH_OPS);
+	ADD_BENCH("parse_script", bench_parse_script, NULL, BENCH_OPS_SLOW);
+#undef ADD_BENCH
+	assert(num <= ARRAY_SIZE(benchmarks));
+
+	for (i = 0; i < num; ++i) {
+		benchmarks[i].ns_per_op = -1;
+		if (filter == NULL || strstr(benchmarks[i].name, filter))
+			run_benchmark(&benchmarks[i]);
+	}
+
+	print_results(stdout, benchmarks, num, false);
+	if (json_path != NULL) {
+		FILE *f = fopen(json_path, "w");
+
+		if (f == NULL)
+			die_perror("fopen");
+		print_results(f, benchmarks, num, true);
+		fclose(f);
+	}
+	return 0;
+}
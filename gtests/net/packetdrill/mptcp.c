@@ -10,17 +10,14 @@
 
 void init_mp_state()
 {
-	mp_state.packetdrill_key_set = false;
-	mp_state.kernel_key_set = false;
 	queue_init(&mp_state.vars_queue);
 	queue_init_val(&mp_state.vals_queue);
 	queue_init_val(&mp_state.script_only_vals_queue);
 	mp_state.vars = NULL; //Init hashmap
-	mp_state.last_packetdrill_addr_id = 0;
-	mp_state.idsn = UNDEFINED;
-	mp_state.remote_idsn = UNDEFINED;
-	mp_state.remote_ssn = 0;
-	mp_state.remote_last_pkt_length = 0;
+	mp_state.subflows = NULL; //Init hashmap
+	mp_state.connections = NULL;
+	//Scripts with a single connection never need to pick another one
+	new_mp_connection();
 }
 
 void free_mp_state(){
@@ -28,6 +25,65 @@ void free_mp_state(){
 	free_val_queue();
 	free_vars();
 	free_flows();
+	free_connections();
+}
+
+/**
+ * Allocate a new mptcp connection, make it the current one (mp_state.conn)
+ * and return it.
+ */
+struct mp_connection *new_mp_connection()
+{
+	struct mp_connection *conn = calloc(1, sizeof(struct mp_connection));
+
+	conn->packetdrill_key_set = false;
+	conn->kernel_key_set = false;
+	conn->last_packetdrill_addr_id = 0;
+	conn->idsn = UNDEFINED;
+	conn->remote_idsn = UNDEFINED;
+	conn->remote_ssn = 0;
+	conn->remote_last_pkt_length = 0;
+	conn->bytes_sent_on_all_ssn = 1; // first subflow has already one packet sent
+	conn->num_subflows = 0;
+
+	conn->next = mp_state.connections;
+	mp_state.connections = conn;
+	mp_state.conn = conn;
+	return conn;
+}
+
+/**
+ * Free all mptcp connections.
+ */
+void free_connections()
+{
+	struct mp_connection *conn = mp_state.connections;
+	struct mp_connection *next;
+	while(conn){
+		next = conn->next;
+		free(conn);
+		conn = next;
+	}
+	mp_state.connections = NULL;
+	mp_state.conn = NULL;
+}
+
+/**
+ * Return the connection whose kernel key (kernel == true) or packetdrill key
+ * (kernel == false) hashes to the given token, or NULL.
+ */
+static struct mp_connection *find_connection_by_token(u32 token, bool kernel)
+{
+	struct mp_connection *conn;
+	for(conn = mp_state.connections; conn; conn = conn->next){
+		if(kernel && conn->kernel_key_set &&
+				sha1_least_32bits(conn->kernel_key) == token)
+			return conn;
+		if(!kernel && conn->packetdrill_key_set &&
+				sha1_least_32bits(conn->packetdrill_key) == token)
+			return conn;
+	}
+	return NULL;
 }
 
 /**
@@ -36,8 +92,8 @@ void free_mp_state(){
  */
 void set_packetdrill_key(u64 sender_key)
 {
-	mp_state.packetdrill_key = sender_key;
-	mp_state.packetdrill_key_set = true;
+	mp_state.conn->packetdrill_key = sender_key;
+	mp_state.conn->packetdrill_key_set = true;
 }
 
 /**
@@ -46,8 +102,8 @@ void set_packetdrill_key(u64 sender_key)
  */
 void set_kernel_key(u64 receiver_key)
 {
-    mp_state.kernel_key = receiver_key;
-    mp_state.kernel_key_set = true;
+    mp_state.conn->kernel_key = receiver_key;
+    mp_state.conn->kernel_key_set = true;
 }
 
 /* var_queue functions */
@@ -199,6 +255,71 @@ u64 find_next_value(){
 	return val;
 }
 
+/**
+ * Fill key with the 4-tuple of packet, seen from packetdrill side: for an
+ * inbound packet src is the packet source, for an outbound packet src is the
+ * packet destination. Return STATUS_ERR if packet is not TCP over IP.
+ */
+static int get_subflow_key(struct packet *packet,
+		unsigned direction,
+		struct mp_subflow_key *key)
+{
+	struct ip_address src_ip, dst_ip;
+
+	if(!packet->tcp)
+		return STATUS_ERR;
+
+	memset(key, 0, sizeof(*key));
+	memset(&src_ip, 0, sizeof(src_ip));
+	memset(&dst_ip, 0, sizeof(dst_ip));
+	if(packet->ipv4){
+		ip_from_ipv4(&packet->ipv4->src_ip, &src_ip);
+		ip_from_ipv4(&packet->ipv4->dst_ip, &dst_ip);
+	}
+	else if(packet->ipv6){
+		ip_from_ipv6(&packet->ipv6->src_ip, &src_ip);
+		ip_from_ipv6(&packet->ipv6->dst_ip, &dst_ip);
+	}
+	else{
+		return STATUS_ERR;
+	}
+
+	if(direction == DIRECTION_INBOUND){
+		key->src_ip = src_ip;
+		key->dst_ip = dst_ip;
+		key->src_port = ntohs(packet->tcp->src_port);
+		key->dst_port = ntohs(packet->tcp->dst_port);
+	}
+	else{
+		key->src_ip = dst_ip;
+		key->dst_ip = src_ip;
+		key->src_port = ntohs(packet->tcp->dst_port);
+		key->dst_port = ntohs(packet->tcp->src_port);
+	}
+	return STATUS_OK;
+}
+
+/**
+ * Insert subflow in mp_state.subflows and attach it to the current
+ * connection. An older subflow with the same 4-tuple is replaced.
+ */
+static void add_subflow(struct mp_subflow *subflow)
+{
+	struct mp_subflow *old = find_subflow(&subflow->key);
+	if(old){
+		HASH_DEL(mp_state.subflows, old);
+		old->conn->bytes_sent_on_all_ssn -= old->ssn - 1;
+		old->conn->num_subflows--;
+		free(old);
+	}
+
+	subflow->conn = mp_state.conn;
+	subflow->conn->num_subflows++;
+	subflow->conn->bytes_sent_on_all_ssn += subflow->ssn - 1;
+	HASH_ADD(hh, mp_state.subflows, key, sizeof(struct mp_subflow_key),
+			subflow);
+}
+
 /**
  * @pre inbound packet should be the first packet of a three-way handshake
  * mp_join initiated by packetdrill (thus an inbound mp_join syn packet).
@@ -214,33 +335,25 @@ u64 find_next_value(){
 struct mp_subflow *new_subflow_inbound(struct packet *inbound_packet)
 {
 
-	struct mp_subflow *subflow = malloc(sizeof(struct mp_subflow));
+	struct mp_subflow *subflow = calloc(1, sizeof(struct mp_subflow));
 
-	if(inbound_packet->ipv4){
-		ip_from_ipv4(&inbound_packet->ipv4->src_ip, &subflow->src_ip);
-		ip_from_ipv4(&inbound_packet->ipv4->dst_ip, &subflow->dst_ip);
-	}
-
-	else if(inbound_packet->ipv6){
-		ip_from_ipv6(&inbound_packet->ipv6->src_ip, &subflow->src_ip);
-		ip_from_ipv6(&inbound_packet->ipv6->dst_ip, &subflow->dst_ip );
-	}
-
-	else{
+	if(get_subflow_key(inbound_packet, DIRECTION_INBOUND, &subflow->key)){
+		free(subflow);
 		return NULL;
 	}
 
-	subflow->src_port =	ntohs(inbound_packet->tcp->src_port);
-	subflow->dst_port = ntohs(inbound_packet->tcp->dst_port);
+	subflow->src_ip = subflow->key.src_ip;
+	subflow->dst_ip = subflow->key.dst_ip;
+	subflow->src_port =	subflow->key.src_port;
+	subflow->dst_port = subflow->key.dst_port;
 	subflow->packetdrill_rand_nbr =	generate_32();
-	subflow->packetdrill_addr_id = mp_state.last_packetdrill_addr_id;
-	mp_state.last_packetdrill_addr_id++;
+	subflow->packetdrill_addr_id = mp_state.conn->last_packetdrill_addr_id;
+	mp_state.conn->last_packetdrill_addr_id++;
 	subflow->ssn = 1; // =1 because the code assumes it is being set with the third ack,
 			  // although that is not the case anymore (new_subflow_inbound is also
 			  // called at syn time)
 //	subflow->state = UNDEFINED;  // TODO to define it and change the state after
-	subflow->next = mp_state.subflows;
-	mp_state.subflows = subflow;
+	add_subflow(subflow);
 
 	return subflow;
 }
@@ -248,102 +361,69 @@ struct mp_subflow *new_subflow_inbound(struct packet *inbound_packet)
 struct mp_subflow *new_subflow_outbound(struct packet *outbound_packet)
 {
 
-	struct mp_subflow *subflow = malloc(sizeof(struct mp_subflow));
+	struct mp_subflow *subflow;
 	struct tcp_option *mp_join_syn =
 			get_mptcp_option(outbound_packet, MP_CAPABLE_SUBTYPE); //TCPOPT_MPTCP);
 
 	if(!mp_join_syn)
 		return NULL;
 
-	if(outbound_packet->ipv4){
-		ip_from_ipv4(&outbound_packet->ipv4->dst_ip, &subflow->src_ip);
-		ip_from_ipv4(&outbound_packet->ipv4->src_ip, &subflow->dst_ip);
-	}
-
-	else if(outbound_packet->ipv6){
-		ip_from_ipv6(&outbound_packet->ipv6->dst_ip, &subflow->src_ip);
-		ip_from_ipv6(&outbound_packet->ipv6->src_ip, &subflow->dst_ip);
-	}
-
-	else{
+	subflow = calloc(1, sizeof(struct mp_subflow));
+	if(get_subflow_key(outbound_packet, DIRECTION_OUTBOUND, &subflow->key)){
+		free(subflow);
 		return NULL;
 	}
 
-	subflow->src_port =	ntohs(outbound_packet->tcp->dst_port);
-	subflow->dst_port = ntohs(outbound_packet->tcp->src_port);
+	subflow->src_ip = subflow->key.src_ip;
+	subflow->dst_ip = subflow->key.dst_ip;
+	subflow->src_port =	subflow->key.src_port;
+	subflow->dst_port = subflow->key.dst_port;
 	subflow->kernel_rand_nbr =
 			mp_join_syn->data.mp_join.syn.no_ack.sender_random_number;
 	subflow->kernel_addr_id =
 			mp_join_syn->data.mp_join.syn.address_id;
 	subflow->ssn = 1;
-	subflow->next = mp_state.subflows;
-	mp_state.subflows = subflow;
+	add_subflow(subflow);
 	return subflow;
 }
 
 /**
- * Return the first subflow S of mp_state.subflows for which match(packet, S)
- * returns true.
+ * Return the subflow of mp_state.subflows with the given 4-tuple, or NULL.
  */
-struct mp_subflow *find_matching_subflow(struct packet *packet,
-		bool (*match)(struct mp_subflow*, struct packet*))
+struct mp_subflow *find_subflow(const struct mp_subflow_key *key)
 {
-	struct mp_subflow *subflow = mp_state.subflows;
-	while(subflow){
-		if((*match)(subflow, packet)){
-			return subflow;
-		}
-		subflow = subflow->next;
-	}
-	return NULL;
-}
-
-static bool does_subflow_match_outbound_packet(struct mp_subflow *subflow,
-		struct packet *outbound_packet){
-	return subflow->dst_port == ntohs(outbound_packet->tcp->src_port) &&
-			subflow->src_port == ntohs(outbound_packet->tcp->dst_port);
+	struct mp_subflow *subflow;
+	HASH_FIND(hh, mp_state.subflows, key, sizeof(struct mp_subflow_key),
+			subflow);
+	return subflow;
 }
 
 struct mp_subflow *find_subflow_matching_outbound_packet(
 		struct packet *outbound_packet)
 {
-	return find_matching_subflow(outbound_packet, does_subflow_match_outbound_packet);
-}
-
-static bool does_subflow_match_inbound_packet(struct mp_subflow *subflow,
-		struct packet *inbound_packet){
-	return subflow->dst_port == ntohs(inbound_packet->tcp->dst_port) &&
-			subflow->src_port == ntohs(inbound_packet->tcp->src_port);
+	struct mp_subflow_key key;
+	if(get_subflow_key(outbound_packet, DIRECTION_OUTBOUND, &key))
+		return NULL;
+	return find_subflow(&key);
 }
 
 struct mp_subflow *find_subflow_matching_inbound_packet(
 		struct packet *inbound_packet)
 {
-	return find_matching_subflow(inbound_packet, does_subflow_match_inbound_packet);
-}
-
-struct mp_subflow *find_subflow_matching_socket(struct socket *socket){
-	struct mp_subflow *subflow = mp_state.subflows;
-	while(subflow){
-		if(subflow->dst_port == socket->live.remote.port &&
-				subflow->src_port == socket->live.local.port){
-			return subflow;
-		}
-		subflow = subflow->next;
-	}
-	return NULL;
+	struct mp_subflow_key key;
+	if(get_subflow_key(inbound_packet, DIRECTION_INBOUND, &key))
+		return NULL;
+	return find_subflow(&key);
 }
 
 /**
- * Free all mptcp subflows struct being a member of mp_state.subflows list.
+ * Free all mptcp subflows struct being a member of mp_state.subflows hashmap.
  */
 void free_flows(){
-	struct mp_subflow *subflow = mp_state.subflows;
-	struct mp_subflow *temp;
-	while(subflow){
-		temp = subflow->next;
+	struct mp_subflow *subflow, *temp;
+	HASH_ITER(hh, mp_state.subflows, subflow, temp){
+		HASH_DEL(mp_state.subflows, subflow);
 		free(subflow);
-		subflow = temp;
 	}
 }
 
@@ -370,11 +450,11 @@ int mptcp_gen_key()
 
 	//First inbound mp_capable, generate new key
 	//and save corresponding variable
-	if(!mp_state.packetdrill_key_set){
+	if(!mp_state.conn->packetdrill_key_set){
 		seed_generator();
 		u64 key = rand_64();
 		set_packetdrill_key(key);
-		add_mp_var_key(snd_var_name, &mp_state.packetdrill_key);
+		add_mp_var_key(snd_var_name, &mp_state.conn->packetdrill_key);
 	}
 
 	return STATUS_OK;
@@ -435,7 +515,7 @@ static int extract_and_set_kernel_key(
 			set_kernel_key(*(u64*)var->value);
 	}
 
-	if(!mp_state.kernel_key_set){
+	if(!mp_state.conn->kernel_key_set){
 
 		//Set found kernel key
 		set_kernel_key(mpcap_opt->data.mp_capable.syn.key);
@@ -444,7 +524,7 @@ static int extract_and_set_kernel_key(
 		if(queue_front(&mp_state.vars_queue, (void**)&var_name)){
 			return STATUS_ERR;
 		}
-		add_mp_var_key(var_name, &mp_state.kernel_key);
+		add_mp_var_key(var_name, &mp_state.conn->kernel_key);
 	}
 
 	return STATUS_OK;
@@ -474,14 +554,14 @@ int mptcp_subtype_mp_capable(struct packet *packet_to_modify,
 			direction == DIRECTION_OUTBOUND){
 		error = extract_and_set_kernel_key(live_packet);
 		error = mptcp_set_mp_cap_syn_key(tcp_opt_to_modify);
-		mp_state.remote_ssn++;
+		mp_state.conn->remote_ssn++;
 	}
 	// Third (ack) packet in three-hand shake
 	else if(tcp_opt_to_modify->length == TCPOLEN_MP_CAPABLE ){
 		error = mptcp_set_mp_cap_keys(tcp_opt_to_modify);
 		// Automatically put the idsn tokens
-		mp_state.idsn = sha1_least_64bits(mp_state.packetdrill_key);
-		mp_state.remote_idsn = sha1_least_64bits(mp_state.kernel_key);
+		mp_state.conn->idsn = sha1_least_64bits(mp_state.conn->packetdrill_key);
+		mp_state.conn->remote_idsn = sha1_least_64bits(mp_state.conn->kernel_key);
 		// If this is done at syn packet time as for inbound, key comparisons fail
 		// due to, I guess, key set too early as it complains key is not 0
 		if(direction == DIRECTION_OUTBOUND)
@@ -523,11 +603,11 @@ static void mp_join_syn_rcv_token(struct tcp_option *tcp_opt_to_modify,
 	}
 	else if(direction == DIRECTION_INBOUND){
 		tcp_opt_to_modify->data.mp_join.syn.no_ack.receiver_token =
-				htonl(sha1_least_32bits(mp_state.kernel_key));
+				htonl(sha1_least_32bits(mp_state.conn->kernel_key));
 	}
 	else if(direction == DIRECTION_OUTBOUND){
 		tcp_opt_to_modify->data.mp_join.syn.no_ack.receiver_token =
-				htonl(sha1_least_32bits(mp_state.packetdrill_key));
+				htonl(sha1_least_32bits(mp_state.conn->packetdrill_key));
 	}
 }
 
@@ -576,6 +656,32 @@ static void mp_join_syn_rand(struct tcp_option *tcp_opt_to_modify,
 	}
 }
 
+/**
+ * A mp_join_syn sent by packetdrill joins the connection whose kernel token
+ * the script gives, if any. Otherwise it joins the current connection.
+ */
+static void select_connection_for_join(struct mp_join_info *mp_join_script_info)
+{
+	struct mp_connection *conn = NULL;
+
+	if(!mp_join_script_info->syn_or_syn_ack.is_script_defined)
+		return;
+
+	if(mp_join_script_info->syn_or_syn_ack.is_var){
+		struct mp_var *var =
+				find_mp_var(mp_join_script_info->syn_or_syn_ack.var);
+		if(var)
+			conn = find_connection_by_token(
+					sha1_least_32bits(*(u64*)var->value), true);
+	}
+	else{
+		conn = find_connection_by_token(
+				mp_join_script_info->syn_or_syn_ack.hash, true);
+	}
+	if(conn)
+		mp_state.conn = conn;
+}
+
 /**
  * Manage the case when packetdrill send a mp_join_syn to the kernel.
  *
@@ -587,6 +693,8 @@ static int mp_join_syn(struct packet *packet_to_modify,
 		unsigned direction)
 {
 	struct mp_subflow *subflow;
+	if(direction == DIRECTION_INBOUND)
+		select_connection_for_join(mp_join_script_info);
 	if(direction == DIRECTION_INBOUND)
 		subflow = new_subflow_inbound(packet_to_modify);
 	else if(direction == DIRECTION_OUTBOUND)
@@ -647,7 +755,7 @@ static int mp_join_syn_ack(struct packet *packet_to_modify,
 				mp_join_script_info,
 				subflow,
 				direction);
-		mp_state.last_packetdrill_addr_id++;
+		mp_state.conn->last_packetdrill_addr_id++;
 
 		if(mp_join_script_info->syn_or_syn_ack.rand_script_defined)
 			subflow->packetdrill_rand_nbr =
@@ -672,8 +780,8 @@ static int mp_join_syn_ack(struct packet *packet_to_modify,
 		}
 		else{
 			mp_join_syn_ack_sender_hmac(tcp_opt_to_modify,
-					mp_state.packetdrill_key,
-					mp_state.kernel_key,
+					mp_state.conn->packetdrill_key,
+					mp_state.conn->kernel_key,
 					subflow->packetdrill_rand_nbr,
 					subflow->kernel_rand_nbr);
 		}
@@ -698,8 +806,8 @@ static int mp_join_syn_ack(struct packet *packet_to_modify,
 		unsigned char hmac_key[16];
 		unsigned long *key_b = (unsigned long*)hmac_key;
 		unsigned long *key_a = (unsigned long*)&(hmac_key[8]);
-		*key_b = mp_state.kernel_key;
-		*key_a = mp_state.packetdrill_key;
+		*key_b = mp_state.conn->kernel_key;
+		*key_a = mp_state.conn->packetdrill_key;
 
 		//Build message for HMAC-SHA1
 		unsigned msg[2];
@@ -767,8 +875,8 @@ int mptcp_subtype_mp_join(struct packet *packet_to_modify,
 				live_mp_join->data.mp_join.syn.ack.sender_random_number;
 
 		//Build key for HMAC-SHA1
-		u64 loc_key = mp_state.packetdrill_key;
-		u64 rem_key = mp_state.kernel_key;
+		u64 loc_key = mp_state.conn->packetdrill_key;
+		u64 rem_key = mp_state.conn->kernel_key;
 		u32 loc_nonce = subflow->packetdrill_rand_nbr;
 		u32 rem_nonce = live_mp_join->data.mp_join.syn.ack.sender_random_number;
 
@@ -797,8 +905,8 @@ int mptcp_subtype_mp_join(struct packet *packet_to_modify,
 
 		if(mp_join_script_info->ack.is_var){
 			//Build key for HMAC-SHA1
-			u64 loc_key = mp_state.packetdrill_key;
-			u64 rem_key = mp_state.kernel_key;
+			u64 loc_key = mp_state.conn->packetdrill_key;
+			u64 rem_key = mp_state.conn->kernel_key;
 			u32 loc_nonce = subflow->packetdrill_rand_nbr;
 			u32 rem_nonce = subflow->kernel_rand_nbr;
 
@@ -873,14 +981,14 @@ int mptcp_subtype_mp_join(struct packet *packet_to_modify,
 			tcp_opt_to_modify->length == TCPOLEN_MP_JOIN_ACK){
 
 		struct mp_subflow *subflow =
-				find_subflow_matching_outbound_packet(packet_to_modify);
+				find_subflow_matching_outbound_packet(live_packet);
 
 		if(!subflow)
 			return STATUS_ERR;
 
 		//Build key for HMAC-SHA1
-		u64 loc_key = mp_state.packetdrill_key;
-		u64 rem_key = mp_state.kernel_key;
+		u64 loc_key = mp_state.conn->packetdrill_key;
+		u64 rem_key = mp_state.conn->kernel_key;
 		u32 loc_nonce = subflow->packetdrill_rand_nbr;
 		u32 rem_nonce = subflow->kernel_rand_nbr;
 
@@ -911,14 +1019,12 @@ u16 get_tcp_payload_size(struct packet *packet){
 	return (packet_total_length-ip_header_length-
 			(tcp_header_length-tcp_header_wo_options));
 }
+/**
+ * Data sequence space used on all subflows of the current connection; kept
+ * up to date by add_subflow() and dss_inbound_parser().
+ */
 u32 get_sum_ssn(){
-	struct mp_subflow *mp_sub = mp_state.subflows;
-	u32 total_length = 1; // first subflow has already one packet sent
-	while(mp_sub != NULL){
-		total_length += mp_sub->ssn -1;
-		mp_sub = mp_sub->next;
-	}
-	return total_length;
+	return mp_state.conn->bytes_sent_on_all_ssn;
 }
 
 u16 get_tcp_header_length(struct packet *packet){
@@ -962,7 +1068,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 
 			// put information in script packet automatically
 			if(dss_opt_script->data.dss.dack_dsn.dack.dack4 == UNDEFINED)
-				dack_live->dack4 = htonl(mp_state.remote_idsn + mp_state.remote_ssn + mp_state.remote_last_pkt_length);
+				dack_live->dack4 = htonl(mp_state.conn->remote_idsn + mp_state.conn->remote_ssn + mp_state.conn->remote_last_pkt_length);
 			else if(dss_opt_script->data.dss.dack_dsn.dack.dack4 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -971,12 +1077,12 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dack_live->dack4 = htonl(sha1_least_64bits(*key)+ additional_val);
 			}else{
 				if(dack_script->dack4>0)
-					dack_live->dack4 = htonl(sha1_least_64bits(mp_state.kernel_key) + dack_script->dack4);
+					dack_live->dack4 = htonl(sha1_least_64bits(mp_state.conn->kernel_key) + dack_script->dack4);
 			}
 
 
 			if(dsn_script->dsn4 == UNDEFINED){
-				dsn_live->dsn4 = htonl(mp_state.idsn + bytes_sent_on_all_ssn); //subflow->ssn);
+				dsn_live->dsn4 = htonl(mp_state.conn->idsn + bytes_sent_on_all_ssn); //subflow->ssn);
 			}else if(dsn_script->dsn4 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -985,7 +1091,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dsn_live->dsn4 = htonl(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dsn_script->dsn4>0)
-					dsn_live->dsn4 = htonl(sha1_least_64bits(mp_state.packetdrill_key) + dsn_script->dsn4);
+					dsn_live->dsn4 = htonl(sha1_least_64bits(mp_state.conn->packetdrill_key) + dsn_script->dsn4);
 			}
 
 			if(dss_opt_script->length == TCPOLEN_DSS_DACK4_DSN4){
@@ -1003,15 +1109,15 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				u16 *dll_first = (u16*)(w_cs+1);// w_cs + 1 == dll & chk
 				*dll_first = (s16)*(dll_first) == UNDEFINED ? htons(tcp_payload_length): htons(*(dll_first));
 
-				//buff_chk.dsn = mp_state.idsn + bytes_sent_on_all_ssn;
-				buff_chk.dsn = ((mp_state.idsn >>32)<<32) + ntohl(dsn_live->dsn4);
+				//buff_chk.dsn = mp_state.conn->idsn + bytes_sent_on_all_ssn;
+				buff_chk.dsn = ((mp_state.conn->idsn >>32)<<32) + ntohl(dsn_live->dsn4);
 				buff_chk.ssn = ntohl(*w_cs); //subflow->ssn;
 				buff_chk.dll = ntohs(*dll_first); //(u16)tcp_payload_length;
 				buff_chk.zeros = (u16)0;
 
 				// checksum
 				*(dll_first+1) = (s16)*(dll_first+1) == UNDEFINED ? htons(checksum_dss((u16*)&buff_chk, sizeof(buff_chk))): *(dll_first+1); // dll_first+1 = checksum
-				//	printf("dsn: %llu==%llu, ssn:%u, dll:%u ==> %u\n", buff_chk.dsn, mp_state.idsn + bytes_sent_on_all_ssn, buff_chk.ssn, buff_chk.dll, *(dll_first+1));
+				//	printf("dsn: %llu==%llu, ssn:%u, dll:%u ==> %u\n", buff_chk.dsn, mp_state.conn->idsn + bytes_sent_on_all_ssn, buff_chk.ssn, buff_chk.dll, *(dll_first+1));
 			}else{
 				u32* w_cs = (u32*)dsn_live+1;	// w_cs == ssn (== dsn_live + 1 )
 				// ssn
@@ -1031,7 +1137,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 
 			// put information in script packet
 			if(dss_opt_script->data.dss.dack_dsn.dack.dack8 == UNDEFINED)
-				dack_live->dack8 = htonll(mp_state.remote_idsn + mp_state.remote_ssn);
+				dack_live->dack8 = htonll(mp_state.conn->remote_idsn + mp_state.conn->remote_ssn);
 			else if(dss_opt_script->data.dss.dack_dsn.dack.dack8 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -1040,11 +1146,11 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dack_live->dack8 = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dack_script->dack8>0)
-					dack_live->dack8 = htonll(sha1_least_64bits(mp_state.kernel_key) + dack_script->dack8);
+					dack_live->dack8 = htonll(sha1_least_64bits(mp_state.conn->kernel_key) + dack_script->dack8);
 			}
 
 			if(dsn_script->dsn4 == UNDEFINED)
-				dsn_live->dsn4 = htonl( mp_state.idsn + bytes_sent_on_all_ssn); //subflow->ssn);
+				dsn_live->dsn4 = htonl( mp_state.conn->idsn + bytes_sent_on_all_ssn); //subflow->ssn);
 			else if(dsn_script->dsn4 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -1053,7 +1159,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dsn_live->dsn4 = htonl(sha1_least_64bits(*key)+ additional_val);
 			}else{
 				if(dsn_script->dsn4>0)
-					dsn_live->dsn4 = htonl(sha1_least_64bits(mp_state.packetdrill_key) + dsn_script->dsn4);
+					dsn_live->dsn4 = htonl(sha1_least_64bits(mp_state.conn->packetdrill_key) + dsn_script->dsn4);
 			}
 
 			if(dss_opt_script->length == TCPOLEN_DSS_DACK4_DSN4){
@@ -1071,8 +1177,8 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				u16 *dll_first = (u16*)(w_cs+1);// w_cs + 1 == dll & chk
 				*dll_first = (s16)*(dll_first) == UNDEFINED ? htons(tcp_payload_length): htons(*(dll_first));
 
-				//buff_chk.dsn = mp_state.idsn + bytes_sent_on_all_ssn;
-				buff_chk.dsn = ((mp_state.idsn >>32)<<32) + ntohl(dsn_live->dsn4);
+				//buff_chk.dsn = mp_state.conn->idsn + bytes_sent_on_all_ssn;
+				buff_chk.dsn = ((mp_state.conn->idsn >>32)<<32) + ntohl(dsn_live->dsn4);
 				buff_chk.ssn = ntohl(*w_cs); //subflow->ssn;
 				buff_chk.dll = ntohs(*dll_first); //(u16)tcp_payload_length;
 				buff_chk.zeros = (u16)0;
@@ -1098,7 +1204,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 
 			// put information in script packet
 			if(dss_opt_script->data.dss.dack_dsn.dack.dack4 == UNDEFINED)
-				dack_live->dack4 = htobe32(mp_state.remote_idsn + mp_state.remote_ssn);
+				dack_live->dack4 = htobe32(mp_state.conn->remote_idsn + mp_state.conn->remote_ssn);
 			else if(dss_opt_script->data.dss.dack_dsn.dack.dack4 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -1107,11 +1213,11 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dack_live->dack4 = htonl(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dack_script->dack4>0)
-					dack_live->dack4 = htonl(sha1_least_64bits(mp_state.kernel_key) + dack_script->dack4);
+					dack_live->dack4 = htonl(sha1_least_64bits(mp_state.conn->kernel_key) + dack_script->dack4);
 			}
 
 			if(dss_opt_script->data.dss.dack_dsn.dsn.dsn8 == UNDEFINED)
-				dsn_live->dsn8 = htonll(mp_state.idsn + bytes_sent_on_all_ssn); //subflow->ssn);
+				dsn_live->dsn8 = htonll(mp_state.conn->idsn + bytes_sent_on_all_ssn); //subflow->ssn);
 			else if(dss_opt_script->data.dss.dack_dsn.dsn.dsn8 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -1120,7 +1226,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dsn_live->dsn8 = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dsn_script->dsn8>0)
-					dsn_live->dsn8 = htonl(sha1_least_64bits(mp_state.packetdrill_key) + dsn_script->dsn8);
+					dsn_live->dsn8 = htonl(sha1_least_64bits(mp_state.conn->packetdrill_key) + dsn_script->dsn8);
 			}
 
 			if(dss_opt_script->length == TCPOLEN_DSS_DACK4_DSN4){
@@ -1138,7 +1244,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				u16 *dll_first = (u16*)(w_cs+1);// w_cs + 1 == dll & chk
 				*dll_first = (s16)*(dll_first) == UNDEFINED ? htons(tcp_payload_length): htons(*(dll_first));
 
-				//buff_chk.dsn = mp_state.idsn + bytes_sent_on_all_ssn;
+				//buff_chk.dsn = mp_state.conn->idsn + bytes_sent_on_all_ssn;
 				buff_chk.dsn = dsn_live->dsn8;
 				buff_chk.ssn = ntohl(*w_cs); //subflow->ssn;
 				buff_chk.dll = ntohs(*dll_first); //(u16)tcp_payload_length;
@@ -1163,7 +1269,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 
 			// put information in script packet
 			if(dss_opt_script->data.dss.dack_dsn.dack.dack8 == UNDEFINED)
-				dack_live->dack8 = htonll(mp_state.remote_idsn + mp_state.remote_ssn);
+				dack_live->dack8 = htonll(mp_state.conn->remote_idsn + mp_state.conn->remote_ssn);
 			else if(dss_opt_script->data.dss.dack_dsn.dack.dack8 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -1172,11 +1278,11 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dack_live->dack8 = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dack_script->dack8>0)
-					dack_live->dack8 = htonl(sha1_least_64bits(mp_state.kernel_key) + dack_script->dack8);
+					dack_live->dack8 = htonl(sha1_least_64bits(mp_state.conn->kernel_key) + dack_script->dack8);
 			}
 
 			if(dss_opt_script->data.dss.dack_dsn.dsn.dsn8 == UNDEFINED)
-				dsn_live->dsn8 = htonll(mp_state.idsn + bytes_sent_on_all_ssn); //subflow->ssn);
+				dsn_live->dsn8 = htonll(mp_state.conn->idsn + bytes_sent_on_all_ssn); //subflow->ssn);
 			else if(dss_opt_script->data.dss.dack_dsn.dsn.dsn8 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -1185,7 +1291,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dsn_live->dsn8 = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dsn_script->dsn8>0)
-					dsn_live->dsn8 = htonl(sha1_least_64bits(mp_state.packetdrill_key) + dsn_script->dsn8);
+					dsn_live->dsn8 = htonl(sha1_least_64bits(mp_state.conn->packetdrill_key) + dsn_script->dsn8);
 			}
 
 			if(dss_opt_script->length == TCPOLEN_DSS_DACK4_DSN4){
@@ -1203,7 +1309,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				u16 *dll_first = (u16*)(w_cs+1);// w_cs + 1 == dll & chk
 				*dll_first = (s16)*(dll_first) == UNDEFINED ? htons(tcp_payload_length): htons(*(dll_first));
 
-				//buff_chk.dsn = mp_state.idsn + bytes_sent_on_all_ssn;
+				//buff_chk.dsn = mp_state.conn->idsn + bytes_sent_on_all_ssn;
 				buff_chk.dsn = dsn_live->dsn8;
 				buff_chk.ssn = ntohl(*w_cs); //subflow->ssn;
 				buff_chk.dll = ntohs(*dll_first); //(u16)tcp_payload_length;
@@ -1230,7 +1336,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 			// get original information from live_packet
 
 			if(dss_opt_script->data.dss.dsn.dsn4 == UNDEFINED)
-				dsn_live->dsn4 = htonl(mp_state.idsn + bytes_sent_on_all_ssn); //subflow->ssn);
+				dsn_live->dsn4 = htonl(mp_state.conn->idsn + bytes_sent_on_all_ssn); //subflow->ssn);
 			else if(dss_opt_script->data.dss.dsn.dsn4 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -1239,7 +1345,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dsn_live->dsn4 = htobe32(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dsn_script->dsn4>0)
-					dsn_live->dsn4 = htonl(sha1_least_64bits(mp_state.packetdrill_key) + dsn_script->dsn4);
+					dsn_live->dsn4 = htonl(sha1_least_64bits(mp_state.conn->packetdrill_key) + dsn_script->dsn4);
 			}
 
 			if(dss_opt_script->length == TCPOLEN_DSS_DACK4_DSN4){
@@ -1257,7 +1363,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				u16 *dll_first = (u16*)(w_cs+1);// w_cs + 1 == dll & chk
 				*dll_first = (s16)*(dll_first) == UNDEFINED ? htons(tcp_payload_length): htons(*(dll_first));
 
-				buff_chk.dsn = ((mp_state.idsn >>32)<<32) + ntohl(dsn_live->dsn4);
+				buff_chk.dsn = ((mp_state.conn->idsn >>32)<<32) + ntohl(dsn_live->dsn4);
 				buff_chk.ssn = ntohl(*w_cs); //subflow->ssn;
 				buff_chk.dll = ntohs(*dll_first); //(u16)tcp_payload_length;
 				buff_chk.zeros = (u16)0;
@@ -1275,7 +1381,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 		//DSN8
 		}else{
 			if(dss_opt_script->data.dss.dsn.dsn8 == UNDEFINED)
-				dsn_live->dsn8 = htonll(mp_state.idsn + bytes_sent_on_all_ssn); //subflow->ssn);
+				dsn_live->dsn8 = htonll(mp_state.conn->idsn + bytes_sent_on_all_ssn); //subflow->ssn);
 			else if(dss_opt_script->data.dss.dsn.dsn8 == SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -1284,7 +1390,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dsn_live->dsn8 = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dsn_script->dsn8>0)
-					dsn_live->dsn8 = htonll(sha1_least_64bits(mp_state.packetdrill_key) + dsn_script->dsn8);
+					dsn_live->dsn8 = htonll(sha1_least_64bits(mp_state.conn->packetdrill_key) + dsn_script->dsn8);
 			}
 
 			if(dss_opt_script->length == TCPOLEN_DSS_DACK4_DSN4){
@@ -1324,7 +1430,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 		// dack4
 		if(!dss_opt_script->data.dss.flag_a){
 			if(dss_opt_script->data.dss.dack.dack4==UNDEFINED){
-				dss_opt_script->data.dss.dack.dack4 = ntohl((u32)(mp_state.remote_idsn + mp_state.remote_ssn + mp_state.remote_last_pkt_length));
+				dss_opt_script->data.dss.dack.dack4 = ntohl((u32)(mp_state.conn->remote_idsn + mp_state.conn->remote_ssn + mp_state.conn->remote_last_pkt_length));
 			}else if(dss_opt_script->data.dss.dack.dack4==SCRIPT_DEFINED_TO_HASH_LSB){
 				u64 additional_val 	= find_next_value();
 				u64 *key = find_next_key();
@@ -1333,7 +1439,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 				dss_opt_script->data.dss.dack.dack4 = htonl(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dss_opt_script->data.dss.dack.dack4>0)
-					dss_opt_live->data.dss.dack.dack4 = htonl(sha1_least_64bits(mp_state.kernel_key) + dss_opt_script->data.dss.dack.dack4);
+					dss_opt_live->data.dss.dack.dack4 = htonl(sha1_least_64bits(mp_state.conn->kernel_key) + dss_opt_script->data.dss.dack.dack4);
 				else
 					return STATUS_ERR;
 			}
@@ -1341,6 +1447,7 @@ int dss_inbound_parser(struct packet *packet_to_modify,
 		}
 	}
 	subflow->ssn += tcp_payload_length;
+	subflow->conn->bytes_sent_on_all_ssn += tcp_payload_length;
 	return STATUS_OK;
 }
 
@@ -1388,7 +1495,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				*dack_script = htonl(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(*dack_script>0){
-					*dack_script = htonl(sha1_least_64bits(mp_state.packetdrill_key) + *dack_script);
+					*dack_script = htonl(sha1_least_64bits(mp_state.conn->packetdrill_key) + *dack_script);
 				}
 			}
 
@@ -1403,7 +1510,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				*dsn_script = htonl(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(*dsn_script>0){
-					*dsn_script = htonl(sha1_least_64bits(mp_state.kernel_key) + *dsn_script);
+					*dsn_script = htonl(sha1_least_64bits(mp_state.conn->kernel_key) + *dsn_script);
 				}
 			}
 
@@ -1425,10 +1532,10 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 			else
 				*chk_script = htons(*chk_script);
 
-			mp_state.remote_last_pkt_length = ntohs(*dll_script);
+			mp_state.conn->remote_last_pkt_length = ntohs(*dll_script);
 			if(dss_opt_live->data.dss.flag_F)
-				mp_state.remote_last_pkt_length++;
-			mp_state.remote_ssn = ntohl(*ssn_script);
+				mp_state.conn->remote_last_pkt_length++;
+			mp_state.conn->remote_ssn = ntohl(*ssn_script);
 
 			// DSN4 & DACK8
 		}else if(!dss_opt_script->data.dss.flag_m && dss_opt_script->data.dss.flag_a){
@@ -1456,7 +1563,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				*dack_script = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(*dack_script>0){
-					*dack_script = htonll(sha1_least_64bits(mp_state.packetdrill_key) + *dack_script);
+					*dack_script = htonll(sha1_least_64bits(mp_state.conn->packetdrill_key) + *dack_script);
 				}
 			}
 
@@ -1471,7 +1578,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				*dsn_script = htonl(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(*dsn_script>0){
-					*dsn_script = htonl(sha1_least_64bits(mp_state.kernel_key) + *dsn_script);
+					*dsn_script = htonl(sha1_least_64bits(mp_state.conn->kernel_key) + *dsn_script);
 				}
 			}
 
@@ -1493,10 +1600,10 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 			else
 				*chk_script = htons(*chk_script);
 
-			mp_state.remote_last_pkt_length = ntohs(*dll_script);
+			mp_state.conn->remote_last_pkt_length = ntohs(*dll_script);
 			if(dss_opt_live->data.dss.flag_F)
-				mp_state.remote_last_pkt_length++;
-			mp_state.remote_ssn = ntohl(*ssn_script);
+				mp_state.conn->remote_last_pkt_length++;
+			mp_state.conn->remote_ssn = ntohl(*ssn_script);
 
 			// DSN8 & DACK4
 		}else if(dss_opt_script->data.dss.flag_m && !dss_opt_script->data.dss.flag_a){
@@ -1525,7 +1632,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				*dack_script = htonl(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(*dack_script>0){
-					*dack_script = htonl(sha1_least_64bits(mp_state.packetdrill_key) + *dack_script);
+					*dack_script = htonl(sha1_least_64bits(mp_state.conn->packetdrill_key) + *dack_script);
 				}
 			}
 
@@ -1540,7 +1647,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				*dsn_script = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(*dsn_script>0){
-					*dsn_script = htonll(sha1_least_64bits(mp_state.kernel_key) + *dsn_script);
+					*dsn_script = htonll(sha1_least_64bits(mp_state.conn->kernel_key) + *dsn_script);
 				}
 			}
 
@@ -1562,10 +1669,10 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 			else
 				*chk_script = htons(*chk_script);
 
-			mp_state.remote_last_pkt_length = ntohs(*dll_script);
+			mp_state.conn->remote_last_pkt_length = ntohs(*dll_script);
 			if(dss_opt_live->data.dss.flag_F)
-				mp_state.remote_last_pkt_length++;
-			mp_state.remote_ssn = ntohl(*ssn_script);
+				mp_state.conn->remote_last_pkt_length++;
+			mp_state.conn->remote_ssn = ntohl(*ssn_script);
 
 		// DSN8 & DACK8
 		}else if(dss_opt_script->data.dss.flag_m && dss_opt_script->data.dss.flag_a){
@@ -1594,7 +1701,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				*dack_script = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(*dack_script>0){
-					*dack_script = htonll(sha1_least_64bits(mp_state.packetdrill_key) + *dack_script);
+					*dack_script = htonll(sha1_least_64bits(mp_state.conn->packetdrill_key) + *dack_script);
 				}
 			}
 
@@ -1609,7 +1716,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				*dsn_script = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(*dsn_script>0){
-					*dsn_script = htonll(sha1_least_64bits(mp_state.kernel_key) + *dsn_script);
+					*dsn_script = htonll(sha1_least_64bits(mp_state.conn->kernel_key) + *dsn_script);
 				}
 			}
 
@@ -1631,10 +1738,10 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 			else
 				*chk_script = htons(*chk_script);
 
-			mp_state.remote_last_pkt_length = ntohs(*dll_script);
+			mp_state.conn->remote_last_pkt_length = ntohs(*dll_script);
 			if(dss_opt_live->data.dss.flag_F)
-				mp_state.remote_last_pkt_length++;
-			mp_state.remote_ssn = ntohl(*ssn_script);
+				mp_state.conn->remote_last_pkt_length++;
+			mp_state.conn->remote_ssn = ntohl(*ssn_script);
 
 		}else{
 			// It means we have a difference of flags about what we waited for
@@ -1669,7 +1776,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				dss_opt_script->data.dss.dsn.dsn8 = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dss_opt_script->data.dss.dsn.dsn8>0){
-					dss_opt_script->data.dss.dsn.dsn8  = htonll(sha1_least_64bits(mp_state.kernel_key) + dss_opt_script->data.dss.dsn.dsn8 );
+					dss_opt_script->data.dss.dsn.dsn8  = htonll(sha1_least_64bits(mp_state.conn->kernel_key) + dss_opt_script->data.dss.dsn.dsn8 );
 				}
 			}
 
@@ -1681,10 +1788,10 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				dss_opt_script->data.dss.dsn.wo_cs.dll =	dll;
 				dss_opt_script->data.dss.dsn.wo_cs.ssn = ssn;
 			} WOCS*/
-			mp_state.remote_last_pkt_length = ntohs(dll);
+			mp_state.conn->remote_last_pkt_length = ntohs(dll);
 			if(dss_opt_live->data.dss.flag_F)
-				mp_state.remote_last_pkt_length++;
-			mp_state.remote_ssn = ntohl(ssn);
+				mp_state.conn->remote_last_pkt_length++;
+			mp_state.conn->remote_ssn = ntohl(ssn);
 		}
 		// if DSN is 4 octets
 		else {
@@ -1705,7 +1812,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				dss_opt_script->data.dss.dsn.dsn4 = htobe32(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dss_opt_script->data.dss.dsn.dsn4>0){
-					dss_opt_script->data.dss.dsn.dsn4  = htonll(sha1_least_64bits(mp_state.kernel_key) + dss_opt_script->data.dss.dsn.dsn4 );
+					dss_opt_script->data.dss.dsn.dsn4  = htonll(sha1_least_64bits(mp_state.conn->kernel_key) + dss_opt_script->data.dss.dsn.dsn4 );
 				}
 			}
 			u32 *script_dsn4 	= (u32*)dss_opt_script+3;
@@ -1714,10 +1821,10 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 			*script_ssn 			= ssn;
 			u32 *script_dll_chk 	= script_ssn + 1;
 			*script_dll_chk 		= dll_chk;
-			mp_state.remote_last_pkt_length = ntohs(dll);
+			mp_state.conn->remote_last_pkt_length = ntohs(dll);
 			if(dss_opt_live->data.dss.flag_F)
-				mp_state.remote_last_pkt_length++;
-			mp_state.remote_ssn = ntohl(ssn);
+				mp_state.conn->remote_last_pkt_length++;
+			mp_state.conn->remote_ssn = ntohl(ssn);
 		}
 
 	// if it's DACK only from kernel, need to save it
@@ -1742,7 +1849,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				dss_opt_script->data.dss.dack.dack8 = htonll(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dss_opt_script->data.dss.dack.dack8>0){
-					dss_opt_script->data.dss.dack.dack8 = htonll(sha1_least_64bits(mp_state.packetdrill_key) + dss_opt_script->data.dss.dack.dack8);
+					dss_opt_script->data.dss.dack.dack8 = htonll(sha1_least_64bits(mp_state.conn->packetdrill_key) + dss_opt_script->data.dss.dack.dack8);
 				}
 			}
 		}
@@ -1764,7 +1871,7 @@ int dss_outbound_parser(struct packet *packet_to_modify,
 				dss_opt_script->data.dss.dack.dack4 = htonl(sha1_least_64bits(*key) + additional_val);
 			}else{
 				if(dss_opt_script->data.dss.dack.dack4>0){
-					dss_opt_script->data.dss.dack.dack4 = htonl(sha1_least_64bits(mp_state.packetdrill_key) + dss_opt_script->data.dss.dack.dack4);
+					dss_opt_script->data.dss.dack.dack4 = htonl(sha1_least_64bits(mp_state.conn->packetdrill_key) + dss_opt_script->data.dss.dack.dack4);
 				}
 			}
 		}
@@ -1904,7 +2011,7 @@ int mptcp_subtype_mp_fail(struct packet *packet_to_modify,
 
 		//Set dsn being value specified in script
 		if(dss_opt_script->data.dss.dsn.dsn8 == UNDEFINED)
-			dss_opt_script->data.dss.dsn.dsn8 = htonll(mp_state.idsn + bytes_sent_on_all_ssn); //subflow->ssn);
+			dss_opt_script->data.dss.dsn.dsn8 = htonll(mp_state.conn->idsn + bytes_sent_on_all_ssn); //subflow->ssn);
 		else if(dss_opt_script->data.dss.dsn.dsn8 == SCRIPT_DEFINED_TO_HASH_LSB){
 			u64 additional_val 	= find_next_value();
 			u64 *key = find_next_key();
@@ -1914,7 +2021,7 @@ int mptcp_subtype_mp_fail(struct packet *packet_to_modify,
 		}else{
 			// this is to get the relative numbers from script
 			if(dss_opt_script->data.dss.dsn.dsn8>0)
-				dss_opt_script->data.dss.dsn.dsn8 = htonll(sha1_least_64bits(mp_state.packetdrill_key) +
+				dss_opt_script->data.dss.dsn.dsn8 = htonll(sha1_least_64bits(mp_state.conn->packetdrill_key) +
 						dss_opt_script->data.dss.dsn.dsn8 );
 		}
 	}else if(direction == DIRECTION_OUTBOUND){
@@ -1930,7 +2037,7 @@ int mptcp_subtype_mp_fail(struct packet *packet_to_modify,
 		}else{
 			// this is to get the relative numbers from script
 			if(dss_opt_script->data.dss.dsn.dsn8 >0){
-				dss_opt_script->data.dss.dsn.dsn8  = htonll(sha1_least_64bits(mp_state.kernel_key) +
+				dss_opt_script->data.dss.dsn.dsn8  = htonll(sha1_least_64bits(mp_state.conn->kernel_key) +
 						dss_opt_script->data.dss.dsn.dsn8 );
 			}
 		}
@@ -1952,7 +2059,7 @@ int mptcp_subtype_mp_fastclose(struct packet *packet_to_modify,
 
 	if(dss_opt_script->data.mp_fastclose.receiver_key == UNDEFINED){ // <mp_fastclose>
 		if(direction == DIRECTION_INBOUND)
-			dss_opt_script->data.mp_fastclose.receiver_key = htonll(mp_state.kernel_key);
+			dss_opt_script->data.mp_fastclose.receiver_key = htonll(mp_state.conn->kernel_key);
 		else if(direction == DIRECTION_OUTBOUND)
 			dss_opt_script->data.mp_fastclose.receiver_key = dss_opt_live->data.mp_fastclose.receiver_key;
 		else
@@ -1975,6 +2082,68 @@ int mptcp_subtype_mp_fastclose(struct packet *packet_to_modify,
 	return STATUS_OK;
 }
 
+/* Has this connection not yet been used by any handshake or subflow? */
+static bool is_connection_unused(struct mp_connection *conn)
+{
+	return !conn->packetdrill_key_set && !conn->kernel_key_set &&
+			!conn->handshake_key_set && conn->num_subflows == 0;
+}
+
+/**
+ * Make mp_state.conn the connection live_packet belongs to:
+ * - the connection of its subflow, or of the MP_CAPABLE handshake on its
+ *   4-tuple;
+ * - a new connection for a new MP_CAPABLE SYN;
+ * - for a MP_JOIN SYN from the kernel, the connection owning the token;
+ * - otherwise the current connection is kept.
+ */
+static void select_connection(struct packet *live_packet, unsigned direction)
+{
+	struct mp_subflow_key key;
+	struct mp_subflow *subflow;
+	struct mp_connection *conn;
+	struct tcp_option *opt;
+
+	if(get_subflow_key(live_packet, direction, &key))
+		return;
+
+	subflow = find_subflow(&key);
+	if(subflow){
+		mp_state.conn = subflow->conn;
+		return;
+	}
+
+	for(conn = mp_state.connections; conn; conn = conn->next){
+		if(conn->handshake_key_set &&
+				!memcmp(&conn->handshake_key, &key, sizeof(key))){
+			mp_state.conn = conn;
+			return;
+		}
+	}
+
+	if(!live_packet->tcp->syn || live_packet->tcp->ack)
+		return;
+
+	opt = get_tcp_option(live_packet, TCPOPT_MPTCP);
+	if(!opt)
+		return;
+
+	if(opt->data.mp_capable.subtype == MP_CAPABLE_SUBTYPE){
+		if(!is_connection_unused(mp_state.conn))
+			new_mp_connection();
+		mp_state.conn->handshake_key = key;
+		mp_state.conn->handshake_key_set = true;
+	}
+	else if(opt->data.mp_capable.subtype == MP_JOIN_SUBTYPE &&
+			direction == DIRECTION_OUTBOUND){
+		conn = find_connection_by_token(
+				ntohl(opt->data.mp_join.syn.no_ack.receiver_token),
+				false);
+		if(conn)
+			mp_state.conn = conn;
+	}
+}
+
 /**
  * Main function for managing mptcp packets. We have to insert appropriate
  * fields values for mptcp options according to previous state.
@@ -1987,14 +2156,18 @@ int mptcp_insert_and_extract_opt_fields(struct packet *packet_to_modify,
 		struct packet *live_packet, // could be the same as packet_to_modify
 		unsigned direction)
 {
+	if(get_tcp_option(live_packet, TCPOPT_MPTCP))
+		select_connection(live_packet, direction);
 
-	struct tcp_options_iterator tcp_opt_iter;
-	struct tcp_option *tcp_opt_to_modify =
-			tcp_options_begin(packet_to_modify, &tcp_opt_iter);
+	struct tcp_option *tcp_opt_to_modify;
 	int error = STATUS_OK;
-	while(tcp_opt_to_modify != NULL){
-		if(tcp_opt_to_modify->kind == TCPOPT_MPTCP){
-			switch(tcp_opt_to_modify->data.mp_capable.subtype){
+	int slot;
+
+	tcp_options_ensure_index(packet_to_modify, NULL);
+	for(slot = 0; slot < packet_to_modify->num_tcp_options; ++slot){
+		if(packet_to_modify->tcp_options[slot].kind == TCPOPT_MPTCP){
+			tcp_opt_to_modify = tcp_option_at(packet_to_modify, slot);
+			switch(packet_to_modify->tcp_options[slot].subtype){
 			case MP_CAPABLE_SUBTYPE:	// 00
 
 				error = mptcp_subtype_mp_capable(packet_to_modify,
@@ -2044,8 +2217,64 @@ int mptcp_insert_and_extract_opt_fields(struct packet *packet_to_modify,
 				break;
 			}
 		}
-		tcp_opt_to_modify = tcp_options_next(&tcp_opt_iter, NULL);
 	}
 
 	return error;
 }
+
+bool mptcp_data_offset(struct packet *live_packet,
+		unsigned direction,
+		u32 subflow_offset,
+		u64 *data_offset,
+		u16 **checksum)
+{
+	u64 idsn;
+	int slot;
+
+	if(!mp_state.conn)
+		return false;
+	// Inbound data is ours, outbound data is the kernel's.
+	idsn = direction == DIRECTION_INBOUND ?
+			mp_state.conn->idsn : mp_state.conn->remote_idsn;
+	if(idsn == UNDEFINED)
+		return false;
+
+	tcp_options_ensure_index(live_packet, NULL);
+	for(slot = 0; slot < live_packet->num_tcp_options; ++slot){
+		struct tcp_option *dss;
+		u8 *field, *end;
+		u64 dsn;
+		u32 ssn;
+
+		if(live_packet->tcp_options[slot].kind != TCPOPT_MPTCP ||
+				live_packet->tcp_options[slot].subtype != DSS_SUBTYPE)
+			continue;
+		dss = tcp_option_at(live_packet, slot);
+		if(!dss->data.dss.flag_M)
+			return false;
+
+		// Walk the wire format: the data ACK, if any, comes first.
+		field = (u8*)dss + 4;
+		end = (u8*)dss + dss->length;
+		if(dss->data.dss.flag_A)
+			field += dss->data.dss.flag_a ? 8 : 4;
+		if(dss->data.dss.flag_m){
+			u64 dsn8;
+			memcpy(&dsn8, field, sizeof(dsn8));
+			dsn = be64toh(dsn8) - idsn - 1;
+			field += 8;
+		}else{
+			u32 dsn4;
+			memcpy(&dsn4, field, sizeof(dsn4));
+			dsn = (u32)(ntohl(dsn4) - (u32)idsn - 1);
+			field += 4;
+		}
+		memcpy(&ssn, field, sizeof(ssn));
+		field += 4 + 2;		// ssn, then data-level length
+
+		*data_offset = dsn + (u32)(subflow_offset - ntohl(ssn));
+		*checksum = field + 2 <= end ? (u16*)field : NULL;
+		return true;
+	}
+	return false;
+}
@@ -142,10 +142,26 @@ struct mp_var {
 	UT_hash_handle hh;
 };
 
+/**
+ * Hash key of a subflow: its 4-tuple, seen from packetdrill side (src is the
+ * remote end packetdrill plays, dst is the kernel side). Ports are in host
+ * byte order. Must be zeroed before being filled since it is hashed as raw
+ * bytes.
+ */
+struct mp_subflow_key {
+	struct ip_address src_ip;
+	struct ip_address dst_ip;
+	u16 src_port;
+	u16 dst_port;
+};
+
+struct mp_connection;
+
 /**
  * Keep all info specific to a mptcp subflow
  */
 struct mp_subflow {
+	struct mp_subflow_key key; //hashmap key, see mp_state.subflows
 	struct ip_address src_ip;
 	struct ip_address dst_ip;
 	u16 src_port;
@@ -156,19 +172,53 @@ struct mp_subflow {
 	unsigned packetdrill_rand_nbr;
 	u32 ssn;
 //	u8 state; // undefined, pre_established or established
-	struct mp_subflow *next;
+	struct mp_connection *conn; //mptcp connection this subflow belongs to
+	UT_hash_handle hh;
 };
 
 /**
- * Global state for multipath TCP
+ * State of one mptcp connection, shared by all its subflows.
  */
-struct mp_state_s {
+struct mp_connection {
     u64 packetdrill_key; //packetdrill side key
     u64 kernel_key; //mptcp stack side key
     //Should be a single key for a mptcp session.
     bool packetdrill_key_set;
     bool kernel_key_set;
 
+    unsigned last_packetdrill_addr_id;
+
+    u64 remote_idsn; 	// least 64 bits of Hash(kernel_key)
+    u64 idsn;			// least 64 bits of Hash(packetdrill_key)
+    u32 remote_ssn;		// number of packets received from kernel
+    u64 remote_last_pkt_length;
+
+    /*
+     * Data sequence space consumed by packetdrill on all subflows of this
+     * connection, i.e. 1 + sum(subflow->ssn - 1). Maintained incrementally
+     * when a subflow ssn advances, so DSS packets do not walk the subflows.
+     */
+    u32 bytes_sent_on_all_ssn;
+    unsigned num_subflows;
+
+    //4-tuple of the MP_CAPABLE handshake, until its subflow is created
+    struct mp_subflow_key handshake_key;
+    bool handshake_key_set;
+
+    struct mp_connection *next;
+};
+
+/**
+ * Global state for multipath TCP
+ */
+struct mp_state_s {
+    /*
+     * Connection the packet being processed belongs to. Selected by
+     * mptcp_insert_and_extract_opt_fields() before handling each packet.
+     */
+    struct mp_connection *conn;
+    struct mp_connection *connections; //all connections, newest first
+
     /*
      * FIFO queue to track variables use. Once parser encounter a mptcp
      * variable, it will enqueue it in the var_queue. Since packets are
@@ -183,15 +233,8 @@ struct mp_state_s {
     queue_t_val script_only_vals_queue; // used to queu and dequeue in script file
     //hashmap, contains <key:variable_name, value: variable_value>
     struct mp_var *vars;
+    //hashmap of the subflows of all connections, keyed by mp_subflow_key
     struct mp_subflow *subflows;
-
-    unsigned last_packetdrill_addr_id;
-
-    u64 remote_idsn; 	// least 64 bits of Hash(kernel_key)
-    u64 idsn;			// least 64 bits of Hash(packetdrill_key)
-    u32 remote_ssn;		// number of packets received from kernel
-//    u64 last_dsn_rcvd;  // last dsn received from kernel
-    u64 remote_last_pkt_length;
 };
 
 typedef struct mp_state_s mp_state_t;
@@ -296,20 +339,28 @@ void free_vars();
 struct mp_subflow *new_subflow_inbound(struct packet *packet);
 struct mp_subflow *new_subflow_outbound(struct packet *outbound_packet);
 /**
- * Return the first subflow S of mp_state.subflows for which match(packet, S)
- * returns true.
+ * Return the subflow of mp_state.subflows with the given 4-tuple, or NULL.
  */
-struct mp_subflow *find_matching_subflow(struct packet *packet,
-		bool (*match)(struct mp_subflow*, struct packet*));
+struct mp_subflow *find_subflow(const struct mp_subflow_key *key);
 struct mp_subflow *find_subflow_matching_outbound_packet(struct packet *outbound_packet);
-struct mp_subflow *find_subflow_matching_socket(struct socket *socket);
 struct mp_subflow *find_subflow_matching_inbound_packet(
 		struct packet *inbound_packet);
 /**
- * Free all mptcp subflows struct being a member of mp_state.subflows list.
+ * Free all mptcp subflows struct being a member of mp_state.subflows hashmap.
  */
 void free_flows();
 
+/**
+ * Allocate a new mptcp connection, make it the current one (mp_state.conn)
+ * and return it.
+ */
+struct mp_connection *new_mp_connection();
+
+/**
+ * Free all mptcp connections.
+ */
+void free_connections();
+
 /**
  * Generate a mptcp packetdrill side key and save it for later reference in
  * the script.
@@ -365,4 +416,19 @@ int mptcp_insert_and_extract_opt_fields(struct packet *packet_to_modify,
 		struct packet *live_packet, // could be the same as packet_to_modify
 		unsigned direction);
 
+/**
+ * For a live packet whose DSS option maps its payload, set *data_offset
+ * to where the payload starts in the data stream of the sender (0 for
+ * the byte at its IDSN + 1), and *checksum to the DSS checksum field, or
+ * NULL if the option has none. subflow_offset is where the payload
+ * starts in the subflow's sequence space, relative to its ISN.
+ * Returns false if the packet maps no data. Call after
+ * mptcp_insert_and_extract_opt_fields() has handled the packet.
+ */
+bool mptcp_data_offset(struct packet *live_packet,
+		unsigned direction,
+		u32 subflow_offset,
+		u64 *data_offset,
+		u16 **checksum);
+
 #endif /* __MPTCP_H__ */
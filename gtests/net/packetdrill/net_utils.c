@@ -24,12 +24,25 @@
 
 #include "net_utils.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <net/if.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#ifdef linux
+#include <linux/genetlink.h>
+#include <linux/if_link.h>
+#include <linux/neighbour.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/tcp_metrics.h>
+#include <linux/veth.h>
+#endif
+
 #include "logging.h"
 
+#if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 static void verbose_system(const char *command)
 {
 	int result;
@@ -40,28 +53,383 @@ static void verbose_system(const char *command)
 	if (result != 0)
 		DEBUGP("error executing command '%s'\n", command);
 }
+#endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
+
+#ifdef linux
+/* A netlink request: header, family-specific message, attributes. */
+struct netlink_request {
+	struct nlmsghdr hdr;
+	union {
+		struct ifaddrmsg ifa;
+		struct rtmsg rt;
+		struct genlmsghdr genl;
+		struct ifinfomsg ifi;
+		struct ndmsg nd;
+	};
+	char attrs[128];
+};
+
+/* Append len zeroed bytes to the request and return a pointer to them. */
+static void *netlink_reserve(struct netlink_request *req, int len)
+{
+	char *data = (char *)req + NLMSG_ALIGN(req->hdr.nlmsg_len);
+
+	assert(NLMSG_ALIGN(req->hdr.nlmsg_len) + NLMSG_ALIGN(len) <=
+	       sizeof(*req));
+	memset(data, 0, NLMSG_ALIGN(len));
+	req->hdr.nlmsg_len = NLMSG_ALIGN(req->hdr.nlmsg_len) + NLMSG_ALIGN(len);
+	return data;
+}
+
+static void netlink_add_attr(struct netlink_request *req, u16 type,
+			     const void *data, int len)
+{
+	struct rtattr *rta = netlink_reserve(req, RTA_SPACE(len));
+
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+}
+
+/* Start an attribute holding the attributes added until the matching
+ * netlink_nest_end().
+ */
+static struct rtattr *netlink_nest_begin(struct netlink_request *req,
+					 u16 type)
+{
+	struct rtattr *nest = netlink_reserve(req, RTA_LENGTH(0));
+
+	nest->rta_type = type;
+	return nest;
+}
+
+static void netlink_nest_end(struct netlink_request *req,
+			     struct rtattr *nest)
+{
+	nest->rta_len = (char *)req + req->hdr.nlmsg_len - (char *)nest;
+}
+
+/* Send the request on a netlink socket of the given protocol and wait
+ * for the kernel's answer. Returns 0 on success or a negative errno
+ * value. If the kernel answers with a message other than an
+ * acknowledgement, it is copied to the given reply buffer, if any.
+ */
+static int netlink_talk(int protocol, struct netlink_request *req,
+			void *reply_buf, int reply_len)
+{
+	struct sockaddr_nl kernel;
+	char reply[1024];
+	int fd, result = -EIO;
+	ssize_t bytes;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+	if (fd < 0)
+		die_perror("socket(AF_NETLINK, SOCK_RAW)");
+
+	memset(&kernel, 0, sizeof(kernel));
+	kernel.nl_family = AF_NETLINK;
+	req->hdr.nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+	req->hdr.nlmsg_seq = 1;
+
+	if (sendto(fd, req, req->hdr.nlmsg_len, 0,
+		   (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+		die_perror("netlink sendto");
+
+	bytes = recv(fd, reply, sizeof(reply), 0);
+	if (bytes < 0)
+		die_perror("netlink recv");
+
+	struct nlmsghdr *nlh = (struct nlmsghdr *)reply;
+	if (NLMSG_OK(nlh, bytes) && nlh->nlmsg_type == NLMSG_ERROR) {
+		struct nlmsgerr *err = NLMSG_DATA(nlh);
+		result = err->error;
+	} else if (NLMSG_OK(nlh, bytes)) {
+		if (reply_buf != NULL)
+			memcpy(reply_buf, reply,
+			       bytes < reply_len ? bytes : reply_len);
+		result = 0;
+	}
+
+	close(fd);
+	return result;
+}
+
+/* Add (RTM_NEWADDR) or delete (RTM_DELADDR) an address on a device. */
+static int netlink_dev_address(int type, const char *dev_name,
+			       const struct ip_address *ip, int prefix_len)
+{
+	struct netlink_request req;
+	int index = if_nametoindex(dev_name);
+	int bytes = ip_address_length(ip->address_family);
+
+	if (index == 0)
+		die_perror("if_nametoindex");
+
+	memset(&req, 0, sizeof(req));
+	req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+	req.hdr.nlmsg_type = type;
+	if (type == RTM_NEWADDR)
+		req.hdr.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+	req.ifa.ifa_family = ip->address_family;
+	req.ifa.ifa_prefixlen = prefix_len;
+	req.ifa.ifa_index = index;
+	/* Our test addresses are unique; skip IPv6 duplicate address
+	 * detection, so the address is usable right away.
+	 */
+	if (ip->address_family == AF_INET6)
+		req.ifa.ifa_flags = IFA_F_NODAD;
+	netlink_add_attr(&req, IFA_LOCAL, &ip->ip, bytes);
+	netlink_add_attr(&req, IFA_ADDRESS, &ip->ip, bytes);
+
+	return netlink_talk(NETLINK_ROUTE, &req, NULL, 0);
+}
+
+/* Add (RTM_NEWROUTE) or delete (RTM_DELROUTE) a route to the given
+ * prefix through the given gateway on a device.
+ */
+static int netlink_route(int type, const char *dev_name,
+			 const struct ip_prefix *prefix,
+			 const struct ip_address *gateway)
+{
+	struct netlink_request req;
+	int index = if_nametoindex(dev_name);
+	int bytes = ip_address_length(prefix->ip.address_family);
+
+	if (index == 0)
+		die_perror("if_nametoindex");
+
+	memset(&req, 0, sizeof(req));
+	req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+	req.hdr.nlmsg_type = type;
+	/* Replace any route left over for this prefix. */
+	if (type == RTM_NEWROUTE)
+		req.hdr.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+	req.rt.rtm_family = prefix->ip.address_family;
+	req.rt.rtm_dst_len = prefix->prefix_len;
+	req.rt.rtm_table = RT_TABLE_MAIN;
+	req.rt.rtm_protocol = RTPROT_BOOT;
+	req.rt.rtm_scope = RT_SCOPE_UNIVERSE;
+	req.rt.rtm_type = RTN_UNICAST;
+	netlink_add_attr(&req, RTA_DST, &prefix->ip.ip, bytes);
+	netlink_add_attr(&req, RTA_GATEWAY, &gateway->ip, bytes);
+	netlink_add_attr(&req, RTA_OIF, &index, sizeof(index));
+
+	return netlink_talk(NETLINK_ROUTE, &req, NULL, 0);
+}
+
+void net_setup_route(const char *dev_name,
+		     const struct ip_prefix *prefix,
+		     const struct ip_address *gateway)
+{
+	int result = netlink_route(RTM_NEWROUTE, dev_name, prefix, gateway);
+
+	if (result < 0) {
+		char prefix_string[ADDR_STR_LEN];
+		char gateway_string[ADDR_STR_LEN];
+
+		die("unable to route %s/%d via %s on %s: %s\n",
+		    ip_to_string(&prefix->ip, prefix_string),
+		    prefix->prefix_len,
+		    ip_to_string(gateway, gateway_string),
+		    dev_name, strerror(-result));
+	}
+}
+
+void net_del_route(const char *dev_name,
+		   const struct ip_prefix *prefix,
+		   const struct ip_address *gateway)
+{
+	int result = netlink_route(RTM_DELROUTE, dev_name, prefix, gateway);
+	DEBUGP("RTM_DELROUTE on %s: %d\n", dev_name, result);
+}
+
+/* Start an RTM_NEWLINK/RTM_DELLINK/RTM_SETLINK request for a device. */
+static void netlink_link_request(struct netlink_request *req, int type,
+				 int index)
+{
+	memset(req, 0, sizeof(*req));
+	req->hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+	req->hdr.nlmsg_type = type;
+	req->ifi.ifi_family = AF_UNSPEC;
+	req->ifi.ifi_index = index;
+}
+
+void net_create_veth(const char *dev_name, const char *peer_name)
+{
+	struct netlink_request req;
+	struct rtattr *linkinfo, *data, *peer;
+	struct ifinfomsg *peer_ifi;
+	int result;
+
+	netlink_link_request(&req, RTM_NEWLINK, 0);
+	req.hdr.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+	netlink_add_attr(&req, IFLA_IFNAME, dev_name, strlen(dev_name) + 1);
+	linkinfo = netlink_nest_begin(&req, IFLA_LINKINFO);
+	netlink_add_attr(&req, IFLA_INFO_KIND, "veth", strlen("veth") + 1);
+	data = netlink_nest_begin(&req, IFLA_INFO_DATA);
+	peer = netlink_nest_begin(&req, VETH_INFO_PEER);
+	peer_ifi = netlink_reserve(&req, sizeof(*peer_ifi));
+	peer_ifi->ifi_family = AF_UNSPEC;
+	netlink_add_attr(&req, IFLA_IFNAME, peer_name, strlen(peer_name) + 1);
+	netlink_nest_end(&req, peer);
+	netlink_nest_end(&req, data);
+	netlink_nest_end(&req, linkinfo);
+
+	result = netlink_talk(NETLINK_ROUTE, &req, NULL, 0);
+	if (result < 0)
+		die("unable to create veth pair %s/%s: %s\n",
+		    dev_name, peer_name, strerror(-result));
+}
+
+void net_del_link(const char *dev_name)
+{
+	struct netlink_request req;
+	int index = if_nametoindex(dev_name);
+	int result;
+
+	if (index == 0)
+		return;
+
+	netlink_link_request(&req, RTM_DELLINK, index);
+	result = netlink_talk(NETLINK_ROUTE, &req, NULL, 0);
+	DEBUGP("RTM_DELLINK on %s: %d\n", dev_name, result);
+}
+
+void net_set_link_xdp(const char *dev_name, int prog_fd, u32 flags)
+{
+	struct netlink_request req;
+	struct rtattr *xdp;
+	int index = if_nametoindex(dev_name);
+	int result;
+
+	if (index == 0)
+		die_perror("if_nametoindex");
+
+	netlink_link_request(&req, RTM_SETLINK, index);
+	xdp = netlink_nest_begin(&req, IFLA_XDP);
+	netlink_add_attr(&req, IFLA_XDP_FD, &prog_fd, sizeof(prog_fd));
+	netlink_add_attr(&req, IFLA_XDP_FLAGS, &flags, sizeof(flags));
+	netlink_nest_end(&req, xdp);
+
+	result = netlink_talk(NETLINK_ROUTE, &req, NULL, 0);
+	if (result < 0)
+		die("unable to attach XDP program to %s: %s\n",
+		    dev_name, strerror(-result));
+}
+
+void net_add_neighbor(const char *dev_name, const struct ip_address *ip,
+		      const struct ether_addr *ether_addr)
+{
+	struct netlink_request req;
+	int index = if_nametoindex(dev_name);
+	int result;
+
+	if (index == 0)
+		die_perror("if_nametoindex");
+
+	memset(&req, 0, sizeof(req));
+	req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+	req.hdr.nlmsg_type = RTM_NEWNEIGH;
+	req.hdr.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+	req.nd.ndm_family = ip->address_family;
+	req.nd.ndm_ifindex = index;
+	req.nd.ndm_state = NUD_PERMANENT;
+	netlink_add_attr(&req, NDA_DST, &ip->ip,
+			 ip_address_length(ip->address_family));
+	netlink_add_attr(&req, NDA_LLADDR, ether_addr, sizeof(*ether_addr));
+
+	result = netlink_talk(NETLINK_ROUTE, &req, NULL, 0);
+	if (result < 0) {
+		char ip_string[ADDR_STR_LEN];
+
+		die("unable to add neighbor %s on %s: %s\n",
+		    ip_to_string(ip, ip_string), dev_name,
+		    strerror(-result));
+	}
+}
+
+/* Look up the id of the generic netlink family with the given name.
+ * Returns the id, or a negative errno value.
+ */
+static int genl_family_id(const char *name)
+{
+	struct netlink_request req;
+	struct {
+		struct nlmsghdr hdr;
+		struct genlmsghdr genl;
+		char attrs[512];
+	} reply;
+	struct rtattr *rta;
+	int len, result;
+
+	memset(&req, 0, sizeof(req));
+	req.hdr.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	req.hdr.nlmsg_type = GENL_ID_CTRL;
+	req.genl.cmd = CTRL_CMD_GETFAMILY;
+	req.genl.version = 1;
+	netlink_add_attr(&req, CTRL_ATTR_FAMILY_NAME, name, strlen(name) + 1);
+
+	memset(&reply, 0, sizeof(reply));
+	result = netlink_talk(NETLINK_GENERIC, &req, &reply, sizeof(reply));
+	if (result < 0)
+		return result;
+
+	len = reply.hdr.nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+	if (len > (int)sizeof(reply.attrs))
+		len = sizeof(reply.attrs);
+	for (rta = (struct rtattr *)reply.attrs; RTA_OK(rta, len);
+	     rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == CTRL_ATTR_FAMILY_ID)
+			return *(u16 *)RTA_DATA(rta);
+	}
+	return -ENOENT;
+}
+
+void net_flush_tcp_metrics(void)
+{
+	struct netlink_request req;
+	int family = genl_family_id(TCP_METRICS_GENL_NAME);
+	int result;
+
+	if (family < 0) {
+		DEBUGP("no tcp_metrics genetlink family: %d\n", family);
+		return;
+	}
+
+	/* A delete without any address flushes the whole cache. */
+	memset(&req, 0, sizeof(req));
+	req.hdr.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	req.hdr.nlmsg_type = family;
+	req.genl.cmd = TCP_METRICS_CMD_DEL;
+	req.genl.version = TCP_METRICS_GENL_VERSION;
+	result = netlink_talk(NETLINK_GENERIC, &req, NULL, 0);
+	if (result < 0) {
+		errno = -result;
+		die_perror("TCP_METRICS_CMD_DEL");
+	}
+}
+#endif /* linux */
 
 /* Configure a local IPv4 address and netmask for the device */
 static void net_add_ipv4_address(const char *dev_name,
 				 const struct ip_address *ip,
 				 int prefix_len)
 {
+#ifdef linux
+	int result = netlink_dev_address(RTM_NEWADDR, dev_name, ip, prefix_len);
+	DEBUGP("RTM_NEWADDR on %s: %d\n", dev_name, result);
+#endif
+#if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	char *command = NULL;
 	char ip_string[ADDR_STR_LEN];
 
 	ip_to_string(ip, ip_string);
-
-#ifdef linux
-	asprintf(&command, "ip addr add %s/%d dev %s > /dev/null 2>&1",
-		 ip_string, prefix_len, dev_name);
-#endif
-#if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	asprintf(&command, "/sbin/ifconfig %s %s/%d alias",
 		 dev_name, ip_string, prefix_len);
-#endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
 
 	verbose_system(command);
 	free(command);
+#endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
 }
 
 /* Configure a local IPv6 address and prefix length for the device */
@@ -69,37 +437,29 @@ static void net_add_ipv6_address(const char *dev_name,
 				 const struct ip_address *ip,
 				 int prefix_len)
 {
-	char *command = NULL;
-	char ip_string[ADDR_STR_LEN];
-
-	ip_to_string(ip, ip_string);
-
 #ifdef linux
-
-	asprintf(&command, "ip addr add %s/%d dev %s > /dev/null 2>&1",
-		 ip_string, prefix_len, dev_name);
+	/* Added with IFA_F_NODAD, so there is no duplicate address
+	 * detection to wait for.
+	 */
+	int result = netlink_dev_address(RTM_NEWADDR, dev_name, ip, prefix_len);
+	DEBUGP("RTM_NEWADDR on %s: %d\n", dev_name, result);
 #endif
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+	char *command = NULL;
+	char ip_string[ADDR_STR_LEN];
 
+	ip_to_string(ip, ip_string);
 	asprintf(&command, "/sbin/ifconfig %s inet6 %s/%d",
 		 dev_name, ip_string, prefix_len);
-#endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
 
 	verbose_system(command);
 	free(command);
 
 	/* Wait for IPv6 duplicate address detection to converge,
 	 * so that this address no longer shows as "tentative".
-	 * e.g. "ip addr show" shows:
-	 * inet6 fd3d:fa7b:d17d::36/48 scope global tentative
 	 */
-#ifdef linux
-	if (!strstr(dev_name, "tun"))
-		sleep(2);
-#endif
-#if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	sleep(3);
-#endif
+#endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
 }
 
 void net_add_dev_address(const char *dev_name,
@@ -123,24 +483,23 @@ void net_del_dev_address(const char *dev_name,
 			 const struct ip_address *ip,
 			 int prefix_len)
 {
+#ifdef linux
+	int result = netlink_dev_address(RTM_DELADDR, dev_name, ip, prefix_len);
+	DEBUGP("RTM_DELADDR on %s: %d\n", dev_name, result);
+#endif
+#if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	char *command = NULL;
 	char ip_string[ADDR_STR_LEN];
 
 	ip_to_string(ip, ip_string);
-
-#ifdef linux
-	asprintf(&command, "ip addr del %s/%d dev %s > /dev/null 2>&1",
-		 ip_string, prefix_len, dev_name);
-#endif
-#if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	asprintf(&command, "/sbin/ifconfig %s %s %s/%d -alias",
 		 dev_name,
 		 ip->address_family ==  AF_INET6 ? "inet6" : "",
 		 ip_string, prefix_len);
-#endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
 
 	verbose_system(command);
 	free(command);
+#endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
 }
 
 /* In general we want to avoid configuring a new IP address on an
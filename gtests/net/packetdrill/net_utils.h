@@ -28,7 +28,9 @@
 
 #include "types.h"
 
+#include "ethernet.h"
 #include "ip_address.h"
+#include "ip_prefix.h"
 
 /* Add the given IP address, with the given subnet/prefix length,
  * to the given device.
@@ -53,4 +55,45 @@ extern void net_setup_dev_address(const char *dev_name,
 				  const struct ip_address *ip,
 				  int prefix_len);
 
+#ifdef linux
+/* Route the given destination prefix through the given gateway on the
+ * given device, replacing any existing route for that prefix. Dies on
+ * failure.
+ */
+extern void net_setup_route(const char *dev_name,
+			    const struct ip_prefix *prefix,
+			    const struct ip_address *gateway);
+
+/* Delete the route installed by net_setup_route(), if it still exists. */
+extern void net_del_route(const char *dev_name,
+			  const struct ip_prefix *prefix,
+			  const struct ip_address *gateway);
+
+/* Forget the kernel's cached per-destination TCP metrics (RTT, cwnd,
+ * etc.), as "ip tcp_metrics flush all" would, so that one test cannot
+ * influence the next. Does nothing if the kernel has no such cache.
+ */
+extern void net_flush_tcp_metrics(void);
+
+/* Create a pair of connected veth devices with the given names, or die. */
+extern void net_create_veth(const char *dev_name, const char *peer_name);
+
+/* Delete the given device, if it exists. Deleting either end of a veth
+ * pair deletes both.
+ */
+extern void net_del_link(const char *dev_name);
+
+/* Attach the given XDP program (or detach, with a prog_fd of -1) to
+ * the given device, using the given XDP_FLAGS_*, or die.
+ */
+extern void net_set_link_xdp(const char *dev_name, int prog_fd, u32 flags);
+
+/* Add a permanent neighbor (ARP or NDP) entry on the given device,
+ * mapping the given IP address to the given link layer address.
+ */
+extern void net_add_neighbor(const char *dev_name,
+			     const struct ip_address *ip,
+			     const struct ether_addr *ether_addr);
+#endif /* linux */
+
 #endif /* __NET_UTILS_H__ */
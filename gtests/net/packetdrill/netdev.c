@@ -31,6 +31,8 @@
 #include <fcntl.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <sched.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,10 +43,16 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#ifdef linux
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#endif
+
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 #include <net/if_tun.h>
 #endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
 
+#include "hash.h"
 #include "ip.h"
 #include "ipv6.h"
 #include "logging.h"
@@ -52,23 +60,61 @@
 #include "packet.h"
 #include "packet_parser.h"
 #include "packet_socket.h"
+#include "socket.h"
 #include "tcp.h"
 #include "tun.h"
 
+/* Max number of distinct flows we remember for TUN_STEER_FLOW. */
+#define TUN_MAX_FLOWS 256
+
 /* Internal private state for the netdev for purely local tests. */
 struct local_netdev {
 	struct netdev netdev;		/* "inherit" from netdev */
 
 	char *name;		/* malloc-ed copy of interface name (owned) */
 	int tun_fd;		/* tun for sending/receiving packets */
+	int queue_fds[TUN_MAX_QUEUES];	/* fd per tun queue; [0] is tun_fd */
+	int num_queues;		/* number of tun queues we opened */
+	enum tun_steering_t steering;	/* how packets pick a queue */
+	int next_queue;		/* next queue to hand out */
+	int queue_cpus[TUN_MAX_QUEUES];	/* CPU to inject each queue from */
+	int current_cpu;	/* CPU we are pinned to, or -1 */
+#ifdef linux
+	cpu_set_t saved_cpus;	/* affinity to restore when done */
+#endif
+	struct tuple flows[TUN_MAX_FLOWS];	/* flows seen so far... */
+	int flow_queues[TUN_MAX_FLOWS];		/* ...and their queues */
+	int num_flows;		/* number of valid entries in flows */
 	int ipv4_control_fd;	/* fd for IPv4 configuration of tun interface */
 	int ipv6_control_fd;	/* fd for IPv6 configuration of tun interface */
 	int index;		/* interface index from if_nametoindex */
+	bool vnet_hdr;		/* tun reads/writes carry virtio_net_hdr */
 	struct packet_socket *psock;	/* for sniffing packets (owned) */
+	u16 filter_ports[PACKET_FILTER_MAX_PORTS + 1];	/* ports in filter */
+	int num_filter_ports;	/* number of valid entries in filter_ports */
+
+	/* The configuration the device was set up with, so a later
+	 * script can reuse it (see --reuse_netdev).
+	 */
+	bool reuse;		/* keep the device when freed? */
+	struct ip_address local_ip;	/* address assigned to the device */
+	int prefix_len;			/* ... and its prefix length */
+	struct ip_prefix remote_prefix;	/* prefix routed to the device */
+	struct ip_address gateway_ip;	/* ... and its gateway */
+	u32 speed;		/* speed set with --speed */
+	int mtu;		/* MTU set with --mtu */
 };
 
 struct netdev_ops local_netdev_ops;
 
+/* With --reuse_netdev, the device the last script ran on, kept alive
+ * so the next script can skip creating and configuring a new one.
+ */
+static struct local_netdev *cached_netdev;
+
+static void local_netdev_filter_ports(struct netdev *a_netdev,
+				      const u16 *ports, int num_ports);
+
 /* "Downcast" an abstract netdev to our local flavor. */
 static inline struct local_netdev *to_local_netdev(struct netdev *netdev)
 {
@@ -108,6 +154,60 @@ static void check_remote_address(struct config *config,
 	}
 }
 
+/* Set the device's link speed in Mbit/s, as "ethtool -s DEV speed N
+ * autoneg off" would.
+ */
+static void set_device_speed(struct local_netdev *netdev, u32 speed)
+{
+#ifdef linux
+	struct ethtool_cmd cmd;
+	struct ifreq ifr;
+
+	memset(&cmd, 0, sizeof(cmd));
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, netdev->name, IFNAMSIZ);
+	ifr.ifr_data = (void *)&cmd;
+
+	cmd.cmd = ETHTOOL_GSET;
+	if (ioctl(netdev->ipv4_control_fd, SIOCETHTOOL, &ifr) < 0)
+		die_perror("SIOCETHTOOL ETHTOOL_GSET");
+
+	cmd.cmd = ETHTOOL_SSET;
+	ethtool_cmd_speed_set(&cmd, speed);
+	cmd.autoneg = AUTONEG_DISABLE;
+	if (ioctl(netdev->ipv4_control_fd, SIOCETHTOOL, &ifr) < 0)
+		die_perror("SIOCETHTOOL ETHTOOL_SSET");
+
+	/* Need to bring interface down and up so the interface speed
+	 * will be copied to the link_speed field. This field is
+	 * used by TCP's cwnd bound. The flag changes are synchronous,
+	 * so there is no need to wait in between.
+	 */
+	if (ioctl(netdev->ipv4_control_fd, SIOCGIFFLAGS, &ifr) < 0)
+		die_perror("SIOCGIFFLAGS");
+	ifr.ifr_flags &= ~IFF_UP;
+	if (ioctl(netdev->ipv4_control_fd, SIOCSIFFLAGS, &ifr) < 0)
+		die_perror("SIOCSIFFLAGS");
+	ifr.ifr_flags |= IFF_UP;
+	if (ioctl(netdev->ipv4_control_fd, SIOCSIFFLAGS, &ifr) < 0)
+		die_perror("SIOCSIFFLAGS");
+#else
+	DEBUGP("ignoring speed %u: no ethtool on this platform\n", speed);
+#endif
+}
+
+/* Set the device's MTU, as "ifconfig DEV mtu N" would. */
+static void set_device_mtu(struct local_netdev *netdev, int mtu)
+{
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, netdev->name, IFNAMSIZ);
+	ifr.ifr_mtu = mtu;
+	if (ioctl(netdev->ipv4_control_fd, SIOCSIFMTU, &ifr) < 0)
+		die_perror("SIOCSIFMTU");
+}
+
 /* Create a tun device for the lifetime of this test. */
 static void create_device(struct config *config, struct local_netdev *netdev)
 {
@@ -126,14 +226,40 @@ static void create_device(struct config *config, struct local_netdev *netdev)
 	struct ifreq ifr;
 	memset(&ifr, 0, sizeof(ifr));
 	ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+	if (config->vnet_hdr)
+		ifr.ifr_flags |= IFF_VNET_HDR;
+	if (config->tun_queues > 1)
+		ifr.ifr_flags |= IFF_MULTI_QUEUE;
 	int status = ioctl(netdev->tun_fd, TUNSETIFF, (void *)&ifr);
 	if (status < 0)
 		die_perror("TUNSETIFF");
 
 	netdev->name = strdup(ifr.ifr_name);
+	netdev->vnet_hdr = config->vnet_hdr;
+	netdev->queue_fds[0] = tun_fd;
+	netdev->num_queues = 1;
+
+	/* Attach the remaining queues of a multi-queue device. Each
+	 * TUNSETIFF with the same name and IFF_MULTI_QUEUE adds a queue.
+	 */
+	while (netdev->num_queues < config->tun_queues) {
+		int queue_fd = open(TUN_PATH, O_RDWR);
+		if (queue_fd < 0)
+			die_perror("open tun device");
+		if (ioctl(queue_fd, TUNSETIFF, (void *)&ifr) < 0)
+			die_perror("TUNSETIFF (IFF_MULTI_QUEUE)");
+		netdev->queue_fds[netdev->num_queues++] = queue_fd;
+	}
 #endif
 
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+	if (config->vnet_hdr)
+		die("--vnet_hdr is only supported on Linux\n");
+	if (config->tun_queues > 1)
+		die("--tun_queues is only supported on Linux\n");
+	netdev->queue_fds[0] = tun_fd;
+	netdev->num_queues = 1;
+
 	const int mode = IFF_BROADCAST | IFF_MULTICAST;
 	if (ioctl(netdev->tun_fd, TUNSIFMODE, &mode, sizeof(mode)) < 0)
 		die_perror("TUNSIFMODE");
@@ -159,33 +285,6 @@ static void create_device(struct config *config, struct local_netdev *netdev)
 
 	DEBUGP("tun index: '%d'\n", netdev->index);
 
-	if (config->speed != TUN_DRIVER_SPEED_CUR) {
-		char *command;
-		asprintf(&command, "ethtool -s %s speed %u autoneg off",
-			 netdev->name, config->speed);
-		if (system(command) < 0)
-			die("Error executing %s\n", command);
-		free(command);
-
-		/* Need to bring interface down and up so the interface speed
-		 * will be copied to the link_speed field. This field is
-		 * used by TCP's cwnd bound. */
-		asprintf(&command, "ifconfig %s down; sleep 1; ifconfig %s up; "
-			      "sleep 1", netdev->name, netdev->name);
-		if (system(command) < 0)
-			die("Error executing %s\n", command);
-		free(command);
-	}
-
-	if (config->mtu != TUN_DRIVER_DEFAULT_MTU) {
-		char *command;
-		asprintf(&command, "ifconfig %s mtu %d",
-			 netdev->name, config->mtu);
-		if (system(command) < 0)
-			die("Error executing %s\n", command);
-		free(command);
-	}
-
 	/* Open a socket we can use to configure the tun interface.
 	 * We only open up an AF_INET6 socket on-demand as needed,
 	 * so that we can run IPv4 tests on a machine without IPv6.
@@ -195,6 +294,12 @@ static void create_device(struct config *config, struct local_netdev *netdev)
 	netdev->ipv4_control_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
 	if (netdev->ipv4_control_fd < 0)
 		die_perror("opening AF_INET, SOCK_DGRAM, IPPROTO_IP socket");
+
+	if (config->speed != TUN_DRIVER_SPEED_CUR)
+		set_device_speed(netdev, config->speed);
+
+	if (config->mtu != TUN_DRIVER_DEFAULT_MTU)
+		set_device_mtu(netdev, config->mtu);
 }
 
 /* Set the offload flags to be like a typical ethernet device */
@@ -225,17 +330,16 @@ static void bring_up_device(struct local_netdev *netdev)
 static void route_traffic_to_device(struct config *config,
 				    struct local_netdev *netdev)
 {
-	char *route_command = NULL;
 #ifdef linux
-	asprintf(&route_command,
-		 "ip route del %s > /dev/null 2>&1 ; "
-		 "ip route add %s dev %s via %s > /dev/null 2>&1",
-		 config->live_remote_prefix_string,
-		 config->live_remote_prefix_string,
-		 netdev->name,
-		 config->live_gateway_ip_string);
+	/* Talk rtnetlink directly; replacing the route makes the old
+	 * "ip route del" unnecessary.
+	 */
+	net_setup_route(netdev->name, &config->live_remote_prefix,
+			&config->live_gateway_ip);
 #endif
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+	char *route_command = NULL;
+
 	if (config->wire_protocol == AF_INET) {
 		asprintf(&route_command,
 			 "route delete %s > /dev/null 2>&1 ; "
@@ -257,18 +361,189 @@ static void route_traffic_to_device(struct config *config,
 	} else {
 		assert(!"bad wire protocol");
 	}
-#endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
 	int result = system(route_command);
 	if ((result == -1) || (WEXITSTATUS(result) != 0)) {
 		die("error executing route command '%s'\n",
 		    route_command);
 	}
 	free(route_command);
+#endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
+}
+
+/* Remember the steering policy and the CPU each queue is injected from. */
+static void setup_queue_steering(struct config *config,
+				 struct local_netdev *netdev)
+{
+	int i;
+
+	netdev->steering = config->tun_steering;
+	netdev->current_cpu = -1;
+	for (i = 0; i < TUN_MAX_QUEUES; ++i) {
+		netdev->queue_cpus[i] = config->tun_queue_cpus[i];
+#ifdef linux
+		if (netdev->queue_cpus[i] >= CPU_SETSIZE)
+			die("bad --tun_queue_cpus entry: %d\n",
+			    netdev->queue_cpus[i]);
+#else
+		if (netdev->queue_cpus[i] >= 0)
+			die("--tun_queue_cpus is only supported on Linux\n");
+#endif
+	}
+#ifdef linux
+	if (sched_getaffinity(0, sizeof(netdev->saved_cpus),
+			      &netdev->saved_cpus) < 0)
+		die_perror("sched_getaffinity");
+#endif
+}
+
+/* Remember how the device is configured now. */
+static void save_device_config(struct config *config,
+			       struct local_netdev *netdev)
+{
+	netdev->reuse = config->reuse_netdev;
+	netdev->local_ip = config->live_local_ip;
+	netdev->prefix_len = config->live_prefix_len;
+	netdev->remote_prefix = config->live_remote_prefix;
+	netdev->gateway_ip = config->live_gateway_ip;
+	netdev->speed = config->speed;
+	netdev->mtu = config->mtu;
+}
+
+/* Sniff only the default ports until sockets exist. */
+static void filter_default_ports(struct config *config,
+				 struct local_netdev *netdev)
+{
+	const u16 default_ports[] = {
+		config->default_live_bind_port,
+		config->default_live_connect_port,
+	};
+	local_netdev_filter_ports(&netdev->netdev, default_ports,
+				  ARRAY_SIZE(default_ports));
+}
+
+static bool same_ip_prefix(const struct ip_prefix *a,
+			   const struct ip_prefix *b)
+{
+	return a->prefix_len == b->prefix_len && is_equal_ip(&a->ip, &b->ip);
+}
+
+/* Can the given cached device be reconfigured for the given config,
+ * rather than torn down and created anew?
+ */
+static bool can_reuse_device(struct config *config,
+			     struct local_netdev *netdev)
+{
+	/* The tun flags are fixed when the device is created. */
+	if (config->vnet_hdr != netdev->vnet_hdr ||
+	    config->tun_queues != netdev->num_queues)
+		return false;
+	/* There is no way to ask for the driver's original speed. */
+	if (config->speed == TUN_DRIVER_SPEED_CUR &&
+	    netdev->speed != TUN_DRIVER_SPEED_CUR)
+		return false;
+#ifndef linux
+	/* Elsewhere we can only add routes, not delete stale ones. */
+	if (!same_ip_prefix(&config->live_remote_prefix,
+			    &netdev->remote_prefix) ||
+	    !is_equal_ip(&config->live_gateway_ip, &netdev->gateway_ip))
+		return false;
+#endif
+	return true;
+}
+
+/* Get a cached device ready for another script: apply whatever parts
+ * of the configuration changed and drop state left by the last script.
+ */
+static void reuse_device(struct config *config, struct local_netdev *netdev)
+{
+	DEBUGP("reusing tun device '%s'\n", netdev->name);
+
+	check_remote_address(config, netdev);
+
+	if (config->speed != netdev->speed)
+		set_device_speed(netdev, config->speed);
+	if (config->mtu != netdev->mtu)
+		set_device_mtu(netdev, config->mtu);
+
+	if (config->live_prefix_len != netdev->prefix_len ||
+	    !is_equal_ip(&config->live_local_ip, &netdev->local_ip)) {
+		net_del_dev_address(netdev->name, &netdev->local_ip,
+				    netdev->prefix_len);
+		net_setup_dev_address(netdev->name, &config->live_local_ip,
+				      config->live_prefix_len);
+	}
+
+	if (!same_ip_prefix(&config->live_remote_prefix,
+			    &netdev->remote_prefix) ||
+	    !is_equal_ip(&config->live_gateway_ip, &netdev->gateway_ip)) {
+#ifdef linux
+		net_del_route(netdev->name, &netdev->remote_prefix,
+			      &netdev->gateway_ip);
+#endif
+		route_traffic_to_device(config, netdev);
+	}
+
+	setup_queue_steering(config, netdev);
+	netdev->next_queue = 0;
+	netdev->num_flows = 0;
+
+	filter_default_ports(config, netdev);
+	packet_socket_drain(netdev->psock);
+#ifdef linux
+	net_flush_tcp_metrics();
+#endif
+
+	save_device_config(config, netdev);
+}
+
+/* Undo any pinning to a queue's CPU. */
+static void restore_cpu_affinity(struct local_netdev *netdev)
+{
+#ifdef linux
+	if (netdev->current_cpu >= 0 &&
+	    sched_setaffinity(0, sizeof(netdev->saved_cpus),
+			      &netdev->saved_cpus) < 0)
+		die_perror("sched_setaffinity");
+#endif
+	netdev->current_cpu = -1;
+}
+
+/* Close the device and free the netdev. */
+static void destroy_device(struct local_netdev *netdev)
+{
+	int i;
+
+	if (netdev->psock)
+		packet_socket_free(netdev->psock);
+	if (netdev->tun_fd >= 0)
+		close(netdev->tun_fd);
+	for (i = 1; i < netdev->num_queues; ++i)
+		close(netdev->queue_fds[i]);
+	restore_cpu_affinity(netdev);
+	if (netdev->ipv4_control_fd >= 0)
+		close(netdev->ipv4_control_fd);
+	if (netdev->ipv6_control_fd >= 0)
+		close(netdev->ipv6_control_fd);
+	if (netdev->name != NULL)
+		free(netdev->name);
+	memset(netdev, 0, sizeof(*netdev));  /* paranoia to help catch bugs */
+	free(netdev);
 }
 
 struct netdev *local_netdev_new(struct config *config)
 {
-	struct local_netdev *netdev = calloc(1, sizeof(struct local_netdev));
+	struct local_netdev *netdev = cached_netdev;
+
+	cached_netdev = NULL;
+	if (netdev != NULL) {
+		if (config->reuse_netdev && can_reuse_device(config, netdev)) {
+			reuse_device(config, netdev);
+			return (struct netdev *)netdev;
+		}
+		destroy_device(netdev);
+	}
+
+	netdev = calloc(1, sizeof(struct local_netdev));
 
 	netdev->netdev.ops = &local_netdev_ops;
 
@@ -276,6 +551,7 @@ struct netdev *local_netdev_new(struct config *config)
 
 	check_remote_address(config, netdev);
 	create_device(config, netdev);
+	setup_queue_steering(config, netdev);
 	set_device_offload_flags(netdev);
 	bring_up_device(netdev);
 
@@ -285,6 +561,13 @@ struct netdev *local_netdev_new(struct config *config)
 
 	route_traffic_to_device(config, netdev);
 	netdev->psock = packet_socket_new(netdev->name);
+#ifdef linux
+	if (netdev->vnet_hdr)
+		packet_socket_set_vnet_hdr(netdev->psock);
+#endif
+
+	filter_default_ports(config, netdev);
+	save_device_config(config, netdev);
 
 	return (struct netdev *)netdev;
 }
@@ -293,18 +576,16 @@ static void local_netdev_free(struct netdev *a_netdev)
 {
 	struct local_netdev *netdev = to_local_netdev(a_netdev);
 
-	if (netdev->psock)
-		packet_socket_free(netdev->psock);
-	if (netdev->tun_fd >= 0)
-		close(netdev->tun_fd);
-	if (netdev->ipv4_control_fd >= 0)
-		close(netdev->ipv4_control_fd);
-	if (netdev->ipv6_control_fd >= 0)
-		close(netdev->ipv6_control_fd);
-	if (netdev->name != NULL)
-		free(netdev->name);
-	memset(netdev, 0, sizeof(*netdev));  /* paranoia to help catch bugs */
-	free(netdev);
+	if (!netdev->reuse) {
+		destroy_device(netdev);
+		return;
+	}
+
+	/* Keep the device for the next script. The tun device goes
+	 * away when the process exits.
+	 */
+	restore_cpu_affinity(netdev);
+	cached_netdev = netdev;
 }
 
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
@@ -331,10 +612,125 @@ static void bsd_tun_write(struct local_netdev *netdev,
 #endif /* defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) */
 
 #ifdef linux
+/* Pick the tun queue through which to inject the given packet. With
+ * TUN_STEER_FLOW each new 4-tuple (e.g. each MPTCP subflow) is handed
+ * the next queue in turn, so concurrent subflows enter the kernel
+ * through different queues; flows past TUN_MAX_FLOWS fall back to a
+ * hash of the tuple. With TUN_STEER_PACKET every packet moves on to
+ * the next queue.
+ */
+static int select_queue(struct local_netdev *netdev, struct packet *packet)
+{
+	struct tuple tuple;
+	int i, queue;
+
+	if (netdev->num_queues == 1)
+		return 0;
+
+	if (netdev->steering == TUN_STEER_PACKET) {
+		queue = netdev->next_queue;
+		netdev->next_queue = (queue + 1) % netdev->num_queues;
+		return queue;
+	}
+
+	get_packet_tuple(packet, &tuple);
+	for (i = 0; i < netdev->num_flows; ++i) {
+		if (is_equal_tuple(&netdev->flows[i], &tuple))
+			return netdev->flow_queues[i];
+	}
+
+	if (netdev->num_flows == TUN_MAX_FLOWS) {
+		u32 hash = 0;
+		MurmurHash3_x86_32(&tuple, sizeof(tuple), 0, &hash);
+		return hash % netdev->num_queues;
+	}
+
+	queue = netdev->next_queue;
+	netdev->next_queue = (queue + 1) % netdev->num_queues;
+	netdev->flows[netdev->num_flows] = tuple;
+	netdev->flow_queues[netdev->num_flows] = queue;
+	netdev->num_flows++;
+	DEBUGP("flow %d steered to tun queue %d\n", netdev->num_flows, queue);
+	return queue;
+}
+
+/* Move the injecting thread onto the CPU configured for the given
+ * queue, so the kernel processes the packet in that CPU's context.
+ */
+static void pin_to_queue_cpu(struct local_netdev *netdev, int queue)
+{
+	int cpu = netdev->queue_cpus[queue];
+	cpu_set_t cpus;
+
+	if (cpu < 0 || cpu == netdev->current_cpu)
+		return;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+		die_perror("sched_setaffinity");
+	netdev->current_cpu = cpu;
+}
+
+/* Fill in the virtio_net_hdr describing the given packet. Packets
+ * with a gso_size go in as a single TCP or UDP "super-packet" that the
+ * kernel treats like the output of GRO or of a virtio guest with TSO
+ * or USO. The kernel only takes UDP ones with a partial checksum, and
+ * hands them whole to sockets with UDP_GRO on.
+ *
+ * For every TCP or UDP packet, hdr_len tells tun how much to copy into
+ * the skb's linear area. Of a packet of a page or more, tun puts the
+ * rest, the payload, into page frags, as a NIC would; so an injected
+ * payload of a whole page can be mapped by TCP_ZEROCOPY_RECEIVE.
+ */
+static void fill_vnet_hdr(struct packet *packet, struct virtio_net_hdr *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	if (packet->tcp != NULL || packet->udp != NULL)
+		hdr->hdr_len = packet_payload(packet) - packet_start(packet);
+	if (packet->gso_size == 0)
+		return;
+
+	if (packet->udp != NULL) {
+		hdr->gso_type = VIRTIO_NET_HDR_GSO_UDP_L4;
+		hdr->gso_size = packet->gso_size;
+		hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+		hdr->csum_start = (u8 *)packet->udp - packet_start(packet);
+		hdr->csum_offset = offsetof(struct udp, check);
+		return;
+	}
+
+	assert(packet->tcp != NULL);
+	if (packet->ipv4 != NULL)
+		hdr->gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+	else
+		hdr->gso_type = VIRTIO_NET_HDR_GSO_TCPV6;
+	if (packet->tcp->cwr)
+		hdr->gso_type |= VIRTIO_NET_HDR_GSO_ECN;
+	hdr->gso_size = packet->gso_size;
+}
+
 static void linux_tun_write(struct local_netdev *netdev,
 			    struct packet *packet)
 {
-	if (write(netdev->tun_fd, packet_start(packet), packet->ip_bytes) < 0)
+	int queue = select_queue(netdev, packet);
+	int tun_fd = netdev->queue_fds[queue];
+
+	pin_to_queue_cpu(netdev, queue);
+
+	if (netdev->vnet_hdr) {
+		struct virtio_net_hdr hdr;
+		fill_vnet_hdr(packet, &hdr);
+		struct iovec vector[2] = {
+			{ &hdr, sizeof(hdr) },
+			{ packet_start(packet), packet->ip_bytes }
+		};
+		if (writev(tun_fd, vector, ARRAY_SIZE(vector)) < 0)
+			die_perror("Linux tun writev()");
+		return;
+	}
+
+	if (write(tun_fd, packet_start(packet), packet->ip_bytes) < 0)
 		die_perror("Linux tun write()");
 }
 #endif  /* linux */
@@ -374,6 +770,23 @@ static int local_netdev_receive(struct netdev *a_netdev,
 				   DIRECTION_OUTBOUND, packet, error);
 }
 
+/* Replace the sniffing filter, unless the port set did not change. */
+static void local_netdev_filter_ports(struct netdev *a_netdev,
+				      const u16 *ports, int num_ports)
+{
+	struct local_netdev *netdev = to_local_netdev(a_netdev);
+
+	if (num_ports > PACKET_FILTER_MAX_PORTS)
+		num_ports = PACKET_FILTER_MAX_PORTS + 1;
+	if (num_ports == netdev->num_filter_ports &&
+	    memcmp(ports, netdev->filter_ports, num_ports * sizeof(u16)) == 0)
+		return;
+
+	memcpy(netdev->filter_ports, ports, num_ports * sizeof(u16));
+	netdev->num_filter_ports = num_ports;
+	packet_socket_set_port_filter(netdev->psock, ports, num_ports);
+}
+
 int netdev_receive_loop(struct packet_socket *psock,
 			enum packet_layer_t layer,
 			enum direction_t direction,
@@ -415,4 +828,5 @@ struct netdev_ops local_netdev_ops = {
 	.free = local_netdev_free,
 	.send = local_netdev_send,
 	.receive = local_netdev_receive,
+	.filter_ports = local_netdev_filter_ports,
 };
@@ -54,6 +54,13 @@ struct netdev_ops {
 	 */
 	int (*receive)(struct netdev *netdev,
 		       struct packet **packet, char **error);
+
+	/* Optional: only sniff TCP/UDP packets using one of the given
+	 * ports (host byte order), so that userspace does not wake up
+	 * for packets it would discard.
+	 */
+	void (*filter_ports)(struct netdev *netdev,
+			     const u16 *ports, int num_ports);
 };
 
 
@@ -81,6 +88,13 @@ static inline int netdev_receive(struct netdev *netdev,
 	return netdev->ops->receive(netdev, packet, error);
 }
 
+/* Tell the netdev which ports live sockets use, if it can filter. */
+static inline void netdev_filter_ports(struct netdev *netdev,
+				       const u16 *ports, int num_ports)
+{
+	if (netdev->ops->filter_ports != NULL)
+		netdev->ops->filter_ports(netdev, ports, num_ports);
+}
 
 /* Keep sniffing packets leaving the kernel until we see one we know
  * about and can parse. Return a pointer to the newly-allocated
@@ -133,28 +133,43 @@ static void *offset_ptr(u8 *old_base, u8* new_base, void *old_ptr)
 /* Make a copy of the given old packet, but in the new copy reserve the
  * given number of bytes of headroom at the start of the packet->buffer.
  * This empty headroom can later be filled with outer packet headers.
+ * If back_payload is set, any unbacked bytes of the old packet are
+ * stored as zeroes in the copy; otherwise they stay unbacked.
  * A slow but simple model.
  */
 static struct packet *packet_copy_with_headroom(struct packet *old_packet,
-						int bytes_headroom)
+						int bytes_headroom,
+						bool back_payload)
 {
 	/* Allocate a new packet and copy link layer header and IP datagram. */
 	const int bytes_used = packet_end(old_packet) - old_packet->buffer;
-	assert(bytes_used >= 0);
+	const int bytes_backed = packet_buffer_end(old_packet) -
+				 old_packet->buffer;
+	assert(bytes_backed >= 0);
 	assert(bytes_used <= 128*1024);
-	struct packet *packet = packet_new(bytes_headroom + bytes_used);
+	const int bytes_new = back_payload ? bytes_used : bytes_backed;
+	struct packet *packet = packet_new(bytes_headroom + bytes_new);
 	u8 *old_base = old_packet->buffer;
 	u8 *new_base = packet->buffer + bytes_headroom;
 
-	memcpy(new_base, old_base, bytes_used);
+	memcpy(new_base, old_base, bytes_backed);
+	memset(new_base + bytes_backed, 0, bytes_new - bytes_backed);
 
 	packet->ip_bytes	= old_packet->ip_bytes;
+	packet->unbacked_bytes	= bytes_used - bytes_new;
 	packet->direction	= old_packet->direction;
-	packet->time_usecs	= old_packet->time_usecs;
+	packet->time_nsecs	= old_packet->time_nsecs;
 	packet->flags		= old_packet->flags;
 	packet->ecn		= old_packet->ecn;
+	packet->gso_size	= old_packet->gso_size;
+	packet->gso_type	= old_packet->gso_type;
 	packet->socket_script_fd = old_packet->socket_script_fd;
 
+	memcpy(packet->tcp_options, old_packet->tcp_options,
+	       old_packet->num_tcp_options * sizeof(struct tcp_option_slot));
+	packet->num_tcp_options	= old_packet->num_tcp_options;
+	packet->tcp_options_indexed = old_packet->tcp_options_indexed;
+
 	packet_copy_headers(packet, old_packet, bytes_headroom);
 
 	/* Set up layer 3 header pointer. */
@@ -175,7 +190,7 @@ static struct packet *packet_copy_with_headroom(struct packet *old_packet,
 
 struct packet *packet_copy(struct packet *old_packet)
 {
-	return packet_copy_with_headroom(old_packet, 0);
+	return packet_copy_with_headroom(old_packet, 0, true);
 }
 
 /* Finalize all the headers once we know what's inside inner layers. */
@@ -207,7 +222,7 @@ struct packet *packet_encapsulate(struct packet *outer, struct packet *inner)
 	assert(outer_headers + inner_headers <= PACKET_MAX_HEADERS);
 
 	/* Copy the inner packet bits and header metadata. */
-	packet = packet_copy_with_headroom(inner, outer->ip_bytes);
+	packet = packet_copy_with_headroom(inner, outer->ip_bytes, false);
 
 	/* Copy over the bits in the outer headers. */
 	memcpy(packet->buffer, outer->buffer, outer->ip_bytes);
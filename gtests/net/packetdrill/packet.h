@@ -37,6 +37,7 @@
 #include "ip.h"
 #include "ipv6.h"
 #include "tcp.h"
+#include "tun.h"
 #include "udp.h"
 #include "unaligned.h"
 
@@ -48,15 +49,33 @@
 #define MAX_TCP_DATAGRAM_BYTES (64*1024)	/* for sanity-checking */
 #define MAX_UDP_DATAGRAM_BYTES (64*1024)	/* for sanity-checking */
 
+#ifndef IP_MAXPACKET
+#define IP_MAXPACKET 65535	/* maximum IPv4 packet size */
+#endif
+
 /* We allow reading pretty big packets, since some interface MTUs can
  * be pretty big (the Linux loopback MTU, for example, is typically
- * around 16KB).
+ * around 16KB), and with --vnet_hdr we sniff whole TSO super-packets,
+ * each prefixed with a virtio_net_hdr.
  */
-static const int PACKET_READ_BYTES = 64 * 1024;
+static const int PACKET_READ_BYTES =
+	IP_MAXPACKET + sizeof(struct virtio_net_hdr);
 
 /* Maximum number of headers. */
 #define PACKET_MAX_HEADERS	6
 
+/* Maximum number of TCP options in a packet: every option takes at
+ * least one of the (at most) 40 bytes of TCP option space.
+ */
+#define PACKET_MAX_TCP_OPTIONS	(MAX_TCP_HEADER_BYTES - 20)
+
+/* An entry in the index of the TCP options in a packet. */
+struct tcp_option_slot {
+	u8 kind;		/* TCPOPT_* option kind */
+	u8 subtype;		/* MPTCP subtype for TCPOPT_MPTCP, else 0 */
+	u8 offset;		/* option offset from start of TCP options */
+};
+
 /* Maximum number of bytes of headers. */
 #define PACKET_MAX_HEADER_BYTES	256
 
@@ -71,6 +90,7 @@ struct packet {
 	u32 buffer_bytes;	/* bytes of space in data buffer */
 	u32 l2_header_bytes;	/* bytes in outer hardware/layer-2 header */
 	u32 ip_bytes;		/* bytes in outermost IP hdrs/payload */
+	u32 unbacked_bytes;	/* bytes at the end not in the buffer */
 	enum direction_t direction;	/* direction packet is traveling */
 	int socket_script_fd; /* script fd of socket used /to use to send / receive this packet */
 
@@ -97,7 +117,7 @@ struct packet {
 	struct icmpv4 *icmpv4;	/* start of ICMPv4 header, if present */
 	struct icmpv6 *icmpv6;	/* start of ICMPv6 header, if present */
 
-	s64 time_usecs;		/* wall time of receive/send if non-zero */
+	s64 time_nsecs;		/* wall time of receive/send if non-zero */
 
 	u32 flags;		/* various meta-flags */
 #define FLAG_WIN_NOCHECK	0x1  /* don't check TCP receive window */
@@ -105,8 +125,24 @@ struct packet {
 
 	enum ip_ecn_t ecn;	/* IPv4/IPv6 ECN treatment for packet */
 
+	/* Segmentation offload metadata, for --vnet_hdr. For script
+	 * packets a gso_size of 0 means the size is not checked.
+	 */
+	u16 gso_size;		/* payload bytes per segment, or 0 */
+	u8 gso_type;		/* VIRTIO_NET_HDR_GSO_* type of live packet */
+
 	__be32 *tcp_ts_val;	/* location of TCP timestamp val, or NULL */
 	__be32 *tcp_ts_ecr;	/* location of TCP timestamp ecr, or NULL */
+
+	/* Index of the TCP options in the packet, so that lookups do not
+	 * have to re-walk and re-validate the option list. Built by
+	 * tcp_options_index() when the packet is parsed or created, and
+	 * lazily by the lookup functions otherwise. The offsets are
+	 * relative to the TCP options, so they survive packet_copy().
+	 */
+	struct tcp_option_slot tcp_options[PACKET_MAX_TCP_OPTIONS];
+	u8 num_tcp_options;	/* valid entries in tcp_options[] */
+	bool tcp_options_indexed;	/* is tcp_options[] complete and valid? */
 };
 
 /* Allocate and initialize a packet. */
@@ -115,7 +151,9 @@ extern struct packet *packet_new(u32 buffer_length);
 /* Free all the memory used by the packet. */
 extern void packet_free(struct packet *packet);
 
-/* Create a packet that is a copy of the contents of the given packet. */
+/* Create a packet that is a copy of the contents of the given packet.
+ * Any unbacked payload bytes of the old packet are zeroes in the copy.
+ */
 extern struct packet *packet_copy(struct packet *old_packet);
 
 /* Return the number of headers in the given packet. */
@@ -292,6 +330,16 @@ static inline u8 *packet_end(struct packet *packet)
 	return packet_start(packet) + packet->ip_bytes;
 }
 
+/* Return a pointer to the byte beyond the last one in the buffer. With
+ * --payload_pattern, script packets only store their headers, since
+ * their TCP payloads are made up when they are injected or checked;
+ * unbacked_bytes then counts the payload bytes that are not stored.
+ */
+static inline u8 *packet_buffer_end(struct packet *packet)
+{
+	return packet_end(packet) - packet->unbacked_bytes;
+}
+
 /* Return the length of the TCP/UDP payload. */
 static inline int packet_payload_len(struct packet *packet)
 {
@@ -43,6 +43,7 @@
 #include "logging.h"
 #include "packet.h"
 #include "tcp.h"
+#include "tcp_options_iterator.h"
 
 static int parse_ipv4(struct packet *packet, u8 *header_start, u8 *packet_end,
 		      char **error);
@@ -173,6 +174,7 @@ int parse_packet(struct packet *packet, int in_bytes,
 	/* packet_end points to the byte beyond the end of packet. */
 	u8 *packet_end = packet->buffer + in_bytes;
 
+	packet->tcp_options_indexed = false;
 	if (layer == PACKET_LAYER_2_ETHERNET)
 		result = parse_layer2_packet(packet, header_start, packet_end,
 					     error);
@@ -385,6 +387,11 @@ static int parse_tcp(struct packet *packet, u8 *layer4_start, int layer4_bytes,
 	}
 	tcp_header->total_bytes = layer4_bytes;
 
+	/* Index the options now, so later lookups need not re-walk them.
+	 * Malformed options are reported by whoever looks at them.
+	 */
+	tcp_options_index(packet, NULL);
+
 	p += layer4_bytes;
 	assert(p <= packet_end);
 
@@ -23,6 +23,7 @@
  */
 
 #include "packet_parser.h"
+#include "tcp_options_iterator.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -68,10 +69,25 @@ static void test_parse_tcp_ipv4_packet(void)
 	assert(packet->icmpv4		== NULL);
 	assert(packet->icmpv6		== NULL);
 
-	assert(packet->time_usecs	== 0);
+	assert(packet->time_nsecs	== 0);
 	assert(packet->flags		== 0);
 	assert(packet->ecn		== 0);
 
+	/* The SACK and TS options should be indexed, also in a copy. */
+	assert(packet->tcp_options_indexed);
+	assert(packet->num_tcp_options	== 2);
+	assert(packet->tcp_options[0].kind	== TCPOPT_SACK);
+	assert(packet->tcp_options[0].offset	== 0);
+	assert(packet->tcp_options[1].kind	== TCPOPT_TIMESTAMP);
+	assert(packet->tcp_options[1].offset	== 10);
+
+	struct packet *copy = packet_copy(packet);
+	struct tcp_option *ts = get_tcp_option(copy, TCPOPT_TIMESTAMP);
+	assert(ts == (struct tcp_option *)(packet_tcp_options(copy) + 10));
+	assert(ntohl(ts->data.time_stamp.val) == 300);
+	assert(get_tcp_option(copy, TCPOPT_MAXSEG) == NULL);
+	packet_free(copy);
+
 	packet_free(packet);
 }
 
@@ -115,7 +131,7 @@ static void test_parse_tcp_ipv6_packet(void)
 	assert(packet->icmpv4		== NULL);
 	assert(packet->icmpv6		== NULL);
 
-	assert(packet->time_usecs	== 0);
+	assert(packet->time_nsecs	== 0);
 	assert(packet->flags		== 0);
 	assert(packet->ecn		== 0);
 
@@ -155,7 +171,7 @@ static void test_parse_udp_ipv4_packet(void)
 	assert(packet->icmpv4		== NULL);
 	assert(packet->icmpv6		== NULL);
 
-	assert(packet->time_usecs	== 0);
+	assert(packet->time_nsecs	== 0);
 	assert(packet->flags		== 0);
 	assert(packet->ecn		== 0);
 
@@ -199,7 +215,7 @@ static void test_parse_udp_ipv6_packet(void)
 	assert(packet->icmpv4		== NULL);
 	assert(packet->icmpv6		== NULL);
 
-	assert(packet->time_usecs	== 0);
+	assert(packet->time_nsecs	== 0);
 	assert(packet->flags		== 0);
 	assert(packet->ecn		== 0);
 
@@ -277,7 +293,7 @@ static void test_parse_ipv4_gre_ipv4_tcp_packet(void)
 	assert(packet->icmpv4		== NULL);
 	assert(packet->icmpv6		== NULL);
 
-	assert(packet->time_usecs	== 0);
+	assert(packet->time_nsecs	== 0);
 	assert(packet->flags		== 0);
 	assert(packet->ecn		== 0);
 
@@ -375,7 +391,7 @@ static void test_parse_ipv4_gre_mpls_ipv4_tcp_packet(void)
 	assert(packet->icmpv4		== NULL);
 	assert(packet->icmpv6		== NULL);
 
-	assert(packet->time_usecs	== 0);
+	assert(packet->time_nsecs	== 0);
 	assert(packet->flags		== 0);
 	assert(packet->ecn		== 0);
 
@@ -417,7 +433,7 @@ static void test_parse_icmpv4_packet(void)
 	assert(packet->icmpv4		== expected_icmpv4);
 	assert(packet->icmpv6		== NULL);
 
-	assert(packet->time_usecs	== 0);
+	assert(packet->time_nsecs	== 0);
 	assert(packet->flags		== 0);
 	assert(packet->ecn		== 0);
 
@@ -470,7 +486,7 @@ static void test_parse_icmpv6_packet(void)
 	assert(packet->icmpv4		== NULL);
 	assert(packet->icmpv6		== expected_icmpv6);
 
-	assert(packet->time_usecs	== 0);
+	assert(packet->time_nsecs	== 0);
 	assert(packet->flags		== 0);
 	assert(packet->ecn		== 0);
 
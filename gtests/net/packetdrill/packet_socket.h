@@ -49,6 +49,30 @@ extern void packet_socket_set_filter(
 	const struct ether_addr *client_ether_addr,
 	const struct ip_address *client_live_ip);
 
+/* Largest number of ports packet_socket_set_port_filter() checks one by
+ * one; with more ports all outbound TCP and UDP packets are kept.
+ */
+#define PACKET_FILTER_MAX_PORTS	100
+
+/* Add a filter for local mode that only keeps packets the kernel sends
+ * out: ICMP, ICMPv6 and tunnelled packets, plus TCP and UDP packets
+ * whose source or destination port is one of the num_ports given ports
+ * (in host byte order).
+ */
+extern void packet_socket_set_port_filter(struct packet_socket *psock,
+					  const u16 *ports, int num_ports);
+
+/* Ask the kernel to prepend a virtio_net_hdr to each sniffed packet,
+ * so packet_socket_receive() can fill in the GSO metadata of
+ * super-packets. Linux only.
+ */
+extern void packet_socket_set_vnet_hdr(struct packet_socket *psock);
+
+/* Discard any packets already sniffed but not yet received, e.g. left
+ * over from a previous script.
+ */
+extern void packet_socket_drain(struct packet_socket *psock);
+
 /* Send the given packet using writev. Return STATUS_OK on success,
  * or STATUS_ERR if writev returns an error.
  */
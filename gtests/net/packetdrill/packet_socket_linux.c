@@ -40,6 +40,11 @@
 
 #include "ethernet.h"
 #include "logging.h"
+#include "tun.h"
+
+#ifndef PACKET_VNET_HDR
+#define PACKET_VNET_HDR 15
+#endif
 
 /* Number of bytes to buffer in the packet socket we use for sniffing. */
 static const int PACKET_SOCKET_RCVBUF_BYTES = 2*1024*1024;
@@ -48,6 +53,7 @@ struct packet_socket {
 	int packet_fd;	/* socket for sending, sniffing timestamped packets */
 	char *name;	/* malloc-allocated copy of interface name */
 	int index;	/* interface index from if_nametoindex */
+	bool vnet_hdr;	/* packets are prefixed with a virtio_net_hdr */
 };
 
 /* Set the receive buffer for a socket to the given size in bytes. */
@@ -91,6 +97,12 @@ static void packet_socket_setup(struct packet_socket *psock)
 	bind_to_interface(psock->packet_fd, psock->index);
 
 	set_receive_buffer_size(psock->packet_fd, PACKET_SOCKET_RCVBUF_BYTES);
+
+	/* Have the kernel timestamp sniffed packets in nanoseconds. */
+	int on = 1;
+	if (setsockopt(psock->packet_fd, SOL_SOCKET, SO_TIMESTAMPNS,
+		       &on, sizeof(on)) < 0)
+		die_perror("setsockopt SOL_SOCKET SO_TIMESTAMPNS");
 }
 
 /* Add a filter so we only sniff packets we want. */
@@ -180,6 +192,158 @@ void packet_socket_set_filter(struct packet_socket *psock,
 	}
 }
 
+/* Helpers to emit classic BPF instructions for the port filter. */
+struct filter_prog {
+	struct sock_filter insns[32 + 2 * PACKET_FILTER_MAX_PORTS];
+	int len;
+};
+
+static int emit(struct filter_prog *prog, u16 code, u32 k)
+{
+	assert(prog->len < ARRAY_SIZE(prog->insns));
+	prog->insns[prog->len] = (struct sock_filter)BPF_STMT(code, k);
+	return prog->len++;
+}
+
+/* Emit a conditional jump; targets are patched by set_jump_targets(). */
+static int emit_jump(struct filter_prog *prog, u16 code, u32 k)
+{
+	assert(prog->len < ARRAY_SIZE(prog->insns));
+	prog->insns[prog->len] = (struct sock_filter)BPF_JUMP(code, k, 0, 0);
+	return prog->len++;
+}
+
+/* Point the true and false branches of the jump at index insn to the
+ * given absolute instruction indices (-1 means fall through).
+ */
+static void set_jump_targets(struct filter_prog *prog, int insn,
+			     int jump_true, int jump_false)
+{
+	if (jump_true >= 0) {
+		assert(jump_true - insn - 1 <= 255);
+		prog->insns[insn].jt = jump_true - insn - 1;
+	}
+	if (jump_false >= 0) {
+		assert(jump_false - insn - 1 <= 255);
+		prog->insns[insn].jf = jump_false - insn - 1;
+	}
+}
+
+void packet_socket_set_port_filter(struct packet_socket *psock,
+				   const u16 *ports, int num_ports)
+{
+	struct filter_prog prog;
+	int outgoing, is_v4, v4_l4[3], v4_frag, v4_ports;
+	int is_v6, v6_l4[3], v6_ports, src_port, port_checks, accept, drop;
+	int ip_proto_ports[4];
+	int i, num_checks = 0;
+	struct sock_fprog bpfcode;
+
+	memset(&prog, 0, sizeof(prog));
+	if (num_ports > PACKET_FILTER_MAX_PORTS)
+		num_ports = 0;		/* too many: keep all TCP and UDP */
+
+	/* Only packets the kernel is sending out. */
+	emit(&prog, BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE);
+	outgoing = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING);
+
+	/* The tun device has no link layer, so the IP header is at 0. */
+	emit(&prog, BPF_LD | BPF_B | BPF_ABS, 0);
+	emit(&prog, BPF_ALU | BPF_RSH | BPF_K, 4);
+	is_v4 = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, 4);
+
+	/* IPv4: keep ICMP and tunnels, check ports of TCP and UDP. */
+	emit(&prog, BPF_LD | BPF_B | BPF_ABS, 9);
+	v4_l4[0] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP);
+	v4_l4[1] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_GRE);
+	v4_l4[2] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_IPIP);
+	ip_proto_ports[0] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K,
+				      IPPROTO_TCP);
+	ip_proto_ports[1] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K,
+				      IPPROTO_UDP);
+	/* Non-first fragments carry no ports; keep them. */
+	v4_ports = emit(&prog, BPF_LD | BPF_H | BPF_ABS, 6);
+	v4_frag = emit_jump(&prog, BPF_JMP | BPF_JSET | BPF_K, 0x1fff);
+	emit(&prog, BPF_LDX | BPF_B | BPF_MSH, 0);
+	emit(&prog, BPF_JMP | BPF_JA, 0);	/* patched below */
+
+	/* IPv6: same, without following extension headers. */
+	is_v6 = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, 6);
+	emit(&prog, BPF_LD | BPF_B | BPF_ABS, 6);
+	v6_l4[0] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMPV6);
+	v6_l4[1] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_GRE);
+	v6_l4[2] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_IPV6);
+	ip_proto_ports[2] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K,
+				      IPPROTO_TCP);
+	ip_proto_ports[3] = emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K,
+				      IPPROTO_UDP);
+	v6_ports = emit(&prog, BPF_LDX | BPF_W | BPF_IMM, sizeof(struct ipv6));
+
+	/* X holds the transport header offset; compare both ports. */
+	src_port = emit(&prog, BPF_LD | BPF_H | BPF_IND, 0);
+	port_checks = prog.len;
+	for (i = 0; i < num_ports; ++i)
+		emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, ports[i]);
+	if (num_ports > 0) {
+		emit(&prog, BPF_LD | BPF_H | BPF_IND, 2);
+		for (i = 0; i < num_ports; ++i)
+			emit_jump(&prog, BPF_JMP | BPF_JEQ | BPF_K, ports[i]);
+		num_checks = 2 * num_ports + 1;
+		drop = emit(&prog, BPF_RET | BPF_K, 0);
+	} else {
+		drop = -1;
+	}
+	/* Keep whole packets, including GSO super-packets. */
+	accept = emit(&prog, BPF_RET | BPF_K, 0xffffffff);
+	if (drop < 0)
+		drop = emit(&prog, BPF_RET | BPF_K, 0);
+
+	set_jump_targets(&prog, outgoing, -1, drop);
+	set_jump_targets(&prog, is_v4, -1, is_v6);
+	for (i = 0; i < ARRAY_SIZE(v4_l4); ++i)
+		set_jump_targets(&prog, v4_l4[i], accept, -1);
+	set_jump_targets(&prog, ip_proto_ports[0], v4_ports, -1);
+	set_jump_targets(&prog, ip_proto_ports[1], v4_ports, drop);
+	set_jump_targets(&prog, v4_frag, accept, -1);
+	prog.insns[is_v6 - 1].k = src_port - is_v6;	/* the ja */
+	set_jump_targets(&prog, is_v6, -1, drop);
+	for (i = 0; i < ARRAY_SIZE(v6_l4); ++i)
+		set_jump_targets(&prog, v6_l4[i], accept, -1);
+	set_jump_targets(&prog, ip_proto_ports[2], v6_ports, -1);
+	set_jump_targets(&prog, ip_proto_ports[3], v6_ports, drop);
+	for (i = 0; i < num_checks; ++i) {
+		if (BPF_OP(prog.insns[port_checks + i].code) == BPF_JEQ)
+			set_jump_targets(&prog, port_checks + i, accept, -1);
+	}
+
+	bpfcode.len	= prog.len;
+	bpfcode.filter	= prog.insns;
+
+	if (DEBUG_LOGGING) {
+		DEBUGP("port filter (%d ports):\n", num_ports);
+		for (i = 0; i < bpfcode.len; ++i)
+			DEBUGP("{ 0x%x, %d, %d, 0x%08x }\n",
+			       bpfcode.filter[i].code, bpfcode.filter[i].jt,
+			       bpfcode.filter[i].jf, bpfcode.filter[i].k);
+	}
+
+	/* Attaching a new filter atomically replaces the previous one. */
+	if (setsockopt(psock->packet_fd, SOL_SOCKET, SO_ATTACH_FILTER,
+		       &bpfcode, sizeof(bpfcode)) < 0) {
+		die_perror("setsockopt SOL_SOCKET, SO_ATTACH_FILTER");
+	}
+}
+
+void packet_socket_set_vnet_hdr(struct packet_socket *psock)
+{
+	int on = 1;
+
+	if (setsockopt(psock->packet_fd, SOL_PACKET, PACKET_VNET_HDR,
+		       &on, sizeof(on)) < 0)
+		die_perror("setsockopt SOL_PACKET, PACKET_VNET_HDR");
+	psock->vnet_hdr = true;
+}
+
 struct packet_socket *packet_socket_new(const char *device_name)
 {
 	struct packet_socket *psock = calloc(1, sizeof(struct packet_socket));
@@ -204,6 +368,19 @@ void packet_socket_free(struct packet_socket *psock)
 	free(psock);
 }
 
+void packet_socket_drain(struct packet_socket *psock)
+{
+	char byte;
+	int drained = 0;
+
+	while (recv(psock->packet_fd, &byte, sizeof(byte),
+		    MSG_DONTWAIT | MSG_TRUNC) >= 0)
+		++drained;
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+		die_perror("packet socket recv");
+	DEBUGP("drained %d stale packets\n", drained);
+}
+
 int packet_socket_writev(struct packet_socket *psock,
 			 const struct iovec *iov, int iovcnt)
 {
@@ -222,10 +399,48 @@ int packet_socket_receive(struct packet_socket *psock,
 	memset(&from, 0, sizeof(from));
 	socklen_t from_len = sizeof(from);
 
-	/* Read the packet out of our kernel packet socket buffer. */
-	*in_bytes = recvfrom(psock->packet_fd,
-			     packet->buffer, packet->buffer_bytes, 0,
-			     (struct sockaddr *)&from, &from_len);
+	/* Read the packet out of our kernel packet socket buffer, along
+	 * with the SCM_TIMESTAMPNS time at which the kernel sniffed it.
+	 */
+	struct virtio_net_hdr hdr;
+	struct iovec iov[2];
+	int iovlen = 0;
+	union {
+		char buf[CMSG_SPACE(sizeof(struct timespec))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+
+	if (psock->vnet_hdr) {
+		iov[iovlen].iov_base	= &hdr;
+		iov[iovlen].iov_len	= sizeof(hdr);
+		++iovlen;
+	}
+	iov[iovlen].iov_base	= packet->buffer;
+	iov[iovlen].iov_len	= packet->buffer_bytes;
+	++iovlen;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name		= &from;
+	msg.msg_namelen		= from_len;
+	msg.msg_iov		= iov;
+	msg.msg_iovlen		= iovlen;
+	msg.msg_control		= control.buf;
+	msg.msg_controllen	= sizeof(control.buf);
+
+	*in_bytes = recvmsg(psock->packet_fd, &msg, 0);
+	if (psock->vnet_hdr) {
+		if (*in_bytes >= (int)sizeof(hdr)) {
+			*in_bytes -= sizeof(hdr);
+			packet->gso_type = hdr.gso_type;
+			packet->gso_size = (hdr.gso_type ==
+					    VIRTIO_NET_HDR_GSO_NONE) ?
+				0 : hdr.gso_size;
+		} else if (*in_bytes >= 0) {
+			DEBUGP("short read of virtio_net_hdr\n");
+			return STATUS_ERR;
+		}
+	}
 	assert(*in_bytes <= packet->buffer_bytes);
 	if (*in_bytes < 0) {
 		if (errno == EINTR) {
@@ -259,13 +474,20 @@ int packet_socket_receive(struct packet_socket *psock,
 	}
 
 	/* Get the time at which the kernel sniffed the packet. */
-	struct timeval tv;
-	if (ioctl(psock->packet_fd, SIOCGSTAMP, &tv) < 0)
-		die_perror("SIOCGSTAMP");
-	packet->time_usecs = timeval_to_usecs(&tv);
-	DEBUGP("sniffed packet sent at %u.%u = %lld\n",
-	       (u32)tv.tv_sec, (u32)tv.tv_usec,
-	       packet->time_usecs);
+	struct cmsghdr *cmsg;
+	packet->time_nsecs = 0;
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			struct timespec ts;
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			packet->time_nsecs = timespec_to_nsecs(&ts);
+		}
+	}
+	if (packet->time_nsecs == 0)
+		die("packet socket: no SCM_TIMESTAMPNS for sniffed packet\n");
+	DEBUGP("sniffed packet sent at %lld\n", packet->time_nsecs);
 
 	return STATUS_OK;
 }
@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <net/if.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -50,14 +51,15 @@ struct packet_socket {
 	pcap_t *pcap;	/* handle for sending, sniffing timestamped packets */
 	char pcap_error[PCAP_ERRBUF_SIZE];	/* for libpcap errors */
 	int pcap_offset;  /* offset of packet data in pcap buffer */
+	bool nano_tstamps;	/* pcap ts.tv_usec field holds nanoseconds? */
 };
 
 #if defined(__OpenBSD__)
 #include <net/bpf.h>
-/* Convert a bpf_timeval to microseconds. */
-static inline s64 bpf_timeval_to_usecs(const struct bpf_timeval *tv)
+/* Convert a bpf_timeval to nanoseconds. */
+static inline s64 bpf_timeval_to_nsecs(const struct bpf_timeval *tv)
 {
-	return ((s64)tv->tv_sec) * 1000000LL + (s64)tv->tv_usec;
+	return ((s64)tv->tv_sec) * 1000000000LL + (s64)tv->tv_usec * 1000LL;
 }
 #endif /* defined(__OpenBSD__) */
 
@@ -81,6 +83,15 @@ static void packet_socket_setup(struct packet_socket *psock)
 	if (pcap_set_snaplen(psock->pcap, PACKET_READ_BYTES) != 0)
 		die_pcap_perror(psock->pcap, "pcap_set_snaplen");
 
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+	/* Ask for nanosecond timestamps where libpcap and the capture
+	 * device support them; otherwise we get microseconds.
+	 */
+	psock->nano_tstamps =
+		(pcap_set_tstamp_precision(psock->pcap,
+					   PCAP_TSTAMP_PRECISION_NANO) == 0);
+#endif
+
 	if (pcap_activate(psock->pcap) != 0)
 		die_pcap_perror(psock->pcap,
 				"pcap_activate "
@@ -160,6 +171,42 @@ void packet_socket_set_filter(struct packet_socket *psock,
 	free(filter_str);
 }
 
+void packet_socket_set_port_filter(struct packet_socket *psock,
+				   const u16 *ports, int num_ports)
+{
+	struct bpf_program bpf_code;
+	char *filter_str = NULL;
+	char *port_str = NULL;
+	size_t port_str_len = 0;
+	FILE *s = open_memstream(&port_str, &port_str_len);
+	int i;
+
+	if (num_ports > PACKET_FILTER_MAX_PORTS)
+		num_ports = 0;		/* too many: keep all TCP and UDP */
+	for (i = 0; i < num_ports; ++i)
+		fprintf(s, "%sport %u", i > 0 ? " or " : "", ports[i]);
+	fclose(s);
+
+	asprintf(&filter_str,
+		 "icmp or icmp6 or proto gre or "
+		 "((tcp or udp)%s%s%s)",
+		 num_ports > 0 ? " and (" : "",
+		 port_str,
+		 num_ports > 0 ? ")" : "");
+
+	DEBUGP("setting BPF filter: %s\n", filter_str);
+
+	if (pcap_compile(psock->pcap, &bpf_code, filter_str, 1, 0) != 0)
+		die_pcap_perror(psock->pcap, "pcap_compile");
+
+	if (pcap_setfilter(psock->pcap, &bpf_code) != 0)
+		die_pcap_perror(psock->pcap, "pcap_setfilter");
+
+	pcap_freecode(&bpf_code);
+	free(filter_str);
+	free(port_str);
+}
+
 struct packet_socket *packet_socket_new(const char *device_name)
 {
 	struct packet_socket *psock = calloc(1, sizeof(struct packet_socket));
@@ -182,6 +229,22 @@ void packet_socket_free(struct packet_socket *psock)
 	free(psock);
 }
 
+/* pcap_dispatch() callback that ignores the packet. */
+static void discard_packet(u_char *user, const struct pcap_pkthdr *header,
+			   const u_char *data)
+{
+}
+
+void packet_socket_drain(struct packet_socket *psock)
+{
+	if (pcap_setnonblock(psock->pcap, 1, psock->pcap_error) < 0)
+		die_pcap_perror(psock->pcap, "pcap_setnonblock");
+	while (pcap_dispatch(psock->pcap, -1, discard_packet, NULL) > 0)
+		;
+	if (pcap_setnonblock(psock->pcap, 0, psock->pcap_error) < 0)
+		die_pcap_perror(psock->pcap, "pcap_setnonblock");
+}
+
 int packet_socket_writev(struct packet_socket *psock,
 			 const struct iovec *iov, int iovcnt)
 {
@@ -253,14 +316,24 @@ int packet_socket_receive(struct packet_socket *psock,
 	       (u32)pkt_header->ts.tv_usec);
 
 #if defined(__FreeBSD__) || defined(__NetBSD__)
-	packet->time_usecs = timeval_to_usecs(&pkt_header->ts);
+	if (psock->nano_tstamps)
+		packet->time_nsecs =
+			(s64)pkt_header->ts.tv_sec * 1000000000LL +
+			(s64)pkt_header->ts.tv_usec;
+	else
+		packet->time_nsecs = timeval_to_nsecs(&pkt_header->ts);
 #elif defined(__OpenBSD__)
-	packet->time_usecs = bpf_timeval_to_usecs(&pkt_header->ts);
+	if (psock->nano_tstamps)
+		packet->time_nsecs =
+			(s64)pkt_header->ts.tv_sec * 1000000000LL +
+			(s64)pkt_header->ts.tv_usec;
+	else
+		packet->time_nsecs = bpf_timeval_to_nsecs(&pkt_header->ts);
 #else
-	packet->time_usecs = implement_me("implement me for your platform");
+	packet->time_nsecs = implement_me("implement me for your platform");
 #endif  /* defined(__OpenBSD__) */
 
-	DEBUGP("time_usecs= %llu\n", packet->time_usecs);
+	DEBUGP("time_nsecs= %llu\n", packet->time_nsecs);
 
 	DEBUGP("pcap_next_ex: caplen:%u len:%u offset:%d\n",
 	       pkt_header->caplen, pkt_header->len, psock->pcap_offset);
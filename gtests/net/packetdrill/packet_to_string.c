@@ -45,7 +45,8 @@ static void endpoints_to_string(FILE *s, const struct packet *packet)
 static void packet_buffer_to_string(FILE *s, struct packet *packet)
 {
 	char *hex = NULL;
-	hex_dump(packet->buffer, packet_end(packet) - packet->buffer, &hex);
+	hex_dump(packet->buffer, packet_buffer_end(packet) - packet->buffer,
+		 &hex);
 	fputc('\n', s);
 	fprintf(s, "%s", hex);
 	free(hex);
@@ -161,6 +162,9 @@ static int tcp_packet_to_string(FILE *s, struct packet *packet,
 	if (!(packet->flags & FLAG_WIN_NOCHECK))
 		fprintf(s, "win %u ", ntohs(packet->tcp->window));
 
+	if (packet->gso_size != 0)
+		fprintf(s, "gso %u ", packet->gso_size);
+
 	if (packet_tcp_options_len(packet) > 0) {
 		char *tcp_options = NULL;
 		if (tcp_options_to_string(packet, &tcp_options, error))
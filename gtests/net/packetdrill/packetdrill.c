@@ -31,6 +31,7 @@
 #include <string.h>
 #include <unistd.h>
 #include "config.h"
+#include "fuzz.h"
 #include "parse.h"
 #include "run.h"
 #include "script.h"
@@ -101,12 +102,19 @@ int main(int argc, char *argv[])
 						script_path, NULL))
 			exit(EXIT_FAILURE);
 
+		/* Put back any mutations saved by a fuzzing run. */
+		if (config.fuzz_mutations != NULL)
+			fuzz_replay(&config, &script);
+
 		/* If --dry_run, then don't actually execute the script. */
 		if (config.dry_run)
 			continue;
 
 		run_init_scripts(&config);
-		run_script(&config, &script);
+		if (config.fuzz_iterations > 0)
+			run_fuzz(&config, &script);
+		else
+			run_script(&config, &script);
 	}
 
 	return 0;
@@ -347,8 +347,8 @@ static struct event *new_event(enum event_t type)
 {
 	struct event *e = calloc(1, sizeof(struct event));
 	e->type = type;
-	e->time_usecs_end = NO_TIME_RANGE;
-	e->offset_usecs = NO_TIME_RANGE;
+	e->time_nsecs_end = NO_TIME_RANGE;
+	e->offset_nsecs = NO_TIME_RANGE;
 	return e;
 }
 
@@ -710,7 +710,7 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 	double floating;
 	char *string;
 	char *reserved;
-	s64 time_usecs;
+	s64 time_nsecs;
 	enum direction_t direction;
 	enum ip_ecn_t ip_ecn;
 	struct mpls_stack *mpls_stack;
@@ -772,7 +772,10 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
  */
 %token ELLIPSIS
 %token <reserved> SA_FAMILY SIN_PORT SIN_ADDR _HTONS_ INET_ADDR
-%token <reserved> MSG_NAME MSG_IOV MSG_FLAGS
+%token <reserved> MSG_NAME MSG_IOV MSG_FLAGS MSG_CONTROL MSG_HDR MSG_LEN
+%token <reserved> CMSG_LEVEL CMSG_TYPE CMSG_DATA
+%token <reserved> EE_ERRNO EE_ORIGIN EE_TYPE EE_CODE EE_INFO EE_DATA
+%token <reserved> ZC_ADDRESS ZC_LENGTH ZC_RECV_SKIP_HINT ZC_INQ ZC_ERR
 %token <reserved> FD EVENTS REVENTS ONOFF LINGER
 %token <reserved> ACK ECR EOL MSS NOP SACK SACKOK TIMESTAMP VAL WIN WSCALE PRO SOCK
 %token <reserved> MP_CAPABLE MP_CAPABLE_NO_CS MP_FASTCLOSE FLAG_A FLAG_B FLAG_C FLAG_D FLAG_E FLAG_F FLAG_G FLAG_H NO_FLAGS
@@ -784,7 +787,7 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 %token <reserved> MP_PRIO
 %token <reserved> FAST_OPEN
 %token <reserved> ECT0 ECT1 CE ECT01 NO_ECN
-%token <reserved> IPV4 IPV6 ICMP UDP GRE MTU
+%token <reserved> IPV4 IPV6 ICMP UDP GRE MTU GSO
 %token <reserved> MPLS LABEL TC TTL
 %token <reserved> OPTION
 %token <floating> FLOAT
@@ -795,7 +798,7 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 %type <ip_ecn> ip_ecn
 %type <option> option options opt_options
 %type <event> event events event_time action
-%type <time_usecs> time opt_end_time
+%type <time_nsecs> time opt_end_time
 %type <packet> packet_spec tcp_packet_spec udp_packet_spec icmp_packet_spec
 %type <packet> packet_prefix
 %type <syscall> syscall_spec
@@ -812,6 +815,7 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 %type <string> opt_note note word_list
 %type <string> option_flag option_value script
 %type <window> opt_window
+%type <integer> opt_gso
 %type <sequence_number> opt_ack
 %type <tcp_sequence_info> seq opt_icmp_echoed
 %type <mptcp_dsn_info> dsn add_to_var
@@ -826,6 +830,8 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 %type <expression> expression binary_expression array
 %type <expression> decimal_integer hex_integer
 %type <expression> inaddr sockaddr msghdr iovec pollfd opt_revents linger
+%type <expression> opt_msg_control cmsghdr sock_extended_err
+%type <expression> tcp_zerocopy_receive epoll_event mmsghdr
 %type <errno_info> opt_errno
 
 %%  /* The grammar follows. */
@@ -862,6 +868,9 @@ option
 : option_flag '=' option_value {
 	$$ = new_option($1, $3);
 }
+| option_flag {
+	$$ = new_option($1, NULL);
+}
 
 option_flag
 : OPTION	{ $$ = $1; }
@@ -902,12 +911,12 @@ event
 : event_time action  {
 	$$ = $2;
 	$$->line_number = $1->line_number;   /* use timestamp's line */
-	$$->time_usecs  = $1->time_usecs;
-	$$->time_usecs_end  = $1->time_usecs_end;
+	$$->time_nsecs  = $1->time_nsecs;
+	$$->time_nsecs_end  = $1->time_nsecs_end;
 	$$->time_type = $1->time_type;
 
-	if ($$->time_usecs_end != NO_TIME_RANGE) {
-		if ($$->time_usecs_end < $$->time_usecs)
+	if ($$->time_nsecs_end != NO_TIME_RANGE) {
+		if ($$->time_nsecs_end < $$->time_nsecs)
 			semantic_error("time range is backwards");
 	}
 	if ($$->time_type == ANY_TIME &&  ($$->type != PACKET_EVENT ||
@@ -931,13 +940,13 @@ event_time
 : '+' time	{
 	$$ = new_event(INVALID_EVENT);
 	$$->line_number = @2.first_line;
-	$$->time_usecs = $2;
+	$$->time_nsecs = $2;
 	$$->time_type = RELATIVE_TIME;
 }
 | time         {
 	$$ = new_event(INVALID_EVENT);
 	$$->line_number = @1.first_line;
-	$$->time_usecs = $1;
+	$$->time_nsecs = $1;
 	$$->time_type = ABSOLUTE_TIME;
 }
 | '*'		{
@@ -949,15 +958,15 @@ event_time
 	$$ = new_event(INVALID_EVENT);
 	$$->line_number = @1.first_line;
 	$$->time_type = ABSOLUTE_RANGE_TIME;
-	$$->time_usecs = $1;
-	$$->time_usecs_end = $3;
+	$$->time_nsecs = $1;
+	$$->time_nsecs_end = $3;
 }
 | '+' time '~' '+' time {
 	$$ = new_event(INVALID_EVENT);
 	$$->line_number = @1.first_line;
 	$$->time_type = RELATIVE_RANGE_TIME;
-	$$->time_usecs = $2;
-	$$->time_usecs_end = $5;
+	$$->time_nsecs = $2;
+	$$->time_nsecs_end = $5;
 }
 ;
 
@@ -966,13 +975,16 @@ time
 	if ($1 < 0) {
 		semantic_error("negative time");
 	}
-	$$ = (s64)($1 * 1.0e6); /* convert float secs to s64 microseconds */
+	/* Convert float secs to s64 nanoseconds, rounding to the nearest
+	 * nanosecond so that e.g. .0000015 is not truncated to 1499 ns.
+	 */
+	$$ = (s64)($1 * 1.0e9 + 0.5);
 }
 | INTEGER	{
 	if ($1 < 0) {
 		semantic_error("negative time");
 	}
-	$$ = (s64)($1 * 1000000); /* convert int secs to s64 microseconds */
+	$$ = (s64)($1 * 1000000000LL); /* convert int secs to s64 nanoseconds */
 }
 ;
 
@@ -995,35 +1007,49 @@ socket_fd_spec
 ;
 
 tcp_packet_spec
-: packet_prefix opt_ip_info flags seq opt_ack opt_window opt_tcp_options socket_fd_spec {
+: packet_prefix opt_ip_info flags seq opt_ack opt_window opt_gso opt_tcp_options socket_fd_spec {
 	char *error = NULL;
 	struct packet *outer = $1, *inner = NULL;
 	enum direction_t direction = outer->direction;
 
-	if (($7 == NULL) && (direction != DIRECTION_OUTBOUND)) {
-		yylineno = @7.first_line;
+	if (($8 == NULL) && (direction != DIRECTION_OUTBOUND)) {
+		yylineno = @8.first_line;
 		semantic_error("<...> for TCP options can only be used with "
 			       "outbound packets");
 	}
+	if (($7 != 0) && !in_config->vnet_hdr) {
+		yylineno = @7.first_line;
+		semantic_error("gso requires --vnet_hdr");
+	}
+	if (($7 != 0) && ($4.payload_bytes <= $7)) {
+		yylineno = @7.first_line;
+		semantic_error("gso size must be smaller than the payload");
+	}
 
-	inner = new_tcp_packet($8, in_config->wire_protocol,
+	inner = new_tcp_packet($9, in_config->wire_protocol,
 			       direction, $2, $3,
 			       $4.start_sequence, $4.payload_bytes,
-			       $5, $6, $7, &error);
+			       $5, $6, $8, &error);
 	free($3);
-	free($7);
+	free($8);
 	if (inner == NULL) {
 		assert(error != NULL);
 		semantic_error(error);
 		free(error);
 	}
+	/* With --payload_pattern the payload is made up when the packet
+	 * is injected or checked, so don't keep the zeroes around.
+	 */
+	if (in_config->payload_pattern)
+		inner->unbacked_bytes = $4.payload_bytes;
 
 	$$ = packet_encapsulate_and_free(outer, inner);
+	$$->gso_size = $7;
 }
 ;
 
 udp_packet_spec
-: packet_prefix UDP '(' INTEGER ')' {
+: packet_prefix UDP '(' INTEGER ')' opt_gso {
 	char *error = NULL;
 	struct packet *outer = $1, *inner = NULL;
 	enum direction_t direction = outer->direction;
@@ -1031,6 +1057,14 @@ udp_packet_spec
 	if (!is_valid_u16($4)) {
 		semantic_error("UDP payload size out of range");
 	}
+	if (($6 != 0) && !in_config->vnet_hdr) {
+		yylineno = @6.first_line;
+		semantic_error("gso requires --vnet_hdr");
+	}
+	if (($6 != 0) && ($4 <= $6)) {
+		yylineno = @6.first_line;
+		semantic_error("gso size must be smaller than the payload");
+	}
 
 	inner = new_udp_packet(in_config->wire_protocol, direction, $4, &error);
 	if (inner == NULL) {
@@ -1040,6 +1074,7 @@ udp_packet_spec
 	}
 
 	$$ = packet_encapsulate_and_free(outer, inner);
+	$$->gso_size = $6;
 }
 ;
 
@@ -1245,6 +1280,16 @@ opt_window
 }
 ;
 
+opt_gso
+:		{ $$ = 0; }
+| GSO INTEGER	{
+	if (!is_valid_u16($2) || ($2 == 0)) {
+		semantic_error("GSO segment size out of range");
+	}
+	$$ = $2;
+}
+;
+
 opt_tcp_options
 :                             { $$ = tcp_options_new(); }
 | '<' tcp_option_list '>'     { $$ = $2; }
@@ -1257,12 +1302,14 @@ tcp_option_list
 	if (tcp_options_append($$, $1)) {
 		semantic_error("TCP option list too long");
 	}
+	free($1);
 }
 | tcp_option_list ',' tcp_option   {
 	$$ = $1;
 	if (tcp_options_append($$, $3)) {
 		semantic_error("TCP option list too long");
 	}
+	free($3);
 }
 ;
 
@@ -1853,7 +1900,7 @@ syscall_spec
 : opt_end_time function_name function_arguments '='
   expression opt_errno opt_note  {
 	$$ = calloc(1, sizeof(struct syscall_spec));
-	$$->end_usecs	= $1;
+	$$->end_nsecs	= $1;
 	$$->name	= $2;
 	$$->arguments	= $3;
 	$$->result	= $5;
@@ -1916,6 +1963,9 @@ expression
 | msghdr            {
 	$$ = $1;
 }
+| mmsghdr           {
+	$$ = $1;
+}
 | iovec             {
 	$$ = $1;
 }
@@ -1925,6 +1975,18 @@ expression
 | linger            {
 	$$ = $1;
 }
+| cmsghdr           {
+	$$ = $1;
+}
+| sock_extended_err {
+	$$ = $1;
+}
+| tcp_zerocopy_receive {
+	$$ = $1;
+}
+| epoll_event       {
+	$$ = $1;
+}
 ;
 
 decimal_integer
@@ -2004,6 +2066,7 @@ sockaddr
 msghdr
 : '{' MSG_NAME '(' ELLIPSIS ')' '=' ELLIPSIS ','
       MSG_IOV '(' decimal_integer ')' '=' array ','
+      opt_msg_control
       MSG_FLAGS '=' expression '}' {
 	struct msghdr_expr *msg_expr = calloc(1, sizeof(struct msghdr_expr));
 	$$ = new_expression(EXPR_MSGHDR);
@@ -2012,8 +2075,54 @@ msghdr
 	msg_expr->msg_namelen	= new_expression(EXPR_ELLIPSIS);
 	msg_expr->msg_iov	= $14;
 	msg_expr->msg_iovlen	= $11;
-	msg_expr->msg_flags	= $18;
-	/* TODO(ncardwell): msg_control, msg_controllen */
+	msg_expr->msg_control	= $16;
+	msg_expr->msg_flags	= $19;
+}
+;
+
+mmsghdr
+: '{' MSG_HDR '=' msghdr ',' MSG_LEN '=' expression '}' {
+	struct mmsghdr_expr *mmsg_expr =
+		calloc(1, sizeof(struct mmsghdr_expr));
+	$$ = new_expression(EXPR_MMSGHDR);
+	$$->value.mmsghdr = mmsg_expr;
+	mmsg_expr->msg_hdr	= $4;
+	mmsg_expr->msg_len	= $8;
+}
+;
+
+opt_msg_control
+:                                { $$ = NULL; }
+| MSG_CONTROL '=' array ','      { $$ = $3; }
+;
+
+cmsghdr
+: '{' CMSG_LEVEL '=' expression ',' CMSG_TYPE '=' expression ','
+      CMSG_DATA '=' expression '}' {
+	struct cmsghdr_expr *cmsg_expr =
+		calloc(1, sizeof(struct cmsghdr_expr));
+	$$ = new_expression(EXPR_CMSGHDR);
+	$$->value.cmsghdr = cmsg_expr;
+	cmsg_expr->cmsg_level	= $4;
+	cmsg_expr->cmsg_type	= $8;
+	cmsg_expr->cmsg_data	= $12;
+}
+;
+
+sock_extended_err
+: '{' EE_ERRNO '=' expression ',' EE_ORIGIN '=' expression ','
+      EE_TYPE '=' expression ',' EE_CODE '=' expression ','
+      EE_INFO '=' expression ',' EE_DATA '=' expression '}' {
+	struct sock_extended_err_expr *ee_expr =
+		calloc(1, sizeof(struct sock_extended_err_expr));
+	$$ = new_expression(EXPR_SOCK_EXTENDED_ERR);
+	$$->value.sock_extended_err = ee_expr;
+	ee_expr->ee_errno	= $4;
+	ee_expr->ee_origin	= $8;
+	ee_expr->ee_type	= $12;
+	ee_expr->ee_code	= $16;
+	ee_expr->ee_info	= $20;
+	ee_expr->ee_data	= $24;
 }
 ;
 
@@ -2027,6 +2136,22 @@ iovec
 }
 ;
 
+tcp_zerocopy_receive
+: '{' ZC_ADDRESS '=' expression ',' ZC_LENGTH '=' expression ','
+      ZC_RECV_SKIP_HINT '=' expression ',' ZC_INQ '=' expression ','
+      ZC_ERR '=' expression '}' {
+	struct tcp_zerocopy_receive_expr *zc_expr =
+		calloc(1, sizeof(struct tcp_zerocopy_receive_expr));
+	$$ = new_expression(EXPR_TCP_ZEROCOPY_RECEIVE);
+	$$->value.tcp_zerocopy_receive = zc_expr;
+	zc_expr->address	= $4;
+	zc_expr->length		= $8;
+	zc_expr->recv_skip_hint	= $12;
+	zc_expr->inq		= $16;
+	zc_expr->err		= $20;
+}
+;
+
 pollfd
 : '{' FD '=' expression ',' EVENTS '=' expression opt_revents '}' {
 	struct pollfd_expr *pollfd_expr = calloc(1, sizeof(struct pollfd_expr));
@@ -2038,6 +2163,17 @@ pollfd
 }
 ;
 
+epoll_event
+: '{' EVENTS '=' expression ',' FD '=' expression '}' {
+	struct epoll_event_expr *epoll_event_expr =
+		calloc(1, sizeof(struct epoll_event_expr));
+	$$ = new_expression(EXPR_EPOLL_EVENT);
+	$$->value.epoll_event = epoll_event_expr;
+	epoll_event_expr->events = $4;
+	epoll_event_expr->fd = $8;
+}
+;
+
 opt_revents
 :                                { $$ = new_integer_expression(0, "%ld"); }
 | ',' REVENTS '=' expression     { $$ = $4; }
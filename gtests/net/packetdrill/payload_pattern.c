@@ -0,0 +1,95 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * The payload pattern is a sequence of 64-bit words, each a cheap mix
+ * of its index, laid out little-endian. Whole words are generated and
+ * compared eight bytes at a time, so checking a read costs about as
+ * much as copying it.
+ */
+
+#include "payload_pattern.h"
+
+#include <string.h>
+
+/* Return the pattern word holding stream bytes [8 * index, 8 * index + 8). */
+static inline u64 pattern_word(u64 index)
+{
+	u64 x = (index + 1) * 0x9E3779B97F4A7C15ULL;
+
+	return x ^ (x >> 29);
+}
+
+/* Return the pattern word as it is laid out in memory. */
+static inline u64 pattern_word_in_memory(u64 index)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return __builtin_bswap64(pattern_word(index));
+#else
+	return pattern_word(index);
+#endif
+}
+
+u8 payload_pattern_byte(u64 offset)
+{
+	return pattern_word(offset / 8) >> (8 * (offset % 8));
+}
+
+void payload_pattern_fill(u8 *buf, size_t len, u64 offset)
+{
+	size_t i = 0;
+
+	/* Bytes up to the first word boundary... */
+	for (; i < len && (offset + i) % 8 != 0; ++i)
+		buf[i] = payload_pattern_byte(offset + i);
+
+	/* ...whole words... */
+	for (; i + 8 <= len; i += 8) {
+		u64 word = pattern_word_in_memory((offset + i) / 8);
+
+		memcpy(buf + i, &word, sizeof(word));
+	}
+
+	/* ...and what's left of the last word. */
+	for (; i < len; ++i)
+		buf[i] = payload_pattern_byte(offset + i);
+}
+
+size_t payload_pattern_check(const u8 *buf, size_t len, u64 offset)
+{
+	size_t i = 0;
+
+	for (; i < len && (offset + i) % 8 != 0; ++i) {
+		if (buf[i] != payload_pattern_byte(offset + i))
+			return i;
+	}
+
+	for (; i + 8 <= len; i += 8) {
+		u64 word;
+
+		memcpy(&word, buf + i, sizeof(word));
+		if (word != pattern_word_in_memory((offset + i) / 8))
+			break;	/* find the byte below */
+	}
+
+	for (; i < len; ++i) {
+		if (buf[i] != payload_pattern_byte(offset + i))
+			return i;
+	}
+	return len;
+}
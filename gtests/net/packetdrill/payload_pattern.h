@@ -0,0 +1,48 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * A deterministic stream of payload bytes that can be generated or
+ * checked starting at any offset (--payload_pattern). Inbound script
+ * packets are filled from it at the stream offset of their data, and
+ * what the application reads is checked against it. The other way
+ * round, the application writes it, and outbound packets are checked
+ * against it instead of against the script's payloads. Data that the
+ * kernel reorders, drops or corrupts on the way is caught.
+ */
+
+#ifndef __PAYLOAD_PATTERN_H__
+#define __PAYLOAD_PATTERN_H__
+
+#include "types.h"
+
+/* Fill buf with the len pattern bytes that start at the given stream
+ * offset.
+ */
+extern void payload_pattern_fill(u8 *buf, size_t len, u64 offset);
+
+/* Check the len bytes in buf against the pattern bytes that start at
+ * the given stream offset. Return the index of the first byte that
+ * differs, or len if they all match.
+ */
+extern size_t payload_pattern_check(const u8 *buf, size_t len, u64 offset);
+
+/* Return the pattern byte at the given stream offset. */
+extern u8 payload_pattern_byte(u64 offset);
+
+#endif /* __PAYLOAD_PATTERN_H__ */
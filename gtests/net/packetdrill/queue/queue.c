@@ -49,7 +49,7 @@ int queue_rear(queue_t *queue, void **element){
 		*element = queue->elements[queue->r-1];
 	}
 	else{
-		*element = queue->elements[QUEUE_SIZE];
+		*element = queue->elements[QUEUE_SIZE-1];
 	}
 	return STATUS_OK;
 }
@@ -60,7 +60,7 @@ int queue_dequeue(queue_t *queue, void **element){
 	}
 	void *temp = queue->elements[queue->f];
 	queue->elements[queue->f] = NULL;
-	queue->f = (queue->f+1%QUEUE_SIZE);
+	queue->f = (queue->f+1)%QUEUE_SIZE;
 	*element = temp;
 	return STATUS_OK;
 }
@@ -110,7 +110,7 @@ int queue_rear_val(queue_t_val *queue, u64 *element){
 		*element = queue->elements[queue->r-1];
 	}
 	else{
-		*element = queue->elements[QUEUE_SIZE];
+		*element = queue->elements[QUEUE_SIZE-1];
 	}
 	return STATUS_OK;
 }
@@ -129,6 +129,6 @@ int queue_dequeue_val(queue_t_val *queue, u64 *element){
 		return STATUS_ERR;
 	}
 	*element = queue->elements[queue->f];
-	queue->f = (queue->f+1%QUEUE_SIZE);
+	queue->f = (queue->f+1)%QUEUE_SIZE;
 	return STATUS_OK;
 }
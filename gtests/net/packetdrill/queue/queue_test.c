@@ -0,0 +1,86 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Unit test for queue.c: both queues must keep their FIFO order when
+ * their front and rear indices wrap around the end of the array.
+ */
+
+#include "queue.h"
+
+#include <assert.h>
+
+static void test_queue_wrap(void)
+{
+	static int values[QUEUE_SIZE];
+	queue_t queue;
+	void *element = NULL;
+	int i;
+
+	queue_init(&queue);
+	/* Half fill, then keep the queue half full for two laps. */
+	for (i = 0; i < QUEUE_SIZE / 2; ++i)
+		assert(queue_enqueue(&queue, &values[i]) == STATUS_OK);
+	for (i = QUEUE_SIZE / 2; i < 2 * QUEUE_SIZE; ++i) {
+		assert(queue_enqueue(&queue, &values[i % QUEUE_SIZE]) ==
+		       STATUS_OK);
+		assert(queue_rear(&queue, &element) == STATUS_OK);
+		assert(element == &values[i % QUEUE_SIZE]);
+		assert(queue_dequeue(&queue, &element) == STATUS_OK);
+		assert(element == &values[(i - QUEUE_SIZE / 2) % QUEUE_SIZE]);
+		assert(queue_size(&queue) == QUEUE_SIZE / 2);
+	}
+	for (i = 2 * QUEUE_SIZE - QUEUE_SIZE / 2; i < 2 * QUEUE_SIZE; ++i) {
+		assert(queue_dequeue(&queue, &element) == STATUS_OK);
+		assert(element == &values[i % QUEUE_SIZE]);
+	}
+	assert(queue_is_empty(&queue));
+	assert(queue_dequeue(&queue, &element) == STATUS_ERR);
+}
+
+static void test_queue_val_wrap(void)
+{
+	queue_t_val queue;
+	u64 element = 0;
+	u64 i;
+
+	queue_init_val(&queue);
+	for (i = 0; i < QUEUE_SIZE / 2; ++i)
+		assert(queue_enqueue_val(&queue, i) == STATUS_OK);
+	for (i = QUEUE_SIZE / 2; i < 2 * QUEUE_SIZE; ++i) {
+		assert(queue_enqueue_val(&queue, i) == STATUS_OK);
+		assert(queue_rear_val(&queue, &element) == STATUS_OK);
+		assert(element == i);
+		assert(queue_dequeue_val(&queue, &element) == STATUS_OK);
+		assert(element == i - QUEUE_SIZE / 2);
+		assert(queue_size_val(&queue) == QUEUE_SIZE / 2);
+	}
+	for (i = 2 * QUEUE_SIZE - QUEUE_SIZE / 2; i < 2 * QUEUE_SIZE; ++i) {
+		assert(queue_dequeue_val(&queue, &element) == STATUS_OK);
+		assert(element == i);
+	}
+	assert(queue_is_empty_val(&queue));
+	assert(queue_dequeue_val(&queue, &element) == STATUS_ERR);
+}
+
+int main(void)
+{
+	test_queue_wrap();
+	test_queue_val_wrap();
+	return 0;
+}
@@ -34,11 +34,14 @@
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/times.h>
+#include <time.h>
 #include <unistd.h>
 #include "ip.h"
 #include "logging.h"
+#include "loopback_netdev.h"
 #include "netdev.h"
 #include "wire_client_netdev.h"
+#include "xdp_netdev.h"
 #include "parse.h"
 #include "run_command.h"
 #include "run_packet.h"
@@ -50,8 +53,8 @@
 #include "mptcp.h"
 #include "tcp_options.h"
 
-/* MAX_SPIN_USECS is the maximum amount of time (in microseconds) to
- * spin waiting for an event. We sleep up until this many microseconds
+/* MAX_SPIN_NSECS is the maximum amount of time (in nanoseconds) to
+ * spin waiting for an event. We sleep up until this many nanoseconds
  * before a script event. We get the best results on tickless
  * (CONFIG_NO_HZ=y) kernels when we try to sleep until the exact jiffy
  * of a script event; this reduces the staleness/noise we see in
@@ -59,11 +62,11 @@
  * jiffies value at the time we wake, and then we execute the test
  * event shortly thereafter. The value below was chosen experimentally
  * based on experiences on a 2.2GHz machine for which there was a
- * measured overhead of roughly 15 usec for the unlock/usleep/lock
+ * measured overhead of roughly 15000 nsec for the unlock/nanosleep/lock
  * sequence that wait_for_event() must execute while waiting
  * for the next event.
  */
-const int MAX_SPIN_USECS = 20;
+const s64 MAX_SPIN_NSECS = 20000;
 
 struct state *state_new(struct config *config,
 			struct script *script,
@@ -82,20 +85,23 @@ struct state *state_new(struct config *config,
 	state->packets = packets_new();
 	state->syscalls = syscalls_new(state);
 	state->code = code_new(config);
+	state->sampler = sampler_new(config);
 	state->sockets = NULL;
 	return state;
 }
 
-/* Close all sockets, free all the socket structs, and send a RST
- * packet to clean up kernel state for each connection.
+/* Close all sockets, send a RST packet to clean up kernel state for
+ * each connection, and free all the socket structs. We close every
+ * socket before building any RST, so the RSTs go out back to back.
  * TODO(ncardwell): centralize error handling and ensure test errors
  * always result in a call to these clean-up functions, so we can make
  * sure to reset connections in all cases.
  */
 static void close_all_sockets(struct state *state)
 {
-	struct socket *socket = state->sockets;
-	while (socket != NULL) {
+	struct socket *socket = NULL;
+
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
 		if (socket->live.fd >= 0 && !socket->is_closed) {
 			assert(socket->script.fd >= 0);
 			DEBUGP("closing struct state socket "
@@ -104,11 +110,13 @@ static void close_all_sockets(struct state *state)
 			if (close(socket->live.fd))
 				die_perror("close");
 		}
-		if (socket->protocol == IPPROTO_TCP &&
-		    !state->config->is_wire_client &&
-		    reset_connection(state, socket)) {
-			die("error reseting connection\n");
-		}
+	}
+
+	if (!state->config->is_wire_client && reset_connections(state))
+		die("error reseting connections\n");
+
+	socket = state->sockets;
+	while (socket != NULL) {
 		struct socket *dead_socket = socket;
 		socket = socket->next;
 		socket_free(dead_socket);
@@ -131,6 +139,7 @@ void state_free(struct state *state)
 	netdev_free(state->netdev);
 	packets_free(state->packets);
 	code_free(state->code);
+	sampler_free(state->sampler);
 
 	run_unlock(state);
 	if (pthread_mutex_destroy(&state->mutex) != 0)
@@ -140,12 +149,12 @@ void state_free(struct state *state)
 	free(state);
 }
 
-s64 now_usecs(void)
+s64 now_nsecs(void)
 {
-	struct timeval tv;
-	if (gettimeofday(&tv, NULL) < 0)
-		die_perror("gettimeofday");
-	return timeval_to_usecs(&tv);
+	struct timespec ts;
+	if (clock_gettime(CLOCK_REALTIME, &ts) < 0)
+		die_perror("clock_gettime");
+	return timespec_to_nsecs(&ts);
 }
 
 /*
@@ -157,49 +166,49 @@ s64 now_usecs(void)
  * checking.
  */
 int verify_time(struct state *state, enum event_time_t time_type,
-		s64 script_usecs, s64 script_usecs_end,
-		s64 live_usecs, const char *description, char **error)
+		s64 script_nsecs, s64 script_nsecs_end,
+		s64 live_nsecs, const char *description, char **error)
 {
-	s64 expected_usecs = script_usecs - state->script_start_time_usecs;
-	s64 expected_usecs_end = script_usecs_end -
-		state->script_start_time_usecs;
-	s64 actual_usecs = live_usecs - state->live_start_time_usecs;
-	int tolerance_usecs = state->config->tolerance_usecs;
+	s64 expected_nsecs = script_nsecs - state->script_start_time_nsecs;
+	s64 expected_nsecs_end = script_nsecs_end -
+		state->script_start_time_nsecs;
+	s64 actual_nsecs = live_nsecs - state->live_start_time_nsecs;
+	s64 tolerance_nsecs = state->config->tolerance_nsecs;
 
-	DEBUGP("expected: %.3f actual: %.3f  (secs)\n",
-	       usecs_to_secs(script_usecs), usecs_to_secs(actual_usecs));
+	DEBUGP("expected: %.9f actual: %.9f  (secs)\n",
+	       nsecs_to_secs(script_nsecs), nsecs_to_secs(actual_nsecs));
 
 	if (time_type == ANY_TIME)
 		return STATUS_OK;
 
 	if (time_type == ABSOLUTE_RANGE_TIME ||
 	    time_type == RELATIVE_RANGE_TIME) {
-		DEBUGP("expected_usecs_end %.3f\n",
-		       usecs_to_secs(script_usecs_end));
-		if (actual_usecs < (expected_usecs - tolerance_usecs) ||
-		    actual_usecs > (expected_usecs_end + tolerance_usecs)) {
+		DEBUGP("expected_nsecs_end %.9f\n",
+		       nsecs_to_secs(script_nsecs_end));
+		if (actual_nsecs < (expected_nsecs - tolerance_nsecs) ||
+		    actual_nsecs > (expected_nsecs_end + tolerance_nsecs)) {
 			if (time_type == ABSOLUTE_RANGE_TIME) {
 				asprintf(error,
 					 "timing error: expected "
-					 "%s in time range %.6f~%.6f sec "
-					 "but happened at %.6f sec",
+					 "%s in time range %.9f~%.9f sec "
+					 "but happened at %.9f sec",
 					 description,
-					 usecs_to_secs(script_usecs),
-					 usecs_to_secs(script_usecs_end),
-					 usecs_to_secs(actual_usecs));
+					 nsecs_to_secs(script_nsecs),
+					 nsecs_to_secs(script_nsecs_end),
+					 nsecs_to_secs(actual_nsecs));
 			} else if (time_type == RELATIVE_RANGE_TIME) {
-				s64 offset_usecs = state->event->offset_usecs;
+				s64 offset_nsecs = state->event->offset_nsecs;
 				asprintf(error,
 					 "timing error: expected "
-					 "%s in relative time range +%.6f~+%.6f "
-					 "sec but happened at %+.6f sec",
+					 "%s in relative time range +%.9f~+%.9f "
+					 "sec but happened at %+.9f sec",
 					 description,
-					 usecs_to_secs(script_usecs -
-						       offset_usecs),
-					 usecs_to_secs(script_usecs_end -
-						       offset_usecs),
-					 usecs_to_secs(actual_usecs -
-						       offset_usecs));
+					 nsecs_to_secs(script_nsecs -
+						       offset_nsecs),
+					 nsecs_to_secs(script_nsecs_end -
+						       offset_nsecs),
+					 nsecs_to_secs(actual_nsecs -
+						       offset_nsecs));
 			}
 			return STATUS_ERR;
 		} else {
@@ -207,14 +216,14 @@ int verify_time(struct state *state, enum event_time_t time_type,
 		}
 	}
 
-	if ((actual_usecs < (expected_usecs - tolerance_usecs)) ||
-	    (actual_usecs > (expected_usecs + tolerance_usecs))) {
+	if ((actual_nsecs < (expected_nsecs - tolerance_nsecs)) ||
+	    (actual_nsecs > (expected_nsecs + tolerance_nsecs))) {
 		asprintf(error,
 			 "timing error: "
-			 "expected %s at %.6f sec but happened at %.6f sec",
+			 "expected %s at %.9f sec but happened at %.9f sec",
 			 description,
-			 usecs_to_secs(script_usecs),
-			 usecs_to_secs(actual_usecs));
+			 nsecs_to_secs(script_nsecs),
+			 nsecs_to_secs(actual_nsecs));
 		return STATUS_ERR;
 	} else {
 		return STATUS_OK;
@@ -255,14 +264,14 @@ static const char *event_description(struct event *event)
 	return "invalid event";
 }
 
-void check_event_time(struct state *state, s64 live_usecs)
+void check_event_time(struct state *state, s64 live_nsecs)
 {
 	char *error = NULL;
 	const char *description = event_description(state->event);
 	if (verify_time(state,
 			state->event->time_type,
-			state->event->time_usecs,
-			state->event->time_usecs_end, live_usecs,
+			state->event->time_nsecs,
+			state->event->time_nsecs_end, live_nsecs,
 			description, &error)) {
 		die("%s:%d: %s\n",
 		    state->config->script_path,
@@ -276,52 +285,57 @@ void check_event_time(struct state *state, s64 live_usecs)
  */
 void adjust_relative_event_times(struct state *state, struct event *event)
 {
-	s64 offset_usecs;
+	s64 offset_nsecs;
 
 	if (event->time_type != ANY_TIME &&
 	    event->time_type != RELATIVE_TIME &&
 	    event->time_type != RELATIVE_RANGE_TIME)
 		return;
 
-	offset_usecs = now_usecs() - state->live_start_time_usecs;
-	event->offset_usecs = offset_usecs;
+	offset_nsecs = now_nsecs() - state->live_start_time_nsecs;
+	event->offset_nsecs = offset_nsecs;
 
-	event->time_usecs += offset_usecs;
+	event->time_nsecs += offset_nsecs;
 	if (event->time_type == RELATIVE_RANGE_TIME)
-		event->time_usecs_end += offset_usecs;
+		event->time_nsecs_end += offset_nsecs;
 
 	/* Adjust the end time of blocking system calls using relative times. */
 	if (event->time_type == RELATIVE_TIME &&
 	    event->type == SYSCALL_EVENT &&
 	    is_blocking_syscall(event->event.syscall)) {
-		event->event.syscall->end_usecs += offset_usecs;
+		event->event.syscall->end_nsecs += offset_nsecs;
 	}
 }
 
 void wait_for_event(struct state *state)
 {
-	s64 event_usecs =
-		script_time_to_live_time_usecs(
-			state, state->event->time_usecs);
+	s64 event_nsecs =
+		script_time_to_live_time_nsecs(
+			state, state->event->time_nsecs);
 	DEBUGP("waiting until %lld -- now is %lld\n",
-	       event_usecs, now_usecs());
+	       event_nsecs, now_nsecs());
 	while (1) {
-		const s64 wait_usecs = event_usecs - now_usecs();
-		if (wait_usecs <= 0)
+		const s64 wait_nsecs = event_nsecs - now_nsecs();
+		if (wait_nsecs <= 0)
 			break;
 
 		/* If we're waiting a long time, and we are on an OS
-		 * that we know has a fine-grained usleep(), then
-		 * usleep() instead of spinning on the CPU.
+		 * that we know has a fine-grained nanosleep(), then
+		 * nanosleep() instead of spinning on the CPU.
 		 */
 #ifdef linux
 		/* Since the scheduler may not wake us up precisely
 		 * when we tell it to, sleep until just before the
 		 * event we're waiting for and then spin.
 		 */
-		if (wait_usecs > MAX_SPIN_USECS) {
+		if (wait_nsecs > MAX_SPIN_NSECS) {
+			struct timespec ts;
+			s64 sleep_nsecs = wait_nsecs - MAX_SPIN_NSECS;
+
+			ts.tv_sec = sleep_nsecs / 1000000000LL;
+			ts.tv_nsec = sleep_nsecs % 1000000000LL;
 			run_unlock(state);
-			usleep(wait_usecs - MAX_SPIN_USECS);
+			nanosleep(&ts, NULL);
 			run_lock(state);
 		}
 #endif
@@ -331,18 +345,18 @@ void wait_for_event(struct state *state)
 		 */
 	}
 
-	check_event_time(state, now_usecs());
+	check_event_time(state, now_nsecs());
 }
 
 int get_next_event(struct state *state, char **error)
 {
-	DEBUGP("gettimeofday: %.6f\n", now_usecs()/1000000.0);
+	DEBUGP("clock_gettime: %.9f\n", nsecs_to_secs(now_nsecs()));
 
 	if (state->event == NULL) {
 		/* First event. */
 		state->event = state->script->event_list;
-		state->script_start_time_usecs = state->event->time_usecs;
-		if (state->event->time_usecs != 0) {
+		state->script_start_time_nsecs = state->event->time_nsecs;
+		if (state->event->time_nsecs != 0) {
 			asprintf(error,
 				 "%s:%d: first event should be at time 0\n",
 				 state->config->script_path,
@@ -351,7 +365,7 @@ int get_next_event(struct state *state, char **error)
 		}
 	} else {
 		/* Move to the next event. */
-		state->script_last_time_usecs = state->event->time_usecs;
+		state->script_last_time_nsecs = state->event->time_nsecs;
 		state->last_event = state->event;
 		state->event = state->event->next;
 	}
@@ -365,14 +379,14 @@ int get_next_event(struct state *state, char **error)
 	if (state->last_event &&
 	    is_event_time_absolute(state->last_event) &&
 	    is_event_time_absolute(state->event) &&
-	    state->event->time_usecs < state->script_last_time_usecs) {
+	    state->event->time_nsecs < state->script_last_time_nsecs) {
 		asprintf(error,
 			 "%s:%d: time goes backward in script "
-			 "from %lld usec to %lld usec\n",
+			 "from %lld nsec to %lld nsec\n",
 			 state->config->script_path,
 			 state->event->line_number,
-			 state->script_last_time_usecs,
-			 state->event->time_usecs);
+			 state->script_last_time_nsecs,
+			 state->event->time_nsecs);
 		return STATUS_ERR;
 	}
 	return STATUS_OK;
@@ -440,9 +454,9 @@ void lock_memory(void)
 }
 
 /* Wait for and return the wall time at which we should start the
- * test, in microseconds. To make test results more reproducible, we
+ * test, in nanoseconds. To make test results more reproducible, we
  * wait for a start time that is well into the middle of a Linux jiffy
- * (JIFFY_OFFSET_USECS into the jiffy). If you try to run a test
+ * (JIFFY_OFFSET_NSECS into the jiffy). If you try to run a test
  * script starting at a time that is too near the edge of a jiffy, and
  * the test tries (as most do) to schedule events at 1-millisecond
  * boundaries relative to this start time, then slight CPU or
@@ -458,26 +472,26 @@ void lock_memory(void)
  * effects. We could do fancier measuring and filtering here, but so
  * far this level of complexity seems sufficient.
  */
-static s64 schedule_start_time_usecs(void)
+static s64 schedule_start_time_nsecs(void)
 {
 #ifdef linux
-	s64 start_usecs = 0;
+	s64 start_nsecs = 0;
 	clock_t last_jiffies = times(NULL);
 	int jiffy_ticks = 0;
 	const int TARGET_JIFFY_TICKS = 10;
 	while (jiffy_ticks < TARGET_JIFFY_TICKS) {
 		clock_t jiffies = times(NULL);
 		if (jiffies != last_jiffies) {
-			start_usecs = now_usecs();
+			start_nsecs = now_nsecs();
 			++jiffy_ticks;
 		}
 		last_jiffies = jiffies;
 	}
-	const int JIFFY_OFFSET_USECS = 250;
-	start_usecs += JIFFY_OFFSET_USECS;
-	return start_usecs;
+	const s64 JIFFY_OFFSET_NSECS = 250000;
+	start_nsecs += JIFFY_OFFSET_NSECS;
+	return start_nsecs;
 #else
-	return now_usecs();
+	return now_nsecs();
 #endif
 }
 
@@ -501,6 +515,10 @@ void run_script(struct config *config, struct script *script)
 	 */
 	if (config->is_wire_client)
 		netdev = wire_client_netdev_new(config);
+	else if (config->netdev_type == NETDEV_XDP)
+		netdev = xdp_netdev_new(config);
+	else if (config->netdev_type == NETDEV_LOOPBACK)
+		netdev = loopback_netdev_new(config);
 	else
 		netdev = local_netdev_new(config);
 
@@ -521,13 +539,15 @@ void run_script(struct config *config, struct script *script)
 
 	signal(SIGPIPE, SIG_IGN);	/* ignore EPIPE */
 
-	state->live_start_time_usecs = schedule_start_time_usecs();
-	DEBUGP("live_start_time_usecs is %lld\n",
-	       state->live_start_time_usecs);
+	state->live_start_time_nsecs = schedule_start_time_nsecs();
+	DEBUGP("live_start_time_nsecs is %lld\n",
+	       state->live_start_time_nsecs);
 
 	if (state->wire_client != NULL)
 		wire_client_send_client_starting(state->wire_client);
 
+	sampler_start(state->sampler);
+
 	while (1) {
 		if (get_next_event(state, &error))
 			die("%s", error);
@@ -570,12 +590,31 @@ void run_script(struct config *config, struct script *script)
 			break;
 		/* We omit default case so compiler catches missing values. */
 		}
+
+		/* Note how far behind the script we are, for benchmarks. */
+		event->finished_nsecs = now_nsecs();
+		if (event->time_type != ANY_TIME) {
+			event->dispatch_lag_nsecs = event->finished_nsecs -
+				script_time_to_live_time_nsecs(
+					state, event->time_nsecs);
+		}
+
+		/* Let the sampler see sockets this event created/closed. */
+		sampler_update_sockets(state->sampler, state);
 	}
 
 	/* Wait for any outstanding packet events we requested on the server. */
 	if (state->wire_client != NULL)
 		wire_client_next_event(state->wire_client, NULL);
 
+	report_injection_lag(state);
+
+	if (sampler_finish(state->sampler, state, &error)) {
+		die("%s: error writing samples: %s\n",
+		    state->config->script_path, error);
+		free(error);
+	}
+
 	if (code_execute(state->code, &error)) {
 		die("%s: error executing code: %s\n",
 		    state->config->script_path, error);
@@ -65,6 +65,7 @@
 #include "netdev.h"
 #include "run_packet.h"
 #include "run_system_call.h"
+#include "sampler.h"
 #include "script.h"
 #include "socket.h"
 #include "wire_client.h"
@@ -98,10 +99,11 @@ struct state {
 	struct event *event;			/* the current event */
 	struct event *last_event;		/* previous event */
 	struct code_state *code;	/* for running post-processing code */
+	struct sampler *sampler;	/* background TCP_INFO sampler */
 	struct wire_client *wire_client;	/* for on-the-wire tests */
-	s64 script_start_time_usecs;	/* time of first event in script */
-	s64 script_last_time_usecs;	/* time of previous event in script */
-	s64 live_start_time_usecs;	/* time of first event in live test */
+	s64 script_start_time_nsecs;	/* time of first event in script */
+	s64 script_last_time_nsecs;	/* time of previous event in script */
+	s64 live_start_time_nsecs;	/* time of first event in live test */
 };
 
 /* Allocate all run-time state for executing a test script. */
@@ -126,25 +128,25 @@ static inline void run_unlock(struct state *state)
 		die_perror("pthread_mutex_unlock");
 }
 
-/* Get the wall clock time of day in microseconds. */
-extern s64 now_usecs(void);
+/* Get the wall clock time of day in nanoseconds. */
+extern s64 now_nsecs(void);
 
 /* Convert script time to live wall clock time. */
-static inline s64 script_time_to_live_time_usecs(struct state *state,
-						 s64 script_time_usecs)
+static inline s64 script_time_to_live_time_nsecs(struct state *state,
+						 s64 script_time_nsecs)
 {
-	s64 offset_usecs = script_time_usecs - state->script_start_time_usecs;
-	s64 live_time_usecs = state->live_start_time_usecs + offset_usecs;
-	return live_time_usecs;
+	s64 offset_nsecs = script_time_nsecs - state->script_start_time_nsecs;
+	s64 live_time_nsecs = state->live_start_time_nsecs + offset_nsecs;
+	return live_time_nsecs;
 }
 
 /* Convert live wall clock time to script time. */
-static inline s64 live_time_to_script_time_usecs(struct state *state,
-						 s64 live_time_usecs)
+static inline s64 live_time_to_script_time_nsecs(struct state *state,
+						 s64 live_time_nsecs)
 {
-	s64 offset_usecs = live_time_usecs - state->live_start_time_usecs;
-	s64 script_time_usecs = state->script_start_time_usecs + offset_usecs;
-	return script_time_usecs;
+	s64 offset_nsecs = live_time_nsecs - state->live_start_time_nsecs;
+	s64 script_time_nsecs = state->script_start_time_nsecs + offset_nsecs;
+	return script_time_nsecs;
 }
 
 /*
@@ -156,12 +158,12 @@ static inline s64 live_time_to_script_time_usecs(struct state *state,
  * description.  The check_event_time variant is a shortcut
  * for the common case: it looks at the current event and on failure
  * it prints the error message to stderr and exits with an error
- * status.  For time ranges the end time is specified in script_usecs_end.
+ * status.  For time ranges the end time is specified in script_nsecs_end.
  */
 extern int verify_time(struct state *state, enum event_time_t time_type,
-		       s64 script_usecs, s64 script_usecs_end,
-		       s64 live_usecs, const char *description, char **error);
-extern void check_event_time(struct state *state, s64 live_usecs);
+		       s64 script_nsecs, s64 script_nsecs_end,
+		       s64 live_nsecs, const char *description, char **error);
+extern void check_event_time(struct state *state, s64 live_nsecs);
 
 /* Set the start (and end time, if applicable) for the event if it
  * uses wildcard or relative timing.
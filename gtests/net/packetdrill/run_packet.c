@@ -37,8 +37,10 @@
 #include "packet.h"
 #include "packet_checksum.h"
 #include "packet_to_string.h"
+#include "payload_pattern.h"
 #include "run.h"
 #include "script.h"
+#include "sock_diag.h"
 #include "tcp_options_iterator.h"
 #include "tcp_options_to_string.h"
 #include "tcp_packet.h"
@@ -102,7 +104,7 @@ static u16 next_ephemeral_port(struct state *state)
  * packet.
  */
 static void add_packet_dump(char **error, const char *type,
-			    struct packet *packet, s64 time_usecs,
+			    struct packet *packet, s64 time_nsecs,
 			    enum dump_format_t format)
 {
 	if (packet->ip_bytes != 0) {
@@ -111,8 +113,8 @@ static void add_packet_dump(char **error, const char *type,
 
 		packet_to_string(packet, format,
 				 &dump, &dump_error);
-		asprintf(error, "%s\n%s packet: %9.6f %s%s%s",
-			 old_error, type, usecs_to_secs(time_usecs), dump,
+		asprintf(error, "%s\n%s packet: %12.9f %s%s%s",
+			 old_error, type, nsecs_to_secs(time_nsecs), dump,
 			 dump_error ? "\n" : "",
 			 dump_error ? dump_error : "");
 
@@ -124,7 +126,7 @@ static void add_packet_dump(char **error, const char *type,
 
 /* For verbose runs, print a short packet dump of all live packets. */
 static void verbose_packet_dump(struct state *state, const char *type,
-				struct packet *live_packet, s64 time_usecs)
+				struct packet *live_packet, s64 time_nsecs)
 {
 	if (state->config->verbose) {
 		char *dump = NULL, *dump_error = NULL;
@@ -132,8 +134,8 @@ static void verbose_packet_dump(struct state *state, const char *type,
 		packet_to_string(live_packet, DUMP_SHORT,
 				 &dump, &dump_error);
 
-		printf("%s packet: %9.6f %s%s%s\n",
-		       type, usecs_to_secs(time_usecs), dump,
+		printf("%s packet: %12.9f %s%s%s\n",
+		       type, nsecs_to_secs(time_nsecs), dump,
 		       dump_error ? "\n" : "",
 		       dump_error ? dump_error : "");
 
@@ -206,10 +208,13 @@ struct socket *find_connecting_socket(struct state *state)
 static bool is_equals_tuple_socket_and_packet(struct socket *socket,
 		const struct packet *packet)
 {
+	struct tuple tuple;
+
 	//TODO check all 5-tuple ([IP,port] dst/src & protocol), will be
 	//necessary when multiple interface support will be implemented
-	return is_equal_port(socket->live.local.port, packet->tcp->src_port) &&
-		   is_equal_port(socket->live.remote.port, packet->tcp->dst_port);
+	get_packet_tuple(packet, &tuple);
+	return is_equal_port(socket->live.local.port, tuple.src.port) &&
+		   is_equal_port(socket->live.remote.port, tuple.dst.port);
 }
 
 struct socket *find_socket_matching_packet_tuple(struct state *state,
@@ -221,10 +226,13 @@ struct socket *find_socket_matching_packet_tuple(struct state *state,
 static bool is_equals_tuple_socket_and_packet_reversed_ports(struct socket *socket,
 		const struct packet *packet)
 {
+	struct tuple tuple;
+
 	//TODO check IP too, will be necessary when multiple interface support
 	//will be implemented.
-	return is_equal_port(socket->live.local.port, packet->tcp->dst_port) &&
-			is_equal_port(socket->live.remote.port, packet->tcp->src_port);
+	get_packet_tuple(packet, &tuple);
+	return is_equal_port(socket->live.local.port, tuple.dst.port) &&
+			is_equal_port(socket->live.remote.port, tuple.src.port);
 }
 
 struct socket *find_socket_matching_packet_tuple_reversed_ports(struct state *state,
@@ -236,7 +244,10 @@ struct socket *find_socket_matching_packet_tuple_reversed_ports(struct state *st
 static bool socket_remote_port_equals_packet_dst_port(struct socket *socket,
 		const struct packet *packet)
 {
-	return is_equal_port(socket->live.remote.port, packet->tcp->dst_port);
+	struct tuple tuple;
+
+	get_packet_tuple(packet, &tuple);
+	return is_equal_port(socket->live.remote.port, tuple.dst.port);
 }
 
 struct socket *find_corresponding_socket_remote_port(struct state *state,
@@ -508,18 +519,18 @@ static void set_outbound_ts_val_mapping(
  */
 static int find_tcp_timestamp(struct packet *packet, char **error)
 {
-	struct tcp_options_iterator iter;
 	struct tcp_option *option = NULL;
 
 	packet->tcp_ts_val = NULL;
 	packet->tcp_ts_ecr = NULL;
-	for (option = tcp_options_begin(packet, &iter); option != NULL;
-	     option = tcp_options_next(&iter, error))
-		if (option->kind == TCPOPT_TIMESTAMP) {
-			packet->tcp_ts_val = &(option->data.time_stamp.val);
-			packet->tcp_ts_ecr = &(option->data.time_stamp.ecr);
-		}
-	return *error ? STATUS_ERR : STATUS_OK;
+	if (tcp_options_ensure_index(packet, error))
+		return STATUS_ERR;
+	option = get_tcp_option(packet, TCPOPT_TIMESTAMP);
+	if (option != NULL) {
+		packet->tcp_ts_val = &(option->data.time_stamp.val);
+		packet->tcp_ts_ecr = &(option->data.time_stamp.ecr);
+	}
+	return STATUS_OK;
 }
 
 /* A helper to help translate SACK sequence numbers between live and
@@ -530,11 +541,14 @@ static int find_tcp_timestamp(struct packet *packet, char **error)
 static int offset_sack_blocks(struct packet *packet,
 			      u32 ack_offset, char **error)
 {
-	struct tcp_options_iterator iter;
 	struct tcp_option *option = NULL;
-	for (option = tcp_options_begin(packet, &iter); option != NULL;
-	     option = tcp_options_next(&iter, error)) {
-		if (option->kind == TCPOPT_SACK) {
+	int slot;
+
+	if (tcp_options_ensure_index(packet, error))
+		return STATUS_ERR;
+	for (slot = 0; slot < packet->num_tcp_options; ++slot) {
+		if (packet->tcp_options[slot].kind == TCPOPT_SACK) {
+			option = tcp_option_at(packet, slot);
 			int num_blocks = 0;
 			if (num_sack_blocks(option->length,
 						    &num_blocks, error))
@@ -551,7 +565,7 @@ static int offset_sack_blocks(struct packet *packet,
 			}
 		}
 	}
-	return *error ? STATUS_ERR : STATUS_OK;
+	return STATUS_OK;
 }
 
 
@@ -594,7 +608,7 @@ static int map_inbound_icmp_packet(
  * for the given socket and process it. Returns STATUS_OK on success;
  * on failure returns STATUS_ERR and sets error message.
  */
-static int map_inbound_packet(
+int map_inbound_packet(
 	struct socket *socket, struct packet *live_packet, char **error)
 {
 	DEBUGP("map_inbound_packet\n");
@@ -657,7 +671,7 @@ static int map_inbound_packet(
  * in the space of 'script_packet'. This will allow us to compare a
  * packet sent by the kernel to the packet expected by the script.
  */
-static int map_outbound_live_packet(
+int map_outbound_live_packet(
 	struct socket *socket,
 	struct packet *live_packet,
 	struct packet *actual_packet,
@@ -1116,31 +1130,29 @@ static bool same_tcp_options(struct packet *packet_a,
 		return false;
 	}
 
-	struct tcp_options_iterator iter_a, iter_b;
-	struct tcp_option *opt_a = tcp_options_begin(packet_a, &iter_a);
-	struct tcp_option *opt_b = tcp_options_begin(packet_b, &iter_b);
+	tcp_options_ensure_index(packet_a, NULL);
+	tcp_options_ensure_index(packet_b, NULL);
 
-	//No assumption about options order
-	while(opt_a != NULL){
+	int slot_a, slot_b;
+	struct tcp_option *opt_a, *opt_b;
 
-		while(opt_b != NULL && opt_a->kind != opt_b->kind){
-			opt_b = tcp_options_next(&iter_b, NULL);
+	//No assumption about options order
+	for(slot_a = 0; slot_a < packet_a->num_tcp_options; ++slot_a){
+		const struct tcp_option_slot *a = &packet_a->tcp_options[slot_a];
+
+		// find the same kind (and, for mptcp, the same subtype) in b
+		for(slot_b = 0; slot_b < packet_b->num_tcp_options; ++slot_b){
+			const struct tcp_option_slot *b =
+				&packet_b->tcp_options[slot_b];
+			if(a->kind == b->kind && a->subtype == b->subtype)
+				break;
 		}
 		//opt_a not found in packet_b
-		if(opt_b == NULL){
+		if(slot_b == packet_b->num_tcp_options)
 			return false;
-		}
-
-		// loop on subtypes of mptcp, to compare the right option
-		if(opt_a->kind == TCPOPT_MPTCP){
-
-			while(opt_b != NULL && opt_a->data.mp_capable.subtype!=opt_b->data.mp_capable.subtype)
-				opt_b = tcp_options_next(&iter_b, NULL);
 
-			//sub-option opt_a not found in packet_b
-			if(opt_b == NULL)
-				return false;
-		}
+		opt_a = tcp_option_at(packet_a, slot_a);
+		opt_b = tcp_option_at(packet_b, slot_b);
 
 		//NOP option only contains a kind field (not length)
 		if(opt_a->kind != TCPOPT_NOP){
@@ -1153,8 +1165,6 @@ static bool same_tcp_options(struct packet *packet_a,
 
 			}
 		}
-		opt_b = tcp_options_begin(packet_b, &iter_b);
-		opt_a = tcp_options_next(&iter_a, NULL);
 	}
 	return true;
 }
@@ -1302,8 +1312,8 @@ static int verify_outbound_live_tcp_options(
 		 */
 		if (config->tcp_ts_tick_usecs &&
 		    ((abs((s32)(actual_ts_val - script_ts_val)) *
-		      config->tcp_ts_tick_usecs) >
-		     config->tolerance_usecs)) {
+		      config->tcp_ts_tick_usecs * 1000LL) >
+		     config->tolerance_nsecs)) {
 			asprintf(error, "bad outbound TCP timestamp value");
 			return STATUS_ERR;
 		}
@@ -1325,9 +1335,43 @@ static int verify_outbound_live_tcp_options(
 }
 
 
+/* With --payload_pattern, check the payload of an outbound TCP packet
+ * against the bytes the application wrote at that point of the stream:
+ * by data sequence number if a DSS option maps it, else by sequence
+ * number relative to the ISN. The script packet's own payload buffer
+ * is never looked at.
+ */
+static int verify_outbound_pattern_payload(
+	struct socket *socket, struct packet *live_packet, char **error)
+{
+	u32 len = packet_payload_len(live_packet);
+	u8 *payload = packet_payload(live_packet);
+	u16 *dss_checksum = NULL;
+	u32 subflow_offset;
+	u64 offset;
+	size_t bad;
+
+	subflow_offset = ntohl(live_packet->tcp->seq) -
+			 socket->live.local_isn + live_packet->tcp->syn;
+	if (!mptcp_data_offset(live_packet, DIRECTION_OUTBOUND,
+			       subflow_offset, &offset, &dss_checksum))
+		offset = (u32)(subflow_offset - 1);
+
+	bad = payload_pattern_check(payload, len, offset);
+	if (bad < len) {
+		asprintf(error, "incorrect outbound data payload at stream "
+			 "offset %llu: expected 0x%02x but sent 0x%02x",
+			 offset + bad, payload_pattern_byte(offset + bad),
+			 payload[bad]);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
 /* Verify TCP/UDP payload matches expected value. */
 static int verify_outbound_live_payload(
-	struct packet *actual_packet,
+	struct state *state, struct socket *socket,
+	struct packet *live_packet, struct packet *actual_packet,
 	struct packet *script_packet, char **error)
 {
 	/* Diff the TCP/UDP data payloads. We've already implicitly
@@ -1335,6 +1379,9 @@ static int verify_outbound_live_payload(
 	 */
 	assert(packet_payload_len(actual_packet) ==
 	       packet_payload_len(script_packet));
+	if (state->config->payload_pattern && live_packet->tcp != NULL)
+		return verify_outbound_pattern_payload(socket, live_packet,
+						       error);
 	if (memcmp(packet_payload(script_packet),
 		   packet_payload(actual_packet),
 		   packet_payload_len(script_packet)) != 0) {
@@ -1344,13 +1391,48 @@ static int verify_outbound_live_payload(
 	return STATUS_OK;
 }
 
+/* Return how long after its scripted time the injection of the given
+ * inbound packet event finished.
+ */
+static s64 injection_lag_nsecs(struct state *state, const struct event *event)
+{
+	return ((event->injected_nsecs - state->live_start_time_nsecs) -
+		(event->time_nsecs - state->script_start_time_nsecs));
+}
+
+/* If the last inbound packet we injected went out later than the
+ * --injection_lag_usecs threshold (or, by default, the timing
+ * tolerance), say so in the given timing error message, since a late
+ * injection can make the kernel look late.
+ */
+static void add_injection_lag_note(struct state *state, char **error)
+{
+	const struct event *event = state->packets->last_injected;
+	s64 threshold_nsecs = state->config->injection_lag_nsecs;
+	s64 lag_nsecs;
+	char *old_error = *error;
+
+	if (event == NULL || event->time_type == ANY_TIME)
+		return;
+	if (threshold_nsecs == 0)
+		threshold_nsecs = state->config->tolerance_nsecs;
+	lag_nsecs = injection_lag_nsecs(state, event);
+	if (lag_nsecs <= threshold_nsecs)
+		return;
+
+	asprintf(error, "%s (note: inbound packet at line %d was injected "
+		 "%.9f sec late)", old_error, event->line_number,
+		 nsecs_to_secs(lag_nsecs));
+	free(old_error);
+}
+
 /* Verify that the outbound packet correctly matches the expected
  * outbound packet from the script.
  * Return STATUS_OK upon success.  If non_fatal_packet is unset in the
  * config, return STATUS_ERR upon all failures.  With non_fatal_packet,
  * return STATUS_WARN upon non-fatal failures.
  */
-static int verify_outbound_live_packet(
+int verify_outbound_live_packet(
 	struct state *state, struct socket *socket,
 	struct packet *script_packet, struct packet *live_packet,
 	char **error)
@@ -1360,15 +1442,15 @@ static int verify_outbound_live_packet(
 	int result = STATUS_ERR;	/* return value */
 	bool non_fatal = false;		/* ok to continue on error? */
 	enum event_time_t time_type = state->event->time_type;
-	s64 script_usecs = state->event->time_usecs;
-	s64 script_usecs_end = state->event->time_usecs_end;
+	s64 script_nsecs = state->event->time_nsecs;
+	s64 script_nsecs_end = state->event->time_nsecs_end;
 
 	/* The "actual" packet will be the live packet with values
 	 * mapped into script space.
 	 */
 	struct packet *actual_packet = packet_copy(live_packet);
-	s64 actual_usecs = live_time_to_script_time_usecs(
-		state, live_packet->time_usecs);
+	s64 actual_nsecs = live_time_to_script_time_nsecs(
+		state, live_packet->time_nsecs);
 
 	/* Before mapping, see if the live outgoing checksums are correct. */
 	if (verify_outbound_live_checksums(live_packet, error))
@@ -1385,6 +1467,14 @@ static int verify_outbound_live_packet(
 		goto out;
 	}
 
+	/* Verify the kernel built a super-packet with the expected MSS. */
+	if (script_packet->gso_size != 0 &&
+	    check_field("gso_size", script_packet->gso_size,
+			actual_packet->gso_size, error)) {
+		non_fatal = true;
+		goto out;
+	}
+
 	if (script_packet->tcp) {
 		/* Verify TCP options matched expected values. */
 		if (verify_outbound_live_tcp_options(
@@ -1396,16 +1486,18 @@ static int verify_outbound_live_packet(
 	}
 
 	/* Verify TCP/UDP payload matches expected value. */
-	if (verify_outbound_live_payload(actual_packet, script_packet, error)) {
+	if (verify_outbound_live_payload(state, socket, live_packet,
+					 actual_packet, script_packet, error)) {
 		non_fatal = true;
 		goto out;
 	}
 
 	/* Verify that kernel sent packet at the time the script expected. */
-	DEBUGP("packet time_usecs: %lld\n", live_packet->time_usecs);
-	if (verify_time(state, time_type, script_usecs,
-				script_usecs_end, live_packet->time_usecs,
+	DEBUGP("packet time_nsecs: %lld\n", live_packet->time_nsecs);
+	if (verify_time(state, time_type, script_nsecs,
+				script_nsecs_end, live_packet->time_nsecs,
 				"outbound packet", error)) {
+		add_injection_lag_note(state, error);
 		non_fatal = true;
 		goto out;
 	}
@@ -1413,13 +1505,15 @@ static int verify_outbound_live_packet(
 	result = STATUS_OK;
 
 out:
-	add_packet_dump(error, "script", script_packet, script_usecs,
-			DUMP_SHORT);
-	if (actual_packet != NULL) {
-		add_packet_dump(error, "actual", actual_packet, actual_usecs,
+	if (result != STATUS_OK) {
+		add_packet_dump(error, "script", script_packet, script_nsecs,
 				DUMP_SHORT);
-		packet_free(actual_packet);
+		if (actual_packet != NULL)
+			add_packet_dump(error, "actual", actual_packet,
+					actual_nsecs, DUMP_SHORT);
 	}
+	if (actual_packet != NULL)
+		packet_free(actual_packet);
 	if (result == STATUS_ERR &&
 	    non_fatal &&
 	    state->config->non_fatal_packet) {
@@ -1573,12 +1667,12 @@ static int do_outbound_script_packet(
 		       socket->live.local_isn);
 	}
 
-        if (packet->tcp->rst)
+        if (packet->tcp && packet->tcp->rst)
                 socket->state = SOCKET_RESET_RECEIVED;
 
 	verbose_packet_dump(state, "outbound sniffed", live_packet,
-			    live_time_to_script_time_usecs(
-				    state, live_packet->time_usecs));
+			    live_time_to_script_time_nsecs(
+				    state, live_packet->time_nsecs));
 
 	/* Save the TCP header so we can reset the connection at the end. */
 	if (live_packet->tcp)
@@ -1594,6 +1688,35 @@ out:
 	return result;
 }
 
+void report_injection_lag(struct state *state)
+{
+	s64 threshold_nsecs = state->config->injection_lag_nsecs;
+	s64 lag_nsecs;
+	struct event *event;
+	int injected = 0, late = 0;
+
+	if (threshold_nsecs == 0)
+		return;
+
+	for (event = state->script->event_list; event != NULL;
+	     event = event->next) {
+		if (event->injected_nsecs == 0 || event->time_type == ANY_TIME)
+			continue;
+		++injected;
+		lag_nsecs = injection_lag_nsecs(state, event);
+		if (lag_nsecs > threshold_nsecs) {
+			++late;
+			fprintf(stderr, "%s:%d: warning: inbound packet "
+				"injected %.9f sec late\n",
+				state->config->script_path,
+				event->line_number, nsecs_to_secs(lag_nsecs));
+		}
+	}
+	fprintf(stderr, "%s: %d of %d inbound packets injected more than "
+		"%.9f sec late\n", state->config->script_path,
+		late, injected, nsecs_to_secs(threshold_nsecs));
+}
+
 /* Checksum the packet and inject it into the kernel under test. */
 static int send_live_ip_packet(struct netdev *netdev,
 			       struct packet *packet)
@@ -1610,6 +1733,35 @@ static int send_live_ip_packet(struct netdev *netdev,
 	return netdev_send(netdev, packet);
 }
 
+/* With --payload_pattern, fill the payload of an inbound TCP packet
+ * with the pattern bytes for where its data sits in the stream: by
+ * data sequence number if a DSS option maps it, else by its sequence
+ * number relative to the ISN.
+ */
+static void fill_inbound_payload(struct socket *socket,
+				 struct packet *live_packet)
+{
+	u32 len = packet_payload_len(live_packet);
+	u32 subflow_offset;
+	u16 *dss_checksum = NULL;
+	u64 offset;
+
+	if (live_packet->tcp == NULL || len == 0)
+		return;
+
+	/* Data in a SYN starts just after the SYN's own sequence number. */
+	subflow_offset = ntohl(live_packet->tcp->seq) -
+			 socket->live.remote_isn + live_packet->tcp->syn;
+	if (!mptcp_data_offset(live_packet, DIRECTION_INBOUND,
+			       subflow_offset, &offset, &dss_checksum))
+		offset = (u32)(subflow_offset - 1);
+
+	payload_pattern_fill(packet_payload(live_packet), len, offset);
+	if (dss_checksum != NULL)
+		add_payload_to_dss_checksum(dss_checksum,
+					    packet_payload(live_packet), len);
+}
+
 /* Perform the action implied by an inbound packet in a script */
 static int do_inbound_script_packet(
 	struct state *state, struct packet *packet,
@@ -1635,10 +1787,12 @@ static int do_inbound_script_packet(
 	/* Map packet fields from script values to live values. */
 	if (map_inbound_packet(socket, live_packet, error))
 		goto out;
+	if (state->config->payload_pattern)
+		fill_inbound_payload(socket, live_packet);
 
 	verbose_packet_dump(state, "inbound injected", live_packet,
-			    live_time_to_script_time_usecs(
-				    state, now_usecs()));
+			    live_time_to_script_time_nsecs(
+				    state, now_nsecs()));
 
 	if (live_packet->tcp) {
 		/* Save the TCP header so we can reset the connection later. */
@@ -1649,6 +1803,16 @@ static int do_inbound_script_packet(
 
 	/* Inject live packet into kernel. */
 	result = send_live_ip_packet(state->netdev, live_packet);
+	if (result == STATUS_OK) {
+		/* Note when the injection actually finished, so timing
+		 * errors can tell our own lateness from the kernel's.
+		 */
+		state->event->injected_nsecs = now_nsecs();
+		state->packets->last_injected = state->event;
+		DEBUGP("injected %.9f sec after script time\n",
+		       nsecs_to_secs(injection_lag_nsecs(state,
+							 state->event)));
+	}
 
 out:
 	packet_free(live_packet);
@@ -1703,19 +1867,16 @@ out:
 	return result;
 }
 
-/* Inject a TCP RST packet to clear the connection state out of the
- * kernel, so the connection does not continue to retransmit packets
- * that may be sniffed during later test executions and cause false
- * negatives.
+/* Build a TCP RST packet, with live addresses and checksums, that will
+ * clear the connection state for the socket out of the kernel.
  */
-int reset_connection(struct state *state, struct socket *socket)
+static struct packet *new_reset_packet(struct socket *socket)
 {
 	char *error = NULL;
 	u32 seq = 0, ack_seq = 0;
 	u16 window = 0;
 	struct packet *packet = NULL;
 	struct tuple live_inbound;
-	int result = 0;
 
 	/* Pick TCP header fields to be something the kernel will accept. */
 	if (socket->last_injected_tcp_header.ack) {
@@ -1757,10 +1918,105 @@ int reset_connection(struct state *state, struct socket *socket)
 	socket_get_inbound(&socket->live, &live_inbound);
 	set_packet_tuple(packet, &live_inbound);
 
-	/* Inject live packet into kernel. */
-	result = send_live_ip_packet(state->netdev, packet);
+	/* Fill in layer 3 and layer 4 checksums */
+	checksum_packet(packet);
+	return packet;
+}
+
+/* How often we ask inet_diag whether a reset connection is gone. */
+#define RESET_POLL_USECS	1000
 
-	packet_free(packet);
+/* Poll inet_diag until the kernel no longer has any of the given
+ * connections, or until --reset_wait_usecs have passed, and warn
+ * about any connections that are still around then.
+ */
+static void wait_for_resets(struct state *state,
+			    struct socket **sockets, int num_sockets)
+{
+	const s64 deadline_nsecs = now_nsecs() +
+				   state->config->reset_wait_nsecs;
+	int diag_fd = sock_diag_open();
+	int i, num_left = 0;
+
+	for (i = 0; i < num_sockets; ++i) {
+		struct socket *socket = sockets[i];
+		char *error = NULL;
+		bool exists = true;
+
+		while (exists) {
+			if (sock_diag_tcp_exists(diag_fd, &socket->live.local,
+						 &socket->live.remote,
+						 &exists, &error))
+				die("%s\n", error);
+			if (!exists)
+				break;
+			if (now_nsecs() >= deadline_nsecs) {
+				++num_left;
+				break;
+			}
+			usleep(RESET_POLL_USECS);
+		}
+	}
+	if (close(diag_fd))
+		die_perror("close");
+
+	if (num_left > 0) {
+		fprintf(stderr, "%s: warning: %d of %d connections still "
+			"present %.6f sec after reset\n",
+			state->config->script_path, num_left, num_sockets,
+			nsecs_to_secs(state->config->reset_wait_nsecs));
+	}
+}
+
+/* Inject TCP RST packets to clear the state of all TCP connections out
+ * of the kernel, so they do not continue to retransmit packets that may
+ * be sniffed during later test executions and cause false negatives.
+ * All the RSTs are built before the first one is injected, so the
+ * kernel sees them back to back.
+ */
+int reset_connections(struct state *state)
+{
+	struct socket *socket = NULL;
+	struct socket **sockets = NULL;
+	struct packet **packets = NULL;
+	int num_sockets = 0, num_waits = 0;
+	int i, result = STATUS_OK;
+
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
+		if (socket->protocol == IPPROTO_TCP)
+			++num_sockets;
+	}
+	if (num_sockets == 0)
+		return STATUS_OK;
+
+	sockets = calloc(num_sockets, sizeof(struct socket *));
+	packets = calloc(num_sockets, sizeof(struct packet *));
+	i = 0;
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
+		if (socket->protocol != IPPROTO_TCP)
+			continue;
+		sockets[i] = socket;
+		packets[i] = new_reset_packet(socket);
+		++i;
+	}
+
+	/* Inject live packets into kernel. */
+	for (i = 0; i < num_sockets; ++i) {
+		if (result == STATUS_OK)
+			result = netdev_send(state->netdev, packets[i]);
+		packet_free(packets[i]);
+	}
+	free(packets);
+
+	/* Listening sockets have no peer, so there is nothing to wait for. */
+	if (result == STATUS_OK && state->config->reset_wait_nsecs > 0) {
+		for (i = 0; i < num_sockets; ++i) {
+			if (sockets[i]->live.remote.port != 0)
+				sockets[num_waits++] = sockets[i];
+		}
+		wait_for_resets(state, sockets, num_waits);
+	}
+	free(sockets);
 
 	return result;
 }
@@ -37,6 +37,7 @@ struct state;
 /* Internal state for the packet-handling module. */
 struct packets {
 	int next_ephemeral_port;	/* cached port to use, or -1 */
+	struct event *last_injected;	/* latest injected inbound packet */
 };
 
 /* Allocate and return internal state for the packets module. */
@@ -54,8 +55,46 @@ extern int run_packet_event(struct state *state,
 			    struct packet *packet,
 			    char **error);
 
-/* Inject a TCP RST packet to clear the connection state out of the kernel. */
-extern int reset_connection(struct state *state,
-			    struct socket *socket);
+/* The per-packet steps of running a packet event, exported for the
+ * micro-benchmarks in microbench.c.
+ */
+
+/* Map an inbound script packet (already copied into 'live_packet')
+ * from script values to live values for the given socket.
+ */
+extern int map_inbound_packet(struct socket *socket,
+			      struct packet *live_packet,
+			      char **error);
+
+/* Map the sniffed outbound 'live_packet' into script space, writing
+ * the result into 'actual_packet' for comparison with 'script_packet'.
+ */
+extern int map_outbound_live_packet(struct socket *socket,
+				    struct packet *live_packet,
+				    struct packet *actual_packet,
+				    struct packet *script_packet,
+				    char **error);
+
+/* Check a sniffed outbound packet against the current script event.
+ * Returns STATUS_OK, STATUS_WARN or STATUS_ERR with *error filled in.
+ */
+extern int verify_outbound_live_packet(struct state *state,
+				       struct socket *socket,
+				       struct packet *script_packet,
+				       struct packet *live_packet,
+				       char **error);
+
+/* Print a report of inbound packets whose injection finished more than
+ * --injection_lag_usecs after the time the script specified. Does
+ * nothing if no threshold was configured.
+ */
+extern void report_injection_lag(struct state *state);
+
+/* Inject a TCP RST packet for each TCP socket, all in one batch, to
+ * clear the connection state out of the kernel. With --reset_wait_usecs,
+ * then wait for the kernel to drop the connections, and warn about any
+ * it still has when the time is up.
+ */
+extern int reset_connections(struct state *state);
 
 #endif /* __RUN_PACKET_H__ */
@@ -30,20 +30,30 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#if defined(linux)
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#endif
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#include "fuzz.h"
 #include "logging.h"
+#include "payload_pattern.h"
 #include "run.h"
 #include "script.h"
+#include "udp.h"
 
 static int to_live_fd(struct state *state, int script_fd, int *live_fd,
 		      char **error);
@@ -245,8 +255,63 @@ static int ellipsis_arg(struct expression_list *args, int index, char **error)
 	return STATUS_OK;
 }
 
+/* What a buffer from payload_buffer_get() holds a payload for. */
+enum payload_use {
+	PAYLOAD_READ,		/* received data */
+	PAYLOAD_WRITE,		/* sent data, always all zeroes */
+	PAYLOAD_PATTERN_WRITE,	/* sent data filled in by --payload_pattern */
+};
+
+/* Return a buffer for a payload of count bytes, starting offset bytes
+ * into the calling thread's buffer of the payload arena for that use
+ * if it fits there, or else freshly allocated.
+ */
+static void *payload_buffer_get(struct state *state, size_t offset,
+				size_t count, enum payload_use use)
+{
+	struct syscalls *syscalls = state->syscalls;
+	void *buf = NULL;
+
+	if (syscalls->payload_arena != NULL &&
+	    offset <= syscalls->payload_bytes &&
+	    count <= syscalls->payload_bytes - offset) {
+		bool in_thread = pthread_equal(pthread_self(),
+					       syscalls->thread);
+
+		switch (use) {
+		case PAYLOAD_READ:
+			return (in_thread ? syscalls->thread_payload_read :
+				syscalls->payload_read) + offset;
+		case PAYLOAD_WRITE:
+			return (in_thread ? syscalls->thread_payload_write :
+				syscalls->payload_write) + offset;
+		case PAYLOAD_PATTERN_WRITE:
+			return (in_thread ?
+				syscalls->thread_payload_pattern_write :
+				syscalls->payload_pattern_write) + offset;
+		}
+	}
+
+	buf = calloc(count, 1);
+	assert(buf != NULL);
+	return buf;
+}
+
+/* Release a buffer from payload_buffer_get(). */
+static void payload_buffer_put(struct state *state, void *buf)
+{
+	struct syscalls *syscalls = state->syscalls;
+	u8 *p = buf;
+
+	if (p >= syscalls->payload_arena &&
+	    p < syscalls->payload_arena + syscalls->payload_arena_bytes)
+		return;
+	free(buf);
+}
+
 /* Free all the space used by the given iovec. */
-static void iovec_free(struct iovec *iov, size_t iov_len)
+static void iovec_free(struct state *state, struct iovec *iov,
+		       size_t iov_len)
 {
 	int i;
 
@@ -254,16 +319,18 @@ static void iovec_free(struct iovec *iov, size_t iov_len)
 		return;
 
 	for (i = 0; i < iov_len; ++i)
-		free(iov[i].iov_base);
+		payload_buffer_put(state, iov[i].iov_base);
 	free(iov);
 }
 
-/* Allocate and fill in an iovec described by the given expression.
+/* Allocate and fill in an iovec described by the given expression,
+ * with buffers starting offset bytes into the payload arena.
  * Return STATUS_OK if the expression is a valid iovec. Otherwise
  * fill in the error with a human-readable error message and return
  * STATUS_ERR.
  */
-static int iovec_new(struct expression *expression,
+static int iovec_new(struct state *state, struct expression *expression,
+		     enum payload_use use, size_t offset,
 		     struct iovec **iov_ptr, size_t *iov_len_ptr,
 		     char **error)
 {
@@ -296,7 +363,8 @@ static int iovec_new(struct expression *expression,
 		len = iov_expr->iov_len->value.num;
 
 		iov[i].iov_len = len;
-		iov[i].iov_base = calloc(len, 1);
+		iov[i].iov_base = payload_buffer_get(state, offset, len, use);
+		offset += len;
 	}
 
 	status = STATUS_OK;
@@ -308,20 +376,87 @@ error_out:
 }
 
 /* Free all the space used by the given msghdr. */
-static void msghdr_free(struct msghdr *msg, size_t iov_len)
+static void msghdr_free(struct state *state, struct msghdr *msg,
+			size_t iov_len)
 {
 	if (msg == NULL)
 		return;
 
 	free(msg->msg_name);
-	iovec_free(msg->msg_iov, iov_len);
+	iovec_free(state, msg->msg_iov, iov_len);
 	free(msg->msg_control);
 }
 
-/* Allocate and fill in a msghdr described by the given expression. */
-static int msghdr_new(struct expression *expression,
-		      struct msghdr **msg_ptr, size_t *iov_len_ptr,
-		      char **error)
+/* Room we leave for the data of each cmsg we receive: enough for a
+ * sock_extended_err and the address of the offender that follows it.
+ */
+#define MAX_CMSG_DATA	(64 + sizeof(struct sockaddr_storage))
+
+/* Return how many bytes of data a cmsg of the given level and type
+ * carries when the script gives it as an integer.
+ */
+static size_t cmsg_int_bytes(int level, int type)
+{
+#if defined(linux)
+	if (level == SOL_UDP && type == UDP_SEGMENT)
+		return sizeof(u16);	/* the gso_size */
+#endif
+	return sizeof(int);
+}
+
+/* Fill in the control buffer of a msghdr we send with the cmsgs in the
+ * script's msg_control, and trim msg_controllen to fit them.
+ */
+static int cmsgs_new(struct expression *control, struct msghdr *msg,
+		     char **error)
+{
+	struct expression_list *list = control->value.list;
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	size_t controllen = 0;
+
+	for (; list != NULL; list = list->next) {
+		struct cmsghdr_expr *cmsg_expr;
+		s32 level, type, value;
+		size_t data_len;
+
+		if (check_type(list->expression, EXPR_CMSGHDR, error))
+			return STATUS_ERR;
+		cmsg_expr = list->expression->value.cmsghdr;
+		if (get_s32(cmsg_expr->cmsg_level, &level, error) ||
+		    get_s32(cmsg_expr->cmsg_type, &type, error) ||
+		    get_s32(cmsg_expr->cmsg_data, &value, error))
+			return STATUS_ERR;
+
+		data_len = cmsg_int_bytes(level, type);
+		cmsg->cmsg_level = level;
+		cmsg->cmsg_type = type;
+		cmsg->cmsg_len = CMSG_LEN(data_len);
+		if (data_len == sizeof(u16)) {
+			u16 value16 = value;
+
+			memcpy(CMSG_DATA(cmsg), &value16, sizeof(value16));
+		} else {
+			memcpy(CMSG_DATA(cmsg), &value, sizeof(value));
+		}
+		controllen += CMSG_SPACE(data_len);
+		cmsg = CMSG_NXTHDR(msg, cmsg);
+	}
+
+	msg->msg_controllen = controllen;
+	if (controllen == 0) {
+		free(msg->msg_control);
+		msg->msg_control = NULL;
+	}
+	return STATUS_OK;
+}
+
+/* Allocate and fill in a msghdr described by the given expression,
+ * with its iovec buffers starting offset bytes into the payload arena.
+ */
+static int msghdr_new(struct state *state, struct expression *expression,
+		      enum payload_use use, size_t offset,
+		      struct msghdr **msg_ptr,
+		      size_t *iov_len_ptr, char **error)
 {
 	int status = STATUS_ERR;
 	s32 s32_val = 0;
@@ -347,8 +482,8 @@ static int msghdr_new(struct expression *expression,
 	}
 
 	if (msg_expr->msg_iov != NULL) {
-		if (iovec_new(msg_expr->msg_iov, &msg->msg_iov, iov_len_ptr,
-			      error))
+		if (iovec_new(state, msg_expr->msg_iov, use, offset,
+			      &msg->msg_iov, iov_len_ptr, error))
 			goto error_out;
 	}
 
@@ -371,7 +506,22 @@ static int msghdr_new(struct expression *expression,
 		msg->msg_flags = s32_val;
 	}
 
-	/* TODO(ncardwell): msg_control, msg_controllen */
+	if (msg_expr->msg_control != NULL) {
+		int num_cmsgs;
+
+		if (check_type(msg_expr->msg_control, EXPR_LIST, error))
+			goto error_out;
+		/* Leave room for one more cmsg than we expect, so an
+		 * unexpected one shows up as such, not as MSG_CTRUNC.
+		 */
+		num_cmsgs = expression_list_length(
+			msg_expr->msg_control->value.list) + 1;
+		msg->msg_controllen = num_cmsgs * CMSG_SPACE(MAX_CMSG_DATA);
+		msg->msg_control = calloc(1, msg->msg_controllen);
+		if (use != PAYLOAD_READ &&
+		    cmsgs_new(msg_expr->msg_control, msg, error))
+			goto error_out;
+	}
 
 	status = STATUS_OK;
 
@@ -520,10 +670,10 @@ static int end_syscall(struct state *state, struct syscall_spec *syscall,
 
 	/* For blocking calls, advance state and reacquire the global lock. */
 	if (is_blocking_syscall(syscall)) {
-		s64 live_end_usecs = now_usecs();
+		s64 live_end_nsecs = now_nsecs();
 		DEBUGP("syscall thread: end_syscall grabs lock\n");
 		run_lock(state);
-		state->syscalls->live_end_usecs = live_end_usecs;
+		state->syscalls->live_end_nsecs = live_end_nsecs;
 		assert(state->syscalls->state == SYSCALL_RUNNING);
 		state->syscalls->state = SYSCALL_DONE;
 	}
@@ -571,6 +721,18 @@ static int end_syscall(struct state *state, struct syscall_spec *syscall,
 	return STATUS_OK;
 }
 
+/* Return the io_uring to issue this system call through, or NULL to
+ * make a plain system call. Blocking calls run in the syscall thread,
+ * which uses its own ring.
+ */
+static struct uring *syscall_uring(struct state *state,
+				   struct syscall_spec *syscall)
+{
+	if (is_blocking_syscall(syscall))
+		return state->syscalls->thread_uring;
+	return state->syscalls->uring;
+}
+
 /* Return a pointer to the socket with the given script fd, or NULL. */
 static struct socket *find_socket_by_script_fd(
 	struct state *state, int script_fd)
@@ -586,6 +748,176 @@ static struct socket *find_socket_by_script_fd(
 	return NULL;
 }
 
+/* Return the TCP socket whose payloads --payload_pattern covers for
+ * this script fd, or NULL.
+ */
+static struct socket *find_pattern_socket(struct state *state, int script_fd)
+{
+	struct socket *socket = NULL;
+
+	if (!state->config->payload_pattern)
+		return NULL;
+	socket = find_socket_by_script_fd(state, script_fd);
+	if (socket == NULL || socket->protocol != IPPROTO_TCP)
+		return NULL;
+	return socket;
+}
+
+/* Return which payload arena buffer a write on this script fd sends
+ * from: pattern bytes for the sockets --payload_pattern covers, zeroes
+ * for all others.
+ */
+static enum payload_use write_payload_use(struct state *state,
+					  int script_fd)
+{
+	if (find_pattern_socket(state, script_fd) != NULL)
+		return PAYLOAD_PATTERN_WRITE;
+	return PAYLOAD_WRITE;
+}
+
+/* With --payload_pattern, check that the bytes a read-family call
+ * returned from a TCP socket, spread over the given iovec, are the next
+ * ones of the pattern stream, and move the socket's read offset past
+ * them unless the call only peeked.
+ */
+static int verify_read_payload(struct state *state, int script_fd,
+			       const struct iovec *iov, size_t iov_len,
+			       int bytes, bool peek, char **error)
+{
+	struct socket *socket = find_pattern_socket(state, script_fd);
+	u64 offset;
+	size_t i;
+
+	if (socket == NULL || bytes <= 0)
+		return STATUS_OK;
+
+	offset = socket->read_offset;
+	for (i = 0; i < iov_len && bytes > 0; ++i) {
+		size_t len = min(iov[i].iov_len, (size_t)bytes);
+		const u8 *buf = iov[i].iov_base;
+		size_t bad = payload_pattern_check(buf, len, offset);
+
+		if (bad < len) {
+			asprintf(error, "Bad payload byte at stream offset "
+				 "%llu: expected 0x%02x but read 0x%02x",
+				 offset + bad,
+				 payload_pattern_byte(offset + bad), buf[bad]);
+			return STATUS_ERR;
+		}
+		offset += len;
+		bytes -= len;
+	}
+
+	if (!peek)
+		socket->read_offset = offset;
+	return STATUS_OK;
+}
+
+/* With --payload_pattern, fill the buffers of a write-family call on a
+ * TCP socket with the next bytes of the socket's outbound stream, so
+ * the packets the kernel sends can be checked against the pattern.
+ * The kernel copies the data, except for MSG_ZEROCOPY sends, whose
+ * pages the next write would overwrite before they are acked.
+ */
+static int fill_write_payload(struct state *state, int script_fd,
+			      const struct iovec *iov, size_t iov_len,
+			      int flags, char **error)
+{
+	struct socket *socket = find_pattern_socket(state, script_fd);
+	u64 offset;
+	size_t i;
+
+	if (socket == NULL)
+		return STATUS_OK;
+#ifdef MSG_ZEROCOPY
+	if (flags & MSG_ZEROCOPY) {
+		asprintf(error, "MSG_ZEROCOPY does not work with "
+			 "--payload_pattern");
+		return STATUS_ERR;
+	}
+#endif
+
+	offset = socket->write_offset;
+	for (i = 0; i < iov_len; ++i) {
+		payload_pattern_fill(iov[i].iov_base, iov[i].iov_len, offset);
+		offset += iov[i].iov_len;
+	}
+	return STATUS_OK;
+}
+
+/* Move the socket's outbound stream past the bytes a write took. */
+static void advance_write_payload(struct state *state, int script_fd,
+				  int bytes)
+{
+	struct socket *socket = find_pattern_socket(state, script_fd);
+
+	if (socket != NULL && bytes > 0)
+		socket->write_offset += bytes;
+}
+
+/* With --payload_pattern, fail a call that moves the payload of a TCP
+ * socket without going through the pattern stream, as the socket's
+ * stream offsets would no longer match its data.
+ */
+static int reject_pattern_socket(struct state *state, int script_fd,
+				 const char *name, char **error)
+{
+	if (find_pattern_socket(state, script_fd) == NULL)
+		return STATUS_OK;
+	asprintf(error, "%s does not work with --payload_pattern", name);
+	return STATUS_ERR;
+}
+
+/* Add a port to the filter port list, unless it is 0 or already there. */
+static void add_filter_port(u16 *ports, int *num_ports, u16 port)
+{
+	int i;
+
+	if (port == 0 || *num_ports > PACKET_FILTER_MAX_PORTS)
+		return;
+	for (i = 0; i < *num_ports; ++i) {
+		if (ports[i] == port)
+			return;
+	}
+	ports[(*num_ports)++] = port;
+}
+
+/* Narrow the sniffing filter of the netdev to the ports of live
+ * sockets. The default and per-fd configured ports are always kept,
+ * since packets may use them before their socket learns its live ports.
+ */
+static void update_packet_filter(struct state *state)
+{
+	u16 ports[PACKET_FILTER_MAX_PORTS + 1];
+	int num_ports = 0;
+	struct socket *socket = NULL;
+	int fd;
+
+	if (state->netdev == NULL)
+		return;
+
+	add_filter_port(ports, &num_ports,
+			state->config->default_live_bind_port);
+	add_filter_port(ports, &num_ports,
+			state->config->default_live_connect_port);
+	for (fd = 0; fd < ARRAY_SIZE(state->config->sock_fd_ports); ++fd) {
+		add_filter_port(ports, &num_ports,
+				state->config->sock_fd_ports[fd].live_local);
+		add_filter_port(ports, &num_ports,
+				state->config->sock_fd_ports[fd].live_remote);
+	}
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
+		if (socket->is_closed)
+			continue;
+		add_filter_port(ports, &num_ports,
+				ntohs(socket->live.local.port));
+		add_filter_port(ports, &num_ports,
+				ntohs(socket->live.remote.port));
+	}
+
+	netdev_filter_ports(state->netdev, ports, num_ports);
+}
+
 /* Return a pointer to the socket with the given live fd, or NULL. */
 static struct socket *find_socket_by_live_fd(
 	struct state *state, int live_fd)
@@ -600,6 +932,19 @@ static struct socket *find_socket_by_live_fd(
 	return NULL;
 }
 
+/* Return a pointer to the temp file or pipe end with the given script
+ * fd, or NULL.
+ */
+static struct script_file *find_file_by_script_fd(
+	struct state *state, int script_fd)
+{
+	struct script_file *file = NULL;
+	for (file = state->syscalls->files; file != NULL; file = file->next)
+		if (file->script_fd == script_fd)
+			return file;
+	return NULL;
+}
+
 /* Find the live fd corresponding to the fd in a script. Returns
  * STATUS_OK on success; on failure returns STATUS_ERR and sets
  * error message.
@@ -608,15 +953,20 @@ static int to_live_fd(struct state *state, int script_fd, int *live_fd,
 		      char **error)
 {
 	struct socket *socket = find_socket_by_script_fd(state, script_fd);
+	struct script_file *file = NULL;
 	if (socket != NULL) {
 		*live_fd = socket->live.fd;
 		return STATUS_OK;
-	} else {
-		*live_fd = -1;
-		asprintf(error, "unable to find socket with script fd %d",
-			 script_fd);
-		return STATUS_ERR;
 	}
+	file = find_file_by_script_fd(state, script_fd);
+	if (file != NULL) {
+		*live_fd = file->live_fd;
+		return STATUS_OK;
+	}
+	*live_fd = -1;
+	asprintf(error, "unable to find socket, file or pipe with script fd %d",
+		 script_fd);
+	return STATUS_ERR;
 }
 
 /****************************************************************************
@@ -669,6 +1019,7 @@ static int run_syscall_socket(struct state *state, int address_family,
 
 	DEBUGP("socket() creating new socket: script_fd: %d live_fd: %d\n",
 	       socket->script.fd, socket->live.fd);
+	update_packet_filter(state);
 	return STATUS_OK;
 }
 
@@ -693,6 +1044,48 @@ error_out:
 	return STATUS_ERR;
 }
 
+/* The app created a temp file or pipe in the script and we created a
+ * live one. Track the new fd. Returns STATUS_OK on success; on failure
+ * returns STATUS_ERR and sets error message.
+ */
+static int run_syscall_file(struct state *state, int script_fd, int live_fd,
+			    char **error)
+{
+	struct script_file *file = NULL;
+
+	if (script_fd < 0) {
+		asprintf(error, "invalid fd %d in script", script_fd);
+		return STATUS_ERR;
+	}
+	if (find_socket_by_script_fd(state, script_fd) ||
+	    find_file_by_script_fd(state, script_fd)) {
+		asprintf(error, "duplicate fd %d in script", script_fd);
+		return STATUS_ERR;
+	}
+
+	file = calloc(1, sizeof(struct script_file));
+	file->script_fd = script_fd;
+	file->live_fd = live_fd;
+	file->next = state->syscalls->files;
+	state->syscalls->files = file;
+
+	DEBUGP("creating new file: script_fd: %d live_fd: %d\n",
+	       script_fd, live_fd);
+	return STATUS_OK;
+}
+
+/* The app closed a temp file or pipe end; stop tracking it. */
+static void run_syscall_close_file(struct state *state,
+				   struct script_file *file)
+{
+	struct script_file **link = &state->syscalls->files;
+
+	while (*link != file)
+		link = &(*link)->next;
+	*link = file->next;
+	free(file);
+}
+
 /* Fill in the live_addr and live_addrlen for a bind() call.
  * Returns STATUS_OK on success; on failure returns STATUS_ERR and
  * sets error message.
@@ -823,6 +1216,7 @@ static int run_syscall_accept(struct state *state,
 		       ip_to_string(&socket->live.remote.ip, remote_string),
 		       ntohs(socket->live.remote.port));
 	}
+	update_packet_filter(state);
 	return STATUS_OK;
 }
 
@@ -866,6 +1260,7 @@ static int run_syscall_connect(struct state *state,
 	socket->live.remote.ip   = state->config->live_remote_ip;
  	socket->live.remote.port = htons(state->config->default_live_connect_port);
 	DEBUGP("success: setting socket to state %d\n", socket->state);
+	update_packet_filter(state);
 	return STATUS_OK;
 }
 
@@ -961,6 +1356,7 @@ static int set_bind_sockaddr_config(struct state *state,
 		state->config->sock_fd_ports[script_fd].live_local = state->config->default_live_bind_port;
 		state->config->sock_fd_ports[script_fd].live_remote = state->config->default_live_connect_port;
 	}
+	update_packet_filter(state);
 	return STATUS_OK;
 }
 
@@ -1068,6 +1464,7 @@ static int syscall_accept(struct state *state, struct syscall_spec *syscall,
 	int live_fd, script_fd, live_accepted_fd, script_accepted_fd, result;
 	struct sockaddr_storage live_addr;
 	socklen_t live_addrlen = sizeof(live_addr);
+	struct uring *uring = NULL;
 	if (check_arg_count(args, 3, error))
 		return STATUS_ERR;
 	if (s32_arg(args, 0, &script_fd, error))
@@ -1079,9 +1476,17 @@ static int syscall_accept(struct state *state, struct syscall_spec *syscall,
 	if (ellipsis_arg(args, 2, error))
 		return STATUS_ERR;
 
+	uring = syscall_uring(state, syscall);
+
 	begin_syscall(state, syscall);
 
-	result = accept(live_fd, (struct sockaddr *)&live_addr, &live_addrlen);
+	if (uring != NULL)
+		result = uring_accept(uring, live_fd,
+				      (struct sockaddr *)&live_addr,
+				      &live_addrlen);
+	else
+		result = accept(live_fd, (struct sockaddr *)&live_addr,
+				&live_addrlen);
 
 	if (end_syscall(state, syscall, CHECK_NON_NEGATIVE, result, error))
 		return STATUS_ERR;
@@ -1106,6 +1511,7 @@ static int syscall_connect(struct state *state, struct syscall_spec *syscall,
 	int live_fd, script_fd, result;
 	struct sockaddr_storage live_addr;
 	socklen_t live_addrlen = sizeof(live_addr);
+	struct uring *uring = NULL;
 	if (check_arg_count(args, 3, error))
 		return STATUS_ERR;
 	if (s32_arg(args, 0, &script_fd, error))
@@ -1122,9 +1528,17 @@ static int syscall_connect(struct state *state, struct syscall_spec *syscall,
 		    (struct sockaddr *)&live_addr, &live_addrlen, error))
 		return STATUS_ERR;
 
+	uring = syscall_uring(state, syscall);
+
 	begin_syscall(state, syscall);
 
-	result = connect(live_fd, (struct sockaddr *)&live_addr, live_addrlen);
+	if (uring != NULL)
+		result = uring_connect(uring, live_fd,
+				       (struct sockaddr *)&live_addr,
+				       live_addrlen);
+	else
+		result = connect(live_fd, (struct sockaddr *)&live_addr,
+				 live_addrlen);
 
 	return end_syscall(state, syscall, CHECK_EXACT, result, error);
 }
@@ -1133,6 +1547,7 @@ static int syscall_read(struct state *state, struct syscall_spec *syscall,
 			struct expression_list *args, char **error)
 {
 	int live_fd, script_fd, count, result;
+	struct uring *uring = NULL;
 	char *buf = NULL;
 	if (check_arg_count(args, 3, error))
 		return STATUS_ERR;
@@ -1144,16 +1559,25 @@ static int syscall_read(struct state *state, struct syscall_spec *syscall,
 		return STATUS_ERR;
 	if (s32_arg(args, 2, &count, error))
 		return STATUS_ERR;
-	buf = malloc(count);
-	assert(buf != NULL);
+	buf = payload_buffer_get(state, 0, count, PAYLOAD_READ);
+	uring = syscall_uring(state, syscall);
 
 	begin_syscall(state, syscall);
 
-	result = read(live_fd, buf, count);
+	if (uring != NULL)
+		result = uring_read(uring, live_fd, buf, count);
+	else
+		result = read(live_fd, buf, count);
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	if (status == STATUS_OK) {
+		struct iovec iov = { .iov_base = buf, .iov_len = count };
 
-	free(buf);
+		status = verify_read_payload(state, script_fd, &iov, 1,
+					     result, false, error);
+	}
+
+	payload_buffer_put(state, buf);
 	return status;
 }
 
@@ -1177,7 +1601,8 @@ static int syscall_readv(struct state *state, struct syscall_spec *syscall,
 	iov_expression = get_arg(args, 1, error);
 	if (iov_expression == NULL)
 		goto error_out;
-	if (iovec_new(iov_expression, &iov, &iov_len, error))
+	if (iovec_new(state, iov_expression, PAYLOAD_READ, 0, &iov, &iov_len,
+		      error))
 		goto error_out;
 
 	if (s32_arg(args, 2, &iov_count, error))
@@ -1195,9 +1620,12 @@ static int syscall_readv(struct state *state, struct syscall_spec *syscall,
 	result = readv(live_fd, iov, iov_count);
 
 	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	if (status == STATUS_OK)
+		status = verify_read_payload(state, script_fd, iov, iov_len,
+					     result, false, error);
 
 error_out:
-	iovec_free(iov, iov_len);
+	iovec_free(state, iov, iov_len);
 	return status;
 }
 
@@ -1205,6 +1633,7 @@ static int syscall_recv(struct state *state, struct syscall_spec *syscall,
 			struct expression_list *args, char **error)
 {
 	int live_fd, script_fd, count, flags, result;
+	struct uring *uring = NULL;
 	char *buf = NULL;
 	if (check_arg_count(args, 4, error))
 		return STATUS_ERR;
@@ -1218,16 +1647,25 @@ static int syscall_recv(struct state *state, struct syscall_spec *syscall,
 		return STATUS_ERR;
 	if (s32_arg(args, 3, &flags, error))
 		return STATUS_ERR;
-	buf = malloc(count);
-	assert(buf != NULL);
+	buf = payload_buffer_get(state, 0, count, PAYLOAD_READ);
+	uring = syscall_uring(state, syscall);
 
 	begin_syscall(state, syscall);
 
-	result = recv(live_fd, buf, count, flags);
+	if (uring != NULL)
+		result = uring_recv(uring, live_fd, buf, count, flags);
+	else
+		result = recv(live_fd, buf, count, flags);
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	if (status == STATUS_OK) {
+		struct iovec iov = { .iov_base = buf, .iov_len = count };
 
-	free(buf);
+		status = verify_read_payload(state, script_fd, &iov, 1,
+					     result, flags & MSG_PEEK, error);
+	}
+
+	payload_buffer_put(state, buf);
 	return status;
 }
 
@@ -1254,8 +1692,7 @@ static int syscall_recvfrom(struct state *state, struct syscall_spec *syscall,
 		return STATUS_ERR;
 	if (ellipsis_arg(args, 5, error))
 		return STATUS_ERR;
-	buf = malloc(count);
-	assert(buf != NULL);
+	buf = payload_buffer_get(state, 0, count, PAYLOAD_READ);
 
 	begin_syscall(state, syscall);
 
@@ -1263,11 +1700,141 @@ static int syscall_recvfrom(struct state *state, struct syscall_spec *syscall,
 			  (struct sockaddr *)&live_addr, &live_addrlen);
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	if (status == STATUS_OK) {
+		struct iovec iov = { .iov_base = buf, .iov_len = count };
 
-	free(buf);
+		status = verify_read_payload(state, script_fd, &iov, 1,
+					     result, flags & MSG_PEEK, error);
+	}
+
+	payload_buffer_put(state, buf);
 	return status;
 }
 
+/* Verify that a field of a received struct has the value the script
+ * expects, unless the script says "..." for it.
+ */
+static int verify_field(const char *name, struct expression *expected,
+			s64 actual, char **error)
+{
+	if (expected->type == EXPR_ELLIPSIS)
+		return STATUS_OK;
+	if (check_type(expected, EXPR_INTEGER, error))
+		return STATUS_ERR;
+	if (expected->value.num != actual) {
+		asprintf(error, "Bad %s: expected: %lld actual: %lld",
+			 name, expected->value.num, actual);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+/* Verify the data of a received cmsg against the script's cmsg_data. */
+static int verify_cmsg_data(struct expression *expected,
+			    struct cmsghdr *cmsg, char **error)
+{
+	size_t data_len = cmsg->cmsg_len - CMSG_LEN(0);
+
+	switch (expected->type) {
+	case EXPR_ELLIPSIS:
+		return STATUS_OK;
+	case EXPR_INTEGER: {
+		int value = 0;
+
+		if (data_len < sizeof(value)) {
+			asprintf(error, "cmsg_data too short for an int: %zu",
+				 data_len);
+			return STATUS_ERR;
+		}
+		memcpy(&value, CMSG_DATA(cmsg), sizeof(value));
+		return verify_field("cmsg_data", expected, value, error);
+	}
+#if defined(linux)
+	case EXPR_SOCK_EXTENDED_ERR: {
+		struct sock_extended_err_expr *ee_expr =
+			expected->value.sock_extended_err;
+		struct sock_extended_err ee;
+
+		if (data_len < sizeof(ee)) {
+			asprintf(error, "cmsg_data too short for a "
+				 "sock_extended_err: %zu", data_len);
+			return STATUS_ERR;
+		}
+		memcpy(&ee, CMSG_DATA(cmsg), sizeof(ee));
+		if (verify_field("ee_errno", ee_expr->ee_errno,
+				 ee.ee_errno, error) ||
+		    verify_field("ee_origin", ee_expr->ee_origin,
+				 ee.ee_origin, error) ||
+		    verify_field("ee_type", ee_expr->ee_type,
+				 ee.ee_type, error) ||
+		    verify_field("ee_code", ee_expr->ee_code,
+				 ee.ee_code, error) ||
+		    verify_field("ee_info", ee_expr->ee_info,
+				 ee.ee_info, error) ||
+		    verify_field("ee_data", ee_expr->ee_data,
+				 ee.ee_data, error))
+			return STATUS_ERR;
+		return STATUS_OK;
+	}
+#endif
+	default:
+		asprintf(error, "unsupported cmsg_data type: %s",
+			 expression_type_to_string(expected->type));
+		return STATUS_ERR;
+	}
+}
+
+/* Verify that recvmsg() returned exactly the cmsgs in the script's
+ * msg_control, in order.
+ */
+static int verify_cmsgs(struct expression *control, struct msghdr *msg,
+			char **error)
+{
+	struct expression_list *list = control->value.list;
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	int i;
+
+	for (i = 0; list != NULL; ++i, list = list->next) {
+		struct cmsghdr_expr *cmsg_expr;
+		char *data_error = NULL;
+		s32 level, type;
+
+		if (check_type(list->expression, EXPR_CMSGHDR, error))
+			return STATUS_ERR;
+		cmsg_expr = list->expression->value.cmsghdr;
+		if (get_s32(cmsg_expr->cmsg_level, &level, error) ||
+		    get_s32(cmsg_expr->cmsg_type, &type, error))
+			return STATUS_ERR;
+
+		if (cmsg == NULL) {
+			asprintf(error, "Expected cmsg %d but there is none",
+				 i);
+			return STATUS_ERR;
+		}
+		if (cmsg->cmsg_level != level || cmsg->cmsg_type != type) {
+			asprintf(error, "Bad cmsg %d: expected level %d "
+				 "type %d but got level %d type %d", i,
+				 level, type, cmsg->cmsg_level,
+				 cmsg->cmsg_type);
+			return STATUS_ERR;
+		}
+		if (verify_cmsg_data(cmsg_expr->cmsg_data, cmsg,
+				     &data_error)) {
+			asprintf(error, "Bad cmsg %d: %s", i, data_error);
+			free(data_error);
+			return STATUS_ERR;
+		}
+		cmsg = CMSG_NXTHDR(msg, cmsg);
+	}
+
+	if (cmsg != NULL) {
+		asprintf(error, "Unexpected cmsg %d: level %d type %d", i,
+			 cmsg->cmsg_level, cmsg->cmsg_type);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
 static int syscall_recvmsg(struct state *state, struct syscall_spec *syscall,
 			   struct expression_list *args, char **error)
 {
@@ -1288,7 +1855,8 @@ static int syscall_recvmsg(struct state *state, struct syscall_spec *syscall,
 	msg_expression = get_arg(args, 1, error);
 	if (msg_expression == NULL)
 		goto error_out;
-	if (msghdr_new(msg_expression, &msg, &iov_len, error))
+	if (msghdr_new(state, msg_expression, PAYLOAD_READ, 0, &msg, &iov_len,
+		       error))
 		goto error_out;
 
 	if (s32_arg(args, 2, &flags, error))
@@ -1303,16 +1871,30 @@ static int syscall_recvmsg(struct state *state, struct syscall_spec *syscall,
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 		goto error_out;
 
+#ifdef MSG_ERRQUEUE
+	/* What comes back from the error queue isn't stream data. */
+	if (flags & MSG_ERRQUEUE)
+		result = 0;
+#endif
+	if (verify_read_payload(state, script_fd, msg->msg_iov, iov_len,
+				result, flags & MSG_PEEK, error))
+		goto error_out;
+
 	if (msg->msg_flags != expected_msg_flags) {
 		asprintf(error, "Expected msg_flags 0x%08X but got 0x%08X",
 			 expected_msg_flags, msg->msg_flags);
 		goto error_out;
 	}
 
+	if (msg_expression->value.msghdr->msg_control != NULL &&
+	    verify_cmsgs(msg_expression->value.msghdr->msg_control, msg,
+			 error))
+		goto error_out;
+
 	status = STATUS_OK;
 
 error_out:
-	msghdr_free(msg, iov_len);
+	msghdr_free(state, msg, iov_len);
 	return status;
 }
 
@@ -1320,6 +1902,7 @@ static int syscall_write(struct state *state, struct syscall_spec *syscall,
 			 struct expression_list *args, char **error)
 {
 	int live_fd, script_fd, count, result;
+	struct uring *uring = NULL;
 	char *buf = NULL;
 	if (check_arg_count(args, 3, error))
 		return STATUS_ERR;
@@ -1331,16 +1914,27 @@ static int syscall_write(struct state *state, struct syscall_spec *syscall,
 		return STATUS_ERR;
 	if (s32_arg(args, 2, &count, error))
 		return STATUS_ERR;
-	buf = calloc(count, 1);
-	assert(buf != NULL);
+	buf = payload_buffer_get(state, 0, count,
+				 write_payload_use(state, script_fd));
+	uring = syscall_uring(state, syscall);
+
+	struct iovec iov = { .iov_base = buf, .iov_len = count };
+	if (fill_write_payload(state, script_fd, &iov, 1, 0, error)) {
+		payload_buffer_put(state, buf);
+		return STATUS_ERR;
+	}
 
 	begin_syscall(state, syscall);
 
-	result = write(live_fd, buf, count);
+	if (uring != NULL)
+		result = uring_write(uring, live_fd, buf, count);
+	else
+		result = write(live_fd, buf, count);
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	advance_write_payload(state, script_fd, result);
 
-	free(buf);
+	payload_buffer_put(state, buf);
 	return status;
 }
 
@@ -1364,7 +1958,9 @@ static int syscall_writev(struct state *state, struct syscall_spec *syscall,
 	iov_expression = get_arg(args, 1, error);
 	if (iov_expression == NULL)
 		goto error_out;
-	if (iovec_new(iov_expression, &iov, &iov_len, error))
+	if (iovec_new(state, iov_expression,
+		      write_payload_use(state, script_fd), 0, &iov, &iov_len,
+		      error))
 		goto error_out;
 
 	if (s32_arg(args, 2, &iov_count, error))
@@ -1377,14 +1973,18 @@ static int syscall_writev(struct state *state, struct syscall_spec *syscall,
 		goto error_out;
 	}
 
+	if (fill_write_payload(state, script_fd, iov, iov_len, 0, error))
+		goto error_out;
+
 	begin_syscall(state, syscall);
 
 	result = writev(live_fd, iov, iov_count);
 
 	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	advance_write_payload(state, script_fd, result);
 
 error_out:
-	iovec_free(iov, iov_len);
+	iovec_free(state, iov, iov_len);
 	return status;
 }
 
@@ -1392,6 +1992,7 @@ static int syscall_send(struct state *state, struct syscall_spec *syscall,
 			struct expression_list *args, char **error)
 {
 	int live_fd, script_fd, count, flags, result;
+	struct uring *uring = NULL;
 	char *buf = NULL;
 	if (check_arg_count(args, 4, error))
 		return STATUS_ERR;
@@ -1405,16 +2006,27 @@ static int syscall_send(struct state *state, struct syscall_spec *syscall,
 		return STATUS_ERR;
 	if (s32_arg(args, 3, &flags, error))
 		return STATUS_ERR;
-	buf = calloc(count, 1);
-	assert(buf != NULL);
+	buf = payload_buffer_get(state, 0, count,
+				 write_payload_use(state, script_fd));
+	uring = syscall_uring(state, syscall);
+
+	struct iovec iov = { .iov_base = buf, .iov_len = count };
+	if (fill_write_payload(state, script_fd, &iov, 1, flags, error)) {
+		payload_buffer_put(state, buf);
+		return STATUS_ERR;
+	}
 
 	begin_syscall(state, syscall);
 
-	result = send(live_fd, buf, count, flags);
+	if (uring != NULL)
+		result = uring_send(uring, live_fd, buf, count, flags);
+	else
+		result = send(live_fd, buf, count, flags);
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	advance_write_payload(state, script_fd, result);
 
-	free(buf);
+	payload_buffer_put(state, buf);
 	return status;
 }
 
@@ -1447,8 +2059,14 @@ static int syscall_sendto(struct state *state, struct syscall_spec *syscall,
 		    (struct sockaddr *)&live_addr, &live_addrlen, error))
 		return STATUS_ERR;
 
-	buf = calloc(count, 1);
-	assert(buf != NULL);
+	buf = payload_buffer_get(state, 0, count,
+				 write_payload_use(state, script_fd));
+
+	struct iovec iov = { .iov_base = buf, .iov_len = count };
+	if (fill_write_payload(state, script_fd, &iov, 1, flags, error)) {
+		payload_buffer_put(state, buf);
+		return STATUS_ERR;
+	}
 
 	begin_syscall(state, syscall);
 
@@ -1456,8 +2074,9 @@ static int syscall_sendto(struct state *state, struct syscall_spec *syscall,
 			(struct sockaddr *)&live_addr, live_addrlen);
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	advance_write_payload(state, script_fd, result);
 
-	free(buf);
+	payload_buffer_put(state, buf);
 	return status;
 }
 
@@ -1480,7 +2099,9 @@ static int syscall_sendmsg(struct state *state, struct syscall_spec *syscall,
 	msg_expression = get_arg(args, 1, error);
 	if (msg_expression == NULL)
 		goto error_out;
-	if (msghdr_new(msg_expression, &msg, &iov_len, error))
+	if (msghdr_new(state, msg_expression,
+		       write_payload_use(state, script_fd), 0, &msg, &iov_len,
+		       error))
 		goto error_out;
 
 	if (s32_arg(args, 2, &flags, error))
@@ -1494,25 +2115,731 @@ static int syscall_sendmsg(struct state *state, struct syscall_spec *syscall,
 		asprintf(error, "sendmsg ignores msg_flags field in msghdr");
 		goto error_out;
 	}
+	if (fill_write_payload(state, script_fd, msg->msg_iov, iov_len, flags,
+			       error))
+		goto error_out;
 
 	begin_syscall(state, syscall);
 
 	result = sendmsg(live_fd, msg, flags);
 
 	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	advance_write_payload(state, script_fd, result);
 
 error_out:
-	msghdr_free(msg, iov_len);
+	msghdr_free(state, msg, iov_len);
 	return status;
 }
 
-static int syscall_fcntl(struct state *state, struct syscall_spec *syscall,
-			 struct expression_list *args, char **error)
+#if defined(linux)
+
+/* Free the mmsghdr array made by mmsghdrs_new(). */
+static void mmsghdrs_free(struct state *state, struct mmsghdr *msgs,
+			  size_t *iov_lens, int vlen)
 {
-	int live_fd, script_fd, command, result;
+	int i;
 
-	/* fcntl is an odd system call - it can take either 2 or 3 args. */
-	int actual_arg_count = get_arg_count(args);
+	for (i = 0; i < vlen; ++i)
+		msghdr_free(state, &msgs[i].msg_hdr, iov_lens[i]);
+	free(msgs);
+	free(iov_lens);
+}
+
+/* Allocate and fill in the mmsghdr array described by the given list
+ * expression, keeping the iovec length of each message in iov_lens.
+ * The messages' buffers follow one another in the payload arena.
+ */
+static int mmsghdrs_new(struct state *state, struct expression *expression,
+			enum payload_use use, struct mmsghdr **msgs_ptr,
+			size_t **iov_lens_ptr, int *vlen_ptr, char **error)
+{
+	struct expression_list *list = NULL;
+	struct mmsghdr *msgs = NULL;
+	size_t *iov_lens = NULL;
+	size_t offset = 0;		/* bytes of payload arena used */
+	int i, j, vlen = 0;
+	int status = STATUS_ERR;
+
+	if (check_type(expression, EXPR_LIST, error))
+		goto error_out;
+	list = expression->value.list;
+	vlen = expression_list_length(list);
+	msgs = calloc(vlen, sizeof(struct mmsghdr));
+	iov_lens = calloc(vlen, sizeof(size_t));
+
+	for (i = 0; i < vlen; ++i, list = list->next) {
+		struct mmsghdr_expr *mmsg_expr = NULL;
+		struct msghdr *msg = NULL;
+		int msg_status;
+
+		if (check_type(list->expression, EXPR_MMSGHDR, error))
+			goto error_out;
+		mmsg_expr = list->expression->value.mmsghdr;
+
+		/* Keep the parts msghdr_new() allocates, but not the
+		 * msghdr itself, since ours live in the array.
+		 */
+		msg_status = msghdr_new(state, mmsg_expr->msg_hdr, use,
+					offset, &msg, &iov_lens[i], error);
+		msgs[i].msg_hdr = *msg;
+		free(msg);
+		if (msg_status)
+			goto error_out;
+		for (j = 0; j < iov_lens[i]; ++j)
+			offset += msgs[i].msg_hdr.msg_iov[j].iov_len;
+	}
+
+	status = STATUS_OK;
+
+error_out:
+	*msgs_ptr = msgs;
+	*iov_lens_ptr = iov_lens;
+	*vlen_ptr = vlen;
+	return status;
+}
+
+/* Verify the msg_len of each of the first num_msgs messages. */
+static int verify_msg_lens(struct expression *msgs_expression,
+			   const struct mmsghdr *msgs, int num_msgs,
+			   char **error)
+{
+	struct expression_list *list = msgs_expression->value.list;
+	int i;
+
+	for (i = 0; i < num_msgs; ++i, list = list->next) {
+		char *len_error = NULL;
+
+		if (verify_field("msg_len",
+				 list->expression->value.mmsghdr->msg_len,
+				 msgs[i].msg_len, &len_error)) {
+			asprintf(error, "mmsghdr %d: %s", i, len_error);
+			free(len_error);
+			return STATUS_ERR;
+		}
+	}
+	return STATUS_OK;
+}
+
+static int syscall_sendmmsg(struct state *state, struct syscall_spec *syscall,
+			    struct expression_list *args, char **error)
+{
+	int live_fd, script_fd, vlen, num_msgs = 0, flags, result, i;
+	struct expression *msgs_expression = NULL;
+	struct mmsghdr *msgs = NULL;
+	size_t *iov_lens = NULL;
+	int status = STATUS_ERR;
+
+	if (check_arg_count(args, 4, error))
+		goto error_out;
+	if (s32_arg(args, 0, &script_fd, error))
+		goto error_out;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		goto error_out;
+	if (reject_pattern_socket(state, script_fd, "sendmmsg", error))
+		goto error_out;
+
+	msgs_expression = get_arg(args, 1, error);
+	if (msgs_expression == NULL)
+		goto error_out;
+	if (mmsghdrs_new(state, msgs_expression, PAYLOAD_WRITE, &msgs,
+			 &iov_lens, &num_msgs, error))
+		goto error_out;
+
+	if (s32_arg(args, 2, &vlen, error))
+		goto error_out;
+	if (s32_arg(args, 3, &flags, error))
+		goto error_out;
+
+	if (vlen != num_msgs) {
+		asprintf(error,
+			 "vlen %d does not match %d-element mmsghdr array",
+			 vlen, num_msgs);
+		goto error_out;
+	}
+
+	for (i = 0; i < num_msgs; ++i) {
+		struct msghdr *msg = &msgs[i].msg_hdr;
+
+		if ((msg->msg_name != NULL) &&
+		    run_syscall_connect(state, script_fd, false,
+					msg->msg_name, &msg->msg_namelen,
+					error))
+			goto error_out;
+		if (msg->msg_flags != 0) {
+			asprintf(error, "sendmmsg ignores msg_flags field "
+				 "in msghdr %d", i);
+			goto error_out;
+		}
+	}
+
+	begin_syscall(state, syscall);
+
+	result = sendmmsg(live_fd, msgs, vlen, flags);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		goto error_out;
+
+	if (verify_msg_lens(msgs_expression, msgs, result, error))
+		goto error_out;
+
+	status = STATUS_OK;
+
+error_out:
+	mmsghdrs_free(state, msgs, iov_lens, num_msgs);
+	return status;
+}
+
+static int syscall_recvmmsg(struct state *state, struct syscall_spec *syscall,
+			    struct expression_list *args, char **error)
+{
+	int live_fd, script_fd, vlen, num_msgs = 0, flags, result, i;
+	struct expression *msgs_expression = NULL;
+	struct expression_list *list = NULL;
+	struct mmsghdr *msgs = NULL;
+	size_t *iov_lens = NULL;
+	int *expected_msg_flags = NULL;
+	int status = STATUS_ERR;
+
+	if (check_arg_count(args, 5, error))
+		goto error_out;
+	if (s32_arg(args, 0, &script_fd, error))
+		goto error_out;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		goto error_out;
+	if (reject_pattern_socket(state, script_fd, "recvmmsg", error))
+		goto error_out;
+
+	msgs_expression = get_arg(args, 1, error);
+	if (msgs_expression == NULL)
+		goto error_out;
+	if (mmsghdrs_new(state, msgs_expression, PAYLOAD_READ, &msgs, &iov_lens,
+			 &num_msgs, error))
+		goto error_out;
+
+	if (s32_arg(args, 2, &vlen, error))
+		goto error_out;
+	if (s32_arg(args, 3, &flags, error))
+		goto error_out;
+	/* Scripts time blocking calls with "t1...t2", not a timeout. */
+	if (ellipsis_arg(args, 4, error))
+		goto error_out;
+
+	if (vlen != num_msgs) {
+		asprintf(error,
+			 "vlen %d does not match %d-element mmsghdr array",
+			 vlen, num_msgs);
+		goto error_out;
+	}
+
+	expected_msg_flags = calloc(num_msgs, sizeof(int));
+	for (i = 0; i < num_msgs; ++i)
+		expected_msg_flags[i] = msgs[i].msg_hdr.msg_flags;
+
+	begin_syscall(state, syscall);
+
+	result = recvmmsg(live_fd, msgs, vlen, flags, NULL);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		goto error_out;
+
+	if (verify_msg_lens(msgs_expression, msgs, result, error))
+		goto error_out;
+
+	list = msgs_expression->value.list;
+	for (i = 0; i < result; ++i, list = list->next) {
+		struct msghdr *msg = &msgs[i].msg_hdr;
+		struct msghdr_expr *msg_expr =
+			list->expression->value.mmsghdr->msg_hdr->value.msghdr;
+		char *msg_error = NULL;
+
+		if (msg->msg_flags != expected_msg_flags[i]) {
+			asprintf(error, "mmsghdr %d: Expected msg_flags "
+				 "0x%08X but got 0x%08X", i,
+				 expected_msg_flags[i], msg->msg_flags);
+			goto error_out;
+		}
+		if (msg_expr->msg_control != NULL &&
+		    verify_cmsgs(msg_expr->msg_control, msg, &msg_error)) {
+			asprintf(error, "mmsghdr %d: %s", i, msg_error);
+			free(msg_error);
+			goto error_out;
+		}
+	}
+
+	status = STATUS_OK;
+
+error_out:
+	free(expected_msg_flags);
+	mmsghdrs_free(state, msgs, iov_lens, num_msgs);
+	return status;
+}
+
+#endif /* linux */
+
+/* Create an unlinked temp file holding size zero bytes, all of them
+ * already in the page cache, so that sending from it doesn't wait on
+ * the disk. Returns the fd, or -1 with errno set.
+ */
+static int tmpfile_new(int size)
+{
+	static const u8 zeroes[64 * 1024];
+	const char *dir = getenv("TMPDIR");
+	char *path = NULL;
+	int fd, saved_errno;
+	ssize_t written;
+
+	if (size < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	asprintf(&path, "%s/packetdrill-XXXXXX", dir ? dir : "/tmp");
+	fd = mkstemp(path);
+	if (fd < 0)
+		goto out;
+	unlink(path);
+
+	while (size > 0) {
+		written = write(fd, zeroes, min(size, (int)sizeof(zeroes)));
+		if (written < 0) {
+			saved_errno = errno;
+			close(fd);
+			errno = saved_errno;
+			fd = -1;
+			goto out;
+		}
+		size -= written;
+	}
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		die_perror("lseek");
+
+out:
+	saved_errno = errno;
+	free(path);
+	errno = saved_errno;
+	return fd;
+}
+
+static int syscall_tmpfile(struct state *state, struct syscall_spec *syscall,
+			   struct expression_list *args, char **error)
+{
+	int size, script_fd, result;
+	if (check_arg_count(args, 1, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &size, error))
+		return STATUS_ERR;
+
+	/* Filling the file is setup, not part of what we time. */
+	result = tmpfile_new(size);
+
+	begin_syscall(state, syscall);
+
+	if (end_syscall(state, syscall, CHECK_NON_NEGATIVE, result, error))
+		return STATUS_ERR;
+
+	if (result >= 0) {
+		if (get_s32(syscall->result, &script_fd, error))
+			return STATUS_ERR;
+		if (run_syscall_file(state, script_fd, result, error))
+			return STATUS_ERR;
+	}
+
+	return STATUS_OK;
+}
+
+static int syscall_pipe(struct state *state, struct syscall_spec *syscall,
+			struct expression_list *args, char **error)
+{
+	struct expression *expression = NULL;
+	struct expression_list *list = NULL;
+	int script_fds[2], live_fds[2], result, i;
+
+	if (check_arg_count(args, 1, error))
+		return STATUS_ERR;
+	expression = get_arg(args, 0, error);
+	if (expression == NULL)
+		return STATUS_ERR;
+	if (check_type(expression, EXPR_LIST, error))
+		return STATUS_ERR;
+	list = expression->value.list;
+	if (expression_list_length(list) != 2) {
+		asprintf(error, "Expected [<read fd>, <write fd>]");
+		return STATUS_ERR;
+	}
+	for (i = 0; i < 2; ++i, list = list->next) {
+		if (get_s32(list->expression, &script_fds[i], error))
+			return STATUS_ERR;
+	}
+
+	begin_syscall(state, syscall);
+
+	result = pipe(live_fds);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		return STATUS_ERR;
+
+	if (result == 0) {
+		for (i = 0; i < 2; ++i) {
+			if (run_syscall_file(state, script_fds[i], live_fds[i],
+					     error))
+				return STATUS_ERR;
+		}
+	}
+
+	return STATUS_OK;
+}
+
+#if defined(linux)
+
+/* Get a file offset argument: ... to use and update the fd's own file
+ * offset, or [<offset>] to start at the given offset. Sets *has_offset
+ * to whether there is one.
+ */
+static int offset_arg(struct expression_list *args, int index,
+		      bool *has_offset, s64 *offset, char **error)
+{
+	struct expression *expression = get_arg(args, index, error);
+	s32 value = 0;
+
+	if (expression == NULL)
+		return STATUS_ERR;
+	if (expression->type == EXPR_ELLIPSIS) {
+		*has_offset = false;
+		return STATUS_OK;
+	}
+	if (s32_bracketed_arg(args, index, &value, error))
+		return STATUS_ERR;
+	*has_offset = true;
+	*offset = value;
+	return STATUS_OK;
+}
+
+static int syscall_sendfile(struct state *state, struct syscall_spec *syscall,
+			    struct expression_list *args, char **error)
+{
+	int live_out_fd, script_out_fd, live_in_fd, script_in_fd;
+	int count, result;
+	bool has_offset = false;
+	s64 script_offset = 0;
+	off_t offset = 0;
+
+	if (check_arg_count(args, 4, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &script_out_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_out_fd, &live_out_fd, error))
+		return STATUS_ERR;
+	if (reject_pattern_socket(state, script_out_fd, "sendfile", error))
+		return STATUS_ERR;
+	if (s32_arg(args, 1, &script_in_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_in_fd, &live_in_fd, error))
+		return STATUS_ERR;
+	if (offset_arg(args, 2, &has_offset, &script_offset, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 3, &count, error))
+		return STATUS_ERR;
+	offset = script_offset;
+
+	begin_syscall(state, syscall);
+
+	result = sendfile(live_out_fd, live_in_fd,
+			  has_offset ? &offset : NULL, count);
+
+	return end_syscall(state, syscall, CHECK_EXACT, result, error);
+}
+
+static int syscall_splice(struct state *state, struct syscall_spec *syscall,
+			  struct expression_list *args, char **error)
+{
+	int live_in_fd, script_in_fd, live_out_fd, script_out_fd;
+	int len, flags, result;
+	bool has_in_offset = false, has_out_offset = false;
+	s64 script_in_offset = 0, script_out_offset = 0;
+	loff_t in_offset = 0, out_offset = 0;
+
+	if (check_arg_count(args, 6, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &script_in_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_in_fd, &live_in_fd, error))
+		return STATUS_ERR;
+	if (offset_arg(args, 1, &has_in_offset, &script_in_offset, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 2, &script_out_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_out_fd, &live_out_fd, error))
+		return STATUS_ERR;
+	if (offset_arg(args, 3, &has_out_offset, &script_out_offset, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 4, &len, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 5, &flags, error))
+		return STATUS_ERR;
+	if (reject_pattern_socket(state, script_in_fd, "splice", error) ||
+	    reject_pattern_socket(state, script_out_fd, "splice", error))
+		return STATUS_ERR;
+	in_offset = script_in_offset;
+	out_offset = script_out_offset;
+
+	begin_syscall(state, syscall);
+
+	result = splice(live_in_fd, has_in_offset ? &in_offset : NULL,
+			live_out_fd, has_out_offset ? &out_offset : NULL,
+			len, flags);
+
+	return end_syscall(state, syscall, CHECK_EXACT, result, error);
+}
+
+static int syscall_vmsplice(struct state *state, struct syscall_spec *syscall,
+			    struct expression_list *args, char **error)
+{
+	int live_fd, script_fd, iov_count, flags, result;
+	struct expression *iov_expression = NULL;
+	struct iovec *iov = NULL;
+	size_t iov_len = 0;
+	int status = STATUS_ERR;
+
+	if (check_arg_count(args, 4, error))
+		goto error_out;
+	if (s32_arg(args, 0, &script_fd, error))
+		goto error_out;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		goto error_out;
+
+	/* The pipe may keep referencing these pages after we return, so
+	 * they come from the write buffer of the payload arena, which
+	 * stays zeroed for the whole test.
+	 */
+	iov_expression = get_arg(args, 1, error);
+	if (iov_expression == NULL)
+		goto error_out;
+	if (iovec_new(state, iov_expression, PAYLOAD_WRITE, 0, &iov, &iov_len,
+		      error))
+		goto error_out;
+
+	if (s32_arg(args, 2, &iov_count, error))
+		goto error_out;
+	if (iov_count != iov_len) {
+		asprintf(error,
+			 "iov_count %d does not match %d-element iovec array",
+			 iov_count, (int)iov_len);
+		goto error_out;
+	}
+	if (s32_arg(args, 3, &flags, error))
+		goto error_out;
+	if (flags & SPLICE_F_GIFT) {
+		asprintf(error, "vmsplice with SPLICE_F_GIFT is not supported");
+		goto error_out;
+	}
+
+	begin_syscall(state, syscall);
+
+	result = vmsplice(live_fd, iov, iov_count, flags);
+
+	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+
+error_out:
+	iovec_free(state, iov, iov_len);
+	return status;
+}
+
+static int syscall_epoll_create1(struct state *state,
+				 struct syscall_spec *syscall,
+				 struct expression_list *args, char **error)
+{
+	int flags, script_fd, result;
+	if (check_arg_count(args, 1, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &flags, error))
+		return STATUS_ERR;
+
+	begin_syscall(state, syscall);
+
+	result = epoll_create1(flags);
+
+	if (end_syscall(state, syscall, CHECK_NON_NEGATIVE, result, error))
+		return STATUS_ERR;
+
+	if (result >= 0) {
+		if (get_s32(syscall->result, &script_fd, error))
+			return STATUS_ERR;
+		if (run_syscall_file(state, script_fd, result, error))
+			return STATUS_ERR;
+	}
+
+	return STATUS_OK;
+}
+
+/* Fill in a live epoll_event from the script's, keeping the script fd
+ * in its data so epoll_wait() can tell us which fd is ready.
+ */
+static int epoll_event_new(struct expression *expression,
+			   struct epoll_event *event, char **error)
+{
+	struct epoll_event_expr *event_expr = NULL;
+
+	if (check_type(expression, EXPR_EPOLL_EVENT, error))
+		return STATUS_ERR;
+	event_expr = expression->value.epoll_event;
+	if (check_type(event_expr->events, EXPR_INTEGER, error))
+		return STATUS_ERR;
+	if (check_type(event_expr->fd, EXPR_INTEGER, error))
+		return STATUS_ERR;
+
+	memset(event, 0, sizeof(*event));
+	event->events = event_expr->events->value.num;
+	event->data.u64 = event_expr->fd->value.num;
+	return STATUS_OK;
+}
+
+static int syscall_epoll_ctl(struct state *state, struct syscall_spec *syscall,
+			     struct expression_list *args, char **error)
+{
+	int live_epfd, script_epfd, op, live_fd, script_fd, result;
+	struct expression *event_expression = NULL;
+	struct epoll_event event;
+	bool has_event = false;
+
+	if (check_arg_count(args, 4, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &script_epfd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_epfd, &live_epfd, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 1, &op, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 2, &script_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		return STATUS_ERR;
+
+	/* EPOLL_CTL_DEL takes no event, which the script writes as "...". */
+	event_expression = get_arg(args, 3, error);
+	if (event_expression == NULL)
+		return STATUS_ERR;
+	if (event_expression->type != EXPR_ELLIPSIS) {
+		if (epoll_event_new(event_expression, &event, error))
+			return STATUS_ERR;
+		has_event = true;
+	}
+
+	begin_syscall(state, syscall);
+
+	result = epoll_ctl(live_epfd, op, live_fd, has_event ? &event : NULL);
+
+	return end_syscall(state, syscall, CHECK_EXACT, result, error);
+}
+
+/* Check that epoll_wait() returned the events in the script's list,
+ * in the same order. Return STATUS_OK if they match. Otherwise fill in
+ * the error with a human-readable error message and return STATUS_ERR.
+ */
+static int epoll_events_check(struct expression *events_expression,
+			      const struct epoll_event *events,
+			      int num_events, char **error)
+{
+	struct expression_list *list = events_expression->value.list;
+	int i;
+
+	for (i = 0; i < num_events; ++i, list = list->next) {
+		struct epoll_event expected;
+
+		assert(list != NULL);
+		if (epoll_event_new(list->expression, &expected, error))
+			return STATUS_ERR;
+
+		if (events[i].data.u64 != expected.data.u64) {
+			asprintf(error, "Expected event %d for fd %llu but "
+				 "got one for fd %llu", i,
+				 (u64)expected.data.u64,
+				 (u64)events[i].data.u64);
+			return STATUS_ERR;
+		}
+		if (events[i].events != expected.events) {
+			char *expected_string =
+				flags_to_string(epoll_flags, expected.events);
+			char *actual_string =
+				flags_to_string(epoll_flags, events[i].events);
+			asprintf(error, "Expected events of %s but got %s "
+				 "for epoll_event %d", expected_string,
+				 actual_string, i);
+			free(expected_string);
+			free(actual_string);
+			return STATUS_ERR;
+		}
+	}
+	return STATUS_OK;
+}
+
+static int syscall_epoll_wait(struct state *state,
+			      struct syscall_spec *syscall,
+			      struct expression_list *args, char **error)
+{
+	int live_epfd, script_epfd, maxevents, timeout, result;
+	struct expression *events_expression = NULL;
+	struct epoll_event *events = NULL;
+	int num_expected;
+	int status = STATUS_ERR;
+
+	if (check_arg_count(args, 4, error))
+		goto error_out;
+	if (s32_arg(args, 0, &script_epfd, error))
+		goto error_out;
+	if (to_live_fd(state, script_epfd, &live_epfd, error))
+		goto error_out;
+	events_expression = get_arg(args, 1, error);
+	if (events_expression == NULL)
+		goto error_out;
+	if (check_type(events_expression, EXPR_LIST, error))
+		goto error_out;
+	if (s32_arg(args, 2, &maxevents, error))
+		goto error_out;
+	if (s32_arg(args, 3, &timeout, error))
+		goto error_out;
+
+	num_expected = expression_list_length(events_expression->value.list);
+	if (maxevents <= 0 || num_expected > maxevents) {
+		asprintf(error, "maxevents %d does not fit %d-element "
+			 "epoll_event array", maxevents, num_expected);
+		goto error_out;
+	}
+	events = calloc(maxevents, sizeof(struct epoll_event));
+
+	begin_syscall(state, syscall);
+
+	result = epoll_wait(live_epfd, events, maxevents, timeout);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		goto error_out;
+
+	if (result > 0) {
+		if (result != num_expected) {
+			asprintf(error, "epoll_wait returned %d events but "
+				 "the script lists %d", result, num_expected);
+			goto error_out;
+		}
+		if (epoll_events_check(events_expression, events, result,
+				       error))
+			goto error_out;
+	}
+
+	status = STATUS_OK;
+
+error_out:
+	free(events);
+	return status;
+}
+
+#endif /* linux */
+
+static int syscall_fcntl(struct state *state, struct syscall_spec *syscall,
+			 struct expression_list *args, char **error)
+{
+	int live_fd, script_fd, command, result;
+
+	/* fcntl is an odd system call - it can take either 2 or 3 args. */
+	int actual_arg_count = get_arg_count(args);
 	if ((actual_arg_count != 2) && (actual_arg_count != 3)) {
 		asprintf(error, "fcntl expected 2-3 args but got %d",
 			 actual_arg_count);
@@ -1602,6 +2929,7 @@ static int syscall_close(struct state *state, struct syscall_spec *syscall,
 			 struct expression_list *args, char **error)
 {
 	int live_fd, script_fd, result;
+	struct script_file *file = NULL;
 	if (check_arg_count(args, 1, error))
 		return STATUS_ERR;
 	if (s32_arg(args, 0, &script_fd, error))
@@ -1616,6 +2944,12 @@ static int syscall_close(struct state *state, struct syscall_spec *syscall,
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 		return STATUS_ERR;
 
+	file = find_file_by_script_fd(state, script_fd);
+	if (file != NULL) {
+		run_syscall_close_file(state, file);
+		return STATUS_OK;
+	}
+
 	if (run_syscall_close(state, script_fd, live_fd, error))
 		return STATUS_ERR;
 
@@ -1645,12 +2979,162 @@ static int syscall_shutdown(struct state *state, struct syscall_spec *syscall,
 	return STATUS_OK;
 }
 
+/* Return the region mmap()ed on the given script fd, or NULL. */
+static struct script_mapping *find_mapping_by_script_fd(
+	struct state *state, int script_fd)
+{
+	struct script_mapping *mapping = NULL;
+	for (mapping = state->syscalls->mappings; mapping != NULL;
+	     mapping = mapping->next)
+		if (mapping->script_fd == script_fd)
+			return mapping;
+	return NULL;
+}
+
+/* The script's mmap() calls return 0 on success, since the address
+ * only means something to us. The mapping is remembered per fd, and
+ * unmapped when the test ends (or when the fd is mapped again).
+ */
+static int syscall_mmap(struct state *state, struct syscall_spec *syscall,
+			struct expression_list *args, char **error)
+{
+	int live_fd, script_fd, length, prot, flags, offset, result;
+	struct script_mapping *mapping = NULL;
+	void *address = NULL;
+
+	if (check_arg_count(args, 6, error))
+		return STATUS_ERR;
+	if (ellipsis_arg(args, 0, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 1, &length, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 2, &prot, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 3, &flags, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 4, &script_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 5, &offset, error))
+		return STATUS_ERR;
+
+	begin_syscall(state, syscall);
+
+	address = mmap(NULL, length, prot, flags, live_fd, offset);
+	result = (address == MAP_FAILED) ? -1 : 0;
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error)) {
+		if (address != MAP_FAILED)
+			munmap(address, length);
+		return STATUS_ERR;
+	}
+	if (address == MAP_FAILED)
+		return STATUS_OK;
+
+	mapping = find_mapping_by_script_fd(state, script_fd);
+	if (mapping != NULL) {
+		if (munmap(mapping->address, mapping->length))
+			die_perror("munmap");
+	} else {
+		mapping = calloc(1, sizeof(struct script_mapping));
+		mapping->script_fd = script_fd;
+		mapping->next = state->syscalls->mappings;
+		state->syscalls->mappings = mapping;
+	}
+	mapping->address = address;
+	mapping->length = length;
+	return STATUS_OK;
+}
+
+/* Run getsockopt(TCP_ZEROCOPY_RECEIVE) into the region the script
+ * mmap()ed on the socket, and check the fields the kernel fills in.
+ */
+static int getsockopt_zerocopy_receive(struct state *state,
+				       struct syscall_spec *syscall,
+				       struct expression_list *args,
+				       int script_fd, int live_fd,
+				       char **error)
+{
+	struct tcp_zerocopy_receive_expr *zc_expr = NULL;
+	struct tcp_zerocopy_receive_prefix zc;
+	struct script_mapping *mapping = NULL;
+	struct expression *optlen_expression = NULL;
+	socklen_t live_optlen = sizeof(zc);
+	s32 script_optlen = 0;
+	int result;
+
+	if (reject_pattern_socket(state, script_fd, "TCP_ZEROCOPY_RECEIVE",
+				  error))
+		return STATUS_ERR;
+	zc_expr = get_arg(args, 3, error)->value.tcp_zerocopy_receive;
+	if (zc_expr->address->type != EXPR_ELLIPSIS) {
+		asprintf(error, "TCP_ZEROCOPY_RECEIVE address must be ...");
+		return STATUS_ERR;
+	}
+	mapping = find_mapping_by_script_fd(state, script_fd);
+	if (mapping == NULL) {
+		asprintf(error, "no mmap() of script fd %d for "
+			 "TCP_ZEROCOPY_RECEIVE", script_fd);
+		return STATUS_ERR;
+	}
+
+	/* The optlen is [...] for our whole struct, or [<bytes>]. */
+	optlen_expression = get_arg(args, 4, error);
+	if (optlen_expression == NULL)
+		return STATUS_ERR;
+	if (check_type(optlen_expression, EXPR_LIST, error))
+		return STATUS_ERR;
+	if (expression_list_length(optlen_expression->value.list) == 1 &&
+	    optlen_expression->value.list->expression->type ==
+	    EXPR_ELLIPSIS) {
+		script_optlen = -1;
+	} else {
+		if (s32_bracketed_arg(args, 4, &script_optlen, error))
+			return STATUS_ERR;
+		if (script_optlen < 0 || script_optlen > sizeof(zc)) {
+			asprintf(error, "Unsupported TCP_ZEROCOPY_RECEIVE "
+				 "optlen: %d", (int)script_optlen);
+			return STATUS_ERR;
+		}
+		live_optlen = script_optlen;
+	}
+
+	memset(&zc, 0, sizeof(zc));
+	zc.address = (uintptr_t)mapping->address;
+	zc.length = mapping->length;
+
+	begin_syscall(state, syscall);
+
+	result = getsockopt(live_fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE,
+			    &zc, &live_optlen);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		return STATUS_ERR;
+
+	if (script_optlen >= 0 && (int)live_optlen != script_optlen) {
+		asprintf(error,
+			 "Bad getsockopt optlen: expected: %d actual: %d",
+			 (int)script_optlen, (int)live_optlen);
+		return STATUS_ERR;
+	}
+	if (verify_field("length", zc_expr->length, zc.length, error) ||
+	    verify_field("recv_skip_hint", zc_expr->recv_skip_hint,
+			 zc.recv_skip_hint, error) ||
+	    verify_field("inq", zc_expr->inq, zc.inq, error) ||
+	    verify_field("err", zc_expr->err, zc.err, error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
 static int syscall_getsockopt(struct state *state, struct syscall_spec *syscall,
 			      struct expression_list *args, char **error)
 {
 	int script_fd, live_fd, level, optname, result;
 	s32 script_optval, live_optval, script_optlen;
 	socklen_t live_optlen = sizeof(live_optval);
+	struct expression *val_expression;
 	if (check_arg_count(args, 5, error))
 		return STATUS_ERR;
 	if (s32_arg(args, 0, &script_fd, error))
@@ -1661,6 +3145,20 @@ static int syscall_getsockopt(struct state *state, struct syscall_spec *syscall,
 		return STATUS_ERR;
 	if (s32_arg(args, 2, &optname, error))
 		return STATUS_ERR;
+
+	val_expression = get_arg(args, 3, error);
+	if (val_expression == NULL)
+		return STATUS_ERR;
+	if (val_expression->type == EXPR_TCP_ZEROCOPY_RECEIVE) {
+		if (level != IPPROTO_TCP || optname != TCP_ZEROCOPY_RECEIVE) {
+			asprintf(error, "tcp_zerocopy_receive is only for "
+				 "IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE");
+			return STATUS_ERR;
+		}
+		return getsockopt_zerocopy_receive(state, syscall, args,
+						   script_fd, live_fd, error);
+	}
+
 	if (s32_bracketed_arg(args, 3, &script_optval, error))
 		return STATUS_ERR;
 	if (s32_bracketed_arg(args, 4, &script_optlen, error))
@@ -1818,6 +3316,19 @@ struct system_call_entry system_call_table[] = {
 	{"getsockopt", syscall_getsockopt},
 	{"setsockopt", syscall_setsockopt},
 	{"poll",       syscall_poll},
+	{"tmpfile",    syscall_tmpfile},
+	{"pipe",       syscall_pipe},
+	{"mmap",       syscall_mmap},
+#if defined(linux)
+	{"sendfile",   syscall_sendfile},
+	{"splice",     syscall_splice},
+	{"vmsplice",   syscall_vmsplice},
+	{"epoll_create1", syscall_epoll_create1},
+	{"epoll_ctl",  syscall_epoll_ctl},
+	{"epoll_wait", syscall_epoll_wait},
+	{"sendmmsg",   syscall_sendmmsg},
+	{"recvmmsg",   syscall_recvmmsg},
+#endif
 	{"mp_join_accept",	mp_join_accept}
 };
 
@@ -1996,6 +3507,9 @@ static void *system_call_thread(void *arg)
 	if (state->syscalls->thread_id < 0)
 		die_perror("gettid");
 
+	/* When fuzzing, trace the kernel code of blocking calls too. */
+	fuzz_syscall_thread_start();
+
 	while (!done) {
 		DEBUGP("syscall thread: in state %d\n",
 		       state->syscalls->state);
@@ -2024,7 +3538,7 @@ static void *system_call_thread(void *arg)
 			syscall = event->event.syscall;
 			assert(event->type == SYSCALL_EVENT);
 			state->syscalls->event = event;
-			state->syscalls->live_end_usecs = -1;
+			state->syscalls->live_end_nsecs = -1;
 
 			/* Make the system call. Note that our callees
 			 * here will release the global lock before
@@ -2035,11 +3549,11 @@ static void *system_call_thread(void *arg)
 			invoke_system_call(state, event, syscall);
 
 			/* Check end time for the blocking system call. */
-			assert(state->syscalls->live_end_usecs >= 0);
+			assert(state->syscalls->live_end_nsecs >= 0);
 			if (verify_time(state,
 						event->time_type,
-						syscall->end_usecs, 0,
-						state->syscalls->live_end_usecs,
+						syscall->end_nsecs, 0,
+						state->syscalls->live_end_nsecs,
 						"system call return", &error)) {
 				die("%s:%d: %s\n",
 				    state->config->script_path,
@@ -2054,7 +3568,7 @@ static void *system_call_thread(void *arg)
 			assert(state->syscalls->state == SYSCALL_DONE);
 			state->syscalls->state = SYSCALL_IDLE;
 			state->syscalls->event = NULL;
-			state->syscalls->live_end_usecs = -1;
+			state->syscalls->live_end_nsecs = -1;
 			DEBUGP("syscall thread: now idle\n");
 			if (pthread_cond_signal(&state->syscalls->idle) != 0)
 				die_perror("pthread_cond_signal");
@@ -2072,12 +3586,219 @@ static void *system_call_thread(void *arg)
 	return NULL;
 }
 
+/* Return the argument with the given index, or NULL if there is none. */
+static struct expression *peek_arg(struct expression_list *args, int index)
+{
+	while (args != NULL && index-- > 0)
+		args = args->next;
+	return args != NULL ? args->expression : NULL;
+}
+
+/* Return the total iov_len of an iovec array expression, or 0 if the
+ * expression isn't one.
+ */
+static s64 iovec_expression_bytes(struct expression *expression)
+{
+	struct expression_list *list = NULL;
+	s64 bytes = 0;
+
+	if (expression == NULL || expression->type != EXPR_LIST)
+		return 0;
+	for (list = expression->value.list; list != NULL; list = list->next) {
+		struct iovec_expr *iov_expr = NULL;
+
+		if (list->expression->type != EXPR_IOVEC)
+			continue;
+		iov_expr = list->expression->value.iovec;
+		if (iov_expr->iov_len->type == EXPR_INTEGER &&
+		    iov_expr->iov_len->value.num > 0)
+			bytes += iov_expr->iov_len->value.num;
+	}
+	return bytes;
+}
+
+/* Return how many payload bytes the given system call reads or writes,
+ * as far as we can tell before running it.
+ */
+static s64 syscall_payload_bytes(struct syscall_spec *syscall)
+{
+	const char *name = syscall->name;
+	struct expression *arg = NULL;
+
+	if (!strcmp(name, "read") || !strcmp(name, "write") ||
+	    !strcmp(name, "recv") || !strcmp(name, "send") ||
+	    !strcmp(name, "recvfrom") || !strcmp(name, "sendto")) {
+		arg = peek_arg(syscall->arguments, 2);
+		if (arg != NULL && arg->type == EXPR_INTEGER)
+			return arg->value.num;
+	} else if (!strcmp(name, "readv") || !strcmp(name, "writev") ||
+		   !strcmp(name, "vmsplice")) {
+		return iovec_expression_bytes(peek_arg(syscall->arguments, 1));
+	} else if (!strcmp(name, "recvmsg") || !strcmp(name, "sendmsg")) {
+		arg = peek_arg(syscall->arguments, 1);
+		if (arg != NULL && arg->type == EXPR_MSGHDR)
+			return iovec_expression_bytes(
+				arg->value.msghdr->msg_iov);
+	} else if (!strcmp(name, "recvmmsg") || !strcmp(name, "sendmmsg")) {
+		struct expression_list *list = NULL;
+		s64 total_bytes = 0;
+
+		/* The messages' iovecs follow one another in the buffer. */
+		arg = peek_arg(syscall->arguments, 1);
+		if (arg == NULL || arg->type != EXPR_LIST)
+			return 0;
+		for (list = arg->value.list; list != NULL; list = list->next) {
+			struct expression *msg = NULL;
+
+			if (list->expression->type != EXPR_MMSGHDR)
+				continue;
+			msg = list->expression->value.mmsghdr->msg_hdr;
+			if (msg->type != EXPR_MSGHDR)
+				continue;
+			total_bytes += iovec_expression_bytes(
+				msg->value.msghdr->msg_iov);
+		}
+		return total_bytes;
+	}
+	return 0;
+}
+
+/* Return the largest payload any system call in the script transfers. */
+static size_t script_max_payload_bytes(const struct script *script)
+{
+	const struct event *event = NULL;
+	s64 max_bytes = 0;
+
+	for (event = script->event_list; event != NULL; event = event->next) {
+		s64 bytes;
+
+		if (event->type != SYSCALL_EVENT)
+			continue;
+		bytes = syscall_payload_bytes(event->event.syscall);
+		if (bytes > max_bytes)
+			max_bytes = bytes;
+	}
+	return max_bytes;
+}
+
+/* Return the size of the hugepages MAP_HUGETLB hands out. */
+static size_t hugepage_bytes(void)
+{
+	size_t bytes = PAYLOAD_DEFAULT_HUGEPAGE_BYTES;
+	unsigned long kbytes = 0;
+	char line[128];
+	FILE *f = fopen("/proc/meminfo", "r");
+
+	if (f == NULL)
+		return bytes;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "Hugepagesize: %lu kB", &kbytes) == 1) {
+			bytes = kbytes * 1024;
+			break;
+		}
+	}
+	fclose(f);
+	return bytes;
+}
+
+static size_t round_up(size_t bytes, size_t unit)
+{
+	return (bytes + unit - 1) / unit * unit;
+}
+
+/* Number of buffers in the payload arena: see struct syscalls. */
+#define PAYLOAD_ARENA_BUFFERS		4
+#define PAYLOAD_ARENA_PATTERN_BUFFERS	6
+
+/* Map the payload arena, with read and write buffers big enough for
+ * every transfer in the script, and touch each of its pages now, so
+ * that the system calls we time never fault on them.
+ */
+static void payload_arena_new(struct state *state, struct syscalls *syscalls)
+{
+	size_t max_bytes = script_max_payload_bytes(state->script);
+	size_t page_bytes = sysconf(_SC_PAGESIZE);
+	size_t buffer_bytes = 0, arena_bytes = 0, offset;
+	int num_buffers = PAYLOAD_ARENA_BUFFERS;
+	void *arena = MAP_FAILED;
+
+	if (max_bytes == 0)
+		return;
+	if (state->config->payload_pattern)
+		num_buffers = PAYLOAD_ARENA_PATTERN_BUFFERS;
+
+#ifdef MAP_HUGETLB
+	if (state->config->payload_hugetlb) {
+		buffer_bytes = round_up(max_bytes, hugepage_bytes());
+		arena_bytes = num_buffers * buffer_bytes;
+		arena = mmap(NULL, arena_bytes, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+			     MAP_POPULATE, -1, 0);
+		if (arena == MAP_FAILED) {
+			fprintf(stderr, "%s: no hugepages for %zu bytes of "
+				"payload buffers (%s); using normal pages\n",
+				state->config->script_path, arena_bytes,
+				strerror(errno));
+		} else {
+			syscalls->payload_is_hugetlb = true;
+		}
+	}
+#endif
+	if (arena == MAP_FAILED) {
+		buffer_bytes = round_up(max_bytes, page_bytes);
+		arena_bytes = num_buffers * buffer_bytes;
+		arena = mmap(NULL, arena_bytes, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+			     -1, 0);
+		if (arena == MAP_FAILED)
+			die_perror("mmap");
+	}
+
+	/* MAP_POPULATE is only best-effort, so fault the pages in by hand
+	 * as well, for writing, since reads will write to them.
+	 */
+	for (offset = 0; offset < arena_bytes; offset += page_bytes)
+		((volatile u8 *)arena)[offset] = 0;
+
+	syscalls->payload_arena = arena;
+	syscalls->payload_arena_bytes = arena_bytes;
+	syscalls->payload_read = arena;
+	syscalls->payload_write = syscalls->payload_read + buffer_bytes;
+	syscalls->thread_payload_read = syscalls->payload_write + buffer_bytes;
+	syscalls->thread_payload_write =
+		syscalls->thread_payload_read + buffer_bytes;
+	if (state->config->payload_pattern) {
+		syscalls->payload_pattern_write =
+			syscalls->thread_payload_write + buffer_bytes;
+		syscalls->thread_payload_pattern_write =
+			syscalls->payload_pattern_write + buffer_bytes;
+	}
+	syscalls->payload_bytes = buffer_bytes;
+	DEBUGP("payload arena: %d x %zu bytes%s\n", num_buffers,
+	       buffer_bytes, syscalls->payload_is_hugetlb ? " (hugetlb)" : "");
+}
+
+static void payload_arena_free(struct syscalls *syscalls)
+{
+	if (syscalls->payload_arena == NULL)
+		return;
+	if (munmap(syscalls->payload_arena, syscalls->payload_arena_bytes))
+		die_perror("munmap");
+}
+
 struct syscalls *syscalls_new(struct state *state)
 {
 	struct syscalls *syscalls = calloc(1, sizeof(struct syscalls));
 
 	syscalls->state = SYSCALL_IDLE;
 
+	payload_arena_new(state, syscalls);
+
+	if (state->config->io_uring) {
+		syscalls->uring = uring_new();
+		syscalls->thread_uring = uring_new();
+	}
+
 	if (pthread_create(&syscalls->thread, NULL, system_call_thread,
 			   state) != 0) {
 		die_perror("pthread_create");
@@ -2123,6 +3844,31 @@ void syscalls_free(struct state *state, struct syscalls *syscalls)
 		die_perror("pthread_cond_destroy");
 	}
 
+	while (syscalls->files != NULL) {
+		struct script_file *file = syscalls->files;
+
+		syscalls->files = file->next;
+		if (close(file->live_fd))
+			die_perror("close");
+		free(file);
+	}
+
+	while (syscalls->mappings != NULL) {
+		struct script_mapping *mapping = syscalls->mappings;
+
+		syscalls->mappings = mapping->next;
+		if (munmap(mapping->address, mapping->length))
+			die_perror("munmap");
+		free(mapping);
+	}
+
+	if (syscalls->uring != NULL) {
+		uring_free(syscalls->uring);
+		uring_free(syscalls->thread_uring);
+	}
+
+	payload_arena_free(syscalls);
+
 	memset(syscalls, 0, sizeof(*syscalls));  /* to help catch bugs */
 	free(syscalls);
 }
@@ -29,6 +29,7 @@
 
 #include <pthread.h>
 #include "script.h"
+#include "uring.h"
 
 struct state;
 
@@ -41,13 +42,31 @@ enum syscall_state_t {
 	SYSCALL_EXITING,	/* process is exiting */
 };
 
+/* A file descriptor the script created that isn't a socket: a temp
+ * file from tmpfile(), one end of a pipe from pipe(), or an epoll
+ * instance from epoll_create1().
+ */
+struct script_file {
+	int script_fd;			/* fd number in the script */
+	int live_fd;			/* fd number at runtime */
+	struct script_file *next;	/* next in linked list of files */
+};
+
+/* A region the script mmap()ed on a socket, for zerocopy receive. */
+struct script_mapping {
+	int script_fd;			/* script fd the region maps */
+	void *address;			/* where it's mapped... */
+	size_t length;			/* ...and how big it is */
+	struct script_mapping *next;	/* next in linked list of mappings */
+};
+
 /* Internal state for the system call module, including the "syscall
  * thread", which handles blocking system calls.
  */
 struct syscalls {
 	enum syscall_state_t state;	/* current state of syscall thread */
 	struct event *event;		/* current system call it's running */
-	s64 live_end_usecs;		/* time of last system call return */
+	s64 live_end_nsecs;		/* time of last system call return */
 
 	/* Handles for the syscall thread, for blocking system calls. */
 	pthread_t thread;		/* pthread thread handle */
@@ -75,8 +94,45 @@ struct syscalls {
 	 * execution.
 	 */
 	pthread_cond_t dequeued;
+
+	/* Payload buffers for read- and write-family system calls,
+	 * carved from one arena that is mapped and pre-faulted up front,
+	 * so bulk transfers do no allocation or page faulting while
+	 * they are being timed. Reads land in payload_read; writes send
+	 * the zeroes of payload_write, which stay zeroes. With
+	 * --payload_pattern, writes on TCP sockets send from
+	 * payload_pattern_write instead, which they fill with the
+	 * pattern. Blocking calls run in the syscall thread while the
+	 * main thread goes on, so they use the thread_ buffers instead.
+	 * Each buffer holds payload_bytes, enough for the largest
+	 * transfer in the script; bigger ones fall back to calloc().
+	 */
+	u8 *payload_arena;		/* mmap()ed arena, or NULL */
+	size_t payload_arena_bytes;	/* total size of the mapping */
+	u8 *payload_read;		/* buffer for received payloads */
+	u8 *payload_write;		/* buffer for sent payloads */
+	u8 *thread_payload_read;	/* payload_read of syscall thread */
+	u8 *thread_payload_write;	/* payload_write of syscall thread */
+	u8 *payload_pattern_write;	/* pattern sends, or NULL */
+	u8 *thread_payload_pattern_write; /* same, of syscall thread */
+	size_t payload_bytes;		/* size of each buffer */
+	bool payload_is_hugetlb;	/* arena backed by hugepages? */
+
+	struct script_file *files;	/* open non-socket fds */
+	struct script_mapping *mappings;	/* regions mmap()ed on fds */
+
+	/* With --io_uring, accept, connect, read, recv, write and send
+	 * are issued as io_uring SQEs. Blocking calls run in the syscall
+	 * thread while the main thread goes on, so each thread has its
+	 * own ring and never reaps the other's completions.
+	 */
+	struct uring *uring;		/* ring for the main thread, or NULL */
+	struct uring *thread_uring;	/* ring for the syscall thread */
 };
 
+/* Hugepage size to assume when /proc/meminfo doesn't tell us. */
+#define PAYLOAD_DEFAULT_HUGEPAGE_BYTES	(2 * 1024 * 1024)
+
 /* Allocate and return internal state for the system call module. */
 extern struct syscalls *syscalls_new(struct state *state);
 
@@ -0,0 +1,366 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for a module that periodically samples TCP_INFO
+ * (and MPTCP_INFO, where the kernel has it) for all live sockets in
+ * the background, and writes the resulting time series out at the
+ * end of the test.
+ */
+
+#include "sampler.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include "logging.h"
+#include "run.h"
+#include "tcp.h"
+
+struct sampler *sampler_new(struct config *config)
+{
+	struct sampler *sampler = NULL;
+
+	if (config->sample_usecs == 0)
+		return NULL;
+
+#if !HAVE_TCP_INFO
+	die("--sample_usecs needs TCP_INFO, which this platform lacks\n");
+#endif
+
+	sampler = calloc(1, sizeof(struct sampler));
+	sampler->interval_usecs = config->sample_usecs;
+
+	if (strcmp(config->sample_format, "csv") == 0)
+		sampler->format = SAMPLE_FORMAT_CSV;
+	else if (strcmp(config->sample_format, "json") == 0)
+		sampler->format = SAMPLE_FORMAT_JSON;
+	else
+		die("unsupported --sample_format '%s'\n",
+		    config->sample_format);
+
+	if (config->sample_path != NULL)
+		sampler->path = strdup(config->sample_path);
+	else
+		asprintf(&sampler->path, "%s.samples.%s",
+			 config->script_path, config->sample_format);
+
+	if (pthread_mutex_init(&sampler->lock, NULL) != 0)
+		die_perror("pthread_mutex_init");
+
+	/* Allocate and touch the whole ring now, so that we don't take
+	 * page faults while the test is running.
+	 */
+	sampler->ring = calloc(SAMPLER_RING_ENTRIES, sizeof(struct sample));
+	if (sampler->ring == NULL)
+		die("unable to allocate sample ring\n");
+	memset(sampler->ring, 0,
+	       SAMPLER_RING_ENTRIES * sizeof(struct sample));
+
+	return sampler;
+}
+
+/* Take one sample of the given socket into the next ring slot.
+ * Returns STATUS_OK on success, or STATUS_ERR if the socket has
+ * gone away or is not TCP.
+ */
+static int take_sample(struct sampler *sampler,
+		       const struct sampler_socket *socket, s64 now)
+{
+#if HAVE_TCP_INFO
+	struct _tcp_info info;
+	socklen_t len = sizeof(info);
+
+	memset(&info, 0, sizeof(info));
+	if (getsockopt(socket->live_fd, SOL_TCP, TCP_INFO, &info, &len) < 0)
+		return STATUS_ERR;
+
+	struct sample *sample =
+		&sampler->ring[sampler->num_samples % SAMPLER_RING_ENTRIES];
+	memset(sample, 0, sizeof(*sample));
+	sample->time_nsecs	= now;
+	sample->script_fd	= socket->script_fd;
+	sample->state		= info.tcpi_state;
+	sample->rto		= info.tcpi_rto;
+	sample->snd_mss		= info.tcpi_snd_mss;
+	sample->rtt		= info.tcpi_rtt;
+	sample->rttvar		= info.tcpi_rttvar;
+	sample->snd_ssthresh	= info.tcpi_snd_ssthresh;
+	sample->snd_cwnd	= info.tcpi_snd_cwnd;
+	sample->rcv_space	= info.tcpi_rcv_space;
+#ifdef linux
+	sample->ca_state	= info.tcpi_ca_state;
+	sample->retransmits	= info.tcpi_retransmits;
+	sample->unacked		= info.tcpi_unacked;
+	sample->sacked		= info.tcpi_sacked;
+	sample->lost		= info.tcpi_lost;
+	sample->retrans		= info.tcpi_retrans;
+	sample->total_retrans	= info.tcpi_total_retrans;
+
+	struct _mptcp_info mptcp_info;
+	len = sizeof(mptcp_info);
+	memset(&mptcp_info, 0, sizeof(mptcp_info));
+	if (getsockopt(socket->live_fd, SOL_MPTCP, _MPTCP_INFO,
+		       &mptcp_info, &len) == 0) {
+		sample->has_mptcp	= true;
+		sample->mptcp_subflows	= mptcp_info.mptcpi_subflows;
+		sample->mptcp_token	= mptcp_info.mptcpi_token;
+		sample->mptcp_write_seq	= mptcp_info.mptcpi_write_seq;
+		sample->mptcp_snd_una	= mptcp_info.mptcpi_snd_una;
+		sample->mptcp_rcv_nxt	= mptcp_info.mptcpi_rcv_nxt;
+	}
+#endif  /* linux */
+
+	++sampler->num_samples;
+	return STATUS_OK;
+#else
+	return STATUS_ERR;
+#endif  /* HAVE_TCP_INFO */
+}
+
+/* Advance the given absolute time by the given number of microseconds. */
+static void timespec_add_usecs(struct timespec *ts, s64 usecs)
+{
+	s64 nsecs = ts->tv_nsec + (usecs % 1000000) * 1000;
+	ts->tv_sec += usecs / 1000000 + nsecs / 1000000000;
+	ts->tv_nsec = nsecs % 1000000000;
+}
+
+/* The code executed by the sampler thread: wake up every
+ * interval_usecs and take a sample of each published socket.
+ */
+static void *sampler_thread(void *arg)
+{
+	struct sampler *sampler = (struct sampler *)arg;
+	struct sampler_socket sockets[SAMPLER_MAX_SOCKETS];
+	struct timespec next;
+	int num_sockets, i;
+	bool done = false;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &next) != 0)
+		die_perror("clock_gettime");
+
+	while (!done) {
+		timespec_add_usecs(&next, sampler->interval_usecs);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &next, NULL) == EINTR)
+			;
+
+		/* Copy the socket list under the lock, but do the
+		 * getsockopt() calls without it, so that the main thread
+		 * never waits on them to publish or close a socket.
+		 */
+		if (pthread_mutex_lock(&sampler->lock) != 0)
+			die_perror("pthread_mutex_lock");
+		done = sampler->exiting;
+		num_sockets = sampler->num_sockets;
+		memcpy(sockets, sampler->sockets,
+		       num_sockets * sizeof(struct sampler_socket));
+		if (pthread_mutex_unlock(&sampler->lock) != 0)
+			die_perror("pthread_mutex_unlock");
+
+		if (!done) {
+			s64 now = now_nsecs();
+			for (i = 0; i < num_sockets; ++i)
+				take_sample(sampler, &sockets[i], now);
+		}
+	}
+	return NULL;
+}
+
+void sampler_start(struct sampler *sampler)
+{
+	if (sampler == NULL)
+		return;
+
+	assert(!sampler->running);
+	if (pthread_create(&sampler->thread, NULL, sampler_thread,
+			   sampler) != 0) {
+		die_perror("pthread_create");
+	}
+	sampler->running = true;
+}
+
+void sampler_update_sockets(struct sampler *sampler, struct state *state)
+{
+	struct socket *socket = NULL;
+	int n = 0;
+
+	if (sampler == NULL)
+		return;
+
+	if (pthread_mutex_lock(&sampler->lock) != 0)
+		die_perror("pthread_mutex_lock");
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
+		if (socket->is_closed || socket->live.fd < 0 ||
+		    socket->protocol != IPPROTO_TCP)
+			continue;
+		if (n == SAMPLER_MAX_SOCKETS)
+			break;
+		sampler->sockets[n].script_fd	= socket->script.fd;
+		sampler->sockets[n].live_fd	= socket->live.fd;
+		++n;
+	}
+	sampler->num_sockets = n;
+	if (pthread_mutex_unlock(&sampler->lock) != 0)
+		die_perror("pthread_mutex_unlock");
+}
+
+/* Write out one sample in the configured format. The time is written
+ * in script time, in seconds, so it lines up with the script.
+ */
+static void write_sample(struct sampler *sampler, FILE *file,
+			 const struct sample *sample, struct state *state,
+			 bool first)
+{
+	double secs = nsecs_to_secs(
+		live_time_to_script_time_nsecs(state, sample->time_nsecs));
+
+	switch (sampler->format) {
+	case SAMPLE_FORMAT_CSV:
+		fprintf(file,
+			"%.6f,%d,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u",
+			secs, sample->script_fd, sample->state,
+			sample->ca_state, sample->retransmits, sample->rto,
+			sample->snd_mss, sample->unacked, sample->sacked,
+			sample->lost, sample->retrans, sample->rtt,
+			sample->rttvar, sample->snd_ssthresh,
+			sample->snd_cwnd, sample->rcv_space,
+			sample->total_retrans);
+		if (sample->has_mptcp)
+			fprintf(file, ",%u,%u,%llu,%llu,%llu\n",
+				sample->mptcp_subflows, sample->mptcp_token,
+				sample->mptcp_write_seq,
+				sample->mptcp_snd_una,
+				sample->mptcp_rcv_nxt);
+		else
+			fprintf(file, ",,,,,\n");
+		break;
+	case SAMPLE_FORMAT_JSON:
+		fprintf(file,
+			"%s  {\"time\": %.6f, \"fd\": %d, \"state\": %u, "
+			"\"ca_state\": %u, \"retransmits\": %u, "
+			"\"rto\": %u, \"snd_mss\": %u, \"unacked\": %u, "
+			"\"sacked\": %u, \"lost\": %u, \"retrans\": %u, "
+			"\"rtt\": %u, \"rttvar\": %u, \"snd_ssthresh\": %u, "
+			"\"snd_cwnd\": %u, \"rcv_space\": %u, "
+			"\"total_retrans\": %u",
+			first ? "" : ",\n",
+			secs, sample->script_fd, sample->state,
+			sample->ca_state, sample->retransmits, sample->rto,
+			sample->snd_mss, sample->unacked, sample->sacked,
+			sample->lost, sample->retrans, sample->rtt,
+			sample->rttvar, sample->snd_ssthresh,
+			sample->snd_cwnd, sample->rcv_space,
+			sample->total_retrans);
+		if (sample->has_mptcp)
+			fprintf(file,
+				", \"mptcp_subflows\": %u, "
+				"\"mptcp_token\": %u, "
+				"\"mptcp_write_seq\": %llu, "
+				"\"mptcp_snd_una\": %llu, "
+				"\"mptcp_rcv_nxt\": %llu",
+				sample->mptcp_subflows, sample->mptcp_token,
+				sample->mptcp_write_seq,
+				sample->mptcp_snd_una,
+				sample->mptcp_rcv_nxt);
+		fprintf(file, "}");
+		break;
+	/* omitting default so compiler catches missing cases */
+	}
+}
+
+int sampler_finish(struct sampler *sampler, struct state *state,
+		   char **error)
+{
+	u64 first = 0, i;
+	FILE *file = NULL;
+
+	if (sampler == NULL)
+		return STATUS_OK;
+
+	/* Stop the thread; after the join we own all sampler state. */
+	if (sampler->running) {
+		if (pthread_mutex_lock(&sampler->lock) != 0)
+			die_perror("pthread_mutex_lock");
+		sampler->exiting = true;
+		if (pthread_mutex_unlock(&sampler->lock) != 0)
+			die_perror("pthread_mutex_unlock");
+		if (pthread_join(sampler->thread, NULL) != 0)
+			die_perror("pthread_join");
+		sampler->running = false;
+	}
+
+	file = fopen(sampler->path, "w");
+	if (file == NULL) {
+		asprintf(error, "unable to open sample file '%s': %s",
+			 sampler->path, strerror(errno));
+		return STATUS_ERR;
+	}
+
+	if (sampler->num_samples > SAMPLER_RING_ENTRIES) {
+		first = sampler->num_samples - SAMPLER_RING_ENTRIES;
+		fprintf(stderr, "%s: sample ring overflowed; "
+			"dropped the oldest %llu samples\n",
+			state->config->script_path, first);
+	}
+
+	if (sampler->format == SAMPLE_FORMAT_CSV)
+		fprintf(file, "time,fd,state,ca_state,retransmits,rto,"
+			"snd_mss,unacked,sacked,lost,retrans,rtt,rttvar,"
+			"snd_ssthresh,snd_cwnd,rcv_space,total_retrans,"
+			"mptcp_subflows,mptcp_token,mptcp_write_seq,"
+			"mptcp_snd_una,mptcp_rcv_nxt\n");
+	else
+		fprintf(file, "[\n");
+
+	for (i = first; i < sampler->num_samples; ++i) {
+		write_sample(sampler, file,
+			     &sampler->ring[i % SAMPLER_RING_ENTRIES],
+			     state, i == first);
+	}
+
+	if (sampler->format == SAMPLE_FORMAT_JSON)
+		fprintf(file, "\n]\n");
+
+	if (fclose(file) != 0) {
+		asprintf(error, "error writing sample file '%s': %s",
+			 sampler->path, strerror(errno));
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+void sampler_free(struct sampler *sampler)
+{
+	if (sampler == NULL)
+		return;
+
+	assert(!sampler->running);
+	if (pthread_mutex_destroy(&sampler->lock) != 0)
+		die_perror("pthread_mutex_destroy");
+	free(sampler->ring);
+	free(sampler->path);
+	memset(sampler, 0, sizeof(*sampler));  /* paranoia to help catch bugs */
+	free(sampler);
+}
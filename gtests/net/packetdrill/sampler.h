@@ -0,0 +1,128 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for a module that periodically samples TCP_INFO (and
+ * MPTCP_INFO, where the kernel has it) for all live sockets in the
+ * background, and writes the resulting time series out at the end of
+ * the test.
+ */
+
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+#include "types.h"
+
+#include <pthread.h>
+#include "config.h"
+
+/* Maximum number of samples we keep; older samples are overwritten. */
+#define SAMPLER_RING_ENTRIES	16384
+
+/* Maximum number of sockets we sample at once. */
+#define SAMPLER_MAX_SOCKETS	64
+
+/* Output formats for the time series. */
+enum sample_format_t {
+	SAMPLE_FORMAT_CSV,		/* one header line, one line per sample */
+	SAMPLE_FORMAT_JSON,		/* an array of objects, one per sample */
+};
+
+/* The values we record for one socket at one point in time. */
+struct sample {
+	s64 time_nsecs;			/* live wall time of the sample */
+	int script_fd;			/* fd of the socket in the script */
+	u8 state;			/* tcpi_state */
+	u8 ca_state;			/* tcpi_ca_state */
+	u8 retransmits;			/* tcpi_retransmits */
+	u32 rto;
+	u32 snd_mss;
+	u32 unacked;
+	u32 sacked;
+	u32 lost;
+	u32 retrans;
+	u32 rtt;
+	u32 rttvar;
+	u32 snd_ssthresh;
+	u32 snd_cwnd;
+	u32 rcv_space;
+	u32 total_retrans;
+	bool has_mptcp;			/* did MPTCP_INFO succeed? */
+	u8 mptcp_subflows;
+	u32 mptcp_token;
+	u64 mptcp_write_seq;
+	u64 mptcp_snd_una;
+	u64 mptcp_rcv_nxt;
+};
+
+/* A socket the sampler thread should look at. */
+struct sampler_socket {
+	int script_fd;
+	int live_fd;
+};
+
+/* Internal state for the sampler module. The sampler thread does not
+ * take the global run lock, so that sampling never delays script
+ * events; instead the main thread publishes the set of live sockets
+ * to sample under sampler->lock.
+ */
+struct sampler {
+	s64 interval_usecs;		/* time between samples */
+	enum sample_format_t format;	/* output format */
+	char *path;			/* where we write the samples */
+
+	pthread_t thread;		/* sampler thread handle */
+	pthread_mutex_t lock;		/* protects the fields up to ring */
+	bool running;			/* has the thread been started? */
+	bool exiting;			/* should the thread exit? */
+
+	struct sampler_socket sockets[SAMPLER_MAX_SOCKETS];
+	int num_sockets;		/* valid entries in sockets[] */
+
+	/* Only the sampler thread touches these until it is joined. */
+	struct sample *ring;		/* SAMPLER_RING_ENTRIES samples */
+	u64 num_samples;		/* total samples taken so far */
+};
+
+struct state;
+
+/* Allocate and return a new sampler if the config asks for one;
+ * otherwise return NULL.
+ */
+extern struct sampler *sampler_new(struct config *config);
+
+/* Start the sampler thread. Call after the live start time is known. */
+extern void sampler_start(struct sampler *sampler);
+
+/* Publish the current set of live TCP sockets to the sampler. The
+ * main thread calls this, holding the global lock, after each event.
+ */
+extern void sampler_update_sockets(struct sampler *sampler,
+				   struct state *state);
+
+/* Stop the sampler thread and write out all the samples, with times
+ * converted to script time. On success, returns STATUS_OK. On error
+ * returns STATUS_ERR and fills in *error.
+ */
+extern int sampler_finish(struct sampler *sampler, struct state *state,
+			  char **error);
+
+/* Tear down a sampler and free up the resources it has allocated. */
+extern void sampler_free(struct sampler *sampler);
+
+#endif /* __SAMPLER_H__ */
@@ -27,6 +27,9 @@
 #include <assert.h>
 #include <poll.h>
 #include <stdlib.h>
+#if defined(linux)
+#include <sys/epoll.h>
+#endif
 
 #include "symbols.h"
 
@@ -65,6 +68,11 @@ struct expression_type_entry expression_type_table[] = {
 	{ EXPR_IOVEC,                "iovec" },
 	{ EXPR_MSGHDR,               "msghdr" },
 	{ EXPR_POLLFD,               "pollfd" },
+	{ EXPR_CMSGHDR,              "cmsghdr" },
+	{ EXPR_SOCK_EXTENDED_ERR,    "sock_extended_err" },
+	{ EXPR_TCP_ZEROCOPY_RECEIVE, "tcp_zerocopy_receive" },
+	{ EXPR_EPOLL_EVENT,          "epoll_event" },
+	{ EXPR_MMSGHDR,              "mmsghdr" },
 	{ NUM_EXPR_TYPES,            NULL}
 };
 
@@ -175,6 +183,32 @@ struct flag_name poll_flags[] = {
 	{ 0, "" },
 };
 
+/* Names for the event bit mask flags for the epoll system calls */
+struct flag_name epoll_flags[] = {
+
+#if defined(linux)
+	{ EPOLLIN,	"EPOLLIN" },
+	{ EPOLLPRI,	"EPOLLPRI" },
+	{ EPOLLOUT,	"EPOLLOUT" },
+	{ EPOLLRDNORM,	"EPOLLRDNORM" },
+	{ EPOLLRDBAND,	"EPOLLRDBAND" },
+	{ EPOLLWRNORM,	"EPOLLWRNORM" },
+	{ EPOLLWRBAND,	"EPOLLWRBAND" },
+	{ EPOLLMSG,	"EPOLLMSG" },
+	{ EPOLLERR,	"EPOLLERR" },
+	{ EPOLLHUP,	"EPOLLHUP" },
+	{ EPOLLRDHUP,	"EPOLLRDHUP" },
+#ifdef EPOLLEXCLUSIVE
+	{ EPOLLEXCLUSIVE, "EPOLLEXCLUSIVE" },
+#endif
+	{ EPOLLWAKEUP,	"EPOLLWAKEUP" },
+	{ EPOLLONESHOT,	"EPOLLONESHOT" },
+	{ EPOLLET,	"EPOLLET" },
+#endif
+
+	{ 0, "" },
+};
+
 /* Return the human-readable ASCII string corresponding to a given
  * flag value, or "???" if none matches.
  */
@@ -307,6 +341,7 @@ void free_expression(struct expression *expression)
 		free_expression(expression->value.msghdr->msg_namelen);
 		free_expression(expression->value.msghdr->msg_iov);
 		free_expression(expression->value.msghdr->msg_iovlen);
+		free_expression(expression->value.msghdr->msg_control);
 		free_expression(expression->value.msghdr->msg_flags);
 		break;
 	case EXPR_POLLFD:
@@ -315,6 +350,42 @@ void free_expression(struct expression *expression)
 		free_expression(expression->value.pollfd->events);
 		free_expression(expression->value.pollfd->revents);
 		break;
+	case EXPR_CMSGHDR:
+		assert(expression->value.cmsghdr);
+		free_expression(expression->value.cmsghdr->cmsg_level);
+		free_expression(expression->value.cmsghdr->cmsg_type);
+		free_expression(expression->value.cmsghdr->cmsg_data);
+		break;
+	case EXPR_SOCK_EXTENDED_ERR:
+		assert(expression->value.sock_extended_err);
+		free_expression(expression->value.sock_extended_err->ee_errno);
+		free_expression(expression->value.sock_extended_err->ee_origin);
+		free_expression(expression->value.sock_extended_err->ee_type);
+		free_expression(expression->value.sock_extended_err->ee_code);
+		free_expression(expression->value.sock_extended_err->ee_info);
+		free_expression(expression->value.sock_extended_err->ee_data);
+		break;
+	case EXPR_TCP_ZEROCOPY_RECEIVE:
+		assert(expression->value.tcp_zerocopy_receive);
+		free_expression(
+			expression->value.tcp_zerocopy_receive->address);
+		free_expression(
+			expression->value.tcp_zerocopy_receive->length);
+		free_expression(
+			expression->value.tcp_zerocopy_receive->recv_skip_hint);
+		free_expression(expression->value.tcp_zerocopy_receive->inq);
+		free_expression(expression->value.tcp_zerocopy_receive->err);
+		break;
+	case EXPR_EPOLL_EVENT:
+		assert(expression->value.epoll_event);
+		free_expression(expression->value.epoll_event->events);
+		free_expression(expression->value.epoll_event->fd);
+		break;
+	case EXPR_MMSGHDR:
+		assert(expression->value.mmsghdr);
+		free_expression(expression->value.mmsghdr->msg_hdr);
+		free_expression(expression->value.mmsghdr->msg_len);
+		break;
 	case EXPR_NONE:
 	case NUM_EXPR_TYPES:
 		break;
@@ -334,6 +405,71 @@ void free_expression_list(struct expression_list *list)
 	}
 }
 
+static void free_syscall_spec(struct syscall_spec *syscall)
+{
+	free((char *)syscall->name);
+	free_expression_list(syscall->arguments);
+	free_expression(syscall->result);
+	if (syscall->error != NULL) {
+		free((char *)syscall->error->errno_macro);
+		free((char *)syscall->error->strerror);
+		free(syscall->error);
+	}
+	free(syscall->note);
+	free(syscall);
+}
+
+static void free_command_spec(struct command_spec *command)
+{
+	if (command == NULL)
+		return;
+	free((char *)command->command_line);
+	free(command);
+}
+
+static void free_event(struct event *event)
+{
+	switch (event->type) {
+	case PACKET_EVENT:
+		packet_free(event->event.packet);
+		break;
+	case SYSCALL_EVENT:
+		free_syscall_spec(event->event.syscall);
+		break;
+	case COMMAND_EVENT:
+		free_command_spec(event->event.command);
+		break;
+	case CODE_EVENT:
+		free((char *)event->event.code->text);
+		free(event->event.code);
+		break;
+	case INVALID_EVENT:
+	case NUM_EVENT_TYPES:
+		assert(!"bad event type");
+		break;
+	}
+	free(event);
+}
+
+void script_free(struct script *script)
+{
+	while (script->option_list != NULL) {
+		struct option_list *dead = script->option_list;
+		script->option_list = dead->next;
+		free(dead->name);
+		free(dead->value);
+		free(dead);
+	}
+	free_command_spec(script->init_command);
+	while (script->event_list != NULL) {
+		struct event *dead = script->event_list;
+		script->event_list = dead->next;
+		free_event(dead);
+	}
+	free(script->buffer);
+	init_script(script);
+}
+
 static int evaluate_binary_expression(struct expression *in,
 				      struct expression *out, char **error)
 {
@@ -424,6 +560,9 @@ static int evaluate_msghdr_expression(struct expression *in,
 		return STATUS_ERR;
 	if (evaluate(in_msg->msg_iovlen,	&out_msg->msg_iovlen,	error))
 		return STATUS_ERR;
+	if (in_msg->msg_control != NULL &&
+	    evaluate(in_msg->msg_control,	&out_msg->msg_control,	error))
+		return STATUS_ERR;
 	if (evaluate(in_msg->msg_flags,		&out_msg->msg_flags,	error))
 		return STATUS_ERR;
 
@@ -455,6 +594,143 @@ static int evaluate_pollfd_expression(struct expression *in,
 	return STATUS_OK;
 }
 
+static int evaluate_cmsghdr_expression(struct expression *in,
+				       struct expression *out, char **error)
+{
+	struct cmsghdr_expr *in_cmsg;
+	struct cmsghdr_expr *out_cmsg;
+
+	assert(in->type == EXPR_CMSGHDR);
+	assert(in->value.cmsghdr);
+	assert(out->type == EXPR_CMSGHDR);
+
+	out->value.cmsghdr = calloc(1, sizeof(struct cmsghdr_expr));
+
+	in_cmsg = in->value.cmsghdr;
+	out_cmsg = out->value.cmsghdr;
+
+	if (evaluate(in_cmsg->cmsg_level,	&out_cmsg->cmsg_level,	error))
+		return STATUS_ERR;
+	if (evaluate(in_cmsg->cmsg_type,	&out_cmsg->cmsg_type,	error))
+		return STATUS_ERR;
+	if (evaluate(in_cmsg->cmsg_data,	&out_cmsg->cmsg_data,	error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_sock_extended_err_expression(struct expression *in,
+						 struct expression *out,
+						 char **error)
+{
+	struct sock_extended_err_expr *in_ee;
+	struct sock_extended_err_expr *out_ee;
+
+	assert(in->type == EXPR_SOCK_EXTENDED_ERR);
+	assert(in->value.sock_extended_err);
+	assert(out->type == EXPR_SOCK_EXTENDED_ERR);
+
+	out->value.sock_extended_err =
+		calloc(1, sizeof(struct sock_extended_err_expr));
+
+	in_ee = in->value.sock_extended_err;
+	out_ee = out->value.sock_extended_err;
+
+	if (evaluate(in_ee->ee_errno,		&out_ee->ee_errno,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_origin,		&out_ee->ee_origin,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_type,		&out_ee->ee_type,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_code,		&out_ee->ee_code,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_info,		&out_ee->ee_info,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_data,		&out_ee->ee_data,	error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_tcp_zerocopy_receive_expression(struct expression *in,
+						    struct expression *out,
+						    char **error)
+{
+	struct tcp_zerocopy_receive_expr *in_zc;
+	struct tcp_zerocopy_receive_expr *out_zc;
+
+	assert(in->type == EXPR_TCP_ZEROCOPY_RECEIVE);
+	assert(in->value.tcp_zerocopy_receive);
+	assert(out->type == EXPR_TCP_ZEROCOPY_RECEIVE);
+
+	out->value.tcp_zerocopy_receive =
+		calloc(1, sizeof(struct tcp_zerocopy_receive_expr));
+
+	in_zc = in->value.tcp_zerocopy_receive;
+	out_zc = out->value.tcp_zerocopy_receive;
+
+	if (evaluate(in_zc->address,		&out_zc->address,	error))
+		return STATUS_ERR;
+	if (evaluate(in_zc->length,		&out_zc->length,	error))
+		return STATUS_ERR;
+	if (evaluate(in_zc->recv_skip_hint,	&out_zc->recv_skip_hint,
+		     error))
+		return STATUS_ERR;
+	if (evaluate(in_zc->inq,		&out_zc->inq,		error))
+		return STATUS_ERR;
+	if (evaluate(in_zc->err,		&out_zc->err,		error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_epoll_event_expression(struct expression *in,
+					   struct expression *out,
+					   char **error)
+{
+	struct epoll_event_expr *in_event;
+	struct epoll_event_expr *out_event;
+
+	assert(in->type == EXPR_EPOLL_EVENT);
+	assert(in->value.epoll_event);
+	assert(out->type == EXPR_EPOLL_EVENT);
+
+	out->value.epoll_event = calloc(1, sizeof(struct epoll_event_expr));
+
+	in_event = in->value.epoll_event;
+	out_event = out->value.epoll_event;
+
+	if (evaluate(in_event->events,		&out_event->events,	error))
+		return STATUS_ERR;
+	if (evaluate(in_event->fd,		&out_event->fd,		error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_mmsghdr_expression(struct expression *in,
+				       struct expression *out, char **error)
+{
+	struct mmsghdr_expr *in_mmsg;
+	struct mmsghdr_expr *out_mmsg;
+
+	assert(in->type == EXPR_MMSGHDR);
+	assert(in->value.mmsghdr);
+	assert(out->type == EXPR_MMSGHDR);
+
+	out->value.mmsghdr = calloc(1, sizeof(struct mmsghdr_expr));
+
+	in_mmsg = in->value.mmsghdr;
+	out_mmsg = out->value.mmsghdr;
+
+	if (evaluate(in_mmsg->msg_hdr,		&out_mmsg->msg_hdr,	error))
+		return STATUS_ERR;
+	if (evaluate(in_mmsg->msg_len,		&out_mmsg->msg_len,	error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
 static int evaluate(struct expression *in,
 		    struct expression **out_ptr, char **error)
 {
@@ -517,6 +793,22 @@ static int evaluate(struct expression *in,
 	case EXPR_POLLFD:
 		result = evaluate_pollfd_expression(in, out, error);
 		break;
+	case EXPR_CMSGHDR:
+		result = evaluate_cmsghdr_expression(in, out, error);
+		break;
+	case EXPR_SOCK_EXTENDED_ERR:
+		result = evaluate_sock_extended_err_expression(in, out, error);
+		break;
+	case EXPR_TCP_ZEROCOPY_RECEIVE:
+		result = evaluate_tcp_zerocopy_receive_expression(in, out,
+								  error);
+		break;
+	case EXPR_EPOLL_EVENT:
+		result = evaluate_epoll_event_expression(in, out, error);
+		break;
+	case EXPR_MMSGHDR:
+		result = evaluate_mmsghdr_expression(in, out, error);
+		break;
 	case EXPR_NONE:
 	case NUM_EXPR_TYPES:
 		break;
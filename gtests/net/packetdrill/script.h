@@ -45,6 +45,11 @@ enum expression_t {
 	EXPR_IOVEC,		  /* expression tree for an iovec struct */
 	EXPR_MSGHDR,		  /* expression tree for a msghdr struct */
 	EXPR_POLLFD,		  /* expression tree for a pollfd struct */
+	EXPR_CMSGHDR,		  /* expression tree for a cmsghdr struct */
+	EXPR_SOCK_EXTENDED_ERR,	  /* expression tree for sock_extended_err */
+	EXPR_TCP_ZEROCOPY_RECEIVE, /* tree for tcp_zerocopy_receive struct */
+	EXPR_EPOLL_EVENT,	  /* expression tree for an epoll_event struct */
+	EXPR_MMSGHDR,		  /* expression tree for a mmsghdr struct */
 	NUM_EXPR_TYPES,
 };
 /* Convert an expression type to a human-readable string */
@@ -64,6 +69,11 @@ struct expression {
 		struct iovec_expr *iovec;
 		struct msghdr_expr *msghdr;
 		struct pollfd_expr *pollfd;
+		struct cmsghdr_expr *cmsghdr;
+		struct sock_extended_err_expr *sock_extended_err;
+		struct tcp_zerocopy_receive_expr *tcp_zerocopy_receive;
+		struct epoll_event_expr *epoll_event;
+		struct mmsghdr_expr *mmsghdr;
 	} value;
 	const char *format;	/* the printf format for printing the value */
 };
@@ -95,9 +105,55 @@ struct msghdr_expr {
 	struct expression *msg_namelen;
 	struct expression *msg_iov;
 	struct expression *msg_iovlen;
+	struct expression *msg_control;	/* list of cmsghdr, or NULL */
 	struct expression *msg_flags;
 };
 
+/* Parse tree for a mmsghdr struct in a sendmmsg or recvmmsg syscall. */
+struct mmsghdr_expr {
+	struct expression *msg_hdr;	/* the msghdr */
+	struct expression *msg_len;	/* bytes sent or received */
+};
+
+/* Parse tree for a cmsghdr struct in the msg_control of a msghdr. */
+struct cmsghdr_expr {
+	struct expression *cmsg_level;
+	struct expression *cmsg_type;
+	struct expression *cmsg_data;	/* integer or sock_extended_err */
+};
+
+/* Parse tree for a sock_extended_err struct in an error queue cmsg. */
+struct sock_extended_err_expr {
+	struct expression *ee_errno;
+	struct expression *ee_origin;
+	struct expression *ee_type;
+	struct expression *ee_code;
+	struct expression *ee_info;
+	struct expression *ee_data;
+};
+
+/* Parse tree for a tcp_zerocopy_receive struct in a getsockopt of
+ * TCP_ZEROCOPY_RECEIVE. The address is always "...", meaning the
+ * region mmap()ed on the socket; the other fields are the outputs
+ * we expect.
+ */
+struct tcp_zerocopy_receive_expr {
+	struct expression *address;
+	struct expression *length;
+	struct expression *recv_skip_hint;
+	struct expression *inq;
+	struct expression *err;
+};
+
+/* Parse tree for an epoll_event struct in an epoll_ctl or epoll_wait
+ * syscall. The fd is the script fd we keep in the event's data, so
+ * epoll_wait results can name the fd that is ready.
+ */
+struct epoll_event_expr {
+	struct expression *events;	/* EPOLL* event mask */
+	struct expression *fd;		/* script fd the event is for */
+};
+
 /* Parse tree for a pollfd struct in a poll syscall. */
 struct pollfd_expr {
 	struct expression *fd;		/* file descriptor */
@@ -112,9 +168,9 @@ struct errno_spec {
 };
 
 /* A system call and its expected result. System calls that should
- * return immediately have an end_usecs value of SYSCALL_NON_BLOCKING.
+ * return immediately have an end_nsecs value of SYSCALL_NON_BLOCKING.
  * System calls that block for some non-zero time have a non-negative
- * end_usecs indicating the time at which the system call should
+ * end_nsecs indicating the time at which the system call should
  * return.
  */
 struct syscall_spec {
@@ -123,13 +179,13 @@ struct syscall_spec {
 	struct expression *result;		/* expected result from call */
 	struct errno_spec *error;		/* errno symbol or NULL */
 	char *note;				/* extra note from strace */
-	s64 end_usecs;				/* finish time, if it blocks */
+	s64 end_nsecs;				/* finish time, if it blocks */
 };
-#define SYSCALL_NON_BLOCKING  -1		/* end_usecs if non-blocking */
+#define SYSCALL_NON_BLOCKING  -1		/* end_nsecs if non-blocking */
 
 static inline bool is_blocking_syscall(struct syscall_spec *syscall)
 {
-	return syscall->end_usecs != SYSCALL_NON_BLOCKING;
+	return syscall->end_nsecs != SYSCALL_NON_BLOCKING;
 }
 
 /* A shell command line to execute using system(3) */
@@ -167,12 +223,18 @@ enum event_time_t {
 /* An event in a script */
 struct event {
 	int line_number;	/* location in test script file */
-	s64 time_usecs;		/* event time in microseconds */
-	s64 time_usecs_end;	/* event time range end (or NO_TIME_RANGE) */
-	s64 offset_usecs;	/* relative event time offset from script start
+	s64 time_nsecs;		/* event time in nanoseconds */
+	s64 time_nsecs_end;	/* event time range end (or NO_TIME_RANGE) */
+	s64 offset_nsecs;	/* relative event time offset from script start
 				 * (or NO_TIME_RANGE) */
 	enum event_time_t time_type; /* type of time */
 	enum event_t type;	/* type of the event */
+	s64 injected_nsecs;	/* live time at which injecting this inbound
+				 * packet finished (or 0) */
+	s64 finished_nsecs;	/* live time at which running the event
+				 * finished (or 0) */
+	s64 dispatch_lag_nsecs;	/* how long after its script time the
+				 * event finished (0 for ANY_TIME events) */
 	union {
 		struct packet	*packet;
 		struct syscall_spec	*syscall;
@@ -181,7 +243,7 @@ struct event {
 	} event;		/* pointer to the event */
 	struct event *next;	/* next in linked list of events */
 };
-#define NO_TIME_RANGE	-1		/* time_usecs_end if no range */
+#define NO_TIME_RANGE	-1		/* time_nsecs_end if no range */
 
 static inline bool is_event_time_absolute(struct event *event)
 {
@@ -197,8 +259,7 @@ struct option_list {
 };
 
 /* A parsed script. The script owns all of the data to which
- * it points. TODO: add a script_free() to free everything when we are
- * done executing the script, instead of leaking all that memory.
+ * it points; script_free() frees it all.
  */
 struct script {
 	struct option_list *option_list;    /* linked list of options */
@@ -220,6 +281,11 @@ struct flag_name {
 /* Initialize a script object */
 extern void init_script(struct script *script);
 
+/* Free everything a parsed script owns, leaving the script struct
+ * itself initialized again.
+ */
+extern void script_free(struct script *script);
+
 /* Look up the value of the given symbol, and fill it in. On success,
  * return STATUS_OK; if the symbol cannot be found, return
  * STATUS_ERR and fill in an error message in *error.
@@ -232,6 +298,7 @@ extern int symbol_to_int(const char *input_symbol, s64 *output_integer,
  * string. Caller must free() the memory.
  */
 extern struct flag_name poll_flags[];
+extern struct flag_name epoll_flags[];
 char *flags_to_string(struct flag_name *flags_array, u64 flags);
 
 /* Do a deep deallocation of a heap-allocated expression list,
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * inet_diag lookups of single TCP sockets. See sock_diag.h for details.
+ */
+
+#include "sock_diag.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logging.h"
+
+#if defined(linux)
+
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+
+int sock_diag_open(void)
+{
+	int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+			NETLINK_SOCK_DIAG);
+
+	if (fd < 0)
+		die_perror("socket(NETLINK_SOCK_DIAG)");
+	return fd;
+}
+
+int sock_diag_tcp_exists(int diag_fd, const struct endpoint *local,
+			 const struct endpoint *remote, bool *exists,
+			 char **error)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct inet_diag_req_v2 req;
+	} request;
+	union {
+		struct nlmsghdr nlh;
+		u8 bytes[8192];
+	} reply;
+	struct sockaddr_nl kernel;
+	const int family = local->ip.address_family;
+	const int ip_bytes = ip_address_length(family);
+	struct nlmsgerr *err = NULL;
+	ssize_t len;
+
+	memset(&kernel, 0, sizeof(kernel));
+	kernel.nl_family = AF_NETLINK;
+
+	/* Without NLM_F_DUMP, this is an exact lookup of one socket. */
+	memset(&request, 0, sizeof(request));
+	request.nlh.nlmsg_len = sizeof(request);
+	request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	request.nlh.nlmsg_flags = NLM_F_REQUEST;
+	request.req.sdiag_family = family;
+	request.req.sdiag_protocol = IPPROTO_TCP;
+	request.req.idiag_states = ~0U;
+	request.req.id.idiag_sport = local->port;
+	request.req.id.idiag_dport = remote->port;
+	memcpy(request.req.id.idiag_src, &local->ip.ip, ip_bytes);
+	memcpy(request.req.id.idiag_dst, &remote->ip.ip, ip_bytes);
+	request.req.id.idiag_cookie[0] = INET_DIAG_NOCOOKIE;
+	request.req.id.idiag_cookie[1] = INET_DIAG_NOCOOKIE;
+
+	if (sendto(diag_fd, &request, sizeof(request), 0,
+		   (struct sockaddr *)&kernel, sizeof(kernel)) < 0) {
+		asprintf(error, "sock_diag sendto: %s", strerror(errno));
+		return STATUS_ERR;
+	}
+	len = recv(diag_fd, &reply, sizeof(reply), 0);
+	if (len < 0) {
+		asprintf(error, "sock_diag recv: %s", strerror(errno));
+		return STATUS_ERR;
+	}
+	if (!NLMSG_OK(&reply.nlh, len)) {
+		asprintf(error, "sock_diag: truncated reply");
+		return STATUS_ERR;
+	}
+
+	if (reply.nlh.nlmsg_type == NLMSG_ERROR) {
+		err = NLMSG_DATA(&reply.nlh);
+		if (err->error == -ENOENT) {
+			*exists = false;
+			return STATUS_OK;
+		}
+		asprintf(error, "sock_diag lookup: %s", strerror(-err->error));
+		return STATUS_ERR;
+	}
+	*exists = (reply.nlh.nlmsg_type == SOCK_DIAG_BY_FAMILY);
+	return STATUS_OK;
+}
+
+#else  /* !linux */
+
+int sock_diag_open(void)
+{
+	die("--reset_wait_usecs is only supported on Linux\n");
+	return -1;
+}
+
+int sock_diag_tcp_exists(int diag_fd, const struct endpoint *local,
+			 const struct endpoint *remote, bool *exists,
+			 char **error)
+{
+	asprintf(error, "sock_diag is only supported on Linux");
+	return STATUS_ERR;
+}
+
+#endif  /* linux */
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Lookups of single TCP sockets in the kernel under test through
+ * inet_diag (NETLINK_SOCK_DIAG), so we can tell when connections we
+ * reset at the end of a script are really gone.
+ */
+
+#ifndef __PACKET_SOCK_DIAG_H__
+#define __PACKET_SOCK_DIAG_H__
+
+#include "types.h"
+
+#include "socket.h"
+
+/* Open a NETLINK_SOCK_DIAG socket for sock_diag_tcp_exists(). Dies on
+ * failure.
+ */
+extern int sock_diag_open(void);
+
+/* Ask the kernel whether it has a TCP socket, in any state including
+ * TIME_WAIT, with the given local and remote endpoints. On success,
+ * sets *exists and returns STATUS_OK; otherwise fills in *error and
+ * returns STATUS_ERR.
+ */
+extern int sock_diag_tcp_exists(int diag_fd, const struct endpoint *local,
+				const struct endpoint *remote, bool *exists,
+				char **error);
+
+#endif /* __PACKET_SOCK_DIAG_H__ */
@@ -105,6 +105,12 @@ struct socket {
 	struct tcp last_injected_tcp_header;
 	u32 last_injected_tcp_payload_len;
 
+	/* With --payload_pattern, the stream offsets of the next bytes
+	 * the application reads from and writes to this socket.
+	 */
+	u64 read_offset;
+	u64 write_offset;
+
 	struct socket *next;	/* next in linked list of sockets */
 };
 
@@ -34,15 +34,19 @@
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/unistd.h>
 
+#include <linux/errqueue.h>
 #include <linux/sockios.h>
 
 #include "tcp.h"
+#include "udp.h"
 
 /* A table of platform-specific string->int mappings. */
 struct int_symbol platform_symbols_table[] = {
@@ -82,8 +86,19 @@ struct int_symbol platform_symbols_table[] = {
 	{ SO_SNDTIMEO,                      "SO_SNDTIMEO"                     },
 	{ SO_TIMESTAMP,                     "SO_TIMESTAMP"                    },
 	{ SO_TYPE,                          "SO_TYPE"                         },
+	{ SO_ZEROCOPY,                      "SO_ZEROCOPY"                     },
 
 	{ IP_TOS,                           "IP_TOS"                          },
+	{ IP_RECVERR,                       "IP_RECVERR"                      },
+	{ IPV6_RECVERR,                     "IPV6_RECVERR"                    },
+
+	{ SO_EE_ORIGIN_NONE,                "SO_EE_ORIGIN_NONE"               },
+	{ SO_EE_ORIGIN_LOCAL,               "SO_EE_ORIGIN_LOCAL"              },
+	{ SO_EE_ORIGIN_ICMP,                "SO_EE_ORIGIN_ICMP"               },
+	{ SO_EE_ORIGIN_ICMP6,               "SO_EE_ORIGIN_ICMP6"              },
+	{ SO_EE_ORIGIN_ZEROCOPY,            "SO_EE_ORIGIN_ZEROCOPY"           },
+	{ SO_EE_CODE_ZEROCOPY_COPIED,       "SO_EE_CODE_ZEROCOPY_COPIED"      },
+
 	{ IP_MTU_DISCOVER,                  "IP_MTU_DISCOVER"                 },
 	{ IP_PMTUDISC_WANT,                 "IP_PMTUDISC_WANT"                },
 	{ IP_PMTUDISC_DONT,                 "IP_PMTUDISC_DONT"                },
@@ -114,6 +129,7 @@ struct int_symbol platform_symbols_table[] = {
 	{ TCP_THIN_LINEAR_TIMEOUTS,         "TCP_THIN_LINEAR_TIMEOUTS"        },
 	{ TCP_THIN_DUPACK,                  "TCP_THIN_DUPACK"                 },
 	{ TCP_USER_TIMEOUT,                 "TCP_USER_TIMEOUT"                },
+	{ TCP_ZEROCOPY_RECEIVE,             "TCP_ZEROCOPY_RECEIVE"            },
 
 	{ O_RDONLY,                         "O_RDONLY"                        },
 	{ O_WRONLY,                         "O_WRONLY"                        },
@@ -150,6 +166,8 @@ struct int_symbol platform_symbols_table[] = {
 	{ F_GETLEASE,                       "F_GETLEASE"                      },
 	{ F_NOTIFY,                         "F_NOTIFY"                        },
 	{ F_DUPFD_CLOEXEC,                  "F_DUPFD_CLOEXEC"                 },
+	{ F_SETPIPE_SZ,                     "F_SETPIPE_SZ"                    },
+	{ F_GETPIPE_SZ,                     "F_GETPIPE_SZ"                    },
 	{ FD_CLOEXEC,                       "FD_CLOEXEC"                      },
 
 	{ LOCK_SH,                          "LOCK_SH"                         },
@@ -163,10 +181,46 @@ struct int_symbol platform_symbols_table[] = {
 	{ F_EXLCK,                          "F_EXLCK"                         },
 	{ F_SHLCK,                          "F_SHLCK"                         },
 
+	{ EPOLL_CLOEXEC,                    "EPOLL_CLOEXEC"                   },
+	{ EPOLL_CTL_ADD,                    "EPOLL_CTL_ADD"                   },
+	{ EPOLL_CTL_MOD,                    "EPOLL_CTL_MOD"                   },
+	{ EPOLL_CTL_DEL,                    "EPOLL_CTL_DEL"                   },
+	{ EPOLLIN,                          "EPOLLIN"                         },
+	{ EPOLLPRI,                         "EPOLLPRI"                        },
+	{ EPOLLOUT,                         "EPOLLOUT"                        },
+	{ EPOLLRDNORM,                      "EPOLLRDNORM"                     },
+	{ EPOLLRDBAND,                      "EPOLLRDBAND"                     },
+	{ EPOLLWRNORM,                      "EPOLLWRNORM"                     },
+	{ EPOLLWRBAND,                      "EPOLLWRBAND"                     },
+	{ EPOLLMSG,                         "EPOLLMSG"                        },
+	{ EPOLLERR,                         "EPOLLERR"                        },
+	{ EPOLLHUP,                         "EPOLLHUP"                        },
+	{ EPOLLRDHUP,                       "EPOLLRDHUP"                      },
+#ifdef EPOLLEXCLUSIVE
+	{ EPOLLEXCLUSIVE,                   "EPOLLEXCLUSIVE"                  },
+#endif
+	{ EPOLLWAKEUP,                      "EPOLLWAKEUP"                     },
+	{ EPOLLONESHOT,                     "EPOLLONESHOT"                    },
+	{ EPOLLET,                          "EPOLLET"                         },
+
+	{ UDP_SEGMENT,                      "UDP_SEGMENT"                     },
+	{ UDP_GRO,                          "UDP_GRO"                         },
+
+	{ PROT_NONE,                        "PROT_NONE"                       },
+	{ PROT_READ,                        "PROT_READ"                       },
+	{ PROT_WRITE,                       "PROT_WRITE"                      },
+	{ MAP_SHARED,                       "MAP_SHARED"                      },
+	{ MAP_PRIVATE,                      "MAP_PRIVATE"                     },
+
 	{ SEEK_SET,                         "SEEK_SET"                        },
 	{ SEEK_CUR,                         "SEEK_CUR"                        },
 	{ SEEK_END,                         "SEEK_END"                        },
 
+	{ SPLICE_F_MOVE,                    "SPLICE_F_MOVE"                   },
+	{ SPLICE_F_NONBLOCK,                "SPLICE_F_NONBLOCK"               },
+	{ SPLICE_F_MORE,                    "SPLICE_F_MORE"                   },
+	{ SPLICE_F_GIFT,                    "SPLICE_F_GIFT"                   },
+
 	{ MSG_OOB,                          "MSG_OOB"                         },
 	{ MSG_DONTROUTE,                    "MSG_DONTROUTE"                   },
 	{ MSG_PEEK,                         "MSG_PEEK"                        },
@@ -185,6 +239,7 @@ struct int_symbol platform_symbols_table[] = {
 	{ MSG_NOSIGNAL,                     "MSG_NOSIGNAL"                    },
 	{ MSG_MORE,                         "MSG_MORE"                        },
 	{ MSG_CMSG_CLOEXEC,                 "MSG_CMSG_CLOEXEC"                },
+	{ MSG_ZEROCOPY,                     "MSG_ZEROCOPY"                    },
 	{ MSG_FASTOPEN,                     "MSG_FASTOPEN"                    },
 
 #ifdef SIOCINQ
@@ -68,6 +68,36 @@
 #define MSG_FASTOPEN             0x20000000  /* TCP Fast Open: data in SYN */
 #endif
 
+/* Zerocopy transmit, and the completions it queues on the error queue. */
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY              60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY             0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY    5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+/* Zerocopy receive: getsockopt(TCP_ZEROCOPY_RECEIVE) maps received
+ * payload pages into a region mmap()ed on the socket. Kernels keep
+ * adding fields to the end of the struct and accept any prefix of it;
+ * these are the ones we use.
+ */
+#ifndef TCP_ZEROCOPY_RECEIVE
+#define TCP_ZEROCOPY_RECEIVE     35
+#endif
+struct tcp_zerocopy_receive_prefix {
+	u64 address;		/* in: address of mapping */
+	u32 length;		/* in/out: number of bytes to map/mapped */
+	u32 recv_skip_hint;	/* out: amount of bytes to skip */
+	u32 inq;		/* out: amount of bytes in read queue */
+	s32 err;		/* out: socket error */
+};
+
 #endif  /* linux */
 
 /* TCP option numbers and lengths. */
@@ -168,6 +198,28 @@ struct _tcp_info {
 	__u32	tcpi_total_retrans;
 };
 
+/* Connection-level data returned by the upstream MPTCP_INFO socket
+ * option; kernels without it fail the getsockopt and we do without.
+ */
+#ifndef SOL_MPTCP
+#define SOL_MPTCP		284
+#endif
+#define _MPTCP_INFO		1
+
+struct _mptcp_info {
+	__u8	mptcpi_subflows;
+	__u8	mptcpi_add_addr_signal;
+	__u8	mptcpi_add_addr_accepted;
+	__u8	mptcpi_subflows_max;
+	__u8	mptcpi_add_addr_signal_max;
+	__u8	mptcpi_add_addr_accepted_max;
+	__u32	mptcpi_flags;
+	__u32	mptcpi_token;
+	__u64	mptcpi_write_seq;
+	__u64	mptcpi_snd_una;
+	__u64	mptcpi_rcv_nxt;
+};
+
 #endif  /* linux */
 
 #if defined(__FreeBSD__)
@@ -286,34 +286,60 @@ out:
 
 }
 
-/**
- * Search for the option of kind "kind" in the packet and return the tcp_option
- * pointer to this found option, return NULL if not found.
- *
- */
-extern struct tcp_option *get_tcp_option(struct packet *packet, u8 kind){
+int tcp_options_index(struct packet *packet, char **error)
+{
+	struct tcp_options_iterator iter;
+	struct tcp_option *option = NULL;
+	u8 *options_start = packet_tcp_options(packet);
+	char *next_error = NULL;
+	int num = 0;
+
+	for (option = tcp_options_begin(packet, &iter); option != NULL;
+	     option = tcp_options_next(&iter, &next_error)) {
+		struct tcp_option_slot *slot = &packet->tcp_options[num];
+
+		assert(num < PACKET_MAX_TCP_OPTIONS);
+		slot->kind	= option->kind;
+		slot->subtype	= 0;
+		slot->offset	= (u8 *)option - options_start;
+		if (option->kind == TCPOPT_MPTCP &&
+		    (u8 *)option + 2 < iter.options_end)
+			slot->subtype = option->data.mp_capable.subtype;
+		++num;
+	}
+	packet->num_tcp_options = num;
+	packet->tcp_options_indexed = (next_error == NULL);
+
+	if (next_error == NULL)
+		return STATUS_OK;
+	if (error != NULL)
+		*error = next_error;
+	else
+		free(next_error);
+	return STATUS_ERR;
+}
 
-	struct tcp_options_iterator tcp_opt_iter;
-	struct tcp_option *tcp_opt = tcp_options_begin(packet, &tcp_opt_iter);
+struct tcp_option *get_tcp_option(struct packet *packet, u8 kind)
+{
+	int i;
 
-	while(tcp_opt != NULL && tcp_opt->kind != kind){
-		tcp_opt = tcp_options_next(&tcp_opt_iter, NULL);
+	tcp_options_ensure_index(packet, NULL);
+	for (i = 0; i < packet->num_tcp_options; ++i) {
+		if (packet->tcp_options[i].kind == kind)
+			return tcp_option_at(packet, i);
 	}
-	return tcp_opt;
+	return NULL;
 }
 
-/**
- * Search for the sub option of subtype "subtype" in the packet and return the mptcp_suboption
- * pointer to this found option, return NULL if not found.
- *
- */
-extern struct tcp_option *get_mptcp_option(struct packet *packet, u8 subtype){
-
-	struct tcp_options_iterator tcp_opt_iter;
-	struct tcp_option *tcp_opt = tcp_options_begin(packet, &tcp_opt_iter);
+struct tcp_option *get_mptcp_option(struct packet *packet, u8 subtype)
+{
+	int i;
 
-	while(tcp_opt != NULL && tcp_opt->data.mp_capable.subtype!=subtype){
-		tcp_opt = tcp_options_next(&tcp_opt_iter, NULL);
+	tcp_options_ensure_index(packet, NULL);
+	for (i = 0; i < packet->num_tcp_options; ++i) {
+		if (packet->tcp_options[i].kind == TCPOPT_MPTCP &&
+		    packet->tcp_options[i].subtype == subtype)
+			return tcp_option_at(packet, i);
 	}
-	return tcp_opt;
+	return NULL;
 }
@@ -51,7 +51,43 @@ extern struct tcp_option *tcp_options_begin(
 extern struct tcp_option *tcp_options_next(
 	struct tcp_options_iterator *iter, char **error);
 
+/* Walk the TCP options in the packet once and record the kind, MPTCP
+ * subtype and offset of each one in packet->tcp_options[]. Returns
+ * STATUS_OK on success; on failure (malformed options) indexes the
+ * options before the bad one, returns STATUS_ERR and sets error
+ * message if error is non-NULL.
+ */
+extern int tcp_options_index(struct packet *packet, char **error);
+
+/* Make sure the packet's TCP option index is built. Returns STATUS_OK
+ * on success; on failure returns STATUS_ERR and sets error message if
+ * error is non-NULL.
+ */
+static inline int tcp_options_ensure_index(struct packet *packet,
+					   char **error)
+{
+	if (packet->tcp_options_indexed)
+		return STATUS_OK;
+	return tcp_options_index(packet, error);
+}
+
+/* Return a pointer to the option at the given slot of the index. */
+static inline struct tcp_option *tcp_option_at(struct packet *packet,
+					       int slot)
+{
+	assert(slot < packet->num_tcp_options);
+	return (struct tcp_option *)(packet_tcp_options(packet) +
+				     packet->tcp_options[slot].offset);
+}
+
+/* Return the first TCP option of the given kind in the packet, or NULL
+ * if there is none.
+ */
 extern struct tcp_option *get_tcp_option(struct packet *packet, u8 kind);
+
+/* Return the first MPTCP option of the given subtype in the packet, or
+ * NULL if there is none.
+ */
 extern struct tcp_option *get_mptcp_option(struct packet *packet, u8 subtype);
 
 #endif /* __TCP_OPTIONS_ITERATOR_H__ */
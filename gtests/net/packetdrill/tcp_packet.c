@@ -26,6 +26,7 @@
 
 #include "ip_packet.h"
 #include "tcp.h"
+#include "tcp_options_iterator.h"
 
 /* The full list of valid TCP bit flag characters */
 static const char valid_tcp_flags[] = "FSRPU.EWC";
@@ -160,5 +161,6 @@ struct packet *new_tcp_packet(int socket_fd,
 	}
 
 	packet->ip_bytes = ip_bytes;
+	tcp_options_index(packet, NULL);
 	return packet;
 }
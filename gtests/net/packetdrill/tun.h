@@ -76,6 +76,7 @@
 #define TUNDETACHFILTER _IOW('T', 214, struct sock_fprog)
 #define TUNGETVNETHDRSZ _IOR('T', 215, int)
 #define TUNSETVNETHDRSZ _IOW('T', 216, int)
+#define TUNSETQUEUE    _IOW('T', 217, int)
 
 /* TUNSETIFF ifr flags */
 #define IFF_TUN         0x0001
@@ -84,6 +85,9 @@
 #define IFF_ONE_QUEUE   0x2000
 #define IFF_VNET_HDR    0x4000
 #define IFF_TUN_EXCL    0x8000
+#define IFF_MULTI_QUEUE 0x0100
+#define IFF_ATTACH_QUEUE 0x0200
+#define IFF_DETACH_QUEUE 0x0400
 
 /* Features for GSO (TUNSETOFFLOAD). */
 #define TUN_F_CSUM      0x01    /* You can hand me unchecksummed packets. */
@@ -92,6 +96,26 @@
 #define TUN_F_TSO_ECN   0x08    /* I can handle TSO with ECN bits. */
 #define TUN_F_UFO       0x10    /* I can handle UFO packets */
 
+/* Header prepended to each packet read or written when IFF_VNET_HDR
+ * is set, describing the checksum and segmentation offload state of
+ * the packet.
+ */
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM	1	/* use csum_start/offset */
+#define VIRTIO_NET_HDR_GSO_NONE		0	/* not a GSO frame */
+#define VIRTIO_NET_HDR_GSO_TCPV4	1	/* GSO frame, IPv4 TCP */
+#define VIRTIO_NET_HDR_GSO_UDP		3	/* GSO frame, IPv4 UDP */
+#define VIRTIO_NET_HDR_GSO_TCPV6	4	/* GSO frame, IPv6 TCP */
+#define VIRTIO_NET_HDR_GSO_UDP_L4	5	/* GSO frame, IPv4/v6 UDP (USO) */
+#define VIRTIO_NET_HDR_GSO_ECN		0x80	/* TCP has ECN set */
+struct virtio_net_hdr {
+	__u8   flags;
+	__u8   gso_type;
+	__u16  hdr_len;		/* ethernet + IP + tcp/udp hdrs */
+	__u16  gso_size;	/* bytes to append to hdr_len per frame */
+	__u16  csum_start;	/* position to start checksumming from */
+	__u16  csum_offset;	/* offset after that to place checksum */
+};
+
 /* Protocol info prepended to the packets (when IFF_NO_PI is not set) */
 #define TUN_PKT_STRIP   0x0001
 struct tun_pi {
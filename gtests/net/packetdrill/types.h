@@ -156,16 +156,22 @@ static inline bool is_equal_port(u16 a, u16 b)
 	return a == b;
 }
 
-/* Convert microseconds to a floating-point seconds value. */
-static inline double usecs_to_secs(s64 usecs)
+/* Convert nanoseconds to a floating-point seconds value. */
+static inline double nsecs_to_secs(s64 nsecs)
 {
-	return ((double)usecs) / 1.0e6;
+	return ((double)nsecs) / 1.0e9;
 }
 
-/* Convert a timeval to microseconds. */
-static inline s64 timeval_to_usecs(const struct timeval *tv)
+/* Convert a timeval to nanoseconds. */
+static inline s64 timeval_to_nsecs(const struct timeval *tv)
 {
-	return ((s64)tv->tv_sec) * 1000000LL + (s64)tv->tv_usec;
+	return ((s64)tv->tv_sec) * 1000000000LL + (s64)tv->tv_usec * 1000LL;
+}
+
+/* Convert a timespec to nanoseconds. */
+static inline s64 timespec_to_nsecs(const struct timespec *ts)
+{
+	return ((s64)ts->tv_sec) * 1000000000LL + (s64)ts->tv_nsec;
 }
 
 /* Return a malloc-allocated hex dump of the given buffer of the given length */
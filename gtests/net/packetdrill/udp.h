@@ -41,4 +41,19 @@ struct udp {
 	__sum16 check;		/* UDP checksum */
 };
 
+#ifdef linux
+
+/* UDP segmentation offload: setsockopt(SOL_UDP, UDP_SEGMENT) or a cmsg
+ * of the same name sets the gso_size of a send, and with UDP_GRO on,
+ * recvmsg() reports the gso_size of coalesced datagrams in a cmsg.
+ */
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO		104
+#endif
+
+#endif  /* linux */
+
 #endif /* __UDP_HEADERS_H__ */
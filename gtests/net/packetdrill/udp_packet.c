@@ -25,6 +25,7 @@
 #include "udp_packet.h"
 
 #include "ip_packet.h"
+#include "tcp_packet.h"
 #include "udp.h"
 
 struct packet *new_udp_packet(int address_family,
@@ -64,6 +65,7 @@ struct packet *new_udp_packet(int address_family,
 	packet->direction = direction;
 	packet->flags = 0;
 	packet->ecn = ECN_NONE;
+	packet->socket_script_fd = SOCKET_FD_NOT_DEFINED;
 
 	/* Set IP header fields */
 	set_packet_ip_header(packet, address_family, ip_bytes,
@@ -0,0 +1,339 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * A minimal io_uring instance, set up with raw system calls so we
+ * don't need liburing. See uring.h for details.
+ */
+
+#include "uring.h"
+
+#include <errno.h>
+#include "logging.h"
+
+#if defined(linux)
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include "tcp.h"
+
+struct uring {
+	int fd;				/* io_uring instance */
+
+	/* The submission queue: ring indices and the SQE array. */
+	u32 *sq_head;
+	u32 *sq_tail;
+	u32 sq_mask;
+	u32 *sq_array;
+	struct io_uring_sqe *sqes;
+
+	/* The completion queue. */
+	u32 *cq_head;
+	u32 *cq_tail;
+	u32 cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* Mappings to undo when we're done. */
+	void *sq_ring;
+	size_t sq_ring_bytes;
+	void *cq_ring;			/* NULL if shared with sq_ring */
+	size_t cq_ring_bytes;
+	size_t sqes_bytes;
+
+	u64 next_user_data;		/* tag for the next SQE */
+};
+
+static void *uring_mmap(int fd, size_t bytes, off_t offset)
+{
+	void *ring = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, fd, offset);
+
+	if (ring == MAP_FAILED)
+		die_perror("io_uring mmap");
+	return ring;
+}
+
+struct uring *uring_new(void)
+{
+	struct uring *uring = calloc(1, sizeof(struct uring));
+	struct io_uring_params params;
+	u8 *sq_ring, *cq_ring;
+
+	memset(&params, 0, sizeof(params));
+	uring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+	if (uring->fd < 0)
+		die_perror("io_uring_setup");
+
+	uring->sq_ring_bytes = params.sq_off.array +
+			       params.sq_entries * sizeof(u32);
+	uring->cq_ring_bytes = params.cq_off.cqes +
+			       params.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (uring->cq_ring_bytes > uring->sq_ring_bytes)
+			uring->sq_ring_bytes = uring->cq_ring_bytes;
+		uring->sq_ring = uring_mmap(uring->fd, uring->sq_ring_bytes,
+					    IORING_OFF_SQ_RING);
+		cq_ring = uring->sq_ring;
+	} else {
+		uring->sq_ring = uring_mmap(uring->fd, uring->sq_ring_bytes,
+					    IORING_OFF_SQ_RING);
+		uring->cq_ring = uring_mmap(uring->fd, uring->cq_ring_bytes,
+					    IORING_OFF_CQ_RING);
+		cq_ring = uring->cq_ring;
+	}
+	sq_ring = uring->sq_ring;
+
+	uring->sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+	uring->sqes = uring_mmap(uring->fd, uring->sqes_bytes,
+				 IORING_OFF_SQES);
+
+	uring->sq_head = (u32 *)(sq_ring + params.sq_off.head);
+	uring->sq_tail = (u32 *)(sq_ring + params.sq_off.tail);
+	uring->sq_mask = *(u32 *)(sq_ring + params.sq_off.ring_mask);
+	uring->sq_array = (u32 *)(sq_ring + params.sq_off.array);
+
+	uring->cq_head = (u32 *)(cq_ring + params.cq_off.head);
+	uring->cq_tail = (u32 *)(cq_ring + params.cq_off.tail);
+	uring->cq_mask = *(u32 *)(cq_ring + params.cq_off.ring_mask);
+	uring->cqes = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+
+	return uring;
+}
+
+void uring_free(struct uring *uring)
+{
+	if (munmap(uring->sqes, uring->sqes_bytes))
+		die_perror("munmap");
+	if (uring->cq_ring != NULL &&
+	    munmap(uring->cq_ring, uring->cq_ring_bytes))
+		die_perror("munmap");
+	if (munmap(uring->sq_ring, uring->sq_ring_bytes))
+		die_perror("munmap");
+	if (close(uring->fd))
+		die_perror("close");
+
+	memset(uring, 0, sizeof(*uring));  /* paranoia */
+	free(uring);
+}
+
+/* Grab the next free SQE, zeroed and tagged for uring_run(). We only
+ * ever have one operation in flight, so there is always room.
+ */
+static struct io_uring_sqe *uring_sqe(struct uring *uring, u8 opcode, int fd)
+{
+	u32 tail = *uring->sq_tail;
+	u32 index = tail & uring->sq_mask;
+	struct io_uring_sqe *sqe = &uring->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = ++uring->next_user_data;
+	uring->sq_array[index] = index;
+	return sqe;
+}
+
+static int uring_enter(struct uring *uring, u32 to_submit)
+{
+	int result;
+
+	do {
+		result = syscall(__NR_io_uring_enter, uring->fd, to_submit, 1,
+				 IORING_ENTER_GETEVENTS, NULL, 0);
+	} while (result < 0 && errno == EINTR);
+	if (result < 0)
+		die_perror("io_uring_enter");
+	return result;
+}
+
+/* Look for the completion of the operation tagged user_data, skipping
+ * any others (such as zerocopy buffer notifications). Return true and
+ * fill in *res if it was there.
+ */
+static bool uring_reap(struct uring *uring, u64 user_data, s32 *res)
+{
+	u32 head = *uring->cq_head;
+	u32 tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+	bool found = false;
+
+	for (; head != tail && !found; ++head) {
+		const struct io_uring_cqe *cqe =
+			&uring->cqes[head & uring->cq_mask];
+
+#ifdef IORING_CQE_F_NOTIF
+		if (cqe->flags & IORING_CQE_F_NOTIF)
+			continue;
+#endif
+		if (cqe->user_data == user_data) {
+			*res = cqe->res;
+			found = true;
+		}
+	}
+	__atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+	return found;
+}
+
+/* Submit the SQE last handed out by uring_sqe() and wait for its
+ * completion. Return its result, errno-style.
+ */
+static int uring_run(struct uring *uring, struct io_uring_sqe *sqe)
+{
+	u64 user_data = sqe->user_data;
+	s32 res = 0;
+
+	__atomic_store_n(uring->sq_tail, *uring->sq_tail + 1,
+			 __ATOMIC_RELEASE);
+	uring_enter(uring, 1);
+	while (!uring_reap(uring, user_data, &res))
+		uring_enter(uring, 0);
+
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+int uring_accept(struct uring *uring, int fd,
+		 struct sockaddr *addr, socklen_t *addrlen)
+{
+	struct io_uring_sqe *sqe = uring_sqe(uring, IORING_OP_ACCEPT, fd);
+
+	sqe->addr = (unsigned long)addr;
+	sqe->addr2 = (unsigned long)addrlen;
+	return uring_run(uring, sqe);
+}
+
+int uring_connect(struct uring *uring, int fd,
+		  const struct sockaddr *addr, socklen_t addrlen)
+{
+	struct io_uring_sqe *sqe = uring_sqe(uring, IORING_OP_CONNECT, fd);
+
+	sqe->addr = (unsigned long)addr;
+	sqe->off = addrlen;
+	return uring_run(uring, sqe);
+}
+
+int uring_read(struct uring *uring, int fd, void *buf, size_t count)
+{
+	struct io_uring_sqe *sqe = uring_sqe(uring, IORING_OP_READ, fd);
+
+	sqe->addr = (unsigned long)buf;
+	sqe->len = count;
+	sqe->off = (u64)-1;	/* current position, as read() does */
+	return uring_run(uring, sqe);
+}
+
+int uring_write(struct uring *uring, int fd, const void *buf, size_t count)
+{
+	struct io_uring_sqe *sqe = uring_sqe(uring, IORING_OP_WRITE, fd);
+
+	sqe->addr = (unsigned long)buf;
+	sqe->len = count;
+	sqe->off = (u64)-1;	/* current position, as write() does */
+	return uring_run(uring, sqe);
+}
+
+int uring_recv(struct uring *uring, int fd, void *buf, size_t count,
+	       int flags)
+{
+	struct io_uring_sqe *sqe = uring_sqe(uring, IORING_OP_RECV, fd);
+
+	sqe->addr = (unsigned long)buf;
+	sqe->len = count;
+	sqe->msg_flags = flags;
+	return uring_run(uring, sqe);
+}
+
+int uring_send(struct uring *uring, int fd, const void *buf, size_t count,
+	       int flags)
+{
+	u8 opcode = IORING_OP_SEND;
+	struct io_uring_sqe *sqe = NULL;
+
+#if defined(IORING_CQE_F_NOTIF) && defined(MSG_ZEROCOPY)
+	if (flags & MSG_ZEROCOPY) {
+		opcode = IORING_OP_SEND_ZC;
+		flags &= ~MSG_ZEROCOPY;
+	}
+#endif
+	sqe = uring_sqe(uring, opcode, fd);
+	sqe->addr = (unsigned long)buf;
+	sqe->len = count;
+	sqe->msg_flags = flags;
+	return uring_run(uring, sqe);
+}
+
+#else  /* !linux */
+
+struct uring *uring_new(void)
+{
+	die("--io_uring is only supported on Linux\n");
+	return NULL;
+}
+
+void uring_free(struct uring *uring)
+{
+}
+
+int uring_accept(struct uring *uring, int fd,
+		 struct sockaddr *addr, socklen_t *addrlen)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int uring_connect(struct uring *uring, int fd,
+		  const struct sockaddr *addr, socklen_t addrlen)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int uring_read(struct uring *uring, int fd, void *buf, size_t count)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int uring_write(struct uring *uring, int fd, const void *buf, size_t count)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int uring_recv(struct uring *uring, int fd, void *buf, size_t count,
+	       int flags)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int uring_send(struct uring *uring, int fd, const void *buf, size_t count,
+	       int flags)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif  /* linux */
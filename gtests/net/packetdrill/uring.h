@@ -0,0 +1,67 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * A minimal io_uring instance, set up with raw system calls, for
+ * issuing a script's socket operations as submission queue entries
+ * (--io_uring) instead of as plain system calls.
+ */
+
+#ifndef __URING_H__
+#define __URING_H__
+
+#include "types.h"
+
+#include <sys/socket.h>
+
+/* Number of submission queue entries in each ring. */
+#define URING_ENTRIES	8
+
+struct uring;
+
+/* Set up a new io_uring instance. Dies on failure, since the user
+ * asked for io_uring and we must not quietly fall back to syscalls.
+ */
+extern struct uring *uring_new(void);
+
+/* Tear down the ring. */
+extern void uring_free(struct uring *uring);
+
+/* Each of these submits one SQE for the operation and, in the same
+ * io_uring_enter() call, waits for its completion. Like the system
+ * calls they stand in for, they return the result, or -1 with errno
+ * set from a negative completion result.
+ *
+ * uring_send() turns MSG_ZEROCOPY into IORING_OP_SEND_ZC, when the
+ * headers know about it; it returns as soon as the send completes and
+ * drops the later buffer notification, so the buffer must stay
+ * untouched until the data is acked.
+ */
+extern int uring_accept(struct uring *uring, int fd,
+			struct sockaddr *addr, socklen_t *addrlen);
+extern int uring_connect(struct uring *uring, int fd,
+			 const struct sockaddr *addr, socklen_t addrlen);
+extern int uring_read(struct uring *uring, int fd, void *buf, size_t count);
+extern int uring_write(struct uring *uring, int fd, const void *buf,
+		       size_t count);
+extern int uring_recv(struct uring *uring, int fd, void *buf, size_t count,
+		      int flags);
+extern int uring_send(struct uring *uring, int fd, const void *buf,
+		      size_t count, int flags);
+
+#endif /* __URING_H__ */
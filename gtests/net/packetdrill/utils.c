@@ -286,6 +286,29 @@ u16 checksum_dss(u16 *buffer, int size) {
 	return (u16) (~cksum);
 }
 
+/* Add the payload to a DSS checksum, in network byte order, that was
+ * computed with checksum_dss() over the pseudo-header alone. Payload
+ * words are summed as big-endian values, with an odd trailing byte as
+ * the high byte of a last, zero-padded word, as in RFC 1071.
+ */
+void add_payload_to_dss_checksum(u16 *checksum, const u8 *payload, u32 len)
+{
+	u32 sum = (u16)~ntohs(*checksum);
+	u32 i;
+
+	for (i = 0; i + 1 < len; i += 2) {
+		u16 word;
+
+		memcpy(&word, payload + i, sizeof(word));
+		sum += ntohs(word);
+	}
+	if (i < len)
+		sum += payload[i] << 8;
+	while (sum >> 16)
+		sum = (sum >> 16) + (sum & 0xffff);
+	*checksum = htons((u16)~sum);
+}
+
 uint16_t checksum_d(void* vdata, size_t length) {
 	// Cast the data pointer to one that can be indexed.
 	char* data = (char*) vdata;
@@ -44,6 +44,7 @@ void hmac_sha1(const unsigned char *key,
 		u32 data_length,
 		unsigned char *output);
 u16 checksum_dss(u16 *buffer, int size);
+void add_payload_to_dss_checksum(u16 *checksum, const u8 *payload, u32 len);
 uint16_t checksum_d(void* vdata, size_t length);
 void mptcp_hmac_sha1(u8 *key_1, u8 *key_2, u8 *rand_1, u8 *rand_2,
 		u32 *hash_out);
@@ -380,9 +380,9 @@ static int wire_server_run_script(struct wire_server *wire_server,
 
 	DEBUGP("wire_server_run_script\n");
 
-	state->live_start_time_usecs = now_usecs();
-	DEBUGP("live_start_time_usecs is %lld\n",
-	       state->live_start_time_usecs);
+	state->live_start_time_nsecs = now_nsecs();
+	DEBUGP("live_start_time_nsecs is %lld\n",
+	       state->live_start_time_nsecs);
 
 	while (1) {
 		if (get_next_event(state, error))
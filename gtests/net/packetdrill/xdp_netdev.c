@@ -0,0 +1,638 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Network device code for local tests that puts the kernel under test
+ * behind a veth pair: the kernel sends and receives on one end, and we
+ * inject and sniff Ethernet frames on the other end (the peer) through
+ * an AF_XDP socket. An AF_XDP socket avoids the per-packet system call
+ * and copy through a character device that limits the tun backend.
+ *
+ * We use generic (SKB mode) XDP and copy mode, so no special NIC or
+ * driver support is needed. Since there is no libbpf dependency, the
+ * XSKMAP and the tiny XDP program that redirects every frame on the
+ * peer into our socket are set up with the raw bpf(2) system call.
+ */
+
+#include "xdp_netdev.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#ifdef linux
+#include <linux/bpf.h>
+#include <linux/ethtool.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/sockios.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "ethernet.h"
+#include "link_layer.h"
+#include "logging.h"
+#include "net_utils.h"
+#include "packet.h"
+#include "packet_parser.h"
+#include "run.h"
+
+#ifdef linux
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/* Frames [0, XDP_RX_FRAMES) are for RX, the rest for TX. */
+#define XDP_RX_FRAMES		(XDP_NUM_FRAMES / 2)
+#define XDP_TX_FRAMES		(XDP_NUM_FRAMES - XDP_RX_FRAMES)
+
+/* Each ring has room for all the frames that can be on it. */
+#define XDP_RING_SIZE		XDP_RX_FRAMES
+
+/* Our view of one of the rings shared with the kernel. */
+struct xdp_ring {
+	u32 *producer;		/* index of next entry to produce */
+	u32 *consumer;		/* index of next entry to consume */
+	void *descs;		/* struct xdp_desc or u64 entries */
+	void *map;		/* mmap-ed ring, for munmap() */
+	size_t map_bytes;	/* size of the mmap-ed ring */
+};
+
+/* Internal private state for the veth + AF_XDP netdev. */
+struct xdp_netdev {
+	struct netdev netdev;		/* "inherit" from netdev */
+
+	char kernel_name[IFNAMSIZ];	/* veth end used by the kernel */
+	char peer_name[IFNAMSIZ];	/* veth end we inject/sniff on */
+	struct ether_addr kernel_ether_addr;
+	struct ether_addr peer_ether_addr;
+	int control_fd;		/* socket for device ioctls */
+
+	int xsk_fd;		/* AF_XDP socket bound to the peer */
+	int map_fd;		/* XSKMAP holding xsk_fd */
+	int prog_fd;		/* XDP program redirecting into the map */
+
+	u8 *umem;		/* frames shared with the kernel */
+	struct xdp_ring fill;		/* RX frames handed to the kernel */
+	struct xdp_ring completion;	/* TX frames the kernel is done with */
+	struct xdp_ring rx;		/* frames the kernel sent */
+	struct xdp_ring tx;		/* frames for the kernel to receive */
+
+	u32 rx_next;		/* next RX entry to consume */
+	u32 rx_end;		/* RX entries before this are ready */
+	u64 refill[XDP_BATCH];	/* RX frames to give back to the kernel */
+	int num_refill;		/* number of valid entries in refill */
+
+	u64 tx_free[XDP_TX_FRAMES];	/* TX frames we own */
+	int num_tx_free;	/* number of valid entries in tx_free */
+};
+
+struct netdev_ops xdp_netdev_ops;
+
+/* "Downcast" an abstract netdev to our flavor. */
+static inline struct xdp_netdev *to_xdp_netdev(struct netdev *netdev)
+{
+	return (struct xdp_netdev *)netdev;
+}
+
+/* The rings are shared with the kernel, so loads of the index the
+ * kernel writes must happen before we read the entries, and our
+ * writes to entries must be visible before the index we write.
+ */
+static inline u32 ring_load(const u32 *index)
+{
+	return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static inline void ring_store(u32 *index, u32 value)
+{
+	__atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+static inline u64 *ring_addr(struct xdp_ring *ring, u32 index)
+{
+	return (u64 *)ring->descs + (index & (XDP_RING_SIZE - 1));
+}
+
+static inline struct xdp_desc *ring_desc(struct xdp_ring *ring, u32 index)
+{
+	return (struct xdp_desc *)ring->descs + (index & (XDP_RING_SIZE - 1));
+}
+
+static int bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/* Set one of the ethtool on/off offload settings, e.g. ETHTOOL_STSO. */
+static void set_offload(struct xdp_netdev *netdev, const char *name,
+			u32 cmd, u32 value)
+{
+	struct ethtool_value eval = { .cmd = cmd, .data = value };
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, name, IFNAMSIZ);
+	ifr.ifr_data = (void *)&eval;
+	if (ioctl(netdev->control_fd, SIOCETHTOOL, &ifr) < 0)
+		die_perror("SIOCETHTOOL");
+}
+
+static void set_mtu(struct xdp_netdev *netdev, const char *name, int mtu)
+{
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, name, IFNAMSIZ);
+	ifr.ifr_mtu = mtu;
+	if (ioctl(netdev->control_fd, SIOCSIFMTU, &ifr) < 0)
+		die_perror("SIOCSIFMTU");
+}
+
+static void bring_up(struct xdp_netdev *netdev, const char *name)
+{
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, name, IFNAMSIZ);
+	if (ioctl(netdev->control_fd, SIOCGIFFLAGS, &ifr) < 0)
+		die_perror("SIOCGIFFLAGS");
+	ifr.ifr_flags |= IFF_UP;
+	if (ioctl(netdev->control_fd, SIOCSIFFLAGS, &ifr) < 0)
+		die_perror("SIOCSIFFLAGS");
+}
+
+/* Keep the peer from chattering (router solicitations and the like)
+ * at the kernel under test. Failure is harmless, so ignore it.
+ */
+static void disable_peer_ipv6(struct xdp_netdev *netdev)
+{
+	char *path = NULL;
+	int fd;
+
+	asprintf(&path, "/proc/sys/net/ipv6/conf/%s/disable_ipv6",
+		 netdev->peer_name);
+	fd = open(path, O_WRONLY);
+	if (fd >= 0) {
+		if (write(fd, "1", 1) < 0)
+			DEBUGP("unable to disable IPv6 on %s\n",
+			       netdev->peer_name);
+		close(fd);
+	}
+	free(path);
+}
+
+/* Create the veth pair and configure the kernel's end like the tun
+ * device: test address, route to the remote prefix, and a permanent
+ * neighbor entry so the gateway resolves to the peer.
+ */
+static void create_veth(struct config *config, struct xdp_netdev *netdev)
+{
+	snprintf(netdev->kernel_name, IFNAMSIZ, "pdveth%d", getpid());
+	snprintf(netdev->peer_name, IFNAMSIZ, "pdpeer%d", getpid());
+
+	/* Remove any leftover from a previous process with our pid. */
+	net_del_link(netdev->kernel_name);
+	net_create_veth(netdev->kernel_name, netdev->peer_name);
+
+	netdev->control_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+	if (netdev->control_fd < 0)
+		die_perror("opening AF_INET, SOCK_DGRAM, IPPROTO_IP socket");
+
+	get_hw_address(netdev->kernel_name, &netdev->kernel_ether_addr);
+	get_hw_address(netdev->peer_name, &netdev->peer_ether_addr);
+
+	/* Have the kernel segment in software, so every frame we sniff
+	 * is a wire-sized packet that fits in a UMEM frame.
+	 */
+	set_offload(netdev, netdev->kernel_name, ETHTOOL_STSO, 0);
+	set_offload(netdev, netdev->kernel_name, ETHTOOL_SGSO, 0);
+
+	set_mtu(netdev, netdev->kernel_name, config->mtu);
+	set_mtu(netdev, netdev->peer_name, config->mtu);
+
+	disable_peer_ipv6(netdev);
+	bring_up(netdev, netdev->peer_name);
+	bring_up(netdev, netdev->kernel_name);
+
+	net_setup_dev_address(netdev->kernel_name,
+			      &config->live_local_ip,
+			      config->live_prefix_len);
+	net_add_neighbor(netdev->kernel_name, &config->live_gateway_ip,
+			 &netdev->peer_ether_addr);
+	net_setup_route(netdev->kernel_name, &config->live_remote_prefix,
+			&config->live_gateway_ip);
+}
+
+/* mmap one of the socket's rings, given its offsets and entry size. */
+static void map_ring(struct xdp_netdev *netdev, struct xdp_ring *ring,
+		     const struct xdp_ring_offset *off, size_t entry_bytes,
+		     off_t pgoff)
+{
+	ring->map_bytes = off->desc + XDP_RING_SIZE * entry_bytes;
+	ring->map = mmap(NULL, ring->map_bytes, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, netdev->xsk_fd, pgoff);
+	if (ring->map == MAP_FAILED)
+		die_perror("mmap AF_XDP ring");
+	ring->producer = (u32 *)((char *)ring->map + off->producer);
+	ring->consumer = (u32 *)((char *)ring->map + off->consumer);
+	ring->descs = (char *)ring->map + off->desc;
+}
+
+static void set_ring_size(struct xdp_netdev *netdev, int optname)
+{
+	int size = XDP_RING_SIZE;
+
+	if (setsockopt(netdev->xsk_fd, SOL_XDP, optname,
+		       &size, sizeof(size)) < 0)
+		die_perror("setsockopt SOL_XDP ring size");
+}
+
+/* Create the AF_XDP socket and its UMEM, map its four rings, and bind
+ * it to queue 0 of the peer in copy mode.
+ */
+static void create_socket(struct xdp_netdev *netdev)
+{
+	struct xdp_umem_reg umem_reg;
+	struct xdp_mmap_offsets off;
+	struct sockaddr_xdp sxdp;
+	socklen_t off_len = sizeof(off);
+	int i;
+
+	netdev->xsk_fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+	if (netdev->xsk_fd < 0)
+		die_perror("socket(AF_XDP)");
+
+	netdev->umem = mmap(NULL, XDP_NUM_FRAMES * XDP_FRAME_SIZE,
+			    PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (netdev->umem == MAP_FAILED)
+		die_perror("mmap AF_XDP UMEM");
+
+	memset(&umem_reg, 0, sizeof(umem_reg));
+	umem_reg.addr = (unsigned long)netdev->umem;
+	umem_reg.len = XDP_NUM_FRAMES * XDP_FRAME_SIZE;
+	umem_reg.chunk_size = XDP_FRAME_SIZE;
+	if (setsockopt(netdev->xsk_fd, SOL_XDP, XDP_UMEM_REG,
+		       &umem_reg, sizeof(umem_reg)) < 0)
+		die_perror("setsockopt SOL_XDP XDP_UMEM_REG");
+
+	set_ring_size(netdev, XDP_UMEM_FILL_RING);
+	set_ring_size(netdev, XDP_UMEM_COMPLETION_RING);
+	set_ring_size(netdev, XDP_RX_RING);
+	set_ring_size(netdev, XDP_TX_RING);
+
+	if (getsockopt(netdev->xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS,
+		       &off, &off_len) < 0)
+		die_perror("getsockopt SOL_XDP XDP_MMAP_OFFSETS");
+
+	map_ring(netdev, &netdev->fill, &off.fr, sizeof(u64),
+		 XDP_UMEM_PGOFF_FILL_RING);
+	map_ring(netdev, &netdev->completion, &off.cr, sizeof(u64),
+		 XDP_UMEM_PGOFF_COMPLETION_RING);
+	map_ring(netdev, &netdev->rx, &off.rx, sizeof(struct xdp_desc),
+		 XDP_PGOFF_RX_RING);
+	map_ring(netdev, &netdev->tx, &off.tx, sizeof(struct xdp_desc),
+		 XDP_PGOFF_TX_RING);
+
+	/* Hand all RX frames to the kernel up front. */
+	for (i = 0; i < XDP_RX_FRAMES; ++i)
+		*ring_addr(&netdev->fill, i) = (u64)i * XDP_FRAME_SIZE;
+	ring_store(netdev->fill.producer, XDP_RX_FRAMES);
+
+	for (i = 0; i < XDP_TX_FRAMES; ++i)
+		netdev->tx_free[i] = (u64)(XDP_RX_FRAMES + i) * XDP_FRAME_SIZE;
+	netdev->num_tx_free = XDP_TX_FRAMES;
+
+	memset(&sxdp, 0, sizeof(sxdp));
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = if_nametoindex(netdev->peer_name);
+	sxdp.sxdp_queue_id = 0;
+	sxdp.sxdp_flags = XDP_COPY;
+	if (bind(netdev->xsk_fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0)
+		die_perror("bind AF_XDP socket");
+}
+
+/* Load an XDP program that redirects every frame arriving on the peer
+ * into our socket, and attach it to the peer in generic (SKB) mode.
+ */
+static void attach_program(struct xdp_netdev *netdev)
+{
+	union bpf_attr attr;
+	u32 key = 0;
+	char log[4096];
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(u32);
+	attr.value_size = sizeof(u32);
+	attr.max_entries = 1;
+	netdev->map_fd = bpf(BPF_MAP_CREATE, &attr);
+	if (netdev->map_fd < 0)
+		die_perror("bpf BPF_MAP_CREATE XSKMAP");
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = netdev->map_fd;
+	attr.key = (unsigned long)&key;
+	attr.value = (unsigned long)&netdev->xsk_fd;
+	if (bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+		die_perror("bpf BPF_MAP_UPDATE_ELEM XSKMAP");
+
+	/* return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS); */
+	struct bpf_insn prog[] = {
+		{ .code = BPF_LDX | BPF_W | BPF_MEM, .dst_reg = BPF_REG_2,
+		  .src_reg = BPF_REG_1,
+		  .off = offsetof(struct xdp_md, rx_queue_index) },
+		{ .code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1,
+		  .src_reg = BPF_PSEUDO_MAP_FD, .imm = netdev->map_fd },
+		{ 0 },	/* second half of the 64-bit immediate */
+		{ .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3,
+		  .imm = XDP_PASS },
+		{ .code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map },
+		{ .code = BPF_JMP | BPF_EXIT },
+	};
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insn_cnt = ARRAY_SIZE(prog);
+	attr.insns = (unsigned long)prog;
+	attr.license = (unsigned long)"GPL";
+	attr.log_buf = (unsigned long)log;
+	attr.log_size = sizeof(log);
+	attr.log_level = 1;
+	log[0] = '\0';
+	netdev->prog_fd = bpf(BPF_PROG_LOAD, &attr);
+	if (netdev->prog_fd < 0)
+		die("bpf BPF_PROG_LOAD: %s\n%s", strerror(errno), log);
+
+	net_set_link_xdp(netdev->peer_name, netdev->prog_fd,
+			 XDP_FLAGS_SKB_MODE);
+}
+
+struct netdev *xdp_netdev_new(struct config *config)
+{
+	struct xdp_netdev *netdev = calloc(1, sizeof(struct xdp_netdev));
+
+	DEBUGP("xdp_netdev_new\n");
+
+	netdev->netdev.ops = &xdp_netdev_ops;
+	netdev->control_fd = -1;
+	netdev->xsk_fd = -1;
+	netdev->map_fd = -1;
+	netdev->prog_fd = -1;
+
+	if (config->vnet_hdr || config->tun_queues > 1)
+		die("--vnet_hdr and --tun_queues need --netdev=tun\n");
+	if (config->speed != TUN_DRIVER_SPEED_CUR)
+		die("--speed is not supported with --netdev=xdp\n");
+	if (config->mtu + (int)sizeof(struct ether_header) >
+	    XDP_FRAME_SIZE - XDP_PACKET_HEADROOM)
+		die("--mtu %d is too big for --netdev=xdp\n", config->mtu);
+	if (is_ip_local(&config->live_remote_ip)) {
+		die("error: live_remote_ip %s is not remote\n",
+		    config->live_remote_ip_string);
+	}
+
+	create_veth(config, netdev);
+	create_socket(netdev);
+	attach_program(netdev);
+
+	return (struct netdev *)netdev;
+}
+
+static void unmap_ring(struct xdp_ring *ring)
+{
+	if (ring->map != NULL && munmap(ring->map, ring->map_bytes) < 0)
+		die_perror("munmap AF_XDP ring");
+}
+
+static void xdp_netdev_free(struct netdev *a_netdev)
+{
+	struct xdp_netdev *netdev = to_xdp_netdev(a_netdev);
+
+	DEBUGP("xdp_netdev_free\n");
+
+	/* Deleting the veth pair also detaches the XDP program. */
+	net_del_link(netdev->kernel_name);
+
+	unmap_ring(&netdev->fill);
+	unmap_ring(&netdev->completion);
+	unmap_ring(&netdev->rx);
+	unmap_ring(&netdev->tx);
+	if (netdev->xsk_fd >= 0)
+		close(netdev->xsk_fd);
+	if (netdev->umem != NULL &&
+	    munmap(netdev->umem, XDP_NUM_FRAMES * XDP_FRAME_SIZE) < 0)
+		die_perror("munmap AF_XDP UMEM");
+	if (netdev->prog_fd >= 0)
+		close(netdev->prog_fd);
+	if (netdev->map_fd >= 0)
+		close(netdev->map_fd);
+	if (netdev->control_fd >= 0)
+		close(netdev->control_fd);
+
+	memset(netdev, 0, sizeof(*netdev));  /* paranoia */
+	free(netdev);
+}
+
+/* Take back all the TX frames the kernel has finished sending. */
+static void reap_completions(struct xdp_netdev *netdev)
+{
+	struct xdp_ring *ring = &netdev->completion;
+	u32 consumer = *ring->consumer;
+	u32 producer = ring_load(ring->producer);
+
+	while (consumer != producer) {
+		assert(netdev->num_tx_free < XDP_TX_FRAMES);
+		netdev->tx_free[netdev->num_tx_free++] =
+			*ring_addr(ring, consumer);
+		++consumer;
+	}
+	ring_store(ring->consumer, consumer);
+}
+
+/* Tell the kernel to process the TX ring. In copy mode this sends the
+ * frames synchronously.
+ */
+static void kick_tx(struct xdp_netdev *netdev)
+{
+	while (sendto(netdev->xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0) {
+		if (errno != EAGAIN && errno != EBUSY && errno != ENOBUFS &&
+		    errno != EINTR)
+			die_perror("AF_XDP sendto");
+		reap_completions(netdev);
+	}
+}
+
+static int xdp_netdev_send(struct netdev *a_netdev,
+			   struct packet *packet)
+{
+	struct xdp_netdev *netdev = to_xdp_netdev(a_netdev);
+	struct ether_header *ether;
+	struct xdp_desc *desc;
+	u32 producer;
+	u64 addr;
+	u8 *frame;
+
+	DEBUGP("xdp_netdev_send\n");
+
+	assert(packet->ip_bytes > 0);
+	if (sizeof(*ether) + packet->ip_bytes > XDP_FRAME_SIZE) {
+		die("packet of %d bytes does not fit in an AF_XDP frame\n",
+		    packet->ip_bytes);
+	}
+
+	/* Completions are only reaped, in one batch, once we run out. */
+	if (netdev->num_tx_free == 0)
+		reap_completions(netdev);
+	while (netdev->num_tx_free == 0) {
+		kick_tx(netdev);
+		reap_completions(netdev);
+	}
+	addr = netdev->tx_free[--netdev->num_tx_free];
+
+	/* Prepend an Ethernet header addressed to the kernel's end. */
+	frame = netdev->umem + addr;
+	ether = (struct ether_header *)frame;
+	ether_copy(ether->ether_dhost, &netdev->kernel_ether_addr);
+	ether_copy(ether->ether_shost, &netdev->peer_ether_addr);
+	ether->ether_type =
+		htons(ether_type_for_family(packet_address_family(packet)));
+	memcpy(frame + sizeof(*ether), packet_start(packet), packet->ip_bytes);
+
+	producer = *netdev->tx.producer;
+	desc = ring_desc(&netdev->tx, producer);
+	desc->addr = addr;
+	desc->len = sizeof(*ether) + packet->ip_bytes;
+	desc->options = 0;
+	ring_store(netdev->tx.producer, producer + 1);
+
+	/* Injection times matter, so each packet goes out right away. */
+	kick_tx(netdev);
+
+	return STATUS_OK;
+}
+
+/* Give the RX frames we have copied out back to the kernel. */
+static void refill_rx(struct xdp_netdev *netdev)
+{
+	u32 producer = *netdev->fill.producer;
+	int i;
+
+	for (i = 0; i < netdev->num_refill; ++i)
+		*ring_addr(&netdev->fill, producer + i) = netdev->refill[i];
+	ring_store(netdev->fill.producer, producer + netdev->num_refill);
+	netdev->num_refill = 0;
+}
+
+/* Return the next RX descriptor, blocking until there is one. We grab
+ * all ready descriptors at once, and only release them to the kernel
+ * when the whole batch has been consumed.
+ */
+static const struct xdp_desc *next_rx_desc(struct xdp_netdev *netdev)
+{
+	while (netdev->rx_next == netdev->rx_end) {
+		struct pollfd pfd = { .fd = netdev->xsk_fd, .events = POLLIN };
+
+		ring_store(netdev->rx.consumer, netdev->rx_next);
+		netdev->rx_end = ring_load(netdev->rx.producer);
+		if (netdev->rx_next != netdev->rx_end)
+			break;
+
+		/* Out of frames to sniff: make sure the kernel has all
+		 * of ours before we go to sleep.
+		 */
+		refill_rx(netdev);
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			die_perror("poll AF_XDP socket");
+	}
+	return ring_desc(&netdev->rx, netdev->rx_next++);
+}
+
+static int xdp_netdev_receive(struct netdev *a_netdev,
+			      struct packet **packet, char **error)
+{
+	struct xdp_netdev *netdev = to_xdp_netdev(a_netdev);
+
+	DEBUGP("xdp_netdev_receive\n");
+
+	assert(*packet == NULL);	/* should be no packet yet */
+
+	while (1) {
+		const struct xdp_desc *desc = next_rx_desc(netdev);
+		enum packet_parse_result_t result;
+		int in_bytes = desc->len;
+
+		*packet = packet_new(PACKET_READ_BYTES);
+		assert(in_bytes <= (*packet)->buffer_bytes);
+		memcpy((*packet)->buffer, netdev->umem + desc->addr, in_bytes);
+		/* Copy mode frames carry no timestamp, so take our own. */
+		(*packet)->time_nsecs = now_nsecs();
+
+		netdev->refill[netdev->num_refill++] =
+			desc->addr & ~((u64)XDP_FRAME_SIZE - 1);
+		if (netdev->num_refill == XDP_BATCH)
+			refill_rx(netdev);
+
+		/* Everything arriving on the peer was sent by the kernel. */
+		result = parse_packet(*packet, in_bytes,
+				      PACKET_LAYER_2_ETHERNET, error);
+		if (result == PACKET_OK)
+			return STATUS_OK;
+
+		packet_free(*packet);
+		*packet = NULL;
+
+		if (result == PACKET_BAD)
+			return STATUS_ERR;
+
+		DEBUGP("parse_result:%d; error parsing packet: %s\n",
+		       result, *error);
+	}
+
+	assert(!"should not be reached");
+	return STATUS_ERR;	/* not reached */
+}
+
+struct netdev_ops xdp_netdev_ops = {
+	.free = xdp_netdev_free,
+	.send = xdp_netdev_send,
+	.receive = xdp_netdev_receive,
+};
+
+#else
+
+struct netdev *xdp_netdev_new(struct config *config)
+{
+	die("--netdev=xdp is only supported on Linux\n");
+	return NULL;	/* not reached */
+}
+
+#endif /* linux */
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Network device code for local tests that puts the kernel under test
+ * behind a veth pair, and injects and sniffs packets on the peer
+ * device through an AF_XDP socket.
+ */
+
+#ifndef __XDP_NETDEV_H__
+#define __XDP_NETDEV_H__
+
+#include "types.h"
+
+#include "config.h"
+#include "netdev.h"
+
+/* Frames in the AF_XDP UMEM; half are used for RX and half for TX. */
+#define XDP_NUM_FRAMES		4096
+
+/* Bytes per UMEM frame; each frame holds one Ethernet frame. */
+#define XDP_FRAME_SIZE		4096
+
+/* Descriptors moved between userspace and the kernel per ring access. */
+#define XDP_BATCH		64
+
+/* Allocate and return a new netdev for local tests over veth and AF_XDP
+ * (--netdev=xdp). Linux only.
+ */
+extern struct netdev *xdp_netdev_new(struct config *config);
+
+#endif /* __XDP_NETDEV_H__ */